@@ -0,0 +1,653 @@
+/** @file
+  Backup and restore of the OpenCore folder.
+
+  EFI\OC on the volume which config.plist was read from is copied to a
+  timestamped directory on the BootHelper volume, and can be copied back
+  after an experiment goes wrong. Files are streamed through one large
+  buffer; on restore, files whose size and hash already match the backup
+  are left untouched, so a restore over a mostly unchanged folder writes
+  very little. Restore stages every changed file beside its target first,
+  and only swaps them in once the whole backup has been read, so that a
+  read error, full ESP or Esc never leaves OpenCore half replaced.
+
+  Copyright (c) 2020, Mike Beaton. All rights reserved.<BR>
+  SPDX-License-Identifier: BSD-3-Clause
+
+**/
+
+//
+// Basic UEFI Libraries
+//
+#include <Uefi.h>
+#include <Library/UefiLib.h>
+#include <Library/BaseLib.h>
+#include <Library/BaseMemoryLib.h>
+#include <Library/MemoryAllocationLib.h>
+#include <Library/PrintLib.h>
+
+//
+// Boot and Runtime Services
+//
+#include <Library/UefiRuntimeServicesTableLib.h>
+
+//
+// OC Libraries
+//
+#include <Library/OcCryptoLib.h>
+#include <Library/OcDebugLogLib.h>
+#include <Library/OcFileLib.h>
+
+//
+// Local includes
+//
+#include "Backup.h"
+#include "EzKb.h"
+#include "FileUtils.h"
+#include "Integrity.h"
+#include "OcConfig.h"
+#include "Progress.h"
+#include "Timing.h"
+#include "Utils.h"
+
+#define BACKUP_MAX_CHOICES          26
+
+typedef struct BACKUP_WALK_ {
+  EFI_FILE_PROTOCOL   *Target;
+  BOOLEAN             Restore;        ///< Compare before copying, and stage changed files
+  CHAR16              Path[BH_BACKUP_MAX_PATH];  ///< Target path, relative to Target
+  UINTN               PathLength;
+  UINT8               *Buffer;
+  CHAR16              **Staged;       ///< Restore: target paths with a staged copy beside them
+  UINT32              StagedCount;
+  UINT32              StagedAllocCount;
+  BH_BACKUP_RESULT    Result;
+  EFI_STATUS          Status;
+} BACKUP_WALK;
+
+typedef struct BACKUP_CHOICES_ {
+  CHAR16            **Names;
+  UINT32            Count;
+  UINT32            AllocCount;
+} BACKUP_CHOICES;
+
+STATIC
+VOID
+ShowFailed (
+  IN CONST CHAR16   *Path,
+  IN EFI_STATUS     Status
+  )
+{
+  DEBUG ((DEBUG_WARN, "BH: Cannot copy %s - %r\n", Path, Status));
+
+  SetColour (EFI_LIGHTRED);
+  Print (L"  Failed %s - %r\n", Path, Status);
+  SetColour (EFI_WHITE);
+}
+
+//
+// Sizes are compared first, so that only files which might match are read twice.
+//
+STATIC
+BOOLEAN
+IsUnchanged (
+  IN OUT BACKUP_WALK          *Walk,
+  IN     EFI_FILE_PROTOCOL    *Directory,
+  IN     CONST EFI_FILE_INFO  *Info
+  )
+{
+  EFI_STATUS          Status;
+  EFI_FILE_PROTOCOL   *File;
+  UINT32              Size;
+  UINT8               SourceHash[SHA256_DIGEST_SIZE];
+  UINT8               TargetHash[SHA256_DIGEST_SIZE];
+
+  Status = BhOpenFile (Walk->Target, Walk->Path, &File, FALSE);
+  if (EFI_ERROR (Status)) {
+    return FALSE;
+  }
+
+  Status = GetFileSize (File, &Size);
+  File->Close (File);
+  if (EFI_ERROR (Status) || Size != Info->FileSize) {
+    return FALSE;
+  }
+
+  Status = BhHashFile (Walk->Target, Walk->Path, Walk->Buffer, BH_BACKUP_COPY_SIZE, TargetHash, &Walk->Result.Bytes);
+  if (EFI_ERROR (Status)) {
+    return FALSE;
+  }
+
+  Status = BhHashFile (Directory, Info->FileName, Walk->Buffer, BH_BACKUP_COPY_SIZE, SourceHash, &Walk->Result.Bytes);
+  if (EFI_ERROR (Status)) {
+    return FALSE;
+  }
+
+  return CompareMem (SourceHash, TargetHash, sizeof (SourceHash)) == 0;
+}
+
+//
+// Copy the source file beside the current target path, and record it to be swapped in.
+//
+STATIC
+EFI_STATUS
+StageFile (
+  IN OUT BACKUP_WALK          *Walk,
+  IN     EFI_FILE_PROTOCOL    *Directory,
+  IN     CONST EFI_FILE_INFO  *Info,
+  OUT    UINT64               *Copied
+  )
+{
+  EFI_STATUS  Status;
+  CHAR16      *StagedPath;
+  CHAR16      **NewStaged;
+
+  *Copied = 0;
+
+  if (Walk->StagedCount == Walk->StagedAllocCount) {
+    NewStaged = ReallocatePool (
+      Walk->StagedAllocCount * sizeof (CHAR16 *),
+      (Walk->StagedAllocCount + 64) * sizeof (CHAR16 *),
+      Walk->Staged
+      );
+    if (NewStaged == NULL) {
+      return EFI_OUT_OF_RESOURCES;
+    }
+    Walk->Staged = NewStaged;
+    Walk->StagedAllocCount += 64;
+  }
+
+  Walk->Staged[Walk->StagedCount] = AllocateCopyPool (StrSize (Walk->Path), Walk->Path);
+  StagedPath = CatSPrint (NULL, L"%s%s", Walk->Path, BH_BACKUP_STAGED_SUFFIX);
+  if (Walk->Staged[Walk->StagedCount] == NULL || StagedPath == NULL) {
+    Status = EFI_OUT_OF_RESOURCES;
+  } else {
+    Status = BhCopyFile (
+      Directory,
+      Info->FileName,
+      Walk->Target,
+      StagedPath,
+      Walk->Buffer,
+      BH_BACKUP_COPY_SIZE,
+      Copied
+      );
+  }
+
+  if (!EFI_ERROR (Status)) {
+    Walk->StagedCount++;
+  } else if (Walk->Staged[Walk->StagedCount] != NULL) {
+    FreePool (Walk->Staged[Walk->StagedCount]);
+  }
+
+  if (StagedPath != NULL) {
+    FreePool (StagedPath);
+  }
+
+  return Status;
+}
+
+//
+// Swap in every staged file if the whole restore was staged, otherwise delete them all;
+// either way the staged list is freed.
+//
+STATIC
+VOID
+FinishStaged (
+  IN OUT BACKUP_WALK    *Walk,
+  IN     BOOLEAN        Replace
+  )
+{
+  EFI_STATUS  Status;
+  UINT32      Index;
+  CHAR16      *StagedPath;
+
+  for (Index = 0; Index < Walk->StagedCount; Index++) {
+    StagedPath = CatSPrint (NULL, L"%s%s", Walk->Staged[Index], BH_BACKUP_STAGED_SUFFIX);
+    if (StagedPath == NULL) {
+      Status = EFI_OUT_OF_RESOURCES;
+    } else if (Replace) {
+      Status = BhReplaceFile (Walk->Target, StagedPath, Walk->Staged[Index]);
+      if (EFI_ERROR (Status)) {
+        BhDeleteFile (Walk->Target, StagedPath);
+      }
+    } else {
+      BhDeleteFile (Walk->Target, StagedPath);
+      Status = EFI_SUCCESS;
+    }
+
+    if (Replace) {
+      if (EFI_ERROR (Status)) {
+        Walk->Result.Failed++;
+        ShowFailed (Walk->Staged[Index], Status);
+      } else {
+        Walk->Result.Copied++;
+      }
+    }
+
+    if (StagedPath != NULL) {
+      FreePool (StagedPath);
+    }
+    FreePool (Walk->Staged[Index]);
+  }
+
+  if (Walk->Staged != NULL) {
+    FreePool (Walk->Staged);
+  }
+
+  Walk->Staged = NULL;
+  Walk->StagedCount = 0;
+  Walk->StagedAllocCount = 0;
+}
+
+STATIC
+BOOLEAN
+CopyEntry (
+  IN VOID                 *Context,
+  IN EFI_FILE_PROTOCOL    *Directory,
+  IN CONST EFI_FILE_INFO  *Info
+  )
+{
+  EFI_STATUS          Status;
+  BACKUP_WALK         *Walk;
+  UINTN               PathLength;
+  UINTN               NameLength;
+  UINT64              Copied;
+
+  Walk = Context;
+
+  //
+  // Skip metadata which macOS leaves whenever it mounts the ESP (._*, .DS_Store, .fseventsd).
+  //
+  if (Info->FileName[0] == L'.') {
+    return TRUE;
+  }
+
+  PathLength = Walk->PathLength;
+  NameLength = StrLen (Info->FileName);
+  if (PathLength + 1 + NameLength >= BH_BACKUP_MAX_PATH) {
+    DEBUG ((DEBUG_WARN, "BH: Skipping %s\\%s, path too long\n", Walk->Path, Info->FileName));
+    Walk->Result.Failed++;
+    return TRUE;
+  }
+
+  Walk->Path[PathLength] = L'\\';
+  CopyMem (&Walk->Path[PathLength + 1], Info->FileName, (NameLength + 1) * sizeof (CHAR16));
+  Walk->PathLength = PathLength + 1 + NameLength;
+
+  if ((Info->Attribute & EFI_FILE_DIRECTORY) != 0) {
+    //
+    // BootHelper may itself be under EFI\OC (e.g. as an OpenCore tool), in which case
+    // earlier backups must not be backed up again.
+    //
+    if (StrCmp (Info->FileName, BH_BACKUP_DIRECTORY) == 0) {
+      DEBUG ((DEBUG_INFO, "BH: Skipping %s\n", Walk->Path));
+    } else {
+      //
+      // Created up front so that empty directories are kept too.
+      //
+      Status = BhCreateDirectory (Walk->Target, Walk->Path);
+      if (!EFI_ERROR (Status)) {
+        Status = BhForEachFile (Directory, Info->FileName, CopyEntry, Walk);
+      }
+      if (EFI_ERROR (Status)) {
+        Walk->Result.Failed++;
+        ShowFailed (Walk->Path, Status);
+      }
+    }
+  } else {
+    Walk->Result.Files++;
+
+    if (Walk->Restore && IsUnchanged (Walk, Directory, Info)) {
+      Walk->Result.Unchanged++;
+    } else if (Walk->Restore) {
+      Status = StageFile (Walk, Directory, Info, &Copied);
+      Walk->Result.Bytes += Copied;
+      Walk->Result.Written += Copied;
+      if (EFI_ERROR (Status)) {
+        Walk->Result.Failed++;
+        ShowFailed (Walk->Path, Status);
+      }
+    } else {
+      Status = BhCopyFile (
+        Directory,
+        Info->FileName,
+        Walk->Target,
+        Walk->Path,
+        Walk->Buffer,
+        BH_BACKUP_COPY_SIZE,
+        &Copied
+        );
+      Walk->Result.Bytes += Copied;
+      Walk->Result.Written += Copied;
+      if (EFI_ERROR (Status)) {
+        Walk->Result.Failed++;
+        ShowFailed (Walk->Path, Status);
+      } else {
+        Walk->Result.Copied++;
+      }
+    }
+
+    if (BhProgressUpdate (Walk->Result.Files, 0)) {
+      Walk->Status = EFI_ABORTED;
+    }
+  }
+
+  Walk->PathLength = PathLength;
+  Walk->Path[PathLength] = L'\0';
+
+  return Walk->Status != EFI_ABORTED;
+}
+
+STATIC
+VOID
+ShowResult (
+  IN BH_BACKUP_RESULT   *Result
+  )
+{
+  UINT64    Milliseconds;
+  UINT64    KilobytesPerSecond;
+
+  Milliseconds = DivU64x32 (Result->ElapsedNs, 1000000);
+  KilobytesPerSecond = Result->ElapsedNs == 0 ? 0 : DivU64x64Remainder (MultU64x32 (Result->Bytes, 1000000), Result->ElapsedNs, NULL);
+
+  SetColour (Result->Failed == 0 ? EFI_LIGHTGREEN : EFI_LIGHTRED);
+  Print (
+    L"  %u files: %u copied, %u unchanged, %u failed\n",
+    Result->Files,
+    Result->Copied,
+    Result->Unchanged,
+    Result->Failed
+    );
+  SetColour (EFI_WHITE);
+
+  Print (
+    L"  %lu KB read, %lu KB written in %lu ms (%lu KB/s)\n",
+    DivU64x32 (Result->Bytes, 1024),
+    DivU64x32 (Result->Written, 1024),
+    Milliseconds,
+    KilobytesPerSecond
+    );
+
+  DEBUG ((
+    DEBUG_INFO,
+    "BH: Copied %u/%u files (%u unchanged, %u failed), %lu bytes in %lu ms\n",
+    Result->Copied,
+    Result->Files,
+    Result->Unchanged,
+    Result->Failed,
+    Result->Bytes,
+    Milliseconds
+    ));
+}
+
+//
+// Copy SourcePath, relative to SourceDirectory, into Path on Target.
+//
+STATIC
+EFI_STATUS
+CopyTree (
+  IN     EFI_FILE_PROTOCOL    *SourceDirectory,
+  IN     CONST CHAR16         *SourcePath,
+  IN     EFI_FILE_PROTOCOL    *Target,
+  IN     CONST CHAR16         *Path,
+  IN     BOOLEAN              Restore
+  )
+{
+  EFI_STATUS    Status;
+  BACKUP_WALK   *Walk;
+  UINT64        Start;
+
+  Walk = AllocateZeroPool (sizeof (*Walk));
+  if (Walk == NULL) {
+    return EFI_OUT_OF_RESOURCES;
+  }
+
+  Walk->Buffer = AllocatePool (BH_BACKUP_COPY_SIZE);
+  if (Walk->Buffer == NULL) {
+    FreePool (Walk);
+    return EFI_OUT_OF_RESOURCES;
+  }
+
+  Walk->Target = Target;
+  Walk->Restore = Restore;
+  StrCpyS (Walk->Path, BH_BACKUP_MAX_PATH, Path);
+  Walk->PathLength = StrLen (Walk->Path);
+
+  Start = BhTimeNs ();
+  BhProgressBegin (L"Files");
+
+  Status = BhCreateDirectory (Target, Path);
+  if (!EFI_ERROR (Status)) {
+    Status = BhForEachFile (SourceDirectory, SourcePath, CopyEntry, Walk);
+  }
+  if (!EFI_ERROR (Status)) {
+    Status = Walk->Status;
+  }
+
+  BhProgressEnd ();
+
+  //
+  // Only once every changed file has been staged is anything in the target replaced.
+  //
+  if (Restore) {
+    if (!EFI_ERROR (Status) && Walk->Result.Failed == 0) {
+      FinishStaged (Walk, TRUE);
+    } else {
+      FinishStaged (Walk, FALSE);
+      SetColour (EFI_YELLOW);
+      Print (L"  Nothing replaced, %s is unchanged\n", Path);
+      SetColour (EFI_WHITE);
+    }
+  }
+
+  Walk->Result.ElapsedNs = BhTimeNs () - Start;
+
+  if (Status != EFI_ABORTED) {
+    ShowResult (&Walk->Result);
+  }
+
+  if (!EFI_ERROR (Status) && Walk->Result.Failed > 0) {
+    Status = EFI_DEVICE_ERROR;
+  }
+
+  FreePool (Walk->Buffer);
+  FreePool (Walk);
+
+  return Status;
+}
+
+STATIC
+EFI_STATUS
+GetOpenCoreVolume (
+  OUT EFI_FILE_PROTOCOL   **OcRoot
+  )
+{
+  EFI_STATUS      Status;
+  CONST CHAR16    *Volume;
+
+  Status = BhOcConfigVolume (OcRoot, &Volume);
+  if (EFI_ERROR (Status)) {
+    Print (L"No %s found on any volume\n", BH_OC_CONFIG_PATH);
+    return Status;
+  }
+
+  Print (L"%s on %s\n", BH_OC_DIRECTORY, Volume);
+
+  return EFI_SUCCESS;
+}
+
+EFI_STATUS
+BhBackupCreate (
+  IN EFI_FILE_PROTOCOL  *Root
+  )
+{
+  EFI_STATUS          Status;
+  EFI_FILE_PROTOCOL   *OcRoot;
+  EFI_TIME            Time;
+  CHAR16              Path[64];
+
+  Status = GetOpenCoreVolume (&OcRoot);
+  if (EFI_ERROR (Status)) {
+    return Status;
+  }
+
+  Status = gRT->GetTime (&Time, NULL);
+  if (EFI_ERROR (Status)) {
+    return Status;
+  }
+
+  UnicodeSPrint (
+    Path,
+    sizeof (Path),
+    L"%s\\%s%04u%02u%02u-%02u%02u%02u",
+    BH_BACKUP_DIRECTORY,
+    BH_BACKUP_PREFIX,
+    Time.Year,
+    Time.Month,
+    Time.Day,
+    Time.Hour,
+    Time.Minute,
+    Time.Second
+    );
+
+  Print (L"Backing up to %s... (Esc to cancel)\n", Path);
+
+  Status = CopyTree (OcRoot, BH_OC_DIRECTORY, Root, Path, FALSE);
+
+  DEBUG ((DEBUG_INFO, "BH: Backup %s - %r\n", Path, Status));
+
+  return Status;
+}
+
+STATIC
+BOOLEAN
+AddChoice (
+  IN VOID                 *Context,
+  IN EFI_FILE_PROTOCOL    *Directory,
+  IN CONST EFI_FILE_INFO  *Info
+  )
+{
+  BACKUP_CHOICES  *Choices;
+  CHAR16          **NewNames;
+
+  Choices = Context;
+
+  if ((Info->Attribute & EFI_FILE_DIRECTORY) == 0
+    || StrnCmp (Info->FileName, BH_BACKUP_PREFIX, StrLen (BH_BACKUP_PREFIX)) != 0) {
+    return TRUE;
+  }
+
+  //
+  // Keep every name: only after sorting is it known which are the newest.
+  //
+  if (Choices->Count == Choices->AllocCount) {
+    NewNames = ReallocatePool (
+      Choices->AllocCount * sizeof (CHAR16 *),
+      (Choices->AllocCount + BACKUP_MAX_CHOICES) * sizeof (CHAR16 *),
+      Choices->Names
+      );
+    if (NewNames == NULL) {
+      return FALSE;
+    }
+    Choices->Names = NewNames;
+    Choices->AllocCount += BACKUP_MAX_CHOICES;
+  }
+
+  Choices->Names[Choices->Count] = AllocateCopyPool (StrSize (Info->FileName), Info->FileName);
+  if (Choices->Names[Choices->Count] != NULL) {
+    Choices->Count++;
+  }
+
+  return TRUE;
+}
+
+//
+// Newest first, so that the most recent backups are always offered.
+//
+STATIC
+INTN
+CompareChoices (
+  IN VOID       *Context,
+  IN CONST VOID *Left,
+  IN CONST VOID *Right
+  )
+{
+  return StrCmp (*(CONST CHAR16 **) Right, *(CONST CHAR16 **) Left);
+}
+
+EFI_STATUS
+BhBackupRestore (
+  IN EFI_FILE_PROTOCOL  *Root
+  )
+{
+  EFI_STATUS          Status;
+  EFI_FILE_PROTOCOL   *OcRoot;
+  BACKUP_CHOICES      Choices;
+  EFI_INPUT_KEY       Key;
+  CHAR16              Path[64];
+  UINT32              Index;
+
+  Status = GetOpenCoreVolume (&OcRoot);
+  if (EFI_ERROR (Status)) {
+    return Status;
+  }
+
+  ZeroMem (&Choices, sizeof (Choices));
+
+  Status = BhForEachFile (Root, BH_BACKUP_DIRECTORY, AddChoice, &Choices);
+  if (Choices.Count == 0) {
+    if (Choices.Names != NULL) {
+      FreePool (Choices.Names);
+    }
+    Print (L"No backups in %s\n", BH_BACKUP_DIRECTORY);
+    return Status == EFI_NOT_FOUND ? EFI_SUCCESS : Status;
+  }
+
+  BhSort (Choices.Names, Choices.Count, sizeof (Choices.Names[0]), CompareChoices, NULL);
+
+  for (Index = BACKUP_MAX_CHOICES; Index < Choices.Count; Index++) {
+    FreePool (Choices.Names[Index]);
+  }
+  if (Choices.Count > BACKUP_MAX_CHOICES) {
+    Print (L"Newest %u of %u backups:\n", BACKUP_MAX_CHOICES, Choices.Count);
+    Choices.Count = BACKUP_MAX_CHOICES;
+  }
+
+  for (Index = 0; Index < Choices.Count; Index++) {
+    Print (L"[%c] %s\n", L'a' + Index, Choices.Names[Index]);
+  }
+  Print (L"Choose a backup to restore; Esc to cancel...\n");
+
+  Status = EFI_SUCCESS;
+  do {
+    getkeystroke (&Key);
+    Index = (UINT32) ((Key.UnicodeChar | 0x20) - L'a');
+  } while (Key.ScanCode != SCAN_ESC && Index >= Choices.Count);
+
+  if (Key.ScanCode != SCAN_ESC) {
+    UnicodeSPrint (Path, sizeof (Path), L"%s\\%s", BH_BACKUP_DIRECTORY, Choices.Names[Index]);
+
+    SetColour (EFI_YELLOW);
+    Print (L"Restore %s over %s? [Y]es; any other key to cancel...\n", Path, BH_OC_DIRECTORY);
+    SetColour (EFI_WHITE);
+    getkeystroke (&Key);
+
+    if ((Key.UnicodeChar | 0x20) == L'y') {
+      Print (L"Restoring %s... (Esc to cancel)\n", Path);
+      Status = CopyTree (Root, Path, OcRoot, BH_OC_DIRECTORY, TRUE);
+
+      //
+      // config.plist may have been replaced.
+      //
+      BhOcConfigFree ();
+
+      DEBUG ((DEBUG_INFO, "BH: Restore %s - %r\n", Path, Status));
+    }
+  }
+
+  for (Index = 0; Index < Choices.Count; Index++) {
+    FreePool (Choices.Names[Index]);
+  }
+  FreePool (Choices.Names);
+
+  return Status;
+}
@@ -0,0 +1,65 @@
+/** @file
+  Declaration of backup and restore of the OpenCore folder.
+
+  Copyright (c) 2020, Mike Beaton. All rights reserved.<BR>
+  SPDX-License-Identifier: BSD-3-Clause
+
+**/
+
+#ifndef __BH__BACKUP__
+#define __BH__BACKUP__
+
+//
+// Basic UEFI Libraries
+//
+#include <Uefi.h>
+#include <Library/UefiLib.h>
+
+#include <Protocol/SimpleFileSystem.h>
+
+//
+// Backups are made under the BootHelper root, one timestamped directory per backup
+// holding the contents of EFI\OC.
+//
+#define BH_BACKUP_DIRECTORY         L"Backups"
+#define BH_BACKUP_PREFIX            L"OC-"
+
+//
+// Size of each sequential read and write, one buffer for the whole backup or restore.
+//
+#define BH_BACKUP_COPY_SIZE         SIZE_4MB
+
+#define BH_BACKUP_MAX_PATH          256
+
+//
+// Restore copies each changed file beside its target under this suffix first.
+//
+#define BH_BACKUP_STAGED_SUFFIX     L".bhnew"
+
+typedef struct BH_BACKUP_RESULT_ {
+  UINT32    Files;
+  UINT32    Copied;
+  UINT32    Unchanged;
+  UINT32    Failed;
+  UINT64    Bytes;      ///< Bytes read, whether copied or compared
+  UINT64    Written;
+  UINT64    ElapsedNs;
+} BH_BACKUP_RESULT;
+
+// Copy EFI\OC from the OpenCore volume to a new timestamped directory under Root, printing the
+// directory name and a summary; cancellable with Esc, returning EFI_ABORTED
+EFI_STATUS
+BhBackupCreate (
+  IN EFI_FILE_PROTOCOL  *Root
+  );
+
+// Choose a backup under Root and, once confirmed, copy it back over EFI\OC on the OpenCore volume;
+// files whose size and hash are unchanged are not rewritten, files not in the backup are left.
+// Changed files are all copied beside their targets before any target is replaced, so after a
+// failure or Esc (returning EFI_ABORTED) EFI\OC is left exactly as it was
+EFI_STATUS
+BhBackupRestore (
+  IN EFI_FILE_PROTOCOL  *Root
+  );
+
+#endif
@@ -29,6 +29,26 @@ OC_STRUCTORS       (BH_MISC_BOOT, ())
 OC_STRUCTORS       (BH_MISC_DEBUG, ())
 // STRUCT parent=array xref=BH_MISC_TOOLS_ENTRY
 // ARRAY of=struct parent=struct xref=BH_MISC_TOOLS_ARRAY
+// ARRAY of=string parent=struct
+OC_ARRAY_STRUCTORS (BH_MISC_PLUGIN_ACTION_ARRAY)
+// ARRAY of=string parent=struct
+OC_ARRAY_STRUCTORS (BH_MISC_PLUGIN_DECODER_ARRAY)
+// STRUCT parent=array
+OC_STRUCTORS       (BH_MISC_PLUGIN_ENTRY, ())
+// ARRAY of=struct parent=struct
+OC_ARRAY_STRUCTORS (BH_MISC_PLUGIN_ARRAY)
+// STRUCT parent=array
+OC_STRUCTORS       (BH_MISC_QUIRK_ENTRY, ())
+// ARRAY of=struct parent=struct
+OC_ARRAY_STRUCTORS (BH_MISC_QUIRK_ARRAY)
+// ARRAY of=string parent=struct
+OC_ARRAY_STRUCTORS (BH_MISC_RULE_CONDITION_ARRAY)
+// ARRAY of=string parent=struct
+OC_ARRAY_STRUCTORS (BH_MISC_RULE_ACTION_ARRAY)
+// STRUCT parent=array
+OC_STRUCTORS       (BH_MISC_RULE_ENTRY, ())
+// ARRAY of=struct parent=struct
+OC_ARRAY_STRUCTORS (BH_MISC_RULE_ARRAY)
 // STRUCT parent=struct
 OC_STRUCTORS       (BH_MISC_SECURITY, ())
 // STRUCT parent=array
@@ -62,8 +82,11 @@ OC_STRUCTORS       (BH_GLOBAL_CONFIG, ())
 STATIC
 OC_SCHEMA
 mConfigConfigurationSchema[] = {
+  OC_SCHEMA_STRING_IN   ("ExportPassphrase",        BH_GLOBAL_CONFIG,  Config.ExportPassphrase),
+  OC_SCHEMA_BOOLEAN_IN  ("InstallProtocol",         BH_GLOBAL_CONFIG,  Config.InstallProtocol),
   OC_SCHEMA_STRING_IN   ("PickerMode",              BH_GLOBAL_CONFIG,  Config.PickerMode),
   OC_SCHEMA_BOOLEAN_IN  ("PollAppleHotKeys",        BH_GLOBAL_CONFIG,  Config.PollAppleHotKeys),
+  OC_SCHEMA_STRING_IN   ("SerialMirror",            BH_GLOBAL_CONFIG,  Config.SerialMirror),
   OC_SCHEMA_BOOLEAN_IN  ("ShowPicker",              BH_GLOBAL_CONFIG,  Config.ShowPicker),
   OC_SCHEMA_STRING_IN   ("Xanana",                  BH_GLOBAL_CONFIG,  Config.Xanana),
 };
@@ -125,6 +148,77 @@ STATIC
 OC_SCHEMA
 mMiscEntriesSchema = OC_SCHEMA_DICT (NULL, mMiscEntriesSchemaEntry);
 
+// ARRAY of=string parent=struct
+STATIC
+OC_SCHEMA
+mMiscPluginsActionsSchema = OC_SCHEMA_STRING (NULL);
+
+// ARRAY of=string parent=struct
+STATIC
+OC_SCHEMA
+mMiscPluginsDecodersSchema = OC_SCHEMA_STRING (NULL);
+
+// STRUCT parent=array
+STATIC
+OC_SCHEMA
+mMiscPluginsSchemaEntry[] = {
+  OC_SCHEMA_ARRAY_IN    ("Actions",                 BH_MISC_PLUGIN_ENTRY, Actions, &mMiscPluginsActionsSchema),
+  OC_SCHEMA_STRING_IN   ("Comment",                 BH_MISC_PLUGIN_ENTRY, Comment),
+  OC_SCHEMA_ARRAY_IN    ("Decoders",                BH_MISC_PLUGIN_ENTRY, Decoders, &mMiscPluginsDecodersSchema),
+  OC_SCHEMA_BOOLEAN_IN  ("Enabled",                 BH_MISC_PLUGIN_ENTRY, Enabled),
+  OC_SCHEMA_STRING_IN   ("Path",                    BH_MISC_PLUGIN_ENTRY, Path),
+};
+
+// ARRAY of=struct parent=struct
+STATIC
+OC_SCHEMA
+mMiscPluginsSchema = OC_SCHEMA_DICT (NULL, mMiscPluginsSchemaEntry);
+
+// STRUCT parent=array
+STATIC
+OC_SCHEMA
+mMiscQuirksSchemaEntry[] = {
+  OC_SCHEMA_STRING_IN   ("Comment",                 BH_MISC_QUIRK_ENTRY, Comment),
+  OC_SCHEMA_BOOLEAN_IN  ("DeleteBeforeWrite",       BH_MISC_QUIRK_ENTRY, DeleteBeforeWrite),
+  OC_SCHEMA_BOOLEAN_IN  ("DeleteZeroAttributes",    BH_MISC_QUIRK_ENTRY, DeleteZeroAttributes),
+  OC_SCHEMA_BOOLEAN_IN  ("Enabled",                 BH_MISC_QUIRK_ENTRY, Enabled),
+  OC_SCHEMA_INTEGER_IN  ("MaxRevision",             BH_MISC_QUIRK_ENTRY, MaxRevision),
+  OC_SCHEMA_INTEGER_IN  ("MinRevision",             BH_MISC_QUIRK_ENTRY, MinRevision),
+  OC_SCHEMA_STRING_IN   ("Model",                   BH_MISC_QUIRK_ENTRY, Model),
+  OC_SCHEMA_BOOLEAN_IN  ("SlowEnumeration",         BH_MISC_QUIRK_ENTRY, SlowEnumeration),
+  OC_SCHEMA_STRING_IN   ("Vendor",                  BH_MISC_QUIRK_ENTRY, Vendor),
+};
+
+// ARRAY of=struct parent=struct
+STATIC
+OC_SCHEMA
+mMiscQuirksSchema = OC_SCHEMA_DICT (NULL, mMiscQuirksSchemaEntry);
+
+// ARRAY of=string parent=struct
+STATIC
+OC_SCHEMA
+mMiscRulesIfSchema = OC_SCHEMA_STRING (NULL);
+
+// ARRAY of=string parent=struct
+STATIC
+OC_SCHEMA
+mMiscRulesThenSchema = OC_SCHEMA_STRING (NULL);
+
+// STRUCT parent=array
+STATIC
+OC_SCHEMA
+mMiscRulesSchemaEntry[] = {
+  OC_SCHEMA_STRING_IN   ("Comment",                 BH_MISC_RULE_ENTRY, Comment),
+  OC_SCHEMA_BOOLEAN_IN  ("Enabled",                 BH_MISC_RULE_ENTRY, Enabled),
+  OC_SCHEMA_ARRAY_IN    ("If",                      BH_MISC_RULE_ENTRY, If, &mMiscRulesIfSchema),
+  OC_SCHEMA_ARRAY_IN    ("Then",                    BH_MISC_RULE_ENTRY, Then, &mMiscRulesThenSchema),
+};
+
+// ARRAY of=struct parent=struct
+STATIC
+OC_SCHEMA
+mMiscRulesSchema = OC_SCHEMA_DICT (NULL, mMiscRulesSchemaEntry);
+
 // STRUCT parent=struct
 STATIC
 OC_SCHEMA
@@ -173,6 +267,9 @@ mMiscConfigurationSchema[] = {
   OC_SCHEMA_DICT        ("Boot",                    mMiscConfigurationBootSchema),
   OC_SCHEMA_DICT        ("Debug",                   mMiscConfigurationDebugSchema),
   OC_SCHEMA_ARRAY_IN    ("Entries",                 BH_GLOBAL_CONFIG,  Misc.Entries, &mMiscEntriesSchema),
+  OC_SCHEMA_ARRAY_IN    ("Plugins",                 BH_GLOBAL_CONFIG,  Misc.Plugins, &mMiscPluginsSchema),
+  OC_SCHEMA_ARRAY_IN    ("Quirks",                  BH_GLOBAL_CONFIG,  Misc.Quirks, &mMiscQuirksSchema),
+  OC_SCHEMA_ARRAY_IN    ("Rules",                   BH_GLOBAL_CONFIG,  Misc.Rules, &mMiscRulesSchema),
   OC_SCHEMA_DICT        ("Security",                mMiscConfigurationSecuritySchema),
   OC_SCHEMA_ARRAY_IN    ("Tools",                   BH_GLOBAL_CONFIG,  Misc.Tools, &mMiscToolsSchema),
 };
@@ -271,3 +368,15 @@ BhConfigurationFree (
 {
   BH_GLOBAL_CONFIG_DESTRUCT (Config, sizeof (*Config));
 }
+
+///
+/// Appended by ConfigSchema.py, do not edit
+///
+
+OC_SCHEMA_INFO *
+BhConfigurationSchema (
+  VOID
+  )
+{
+  return &mRootConfigurationInfo;
+}
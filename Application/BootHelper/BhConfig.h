@@ -30,8 +30,11 @@
 
 // STRUCT parent=struct
 #define BH_CONFIG_CONFIG_FIELDS(_, __) \
+  _(OC_STRING                       , ExportPassphrase        ,     , OC_STRING_CONSTR ("", _, __)        , OC_DESTR (OC_STRING) ) \
+  _(BOOLEAN                         , InstallProtocol         ,     , FALSE                               , ())                    \
   _(OC_STRING                       , PickerMode              ,     , OC_STRING_CONSTR ("Builtin", _, __) , OC_DESTR (OC_STRING) ) \
   _(BOOLEAN                         , PollAppleHotKeys        ,     , FALSE                               , ())                    \
+  _(OC_STRING                       , SerialMirror            ,     , OC_STRING_CONSTR ("None", _, __)    , OC_DESTR (OC_STRING) ) \
   _(BOOLEAN                         , ShowPicker              ,     , FALSE                               , ())                    \
   _(OC_STRING                       , Xanana                  ,     , OC_STRING_CONSTR ("", _, __)        , OC_DESTR (OC_STRING) )
   OC_DECLARE (BH_CONFIG_CONFIG)
@@ -73,6 +76,71 @@
 
 // STRUCT parent=array xref=BH_MISC_TOOLS_ENTRY
 // ARRAY of=struct parent=struct xref=BH_MISC_TOOLS_ARRAY
+// ARRAY of=string parent=struct
+#define BH_MISC_PLUGIN_ACTION_ARRAY_FIELDS(_, __) \
+  OC_ARRAY (OC_STRING, _, __)
+  OC_DECLARE (BH_MISC_PLUGIN_ACTION_ARRAY)
+
+// ARRAY of=string parent=struct
+#define BH_MISC_PLUGIN_DECODER_ARRAY_FIELDS(_, __) \
+  OC_ARRAY (OC_STRING, _, __)
+  OC_DECLARE (BH_MISC_PLUGIN_DECODER_ARRAY)
+
+// STRUCT parent=array
+#define BH_MISC_PLUGIN_ENTRY_FIELDS(_, __) \
+  _(BH_MISC_PLUGIN_ACTION_ARRAY     , Actions                 ,     , OC_CONSTR3 (BH_MISC_PLUGIN_ACTION_ARRAY, _, __)  , OC_DESTR (BH_MISC_PLUGIN_ACTION_ARRAY))  \
+  _(OC_STRING                       , Comment                 ,     , OC_STRING_CONSTR ("", _, __)        , OC_DESTR (OC_STRING) ) \
+  _(BH_MISC_PLUGIN_DECODER_ARRAY    , Decoders                ,     , OC_CONSTR3 (BH_MISC_PLUGIN_DECODER_ARRAY, _, __) , OC_DESTR (BH_MISC_PLUGIN_DECODER_ARRAY)) \
+  _(BOOLEAN                         , Enabled                 ,     , FALSE                               , ())                    \
+  _(OC_STRING                       , Path                    ,     , OC_STRING_CONSTR ("", _, __)        , OC_DESTR (OC_STRING) )
+  OC_DECLARE (BH_MISC_PLUGIN_ENTRY)
+
+// ARRAY of=struct parent=struct
+#define BH_MISC_PLUGIN_ARRAY_FIELDS(_, __) \
+  OC_ARRAY (BH_MISC_PLUGIN_ENTRY, _, __)
+  OC_DECLARE (BH_MISC_PLUGIN_ARRAY)
+
+// STRUCT parent=array
+#define BH_MISC_QUIRK_ENTRY_FIELDS(_, __) \
+  _(OC_STRING                       , Comment                 ,     , OC_STRING_CONSTR ("", _, __)        , OC_DESTR (OC_STRING) ) \
+  _(BOOLEAN                         , DeleteBeforeWrite       ,     , FALSE                               , ())                    \
+  _(BOOLEAN                         , DeleteZeroAttributes    ,     , FALSE                               , ())                    \
+  _(BOOLEAN                         , Enabled                 ,     , FALSE                               , ())                    \
+  _(UINT32                          , MaxRevision             ,     , 0xFFFFFFFF                          , ())                    \
+  _(UINT32                          , MinRevision             ,     , 0                                   , ())                    \
+  _(OC_STRING                       , Model                   ,     , OC_STRING_CONSTR ("", _, __)        , OC_DESTR (OC_STRING) ) \
+  _(BOOLEAN                         , SlowEnumeration         ,     , FALSE                               , ())                    \
+  _(OC_STRING                       , Vendor                  ,     , OC_STRING_CONSTR ("", _, __)        , OC_DESTR (OC_STRING) )
+  OC_DECLARE (BH_MISC_QUIRK_ENTRY)
+
+// ARRAY of=struct parent=struct
+#define BH_MISC_QUIRK_ARRAY_FIELDS(_, __) \
+  OC_ARRAY (BH_MISC_QUIRK_ENTRY, _, __)
+  OC_DECLARE (BH_MISC_QUIRK_ARRAY)
+
+// ARRAY of=string parent=struct
+#define BH_MISC_RULE_CONDITION_ARRAY_FIELDS(_, __) \
+  OC_ARRAY (OC_STRING, _, __)
+  OC_DECLARE (BH_MISC_RULE_CONDITION_ARRAY)
+
+// ARRAY of=string parent=struct
+#define BH_MISC_RULE_ACTION_ARRAY_FIELDS(_, __) \
+  OC_ARRAY (OC_STRING, _, __)
+  OC_DECLARE (BH_MISC_RULE_ACTION_ARRAY)
+
+// STRUCT parent=array
+#define BH_MISC_RULE_ENTRY_FIELDS(_, __) \
+  _(OC_STRING                       , Comment                 ,     , OC_STRING_CONSTR ("", _, __)        , OC_DESTR (OC_STRING) ) \
+  _(BOOLEAN                         , Enabled                 ,     , FALSE                               , ())                    \
+  _(BH_MISC_RULE_CONDITION_ARRAY    , If                      ,     , OC_CONSTR3 (BH_MISC_RULE_CONDITION_ARRAY, _, __) , OC_DESTR (BH_MISC_RULE_CONDITION_ARRAY)) \
+  _(BH_MISC_RULE_ACTION_ARRAY       , Then                    ,     , OC_CONSTR3 (BH_MISC_RULE_ACTION_ARRAY, _, __)    , OC_DESTR (BH_MISC_RULE_ACTION_ARRAY))
+  OC_DECLARE (BH_MISC_RULE_ENTRY)
+
+// ARRAY of=struct parent=struct
+#define BH_MISC_RULE_ARRAY_FIELDS(_, __) \
+  OC_ARRAY (BH_MISC_RULE_ENTRY, _, __)
+  OC_DECLARE (BH_MISC_RULE_ARRAY)
+
 // STRUCT parent=struct
 #define BH_MISC_SECURITY_FIELDS(_, __) \
   _(BOOLEAN                         , AllowNvramReset         ,     , FALSE                               , ())                    \
@@ -115,6 +183,9 @@
   _(BH_MISC_BOOT                    , Boot                    ,     , OC_CONSTR2 (BH_MISC_BOOT, _, __)           , OC_DESTR (BH_MISC_BOOT))           \
   _(BH_MISC_DEBUG                   , Debug                   ,     , OC_CONSTR2 (BH_MISC_DEBUG, _, __)          , OC_DESTR (BH_MISC_DEBUG))          \
   _(BH_MISC_TOOLS_ARRAY             , Entries                 ,     , OC_CONSTR2 (BH_MISC_TOOLS_ARRAY, _, __)    , OC_DESTR (BH_MISC_TOOLS_ARRAY))    \
+  _(BH_MISC_PLUGIN_ARRAY            , Plugins                 ,     , OC_CONSTR2 (BH_MISC_PLUGIN_ARRAY, _, __)   , OC_DESTR (BH_MISC_PLUGIN_ARRAY))   \
+  _(BH_MISC_QUIRK_ARRAY             , Quirks                  ,     , OC_CONSTR2 (BH_MISC_QUIRK_ARRAY, _, __)    , OC_DESTR (BH_MISC_QUIRK_ARRAY))    \
+  _(BH_MISC_RULE_ARRAY              , Rules                   ,     , OC_CONSTR2 (BH_MISC_RULE_ARRAY, _, __)     , OC_DESTR (BH_MISC_RULE_ARRAY))     \
   _(BH_MISC_SECURITY                , Security                ,     , OC_CONSTR2 (BH_MISC_SECURITY, _, __)       , OC_DESTR (BH_MISC_SECURITY))       \
   _(BH_MISC_TOOLS_ARRAY             , Tools                   ,     , OC_CONSTR2 (BH_MISC_TOOLS_ARRAY, _, __)    , OC_DESTR (BH_MISC_TOOLS_ARRAY))
   OC_DECLARE (BH_MISC_CONFIG)
@@ -198,4 +269,15 @@ BhConfigurationFree (
   IN OUT BH_GLOBAL_CONFIG   *Config
   );
 
+/**
+  Root configuration schema, for parsers other than ParseSerialized.
+  Appended by ConfigSchema.py, do not edit.
+
+  @retval  Schema passed to ParseSerialized by BhConfigurationInit.
+**/
+OC_SCHEMA_INFO *
+BhConfigurationSchema (
+  VOID
+  );
+
 #endif // BH_CONFIGURATION_LIB_H
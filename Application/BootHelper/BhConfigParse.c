@@ -0,0 +1,36 @@
+/** @file
+  BootHelper.plist parsing from a binary plist.
+
+  Copyright (c) 2020, Mike Beaton. All rights reserved.<BR>
+  SPDX-License-Identifier: BSD-3-Clause
+
+**/
+
+//
+// Basic UEFI Libraries
+//
+#include <Uefi.h>
+
+//
+// Local includes
+//
+#include "BhConfig.h"
+#include "BhConfigParse.h"
+#include "Bplist.h"
+
+EFI_STATUS
+BhConfigurationInitBinary (
+  OUT BH_GLOBAL_CONFIG   *Config,
+  IN  VOID               *Buffer,
+  IN  UINT32             Size
+  )
+{
+  BH_GLOBAL_CONFIG_CONSTRUCT (Config, sizeof (*Config));
+
+  if (!BhBplistParseSerialized (Config, BhConfigurationSchema (), Buffer, Size)) {
+    BH_GLOBAL_CONFIG_DESTRUCT (Config, sizeof (*Config));
+    return EFI_UNSUPPORTED;
+  }
+
+  return EFI_SUCCESS;
+}
@@ -0,0 +1,30 @@
+/** @file
+  Declaration of BootHelper.plist parsing from a binary plist.
+
+  Copyright (c) 2020, Mike Beaton. All rights reserved.<BR>
+  SPDX-License-Identifier: BSD-3-Clause
+
+**/
+
+#ifndef __BH__CONFIG_PARSE__
+#define __BH__CONFIG_PARSE__
+
+//
+// Basic UEFI Libraries
+//
+#include <Uefi.h>
+
+//
+// Local includes
+//
+#include "BhConfig.h"
+
+// As BhConfigurationInit, for a binary plist (bplist00) as detected by BhBplistIsBinary
+EFI_STATUS
+BhConfigurationInitBinary (
+  OUT BH_GLOBAL_CONFIG   *Config,
+  IN  VOID               *Buffer,
+  IN  UINT32             Size
+  );
+
+#endif
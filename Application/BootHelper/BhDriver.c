@@ -0,0 +1,58 @@
+/** @file
+  BootHelperDxe: resident driver variant which only installs BOOT_HELPER_PROTOCOL.
+
+  Copyright (c) 2020, Mike Beaton. All rights reserved.<BR>
+  SPDX-License-Identifier: BSD-3-Clause
+
+**/
+
+//
+// Basic UEFI Libraries
+//
+#include <Uefi.h>
+#include <Library/UefiLib.h>
+
+//
+// OC Libraries
+//
+#include <Library/OcDebugLogLib.h>
+
+//
+// Local includes
+//
+#include "BootHelper.h"
+#include "Quirks.h"
+
+//
+// Shared sources expect these application globals; the driver never drives
+// the console, so behave as the interactive application does (no progress text).
+//
+BOOLEAN mInteractive            = TRUE;
+BOOLEAN mClearScreen            = FALSE;
+BH_ON_EXIT mBhOnExit            = BhOnExitExit;
+
+EFI_STATUS
+EFIAPI
+BhDriverEntry (
+  IN EFI_HANDLE        ImageHandle,
+  IN EFI_SYSTEM_TABLE  *SystemTable
+  )
+{
+  DEBUG ((DEBUG_INFO, "BH: Starting BootHelperDxe...\n"));
+
+  BhQuirksInit (NULL);
+
+  //
+  // No configuration is loaded, so ApplyProfile requires a profile buffer.
+  //
+  return BhProtocolInstall (ImageHandle, NULL);
+}
+
+EFI_STATUS
+EFIAPI
+BhDriverUnload (
+  IN EFI_HANDLE        ImageHandle
+  )
+{
+  return BhProtocolUninstall (ImageHandle);
+}
@@ -0,0 +1,74 @@
+/** @file
+  Declaration of BOOT_HELPER_PLUGIN_PROTOCOL, which BootHelper plug-ins install
+  on their own image handle when started.
+
+  Plug-ins are UEFI images in EFI\BootHelper\Plugins, listed with the decoders
+  and actions they provide in Misc/Plugins of BootHelper.plist. BootHelper reads
+  only that list at startup, and loads each plug-in the first time one of its
+  decoders or actions is used.
+
+  A plug-in must be built as a boot services driver (MODULE_TYPE = DXE_DRIVER or
+  UEFI_DRIVER), so that it stays loaded after its entry point returns; any other
+  image type is rejected before it is started. Action keys must not be one of
+  BootHelper's own menu keys; such actions are ignored.
+
+  Copyright (c) 2020, Mike Beaton. All rights reserved.<BR>
+  SPDX-License-Identifier: BSD-3-Clause
+
+**/
+
+#ifndef __BH__PLUGIN__
+#define __BH__PLUGIN__
+
+//
+// Basic UEFI Libraries
+//
+#include <Uefi.h>
+
+#include "BhProtocol.h"
+
+#define BOOT_HELPER_PLUGIN_PROTOCOL_GUID \
+  { 0x3f6b2d1e, 0x8a47, 0x4c59, { 0x9e, 0x0d, 0x5b, 0x7a, 0x1c, 0x2e, 0x4f, 0x68 } }
+
+#define BOOT_HELPER_PLUGIN_PROTOCOL_REVISION  1
+
+typedef struct BOOT_HELPER_PLUGIN_PROTOCOL_ BOOT_HELPER_PLUGIN_PROTOCOL;
+
+/**
+  Format a variable value for display.
+  Text must be allocated from pool, and is freed by BootHelper.
+
+  @retval EFI_UNSUPPORTED   Value not handled, BootHelper formats it as usual.
+**/
+typedef
+EFI_STATUS
+(EFIAPI *BOOT_HELPER_PLUGIN_DECODE) (
+  IN  BOOT_HELPER_PLUGIN_PROTOCOL  *This,
+  IN  CONST CHAR16                 *Name,
+  IN  CONST EFI_GUID               *Guid,
+  IN  CONST VOID                   *Data,
+  IN  UINTN                        DataSize,
+  OUT CHAR16                       **Text
+  );
+
+/**
+  Run the menu action bound to Key (as listed in the plug-in's Actions).
+  Helper gives access to BootHelper's variable engine.
+**/
+typedef
+EFI_STATUS
+(EFIAPI *BOOT_HELPER_PLUGIN_RUN_ACTION) (
+  IN  BOOT_HELPER_PLUGIN_PROTOCOL  *This,
+  IN  CHAR16                       Key,
+  IN  BOOT_HELPER_PROTOCOL         *Helper
+  );
+
+struct BOOT_HELPER_PLUGIN_PROTOCOL_ {
+  UINT32                          Revision;
+  BOOT_HELPER_PLUGIN_DECODE       Decode;
+  BOOT_HELPER_PLUGIN_RUN_ACTION   RunAction;
+};
+
+extern EFI_GUID gBootHelperPluginProtocolGuid;
+
+#endif
@@ -0,0 +1,291 @@
+/** @file
+  BOOT_HELPER_PROTOCOL implementation over the shared variable engine.
+
+  Copyright (c) 2020, Mike Beaton. All rights reserved.<BR>
+  SPDX-License-Identifier: BSD-3-Clause
+
+**/
+
+//
+// Basic UEFI Libraries
+//
+#include <Uefi.h>
+#include <Library/UefiLib.h>
+#include <Library/BaseLib.h>
+#include <Library/BaseMemoryLib.h>
+#include <Library/MemoryAllocationLib.h>
+
+//
+// Boot and Runtime Services
+//
+#include <Library/UefiBootServicesTableLib.h>
+
+//
+// OC Libraries
+//
+#include <Library/OcDebugLogLib.h>
+
+//
+// Local includes
+//
+#include "BhConfig.h"
+#include "BhConfigParse.h"
+#include "BhProtocol.h"
+#include "BootHelper.h"
+#include "Bplist.h"
+#include "DisplayVars.h"
+#include "Snapshot.h"
+#include "Usage.h"
+#include "VarEngine.h"
+
+EFI_GUID gBootHelperProtocolGuid = BOOT_HELPER_PROTOCOL_GUID;
+
+//
+// Configuration loaded by the application, if any, for ApplyProfile (NULL, ...).
+//
+STATIC BH_GLOBAL_CONFIG *mProtocolConfig = NULL;
+
+STATIC
+EFI_STATUS
+EFIAPI
+BhProtocolGetVariable (
+  IN     BOOT_HELPER_PROTOCOL  *This,
+  IN     CONST CHAR16          *Name,
+  IN     CONST EFI_GUID        *Guid,
+  OUT    UINT32                *Attributes OPTIONAL,
+  IN OUT UINTN                 *DataSize,
+  OUT    VOID                  *Data OPTIONAL
+  )
+{
+  EFI_STATUS    Status;
+  UINT32        CurrentAttributes;
+  UINTN         CurrentSize;
+  VOID          *CurrentData;
+
+  if (Name == NULL || Guid == NULL || DataSize == NULL) {
+    return EFI_INVALID_PARAMETER;
+  }
+
+  Status = BhVarRead (Name, Guid, &CurrentAttributes, &CurrentSize, &CurrentData);
+  if (EFI_ERROR (Status)) {
+    return Status;
+  }
+
+  BhUsageNote (Name, Guid);
+
+  if (Attributes != NULL) {
+    *Attributes = CurrentAttributes;
+  }
+
+  if (*DataSize < CurrentSize || Data == NULL) {
+    Status = EFI_BUFFER_TOO_SMALL;
+  } else {
+    CopyMem (Data, CurrentData, CurrentSize);
+  }
+
+  *DataSize = CurrentSize;
+  if (CurrentData != NULL) {
+    FreePool (CurrentData);
+  }
+
+  return Status;
+}
+
+STATIC
+EFI_STATUS
+EFIAPI
+BhProtocolSetVariable (
+  IN  BOOT_HELPER_PROTOCOL  *This,
+  IN  CONST CHAR16          *Name,
+  IN  CONST EFI_GUID        *Guid,
+  IN  UINT32                Attributes,
+  IN  UINTN                 DataSize,
+  IN  CONST VOID            *Data,
+  OUT BOOLEAN               *Changed OPTIONAL
+  )
+{
+  if (Name == NULL || Guid == NULL || (DataSize != 0 && Data == NULL)) {
+    return EFI_INVALID_PARAMETER;
+  }
+
+  return BhVarWrite (Name, Guid, Attributes, DataSize, Data, Changed);
+}
+
+STATIC
+EFI_STATUS
+EFIAPI
+BhProtocolToggleVariable (
+  IN  BOOT_HELPER_PROTOCOL  *This,
+  IN  CONST CHAR16          *Name,
+  IN  CONST EFI_GUID        *Guid,
+  IN  UINTN                 DataSize,
+  IN  CONST VOID            *Data,
+  OUT BOOLEAN               *Deleted OPTIONAL
+  )
+{
+  if (Name == NULL || Guid == NULL || DataSize == 0 || Data == NULL) {
+    return EFI_INVALID_PARAMETER;
+  }
+
+  return BhVarToggle (Name, Guid, BH_VAR_DEFAULT_ATTRIBUTES, DataSize, Data, Deleted);
+}
+
+STATIC
+EFI_STATUS
+EFIAPI
+BhProtocolApplyProfile (
+  IN  BOOT_HELPER_PROTOCOL  *This,
+  IN  VOID                  *Profile OPTIONAL,
+  IN  UINT32                ProfileSize,
+  OUT UINT32                *WriteCount OPTIONAL
+  )
+{
+  EFI_STATUS        Status;
+  BH_GLOBAL_CONFIG  Config;
+
+  if (Profile == NULL) {
+    if (mProtocolConfig == NULL) {
+      return EFI_NOT_READY;
+    }
+    return BhVarApplyProfile (&mProtocolConfig->Nvram, WriteCount);
+  }
+
+  if (BhBplistIsBinary (Profile, ProfileSize)) {
+    Status = BhConfigurationInitBinary (&Config, Profile, ProfileSize);
+  } else {
+    Status = BhConfigurationInit (&Config, Profile, ProfileSize);
+  }
+  if (EFI_ERROR (Status)) {
+    DEBUG ((DEBUG_WARN, "BH: Failed to parse profile - %r\n", Status));
+    return EFI_INVALID_PARAMETER;
+  }
+
+  Status = BhVarApplyProfile (&Config.Nvram, WriteCount);
+  BhConfigurationFree (&Config);
+
+  return Status;
+}
+
+STATIC
+EFI_STATUS
+EFIAPI
+BhProtocolSnapshot (
+  IN  BOOT_HELPER_PROTOCOL  *This,
+  OUT UINT32                *EntryCount OPTIONAL
+  )
+{
+  EFI_STATUS    Status;
+  BH_VAR_STORE  *Store;
+
+  BhVarCacheInvalidate ();
+
+  Status = BhVarCacheGet (&Store);
+  if (!EFI_ERROR (Status) && EntryCount != NULL) {
+    *EntryCount = Store->EntryCount;
+  }
+
+  return Status;
+}
+
+STATIC
+EFI_STATUS
+EFIAPI
+BhProtocolExport (
+  IN  BOOT_HELPER_PROTOCOL  *This,
+  OUT VOID                  **Buffer,
+  OUT UINTN                 *BufferSize
+  )
+{
+  EFI_STATUS    Status;
+  BH_VAR_STORE  *Store;
+
+  if (Buffer == NULL || BufferSize == NULL) {
+    return EFI_INVALID_PARAMETER;
+  }
+
+  Status = BhVarCacheGet (&Store);
+  if (EFI_ERROR (Status)) {
+    return Status;
+  }
+
+  return BhSnapshotSerialize (Store, Buffer, BufferSize);
+}
+
+STATIC
+CHAR16 *
+EFIAPI
+BhProtocolFormatValue (
+  IN  BOOT_HELPER_PROTOCOL  *This,
+  IN  CONST EFI_GUID        *Guid,
+  IN  CONST VOID            *Data,
+  IN  UINTN                 DataSize,
+  IN  BOOLEAN               IsString
+  )
+{
+  return FormatVar ((EFI_GUID *) Guid, (VOID *) Data, DataSize, IsString);
+}
+
+STATIC
+BOOT_HELPER_PROTOCOL
+mBootHelperProtocol = {
+  BOOT_HELPER_PROTOCOL_REVISION,
+  BhProtocolGetVariable,
+  BhProtocolSetVariable,
+  BhProtocolToggleVariable,
+  BhProtocolApplyProfile,
+  BhProtocolSnapshot,
+  BhProtocolExport,
+  BhProtocolFormatValue
+};
+
+BOOT_HELPER_PROTOCOL *
+BhProtocolInterface (
+  VOID
+  )
+{
+  return &mBootHelperProtocol;
+}
+
+EFI_STATUS
+BhProtocolInstall (
+  IN EFI_HANDLE         ImageHandle,
+  IN BH_GLOBAL_CONFIG   *Config OPTIONAL
+  )
+{
+  EFI_STATUS  Status;
+
+  mProtocolConfig = Config;
+
+  Status = gBS->InstallMultipleProtocolInterfaces (
+    &ImageHandle,
+    &gBootHelperProtocolGuid,
+    &mBootHelperProtocol,
+    NULL
+    );
+
+  DEBUG ((DEBUG_INFO, "BH: Install protocol rev %u - %r\n", BOOT_HELPER_PROTOCOL_REVISION, Status));
+
+  return Status;
+}
+
+EFI_STATUS
+BhProtocolUninstall (
+  IN EFI_HANDLE         ImageHandle
+  )
+{
+  EFI_STATUS  Status;
+
+  Status = gBS->UninstallMultipleProtocolInterfaces (
+    ImageHandle,
+    &gBootHelperProtocolGuid,
+    &mBootHelperProtocol,
+    NULL
+    );
+
+  if (!EFI_ERROR (Status)) {
+    mProtocolConfig = NULL;
+    BhVarCacheInvalidate ();
+  }
+
+  return Status;
+}
@@ -0,0 +1,143 @@
+/** @file
+  Declaration of BOOT_HELPER_PROTOCOL, which exposes the BootHelper variable
+  engine to other UEFI tools.
+
+  This header has no BootHelper-local dependencies, so that it may be copied
+  into other projects which want to consume the protocol.
+
+  Copyright (c) 2020, Mike Beaton. All rights reserved.<BR>
+  SPDX-License-Identifier: BSD-3-Clause
+
+**/
+
+#ifndef __BH__PROTOCOL__
+#define __BH__PROTOCOL__
+
+//
+// Basic UEFI Libraries
+//
+#include <Uefi.h>
+
+#define BOOT_HELPER_PROTOCOL_GUID \
+  { 0x0c2d8a62, 0x149b, 0x4ef2, { 0xb2, 0xc3, 0x4e, 0x3e, 0xdc, 0x47, 0x97, 0x42 } }
+
+//
+// Revision is incremented whenever members are added; existing members
+// are never changed or removed.
+//
+#define BOOT_HELPER_PROTOCOL_REVISION   1
+
+typedef struct BOOT_HELPER_PROTOCOL_ BOOT_HELPER_PROTOCOL;
+
+/**
+  Read a variable from the shared store snapshot, with GetVariable semantics.
+
+  @retval EFI_BUFFER_TOO_SMALL  DataSize was updated with the required size.
+  @retval EFI_NOT_FOUND         Variable is not in the snapshot.
+**/
+typedef
+EFI_STATUS
+(EFIAPI *BOOT_HELPER_GET_VARIABLE) (
+  IN     BOOT_HELPER_PROTOCOL  *This,
+  IN     CONST CHAR16          *Name,
+  IN     CONST EFI_GUID        *Guid,
+  OUT    UINT32                *Attributes OPTIONAL,
+  IN OUT UINTN                 *DataSize,
+  OUT    VOID                  *Data OPTIONAL
+  );
+
+/**
+  Write a variable, only if its value or attributes differ from the live value.
+  DataSize == 0 deletes the variable.
+**/
+typedef
+EFI_STATUS
+(EFIAPI *BOOT_HELPER_SET_VARIABLE) (
+  IN  BOOT_HELPER_PROTOCOL  *This,
+  IN  CONST CHAR16          *Name,
+  IN  CONST EFI_GUID        *Guid,
+  IN  UINT32                Attributes,
+  IN  UINTN                 DataSize,
+  IN  CONST VOID            *Data,
+  OUT BOOLEAN               *Changed OPTIONAL
+  );
+
+/**
+  Delete a variable if it currently holds exactly Data, otherwise write Data.
+**/
+typedef
+EFI_STATUS
+(EFIAPI *BOOT_HELPER_TOGGLE_VARIABLE) (
+  IN  BOOT_HELPER_PROTOCOL  *This,
+  IN  CONST CHAR16          *Name,
+  IN  CONST EFI_GUID        *Guid,
+  IN  UINTN                 DataSize,
+  IN  CONST VOID            *Data,
+  OUT BOOLEAN               *Deleted OPTIONAL
+  );
+
+/**
+  Apply the NVRAM Delete and Add sections of a BootHelper.plist format profile.
+  The profile buffer is modified during parsing. If Profile is NULL, the
+  configuration BootHelper itself loaded is used, where there is one.
+**/
+typedef
+EFI_STATUS
+(EFIAPI *BOOT_HELPER_APPLY_PROFILE) (
+  IN  BOOT_HELPER_PROTOCOL  *This,
+  IN  VOID                  *Profile OPTIONAL,
+  IN  UINT32                ProfileSize,
+  OUT UINT32                *WriteCount OPTIONAL
+  );
+
+/**
+  Discard and re-take the shared store snapshot.
+**/
+typedef
+EFI_STATUS
+(EFIAPI *BOOT_HELPER_SNAPSHOT) (
+  IN  BOOT_HELPER_PROTOCOL  *This,
+  OUT UINT32                *EntryCount OPTIONAL
+  );
+
+/**
+  Serialise the shared store snapshot in .bhsnap format.
+  Buffer must be freed by the caller using FreePool.
+**/
+typedef
+EFI_STATUS
+(EFIAPI *BOOT_HELPER_EXPORT) (
+  IN  BOOT_HELPER_PROTOCOL  *This,
+  OUT VOID                  **Buffer,
+  OUT UINTN                 *BufferSize
+  );
+
+/**
+  Format a variable value as BootHelper displays it.
+  Returns NULL on allocation failure, otherwise the string must be freed by
+  the caller using FreePool.
+**/
+typedef
+CHAR16 *
+(EFIAPI *BOOT_HELPER_FORMAT_VALUE) (
+  IN  BOOT_HELPER_PROTOCOL  *This,
+  IN  CONST EFI_GUID        *Guid,
+  IN  CONST VOID            *Data,
+  IN  UINTN                 DataSize,
+  IN  BOOLEAN               IsString
+  );
+
+struct BOOT_HELPER_PROTOCOL_ {
+  UINT32                        Revision;
+  BOOT_HELPER_GET_VARIABLE      GetVariable;
+  BOOT_HELPER_SET_VARIABLE      SetVariable;
+  BOOT_HELPER_TOGGLE_VARIABLE   ToggleVariable;
+  BOOT_HELPER_APPLY_PROFILE     ApplyProfile;
+  BOOT_HELPER_SNAPSHOT          Snapshot;
+  BOOT_HELPER_EXPORT            Export;
+  BOOT_HELPER_FORMAT_VALUE      FormatValue;
+};
+
+extern EFI_GUID gBootHelperProtocolGuid;
+
+#endif
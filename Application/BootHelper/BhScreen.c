@@ -0,0 +1,25 @@
+/** @file
+  Copyright (c) 2020, Mike Beaton. All rights reserved.<BR>
+  SPDX-License-Identifier: BSD-3-Clause
+
+**/
+
+///
+/// This file generated by ScreenToC.py from Screens.txt, do not edit
+///
+
+#include "BootHelper.h"
+#include "BhScreen.h"
+
+STATIC CONST BH_SCREEN_RUN mBannerRuns[] = {
+  { EFI_LIGHTMAGENTA, L"macOS NVRAM Boot Helper\r\n" BOOT_HELPER_VERSION L" oc-340\r\n" },
+  { EFI_WHITE, L"\r\n" },
+};
+
+CONST BH_SCREEN gBhScreenBanner = { mBannerRuns, ARRAY_SIZE (mBannerRuns) };
+
+STATIC CONST BH_SCREEN_RUN mMenuRuns[] = {
+  { EFI_LIGHTRED, L"\r\nboot-[A]rgs; [B]ig Sur; [C]atalina; Startup[M]ute\r\n[R]eboot; [S]hutdown; [Q]uit; E[x]it\r\n[L]ist; Sna[p]shot; [V]iew snapshot; [T]iming; Memor[y] map; [H]ibernation\r\nOC [I]ntegrity; OC confi[g]; OC bac[k]up; OC r[e]store\r\n" },
+};
+
+CONST BH_SCREEN gBhScreenMenu = { mMenuRuns, ARRAY_SIZE (mMenuRuns) };
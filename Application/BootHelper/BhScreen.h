@@ -0,0 +1,19 @@
+/** @file
+  Copyright (c) 2020, Mike Beaton. All rights reserved.<BR>
+  SPDX-License-Identifier: BSD-3-Clause
+
+**/
+
+///
+/// This file generated by ScreenToC.py from Screens.txt, do not edit
+///
+
+#ifndef __BH__BH_SCREEN__
+#define __BH__BH_SCREEN__
+
+#include "Screen.h"
+
+extern CONST BH_SCREEN gBhScreenBanner;
+extern CONST BH_SCREEN gBhScreenMenu;
+
+#endif
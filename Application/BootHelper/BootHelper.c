@@ -26,10 +26,33 @@
 //
 // Local includes
 //
+#include "Backup.h"
 #include "BhConfig.h"
+#include "BhConfigParse.h"
+#include "BhScreen.h"
 #include "BootHelper.h"
+#include "BootPerf.h"
+#include "BootTo.h"
+#include "Bplist.h"
+#include "Crypt.h"
 #include "EzKb.h"
 #include "DisplayVars.h"
+#include "FirstPaint.h"
+#include "Hibernate.h"
+#include "Integrity.h"
+#include "MemMap.h"
+#include "OcConfig.h"
+#include "Persist.h"
+#include "Plugins.h"
+#include "Profile.h"
+#include "Progress.h"
+#include "Quirks.h"
+#include "Report.h"
+#include "Rules.h"
+#include "Serial.h"
+#include "Snapshot.h"
+#include "Timing.h"
+#include "Usage.h"
 #include "Utils.h"
 
 BOOLEAN mInteractive            = TRUE;
@@ -37,6 +60,9 @@ BOOLEAN mClearScreen            = FALSE;
 BOOLEAN mKeyPromptOnExit        = FALSE;
 BH_ON_EXIT mBhOnExit            = BhOnExitExit;
 
+STATIC EFI_HANDLE mImageHandle  = NULL;
+STATIC UINT32 mStartupSpan      = BH_SPAN_NONE;
+
 #if false
 EFI_STATUS
 EFIAPI
@@ -75,6 +101,29 @@ DisplayAppleVar(
   DisplayNvramValueWithoutGuid(Name, &gEfiAppleGuid, isString);
 }
 
+//
+// Apple variables shown at the top of the menu, also filled in by the first paint.
+//
+STATIC CHAR16 *CONST mAppleVarNames[] = {
+  L"boot-args",
+  L"csr-active-config",
+  L"StartupMute"
+};
+
+STATIC CONST BOOLEAN mAppleVarIsString[] = {
+  TRUE,
+  FALSE,
+  TRUE
+};
+
+VOID
+DisplayAppleVars()
+{
+  for (UINT32 i = 0; i < ARRAY_SIZE (mAppleVarNames); i++) {
+    DisplayAppleVar(mAppleVarNames[i], mAppleVarIsString[i]);
+  }
+}
+
 EFI_STATUS
 ToggleAppleVar(
   IN CHAR16 *Name,
@@ -115,6 +164,12 @@ void ToggleStartupMute()
   ToggleAppleVar(L"StartupMute", gStartupMuteVal, sizeof(gStartupMuteVal));
 }
 
+//
+// Keys handled by BhMain ahead of plug-in actions, whether or not currently offered
+// (e.g. n and f depend on BhBootToSupported); keep in step with the key loop below.
+//
+STATIC CONST CHAR8 mMenuKeys[] = "abcefghiklmnopqrstvxy";
+
 STATIC
 BH_GLOBAL_CONFIG
 mBootHelperConfiguration;
@@ -130,11 +185,10 @@ BhMain ()
     // inter alia, we want to clear the other stuff on the hidden text screen, before switching to viewing the text...
     if (mClearScreen) gST->ConOut->ClearScreen(gST->ConOut);
 
-    SetColour(EFI_LIGHTMAGENTA);
-    Print(L"macOS NVRAM Boot Helper\n");
-    Print(L"0.2.8 oc-340\n");
-    SetColour(EFI_WHITE);
-    Print(L"\n");
+    BhScreenShow(&gBhScreenBanner);
+
+    BhPersistShowReport();
+    BhRulesShowReport();
 
     CONST CHAR8 *AsciiPicker;
     AsciiPicker = OC_BLOB_GET (&mBootHelperConfiguration.Config.Xanana);
@@ -146,22 +200,24 @@ BhMain ()
     Print(L"\n");
 
 #if 1
-    DisplayAppleVar(L"boot-args", TRUE);
-    DisplayAppleVar(L"csr-active-config", FALSE);
-    DisplayAppleVar(L"StartupMute", TRUE);
+    DisplayAppleVars();
 #endif
     if (showOCVersion) {
       DisplayNvramValueWithoutGuid(L"opencore-version", &gEfiOpenCoreGuid, TRUE);
     }
 
-    SetColour(EFI_LIGHTRED);
-    Print(L"\nboot-[A]rgs; [B]ig Sur; [C]atalina; Startup[M]ute\n[R]eboot; [S]hutdown; [Q]uit; E[x]it; [L]ist\n");
+    // Static banner and menu legend are pre-encoded from Screens.txt; see makefile
+    BhScreenShow(&gBhScreenMenu);
+    BhBootToPrintActions();
+    BhPluginPrintActions();
     SetColour(EFI_WHITE);
 
+    BhUsagePrintPanel();
+
     EFI_INPUT_KEY key;
 
     while (TRUE) {
-      getkeystroke(&key);
+      getkeystrokeidle(&key, BhUsagePrefetch);
 
       CHAR16 c = key.UnicodeChar;
       if (c >= 'A' && c <= 'Z') c = c - 'A' + 'a';
@@ -192,28 +248,204 @@ BhMain ()
       } else if (c == 's') {
         mBhOnExit = BhOnExitShutdown;
         return EFI_SUCCESS;
+      } else if ((c == 'n' && BhBootToSupported (BhBootToRecovery))
+        || (c == 'f' && BhBootToSupported (BhBootToFirmwareUi))) {
+        EFI_STATUS Status;
+        Status = BhBootToSet (c == 'n' ? BhBootToRecovery : BhBootToFirmwareUi);
+        if (EFI_ERROR (Status)) {
+          Print (L"Error: %r!\n", Status);
+          Print (L"Any Key...\n");
+          getkeystroke (&key);
+          break;
+        }
+        mBhOnExit = BhOnExitReboot;
+        return EFI_SUCCESS;
       } else if (c == 'l') {
-        Print (L"Listing... (any key for next or [Q]uit; E[x]it; List [a]ll remaining)\n");
+        Print (L"Listing... (any key for next or [Q]uit; E[x]it; List [a]ll remaining; Esc to cancel)\n");
         EFI_STATUS Status;
+        BhProgressBegin (NULL);
         Status = ListVars();
+        BhProgressEnd ();
         if (Status == EFI_NOT_FOUND) {
           Print( L"Listed.\n");
         } else if (Status == EFI_SUCCESS) {
           Print (L"Quit.\n");
+        } else if (Status == EFI_ABORTED) {
+          Print (L"Cancelled.\n");
+        } else {
+          Print (L"Error: %r!\n", Status);
+        }
+        Print (L"Any Key...\n");
+        getkeystroke (&key);
+        break;
+      } else if (c == 'p') {
+        CHAR16 SnapshotName[128];
+        EFI_STATUS Status;
+        CONST CHAR8 *Passphrase;
+        Passphrase = NULL;
+        Status = EFI_SUCCESS;
+        if (!BhCryptConfigured ()) {
+          Print (L"[E]ncrypt; any other key to save unencrypted...\n");
+          getkeystroke (&key);
+        }
+        if (BhCryptConfigured () || key.UnicodeChar == 'e' || key.UnicodeChar == 'E') {
+          Status = BhCryptGetPassphrase (TRUE, &Passphrase);
+        }
+        if (!EFI_ERROR (Status)) {
+          Print (L"Saving snapshot... (Esc to cancel)\n");
+          BhProgressBegin (L"Variables read");
+          Status = BhSnapshotExport (mOpenCoreStorage.StorageRoot, Passphrase, SnapshotName, sizeof (SnapshotName));
+          BhProgressEnd ();
+        }
+        if (Status == EFI_ABORTED) {
+          Print (L"Cancelled, nothing written.\n");
+        } else if (EFI_ERROR (Status)) {
+          Print (L"Error: %r!\n", Status);
+        } else {
+          Print (L"Saved %s\n", SnapshotName);
+        }
+        Print (L"Any Key...\n");
+        getkeystroke (&key);
+        break;
+      } else if (c == 'v') {
+        EFI_STATUS Status;
+        Status = BhSnapshotBrowse (mOpenCoreStorage.StorageRoot);
+        if (EFI_ERROR (Status)) {
+          Print (L"Error: %r!\n", Status);
+        }
+        Print (L"Any Key...\n");
+        getkeystroke (&key);
+        break;
+      } else if (c == 'i') {
+        EFI_STATUS Status;
+        Print (L"Checking OpenCore against %s... (Esc to cancel)\n", BH_INTEGRITY_MANIFEST_PATH);
+        BhProgressBegin (NULL);
+        Status = BhIntegrityCheck (mOpenCoreStorage.StorageRoot);
+        BhProgressEnd ();
+        if (Status == EFI_ABORTED) {
+          Print (L"Cancelled.\n");
+        } else if (EFI_ERROR (Status)) {
+          Print (L"Error: %r!\n", Status);
+        }
+        Print (L"Any Key...\n");
+        getkeystroke (&key);
+        break;
+      } else if (c == 'g') {
+        EFI_STATUS Status;
+        UINT32 ProblemCount;
+        Status = BhOcConfigValidate (&ProblemCount);
+        if (EFI_ERROR (Status)) {
+          Print (L"Error: %r!\n", Status);
+        } else {
+          Print (L"[N]VRAM/Add against live; [T]ools; any other key to continue...\n");
+          getkeystroke (&key);
+          if (key.UnicodeChar == 'n' || key.UnicodeChar == 'N') {
+            Status = BhOcConfigShowNvram ();
+          } else if (key.UnicodeChar == 't' || key.UnicodeChar == 'T') {
+            Status = BhOcConfigShowTools ();
+          } else {
+            break;
+          }
+          if (EFI_ERROR (Status)) {
+            Print (L"Error: %r!\n", Status);
+          }
+        }
+        Print (L"Any Key...\n");
+        getkeystroke (&key);
+        break;
+      } else if (c == 'k' || c == 'e') {
+        EFI_STATUS Status;
+        if (c == 'k') {
+          Status = BhBackupCreate (mOpenCoreStorage.StorageRoot);
+        } else {
+          Status = BhBackupRestore (mOpenCoreStorage.StorageRoot);
+        }
+        if (Status == EFI_ABORTED) {
+          Print (L"Cancelled.\n");
+        } else if (EFI_ERROR (Status)) {
+          Print (L"Error: %r!\n", Status);
+        }
+        Print (L"Any Key...\n");
+        getkeystroke (&key);
+        break;
+      } else if (c == 't') {
+        BhBootPerfShow (mOpenCoreStorage.StorageRoot);
+        Print (L"Any Key...\n");
+        getkeystroke (&key);
+        break;
+      } else if (c == 'h') {
+        BH_HIBERNATE_STATE Hibernate;
+        EFI_STATUS Status;
+        UINT32 DeleteCount;
+        Status = BhHibernateScan (OC_BLOB_GET (&mBootHelperConfiguration.Misc.Boot.HibernateMode), &Hibernate);
+        if (EFI_ERROR (Status)) {
+          Print (L"Error: %r!\n", Status);
         } else {
+          BhHibernateShow (&Hibernate);
+          if (Hibernate.PresentCount > 0) {
+            Print (L"[D]elete all %u hibernation variables; any other key to continue...\n", Hibernate.PresentCount);
+            getkeystroke (&key);
+            if (key.UnicodeChar == 'd' || key.UnicodeChar == 'D') {
+              Status = BhHibernateClear (&Hibernate, &DeleteCount);
+              if (EFI_ERROR (Status)) {
+                Print (L"Error: %r!\n", Status);
+              } else {
+                Print (L"Deleted %u\n", DeleteCount);
+              }
+            } else {
+              BhHibernateFree (&Hibernate);
+              break;
+            }
+          }
+          BhHibernateFree (&Hibernate);
+        }
+        Print (L"Any Key...\n");
+        getkeystroke (&key);
+        break;
+      } else if (c == 'y') {
+        BH_MEMMAP_SUMMARY MemMap;
+        EFI_STATUS Status;
+        Status = BhMemMapCapture (&MemMap);
+        if (EFI_ERROR (Status)) {
           Print (L"Error: %r!\n", Status);
+        } else {
+          BhMemMapShow (&MemMap);
+          Print (L"[E]xport; any other key to continue...\n");
+          getkeystroke (&key);
+          if (key.UnicodeChar == 'e' || key.UnicodeChar == 'E') {
+            CHAR16 MemMapName[128];
+            Status = BhMemMapExport (mOpenCoreStorage.StorageRoot, &MemMap, MemMapName, sizeof (MemMapName));
+            if (EFI_ERROR (Status)) {
+              Print (L"Error: %r!\n", Status);
+            } else {
+              Print (L"Saved %s\n", MemMapName);
+            }
+          } else {
+            break;
+          }
         }
         Print (L"Any Key...\n");
         getkeystroke (&key);
         break;
       } else if (c == 'x' || c == 'q') {
         return EFI_SUCCESS;
+      } else {
+        EFI_STATUS Status;
+        Status = BhPluginRunAction (c);
+        if (Status == EFI_NOT_FOUND) {
+          continue;
+        }
+        if (EFI_ERROR (Status)) {
+          Print (L"Error: %r!\n", Status);
+          Print (L"Any Key...\n");
+          getkeystroke (&key);
+        }
+        break;
       }
     }
   }
 }
 
-STATIC
 OC_STORAGE_CONTEXT
 mOpenCoreStorage;
 
@@ -254,9 +486,18 @@ BhConfigLoad (
     );
 
   if (ConfigData != NULL) {
-    DEBUG ((DEBUG_INFO, "BH: Loaded configuration of %u bytes\n", ConfigDataSize));
-
-    Status = BhConfigurationInit (Config, ConfigData, ConfigDataSize);
+    DEBUG ((
+      DEBUG_INFO,
+      "BH: Loaded %a configuration of %u bytes\n",
+      BhBplistIsBinary (ConfigData, ConfigDataSize) ? "binary" : "XML",
+      ConfigDataSize
+      ));
+
+    if (BhBplistIsBinary (ConfigData, ConfigDataSize)) {
+      Status = BhConfigurationInitBinary (Config, ConfigData, ConfigDataSize);
+    } else {
+      Status = BhConfigurationInit (Config, ConfigData, ConfigDataSize);
+    }
     if (EFI_ERROR (Status)) {
       DEBUG ((DEBUG_ERROR, "BH: Failed to parse configuration!\n"));
       return EFI_UNSUPPORTED;
@@ -283,20 +524,108 @@ BhConfigAndMain (
   )
 {
   EFI_STATUS                Status;
+  UINT32                    Span;
+
+  BhFirstPaintStatus (L"Loading configuration...");
 
   DEBUG ((DEBUG_INFO, "BH: BhConfigAndMain calling BhConfigLoad...\n"));
+  Span = BhSpanBegin (L"Load configuration");
   Status = BhConfigLoad (
     Storage,
     &mBootHelperConfiguration,
     mOpenCoreVaultKey
     );
+  BhSpanEnd (Span);
 
   if (EFI_ERROR (Status)) {
     return Status;
   }
 
+  BhQuirksInit (&mBootHelperConfiguration.Misc.Quirks);
+  BhRulesCompile (&mBootHelperConfiguration.Misc.Rules);
+
+  BhSerialStart (
+    OC_BLOB_GET (&mBootHelperConfiguration.Config.SerialMirror),
+    mBootHelperConfiguration.Misc.Debug.SerialInit
+    );
+
+  //
+  // Protocol is available to tools started from BootHelper while it runs;
+  // use BootHelperDxe.efi for a resident copy.
+  //
+  if (mBootHelperConfiguration.Config.InstallProtocol) {
+    if (EFI_ERROR (BhProtocolInstall (mImageHandle, &mBootHelperConfiguration))) {
+      mBootHelperConfiguration.Config.InstallProtocol = FALSE;
+    }
+  }
+
+  BhPluginInit (&mBootHelperConfiguration.Misc.Plugins, Storage, mImageHandle, mMenuKeys);
+
+  BhCryptSetPassphrase (OC_BLOB_GET (&mBootHelperConfiguration.Config.ExportPassphrase));
+
+  //
+  // OpenCore config.plist is only read when first needed, then kept for the session.
+  //
+  BhOcConfigInit (Storage->StorageHandle);
+
+  //
+  // One-shot boot targets are offered only where firmware supports them, checked once.
+  //
+  BhBootToInit ();
+
+  //
+  // Allocate memory map capture buffer up front, so that capture does not perturb the map.
+  //
+  BhMemMapInit ();
+
+  BhFirstPaintStatus (L"Checking NVRAM...");
+
+  //
+  // Check writes made by the previous run before anything is changed in this one.
+  //
+  BhPersistVerify (Storage->StorageRoot);
+  BhReportStart ();
+
+  //
+  // After verification and report start, so that rule writes are recorded and checked like any others.
+  //
+  BhRulesApply ();
+
+  BhUsageLoad (Storage->StorageRoot);
+
+  BhSpanEnd (mStartupSpan);
+
+  //
+  // Menu is drawn in full from here; keys typed during startup are waiting for it.
+  //
+  BhFirstPaintEnd (TRUE);
+
   Status = BhMain();
 
+  BhPersistCommit (Storage->StorageRoot);
+  BhPersistFree ();
+
+  //
+  // After verification bookkeeping, so that the report is not itself checked next time.
+  //
+  BhReportPublish ();
+
+  BhUsageSave (Storage->StorageRoot);
+
+  BhProfileSave (Storage->StorageRoot);
+
+  BhPluginFree ();
+  BhMemMapFree ();
+  BhOcConfigFree ();
+  BhCryptForget ();
+  BhCryptSetPassphrase (NULL);
+
+  if (mBootHelperConfiguration.Config.InstallProtocol) {
+    BhProtocolUninstall (mImageHandle);
+  }
+
+  BhSerialStop ();
+
   BhConfigurationFree (&mBootHelperConfiguration);
 
   return Status;
@@ -313,6 +642,7 @@ BhBootstrap (
   EFI_STATUS                Status;
   EFI_DEVICE_PATH_PROTOCOL  *RemainingPath;
   UINTN                     StoragePathSize;
+  UINT32                    Span;
 
   DEBUG ((DEBUG_INFO, "BH: BhBootstrap\n"));
 
@@ -371,6 +701,9 @@ BhBootstrap (
     &mStorageHandle
     );
 
+  BhFirstPaintStatus (L"Opening storage...");
+
+  Span = BhSpanBegin (L"Open storage");
   Status = OcStorageInitFromFs (
     &mOpenCoreStorage,
     FileSystem,
@@ -379,6 +712,7 @@ BhBootstrap (
     mStorageRoot,
     mOpenCoreVaultKey
     );
+  BhSpanEnd (Span);
 
   if (!EFI_ERROR (Status)) {
     Status = BhConfigAndMain (&mOpenCoreStorage, LoadPath);
@@ -408,8 +742,12 @@ UefiMain (
   EFI_SIMPLE_FILE_SYSTEM_PROTOCOL   *FileSystem;
   EFI_DEVICE_PATH_PROTOCOL          *AbsPath;
 
+  mStartupSpan = BhSpanBegin (L"Startup");
+
   DEBUG ((DEBUG_INFO, "BH: Starting BootHelper...\n"));
 
+  mImageHandle = ImageHandle;
+
   LoadedImage = NULL;
   Status = gBS->HandleProtocol (
     ImageHandle,
@@ -425,6 +763,21 @@ UefiMain (
 
   DebugPrintDevicePath (DEBUG_INFO, "BH: Booter path", LoadedImage->FilePath);
 
+  //
+  // No-op unless built with BH_PROFILE.
+  //
+  BhProfileStart (LoadedImage->ImageBase, LoadedImage->ImageSize);
+
+  //
+  // Static frame first, then values which need no configuration, in place as each is read.
+  //
+  BhFirstPaintBegin ((CONST CHAR16 *CONST *) mAppleVarNames, ARRAY_SIZE (mAppleVarNames));
+  for (UINT32 i = 0; i < ARRAY_SIZE (mAppleVarNames); i++) {
+    if (BhFirstPaintSeek (i)) {
+      DisplayAppleVar(mAppleVarNames[i], mAppleVarIsString[i]);
+    }
+  }
+
   //
   // Obtain the file system device path
   //
@@ -449,6 +802,16 @@ UefiMain (
     FreePool (AbsPath);
   }
 
+  //
+  // Only still painted if startup failed before the menu; leave the frame above the error.
+  //
+  BhFirstPaintEnd (FALSE);
+
+  //
+  // Sampling interrupt must not outlive this image.
+  //
+  BhProfileStop ();
+
   if (mBhOnExit == BhOnExitReboot) {
     Print(L"\nRebooting...\n");
     Reboot();
@@ -15,9 +15,23 @@
 #include <Uefi.h>
 #include <Library/UefiLib.h>
 
+//
+// OC Libraries
+//
+#include <Library/OcStorageLib.h>
+
+//
+// Local includes
+//
+#include "BhConfig.h"
+#include "BhProtocol.h"
+
 #define BOOT_HELPER_ROOT_PATH       L"EFI\\BootHelper"
 #define BOOT_HELPER_CONFIG_PATH     L"BootHelper.plist"
 
+#define BOOT_HELPER_VERSION         L"0.2.8"
+#define BOOT_HELPER_VERSION_NUMBER  0x00000208      ///< 0x00MMmmpp, as published in the NVRAM report
+
 typedef enum BH_ON_EXIT_ {
   BhOnExitExit,
   BhOnExitShutdown,
@@ -28,4 +42,25 @@ extern BOOLEAN mInteractive;
 extern BOOLEAN mClearScreen;
 extern BH_ON_EXIT mBhOnExit;
 
+extern OC_STORAGE_CONTEXT mOpenCoreStorage;
+
+// Return BOOT_HELPER_PROTOCOL interface, whether or not it is installed
+BOOT_HELPER_PROTOCOL *
+BhProtocolInterface (
+  VOID
+  );
+
+// Install BOOT_HELPER_PROTOCOL on ImageHandle; Config is used for ApplyProfile with no profile buffer
+EFI_STATUS
+BhProtocolInstall (
+  IN EFI_HANDLE         ImageHandle,
+  IN BH_GLOBAL_CONFIG   *Config OPTIONAL
+  );
+
+// Uninstall BOOT_HELPER_PROTOCOL from ImageHandle, and drop the shared store snapshot
+EFI_STATUS
+BhProtocolUninstall (
+  IN EFI_HANDLE         ImageHandle
+  );
+
 #endif
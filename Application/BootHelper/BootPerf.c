@@ -0,0 +1,337 @@
+/** @file
+  Firmware boot performance (ACPI FPDT) viewer.
+
+  Copyright (c) 2020, Mike Beaton. All rights reserved.<BR>
+  SPDX-License-Identifier: BSD-3-Clause
+
+**/
+
+//
+// Basic UEFI Libraries
+//
+#include <Uefi.h>
+#include <Library/UefiLib.h>
+#include <Library/BaseLib.h>
+#include <Library/BaseMemoryLib.h>
+#include <Library/PrintLib.h>
+
+//
+// Boot and Runtime Services
+//
+#include <Library/UefiRuntimeServicesTableLib.h>
+
+//
+// OC Libraries
+//
+#include <Library/OcDebugLogLib.h>
+
+#include <Guid/Acpi.h>
+
+//
+// Local includes
+//
+#include "BootPerf.h"
+#include "FileUtils.h"
+#include "Platform.h"
+#include "Timing.h"
+#include "Utils.h"
+
+#define BOOT_PERF_CSV_HEADER \
+  "Time,ResetEnd,OsLoaderLoadImageStart,OsLoaderStartImageStart,ExitBootServicesEntry,ExitBootServicesExit,BootHelperStart,BootHelperReady\r\n"
+
+STATIC BOOLEAN                                        mBasicBootSearched = FALSE;
+STATIC CONST EFI_ACPI_5_0_FPDT_FIRMWARE_BASIC_BOOT_RECORD *mBasicBoot = NULL;
+STATIC BOOLEAN                                        mCsvAppended = FALSE;
+
+STATIC
+CONST EFI_ACPI_DESCRIPTION_HEADER *
+FindAcpiTable (
+  IN UINT32   Signature
+  )
+{
+  EFI_STATUS                                    Status;
+  CONST EFI_ACPI_2_0_ROOT_SYSTEM_DESCRIPTION_POINTER  *Rsdp;
+  CONST EFI_ACPI_DESCRIPTION_HEADER             *Sdt;
+  CONST EFI_ACPI_DESCRIPTION_HEADER             *Table;
+  CONST UINT8                                   *Entry;
+  UINTN                                         EntrySize;
+  UINTN                                         Index;
+  UINTN                                         Count;
+
+  Status = EfiGetSystemConfigurationTable (&gEfiAcpi20TableGuid, (VOID **) &Rsdp);
+  if (EFI_ERROR (Status) || Rsdp == NULL) {
+    Status = EfiGetSystemConfigurationTable (&gEfiAcpi10TableGuid, (VOID **) &Rsdp);
+    if (EFI_ERROR (Status) || Rsdp == NULL) {
+      return NULL;
+    }
+  }
+
+  //
+  // Prefer XSDT (64-bit entries) where present.
+  //
+  if (Rsdp->Revision >= 2 && Rsdp->XsdtAddress != 0) {
+    Sdt = (CONST EFI_ACPI_DESCRIPTION_HEADER *) (UINTN) Rsdp->XsdtAddress;
+    EntrySize = sizeof (UINT64);
+  } else {
+    Sdt = (CONST EFI_ACPI_DESCRIPTION_HEADER *) (UINTN) Rsdp->RsdtAddress;
+    EntrySize = sizeof (UINT32);
+  }
+
+  if (Sdt == NULL || Sdt->Length < sizeof (*Sdt)) {
+    return NULL;
+  }
+
+  Entry = (CONST UINT8 *) (Sdt + 1);
+  Count = (Sdt->Length - sizeof (*Sdt)) / EntrySize;
+
+  for (Index = 0; Index < Count; Index++, Entry += EntrySize) {
+    if (EntrySize == sizeof (UINT64)) {
+      Table = (CONST EFI_ACPI_DESCRIPTION_HEADER *) (UINTN) ReadUnaligned64 ((CONST UINT64 *) Entry);
+    } else {
+      Table = (CONST EFI_ACPI_DESCRIPTION_HEADER *) (UINTN) ReadUnaligned32 ((CONST UINT32 *) Entry);
+    }
+
+    if (Table != NULL && Table->Signature == Signature) {
+      return Table;
+    }
+  }
+
+  return NULL;
+}
+
+//
+// Walk performance records in [Start, End), returning the first of Type
+// which is at least MinLength long.
+//
+STATIC
+CONST EFI_ACPI_5_0_FPDT_PERFORMANCE_RECORD_HEADER *
+FindPerformanceRecord (
+  IN CONST UINT8  *Start,
+  IN CONST UINT8  *End,
+  IN UINT16       Type,
+  IN UINTN        MinLength
+  )
+{
+  CONST EFI_ACPI_5_0_FPDT_PERFORMANCE_RECORD_HEADER  *Record;
+
+  while (Start + sizeof (*Record) <= End) {
+    Record = (CONST EFI_ACPI_5_0_FPDT_PERFORMANCE_RECORD_HEADER *) Start;
+    if (Record->Length < sizeof (*Record) || Start + Record->Length > End) {
+      break;
+    }
+
+    if (Record->Type == Type && Record->Length >= MinLength) {
+      return Record;
+    }
+
+    Start += Record->Length;
+  }
+
+  return NULL;
+}
+
+EFI_STATUS
+BhFpdtGetBasicBootRecord (
+  OUT CONST EFI_ACPI_5_0_FPDT_FIRMWARE_BASIC_BOOT_RECORD  **Record
+  )
+{
+  CONST EFI_ACPI_DESCRIPTION_HEADER                             *Fpdt;
+  CONST EFI_ACPI_5_0_FPDT_BOOT_PERFORMANCE_TABLE_POINTER_RECORD *Pointer;
+  CONST EFI_ACPI_5_0_FPDT_PERFORMANCE_TABLE_HEADER              *Fbpt;
+
+  if (!mBasicBootSearched) {
+    mBasicBootSearched = TRUE;
+
+    Fpdt = FindAcpiTable (EFI_ACPI_5_0_FIRMWARE_PERFORMANCE_DATA_TABLE_SIGNATURE);
+    if (Fpdt == NULL) {
+      DEBUG ((DEBUG_INFO, "BH: No FPDT\n"));
+    } else {
+      Pointer = (CONST EFI_ACPI_5_0_FPDT_BOOT_PERFORMANCE_TABLE_POINTER_RECORD *) FindPerformanceRecord (
+        (CONST UINT8 *) (Fpdt + 1),
+        (CONST UINT8 *) Fpdt + Fpdt->Length,
+        EFI_ACPI_5_0_FPDT_RECORD_TYPE_FIRMWARE_BASIC_BOOT_POINTER,
+        sizeof (*Pointer)
+        );
+
+      Fbpt = NULL;
+      if (Pointer != NULL) {
+        Fbpt = (CONST EFI_ACPI_5_0_FPDT_PERFORMANCE_TABLE_HEADER *) (UINTN) Pointer->BootPerformanceTablePointer;
+      }
+
+      if (Fbpt != NULL && Fbpt->Signature == EFI_ACPI_5_0_FPDT_BOOT_PERFORMANCE_TABLE_SIGNATURE) {
+        mBasicBoot = (CONST EFI_ACPI_5_0_FPDT_FIRMWARE_BASIC_BOOT_RECORD *) FindPerformanceRecord (
+          (CONST UINT8 *) (Fbpt + 1),
+          (CONST UINT8 *) Fbpt + Fbpt->Length,
+          EFI_ACPI_5_0_FPDT_RUNTIME_RECORD_TYPE_FIRMWARE_BASIC_BOOT,
+          sizeof (*mBasicBoot)
+          );
+      }
+
+      DEBUG ((DEBUG_INFO, "BH: FPDT %p FBPT %p basic boot record %p\n", Fpdt, Fbpt, mBasicBoot));
+    }
+  }
+
+  *Record = mBasicBoot;
+  return mBasicBoot != NULL ? EFI_SUCCESS : EFI_NOT_FOUND;
+}
+
+//
+// Whole milliseconds, and microseconds over, using BaseLib so that IA32 needs no 64-bit
+// modulo helper.
+//
+STATIC
+UINT64
+SplitMilliseconds (
+  IN  UINT64        Nanoseconds,
+  OUT UINT32        *Microseconds
+  )
+{
+  return DivU64x32Remainder (DivU64x32 (Nanoseconds, 1000), 1000, Microseconds);
+}
+
+STATIC
+VOID
+PrintTimestamp (
+  IN CONST CHAR16   *Label,
+  IN UINT64         Nanoseconds
+  )
+{
+  UINT32  Microseconds;
+
+  //
+  // Zero means not (yet) recorded: ExitBootServices values for this boot
+  // are only filled in once BootHelper has gone.
+  //
+  if (Nanoseconds == 0) {
+    Print (L"  %-26s         -\n", Label);
+  } else {
+    Print (L"  %-26s %6lu.%03u ms\n", Label, SplitMilliseconds (Nanoseconds, &Microseconds), Microseconds);
+  }
+}
+
+STATIC
+VOID
+AppendCsv (
+  IN EFI_FILE_PROTOCOL                                    *Root,
+  IN CONST EFI_ACPI_5_0_FPDT_FIRMWARE_BASIC_BOOT_RECORD   *Record OPTIONAL,
+  IN UINT64                                               Start,
+  IN UINT64                                               Ready
+  )
+{
+  EFI_STATUS          Status;
+  EFI_TIME            Now;
+  CHAR16              Path[64];
+  CHAR8               Line[256];
+  UINTN               Length;
+  EFI_FILE_PROTOCOL   *File;
+
+  UnicodeSPrint (Path, sizeof (Path), L"%s\\%g.csv", BH_BOOT_PERF_DIRECTORY, &BhGetPlatformInfo ()->SystemUuid);
+
+  Length = 0;
+  if (EFI_ERROR (BhOpenFile (Root, Path, &File, FALSE))) {
+    Length = AsciiSPrint (Line, sizeof (Line), "%a", BOOT_PERF_CSV_HEADER);
+  } else {
+    File->Close (File);
+  }
+
+  if (EFI_ERROR (gRT->GetTime (&Now, NULL))) {
+    ZeroMem (&Now, sizeof (Now));
+  }
+
+  //
+  // Microseconds throughout; empty fields where there is no FPDT.
+  //
+  if (Record != NULL) {
+    Length += AsciiSPrint (
+      Line + Length,
+      sizeof (Line) - Length,
+      "%04u-%02u-%02uT%02u:%02u:%02u,%lu,%lu,%lu,%lu,%lu,%lu,%lu\r\n",
+      Now.Year, Now.Month, Now.Day, Now.Hour, Now.Minute, Now.Second,
+      DivU64x32 (Record->ResetEnd, 1000),
+      DivU64x32 (Record->OsLoaderLoadImageStart, 1000),
+      DivU64x32 (Record->OsLoaderStartImageStart, 1000),
+      DivU64x32 (Record->ExitBootServicesEntry, 1000),
+      DivU64x32 (Record->ExitBootServicesExit, 1000),
+      DivU64x32 (Start, 1000),
+      DivU64x32 (Ready, 1000)
+      );
+  } else {
+    Length += AsciiSPrint (
+      Line + Length,
+      sizeof (Line) - Length,
+      "%04u-%02u-%02uT%02u:%02u:%02u,,,,,,%lu,%lu\r\n",
+      Now.Year, Now.Month, Now.Day, Now.Hour, Now.Minute, Now.Second,
+      DivU64x32 (Start, 1000),
+      DivU64x32 (Ready, 1000)
+      );
+  }
+
+  Status = BhAppendFile (Root, Path, Line, Length);
+  if (!EFI_ERROR (Status)) {
+    mCsvAppended = TRUE;
+    Print (L"\nAppended to %s\n", Path);
+  } else {
+    Print (L"\nCould not append to %s - %r\n", Path, Status);
+  }
+}
+
+EFI_STATUS
+BhBootPerfShow (
+  IN EFI_FILE_PROTOCOL  *Root
+  )
+{
+  EFI_STATUS                                            Status;
+  CONST EFI_ACPI_5_0_FPDT_FIRMWARE_BASIC_BOOT_RECORD    *Record;
+  CONST BH_SPAN                                         *Spans;
+  UINT32                                                Count;
+  UINT32                                                Index;
+  UINT64                                                Start;
+  UINT64                                                Ready;
+  UINT64                                                Milliseconds;
+  UINT32                                                Microseconds;
+
+  Status = BhFpdtGetBasicBootRecord (&Record);
+
+  SetColour (EFI_LIGHTCYAN);
+  Print (L"Firmware (ACPI FPDT), since reset:\n");
+  SetColour (EFI_WHITE);
+
+  if (EFI_ERROR (Status)) {
+    Print (L"  No firmware basic boot performance record\n");
+    Record = NULL;
+  } else {
+    PrintTimestamp (L"Reset end", Record->ResetEnd);
+    PrintTimestamp (L"OS loader load image", Record->OsLoaderLoadImageStart);
+    PrintTimestamp (L"OS loader start image", Record->OsLoaderStartImageStart);
+    PrintTimestamp (L"ExitBootServices entry", Record->ExitBootServicesEntry);
+    PrintTimestamp (L"ExitBootServices exit", Record->ExitBootServicesExit);
+  }
+
+  SetColour (EFI_LIGHTCYAN);
+  Print (L"BootHelper:\n");
+  SetColour (EFI_WHITE);
+
+  Spans = BhSpans (&Count);
+  Start = 0;
+  Ready = 0;
+  for (Index = 0; Index < Count; Index++) {
+    if (Index == 0) {
+      Start = Spans[Index].Start;
+    }
+    PrintTimestamp (Spans[Index].Name, Spans[Index].Start);
+    if (Spans[Index].End != 0) {
+      Milliseconds = SplitMilliseconds (Spans[Index].End - Spans[Index].Start, &Microseconds);
+      Print (L"    took %lu.%03u ms\n", Milliseconds, Microseconds);
+      Ready = MAX (Ready, Spans[Index].End);
+    }
+  }
+
+  //
+  // One row per BootHelper run.
+  //
+  if (!mCsvAppended && Root != NULL) {
+    AppendCsv (Root, Record, Start, Ready);
+  }
+
+  return EFI_SUCCESS;
+}
@@ -0,0 +1,35 @@
+/** @file
+  Declaration of firmware boot performance (ACPI FPDT) viewer.
+
+  Copyright (c) 2020, Mike Beaton. All rights reserved.<BR>
+  SPDX-License-Identifier: BSD-3-Clause
+
+**/
+
+#ifndef __BH__BOOT_PERF__
+#define __BH__BOOT_PERF__
+
+//
+// Basic UEFI Libraries
+//
+#include <Uefi.h>
+#include <Library/UefiLib.h>
+
+#include <IndustryStandard/Acpi.h>
+#include <Protocol/SimpleFileSystem.h>
+
+#define BH_BOOT_PERF_DIRECTORY      L"Performance"
+
+// Locate the Firmware Basic Boot Performance Record in place in the ACPI tables (nothing is copied)
+EFI_STATUS
+BhFpdtGetBasicBootRecord (
+  OUT CONST EFI_ACPI_5_0_FPDT_FIRMWARE_BASIC_BOOT_RECORD  **Record
+  );
+
+// Display firmware boot timestamps with BootHelper startup spans, and append them to Performance\<machine>.csv
+EFI_STATUS
+BhBootPerfShow (
+  IN EFI_FILE_PROTOCOL  *Root
+  );
+
+#endif
@@ -0,0 +1,197 @@
+/** @file
+  One-shot boot to macOS Recovery or firmware setup.
+
+  Holding Cmd+R or the firmware setup key at exactly the right moment often
+  takes several restarts. Both targets can instead be requested through
+  variables which firmware reads, and clears, on the next boot. Support for
+  each is checked once at startup, so the menu only offers what will work.
+
+  Copyright (c) 2020, Mike Beaton. All rights reserved.<BR>
+  SPDX-License-Identifier: BSD-3-Clause
+
+**/
+
+//
+// Basic UEFI Libraries
+//
+#include <Uefi.h>
+#include <Library/UefiLib.h>
+#include <Library/BaseLib.h>
+#include <Library/BaseMemoryLib.h>
+
+//
+// Boot and Runtime Services
+//
+#include <Library/UefiBootServicesTableLib.h>
+#include <Library/UefiRuntimeServicesTableLib.h>
+
+#include <Guid/GlobalVariable.h>
+
+//
+// OC Libraries
+//
+#include <Library/OcDebugLogLib.h>
+
+//
+// Local includes
+//
+#include "BootTo.h"
+#include "Persist.h"
+#include "VarEngine.h"
+
+#define APPLE_BOOT_VARIABLE_GUID \
+  { 0x7c436110, 0xab2a, 0x4bbb, {0xa8, 0x80, 0xfe, 0x41, 0x99, 0x5c, 0x9f, 0x82} }
+STATIC EFI_GUID mAppleBootVariableGuid = APPLE_BOOT_VARIABLE_GUID;
+
+//
+// Value written by macOS (nvram recovery-boot-mode=unused) to restart into Recovery.
+//
+#define RECOVERY_BOOT_MODE_NAME     L"recovery-boot-mode"
+STATIC CONST CHAR8 mRecoveryBootModeValue[] = { 'u', 'n', 'u', 's', 'e', 'd' };
+
+#define BOOT_TO_ATTRIBUTES \
+  (EFI_VARIABLE_NON_VOLATILE | EFI_VARIABLE_BOOTSERVICE_ACCESS | EFI_VARIABLE_RUNTIME_ACCESS)
+
+STATIC BOOLEAN mSupported[BhBootToCount];
+
+STATIC
+CONST CHAR16 *
+mTargetNames[BhBootToCount] = {
+  L"Recovery",
+  L"firmware setup"
+};
+
+//
+// Read back a small value directly from firmware, rather than through the variable cache.
+//
+STATIC
+BOOLEAN
+ValueIs (
+  IN CONST CHAR16     *Name,
+  IN CONST EFI_GUID   *Guid,
+  IN UINTN            Size,
+  IN CONST VOID       *Data
+  )
+{
+  EFI_STATUS  Status;
+  UINT8       Buffer[16];
+  UINTN       ReadSize;
+
+  ASSERT (Size <= sizeof (Buffer));
+
+  ReadSize = sizeof (Buffer);
+  Status = gRT->GetVariable ((CHAR16 *) Name, (EFI_GUID *) Guid, NULL, &ReadSize, Buffer);
+
+  return !EFI_ERROR (Status) && ReadSize == Size && CompareMem (Buffer, Data, Size) == 0;
+}
+
+VOID
+BhBootToInit (
+  VOID
+  )
+{
+  EFI_STATUS  Status;
+  UINT64      OsIndicationsSupported;
+  UINTN       Size;
+
+  mSupported[BhBootToRecovery] = gST->FirmwareVendor != NULL
+    && StrnCmp (gST->FirmwareVendor, L"Apple", 5) == 0;
+
+  OsIndicationsSupported = 0;
+  Size = sizeof (OsIndicationsSupported);
+  Status = gRT->GetVariable (
+    EFI_OS_INDICATIONS_SUPPORT_VARIABLE_NAME,
+    &gEfiGlobalVariableGuid,
+    NULL,
+    &Size,
+    &OsIndicationsSupported
+    );
+  mSupported[BhBootToFirmwareUi] = !EFI_ERROR (Status)
+    && Size == sizeof (OsIndicationsSupported)
+    && (OsIndicationsSupported & EFI_OS_INDICATIONS_BOOT_TO_FW_UI) != 0;
+
+  DEBUG ((
+    DEBUG_INFO,
+    "BH: Boot to Recovery %a, firmware setup %a (OsIndicationsSupported 0x%Lx - %r)\n",
+    mSupported[BhBootToRecovery] ? "supported" : "unsupported",
+    mSupported[BhBootToFirmwareUi] ? "supported" : "unsupported",
+    OsIndicationsSupported,
+    Status
+    ));
+}
+
+BOOLEAN
+BhBootToSupported (
+  IN BH_BOOT_TO   Target
+  )
+{
+  return Target < BhBootToCount && mSupported[Target];
+}
+
+VOID
+BhBootToPrintActions (
+  VOID
+  )
+{
+  if (!mSupported[BhBootToRecovery] && !mSupported[BhBootToFirmwareUi]) {
+    return;
+  }
+
+  Print (L"Reboot to:");
+  if (mSupported[BhBootToRecovery]) {
+    Print (L" Recovery [N]");
+  }
+  if (mSupported[BhBootToFirmwareUi]) {
+    Print (L"%s[F]irmware setup", mSupported[BhBootToRecovery] ? L"; " : L" ");
+  }
+  Print (L"\n");
+}
+
+EFI_STATUS
+BhBootToSet (
+  IN BH_BOOT_TO   Target
+  )
+{
+  EFI_STATUS      Status;
+  CONST CHAR16    *Name;
+  EFI_GUID        *Guid;
+  UINT64          OsIndications;
+  UINTN           Size;
+  CONST VOID      *Data;
+
+  if (!BhBootToSupported (Target)) {
+    return EFI_UNSUPPORTED;
+  }
+
+  if (Target == BhBootToRecovery) {
+    Name = RECOVERY_BOOT_MODE_NAME;
+    Guid = &mAppleBootVariableGuid;
+    Size = sizeof (mRecoveryBootModeValue);
+    Data = mRecoveryBootModeValue;
+  } else {
+    //
+    // Keep any other indications already requested.
+    //
+    Name = EFI_OS_INDICATIONS_VARIABLE_NAME;
+    Guid = &gEfiGlobalVariableGuid;
+    Size = sizeof (OsIndications);
+    if (EFI_ERROR (gRT->GetVariable ((CHAR16 *) Name, Guid, NULL, &Size, &OsIndications))
+      || Size != sizeof (OsIndications)) {
+      OsIndications = 0;
+      Size = sizeof (OsIndications);
+    }
+    OsIndications |= EFI_OS_INDICATIONS_BOOT_TO_FW_UI;
+    Data = &OsIndications;
+  }
+
+  Status = BhVarWrite (Name, Guid, BOOT_TO_ATTRIBUTES, Size, Data, NULL);
+  if (!EFI_ERROR (Status) && !ValueIs (Name, Guid, Size, Data)) {
+    Status = EFI_DEVICE_ERROR;
+  }
+
+  BhPersistForget (Name, Guid);
+
+  DEBUG ((DEBUG_INFO, "BH: Boot to %s requested - %r\n", mTargetNames[Target], Status));
+
+  return Status;
+}
@@ -0,0 +1,51 @@
+/** @file
+  Declaration of one-shot boot to macOS Recovery or firmware setup.
+
+  Copyright (c) 2020, Mike Beaton. All rights reserved.<BR>
+  SPDX-License-Identifier: BSD-3-Clause
+
+**/
+
+#ifndef __BH__BOOT_TO__
+#define __BH__BOOT_TO__
+
+//
+// Basic UEFI Libraries
+//
+#include <Uefi.h>
+#include <Library/UefiLib.h>
+
+typedef enum BH_BOOT_TO_ {
+  BhBootToRecovery,             ///< Apple recovery-boot-mode, honoured by Apple firmware
+  BhBootToFirmwareUi,           ///< EFI_OS_INDICATIONS_BOOT_TO_FW_UI in OsIndications
+  BhBootToCount
+} BH_BOOT_TO;
+
+// Check once which one-shot boot targets this firmware supports (Apple firmware for Recovery,
+// OsIndicationsSupported for firmware setup); the result is cached for the session
+VOID
+BhBootToInit (
+  VOID
+  );
+
+// Return TRUE if Target was found to be supported by BhBootToInit
+BOOLEAN
+BhBootToSupported (
+  IN BH_BOOT_TO   Target
+  );
+
+// Print menu entries for the supported targets, if any
+VOID
+BhBootToPrintActions (
+  VOID
+  );
+
+// Request Target for the next boot only, with a single write which is read back to check it;
+// the caller then resets. The write is not tracked for verification at the next start, since
+// firmware consumes it.
+EFI_STATUS
+BhBootToSet (
+  IN BH_BOOT_TO   Target
+  );
+
+#endif
@@ -0,0 +1,880 @@
+/** @file
+  Binary plist (bplist00) configuration reader.
+
+  A binary plist is a table of objects addressed by index through an offset
+  table, with a trailer giving the table's position and entry sizes. Each
+  object is decoded in place from the file buffer only when the schema walk
+  reaches it, and the schema is walked exactly as OcSerializeLib walks an XML
+  document, dispatching on each entry's Apply handler, so the same generated
+  schema fills the same configuration from either format.
+
+  Copyright (c) 2020, Mike Beaton. All rights reserved.<BR>
+  SPDX-License-Identifier: BSD-3-Clause
+
+**/
+
+//
+// Basic UEFI Libraries
+//
+#include <Uefi.h>
+#include <Library/UefiLib.h>
+#include <Library/BaseLib.h>
+#include <Library/BaseMemoryLib.h>
+
+//
+// OC Libraries
+//
+#include <Library/OcDebugLogLib.h>
+
+//
+// Local includes
+//
+#include "Bplist.h"
+
+#define BPLIST_TRAILER_SIZE     32
+
+//
+// Object markers, high nibble.
+//
+#define BPLIST_MARKER_SIMPLE    0x0
+#define BPLIST_MARKER_INTEGER   0x1
+#define BPLIST_MARKER_REAL      0x2
+#define BPLIST_MARKER_DATE      0x3
+#define BPLIST_MARKER_DATA      0x4
+#define BPLIST_MARKER_ASCII     0x5
+#define BPLIST_MARKER_UTF16     0x6
+#define BPLIST_MARKER_ARRAY     0xA
+#define BPLIST_MARKER_DICT      0xD
+
+#define BPLIST_SIMPLE_FALSE     0x8
+#define BPLIST_SIMPLE_TRUE      0x9
+
+//
+// Low nibble value meaning the length follows as an integer object.
+//
+#define BPLIST_LENGTH_FOLLOWS   0xF
+
+typedef struct BPLIST_ {
+  CONST UINT8   *Buffer;
+  UINT32        OffsetTable;            ///< Objects lie between the magic and the offset table
+  UINT32        ObjectCount;
+  UINT8         OffsetSize;
+  UINT8         RefSize;
+  UINT32        Depth;
+} BPLIST;
+
+typedef struct BPLIST_OBJECT_ {
+  PLIST_NODE_TYPE   Type;
+  BOOLEAN           Utf16;              ///< STRING: UTF-16BE rather than ASCII
+  UINT32            Count;              ///< Bytes of DATA or ASCII STRING, units of UTF-16 STRING, entries of ARRAY or DICT
+  CONST UINT8       *Data;              ///< In the plist buffer: contents, or object references for ARRAY and DICT
+  UINT64            Integer;            ///< INTEGER value, as stored (64-bit values are signed)
+} BPLIST_OBJECT;
+
+STATIC
+VOID
+ApplySchema (
+  IN OUT BPLIST       *Plist,
+  OUT    VOID         *Serialized,
+  IN     UINT64       Ref,
+  IN     OC_SCHEMA    *Schema,
+  IN     CONST CHAR8  *Context
+  );
+
+STATIC
+UINT64
+ReadBigEndian (
+  IN CONST UINT8    *Data,
+  IN UINT32         Size
+  )
+{
+  UINT64  Value;
+  UINT32  Index;
+
+  Value = 0;
+  for (Index = 0; Index < Size; Index++) {
+    Value = LShiftU64 (Value, 8) | Data[Index];
+  }
+
+  return Value;
+}
+
+//
+// Length from the low nibble of a marker, or from the integer object which follows it.
+//
+STATIC
+BOOLEAN
+ReadLength (
+  IN     BPLIST     *Plist,
+  IN     UINT8      Low,
+  IN OUT UINT32     *Position,
+  OUT    UINT32     *Length
+  )
+{
+  UINT8   Marker;
+  UINT32  Bytes;
+  UINT64  Value;
+
+  if (Low != BPLIST_LENGTH_FOLLOWS) {
+    *Length = Low;
+    return TRUE;
+  }
+
+  if (*Position >= Plist->OffsetTable) {
+    return FALSE;
+  }
+
+  Marker = Plist->Buffer[*Position];
+  if ((Marker >> 4) != BPLIST_MARKER_INTEGER || (Marker & 0xF) > 3) {
+    return FALSE;
+  }
+
+  Bytes = 1U << (Marker & 0xF);
+  if (Plist->OffsetTable - *Position - 1 < Bytes) {
+    return FALSE;
+  }
+
+  Value = ReadBigEndian (&Plist->Buffer[*Position + 1], Bytes);
+  if (Value > MAX_UINT32) {
+    return FALSE;
+  }
+
+  *Position += 1 + Bytes;
+  *Length = (UINT32) Value;
+  return TRUE;
+}
+
+//
+// Decode object Ref; all of its contents are checked to lie within the object area.
+//
+STATIC
+BOOLEAN
+GetObject (
+  IN  BPLIST          *Plist,
+  IN  UINT64          Ref,
+  OUT BPLIST_OBJECT   *Object
+  )
+{
+  UINT64  Offset;
+  UINT32  Position;
+  UINT8   Marker;
+  UINT8   Low;
+  UINT32  Bytes;
+
+  if (Ref >= Plist->ObjectCount) {
+    return FALSE;
+  }
+
+  Offset = ReadBigEndian (
+    &Plist->Buffer[Plist->OffsetTable + (UINT32) Ref * Plist->OffsetSize],
+    Plist->OffsetSize
+    );
+  if (Offset < BH_BPLIST_MAGIC_SIZE || Offset >= Plist->OffsetTable) {
+    return FALSE;
+  }
+
+  ZeroMem (Object, sizeof (*Object));
+
+  Position = (UINT32) Offset;
+  Marker = Plist->Buffer[Position++];
+  Low = Marker & 0xF;
+
+  switch (Marker >> 4) {
+    case BPLIST_MARKER_SIMPLE:
+      if (Low == BPLIST_SIMPLE_TRUE) {
+        Object->Type = PLIST_NODE_TYPE_TRUE;
+      } else if (Low == BPLIST_SIMPLE_FALSE) {
+        Object->Type = PLIST_NODE_TYPE_FALSE;
+      } else {
+        return FALSE;
+      }
+      return TRUE;
+
+    case BPLIST_MARKER_INTEGER:
+      //
+      // 16-byte integers are only written for unsigned values above MAX_INT64.
+      //
+      if (Low > 4) {
+        return FALSE;
+      }
+      Bytes = 1U << Low;
+      if (Plist->OffsetTable - Position < Bytes) {
+        return FALSE;
+      }
+      if (Bytes == 16) {
+        if (ReadBigEndian (&Plist->Buffer[Position], 8) != 0) {
+          return FALSE;
+        }
+        Position += 8;
+        Bytes = 8;
+      }
+      Object->Type = PLIST_NODE_TYPE_INTEGER;
+      Object->Integer = ReadBigEndian (&Plist->Buffer[Position], Bytes);
+      return TRUE;
+
+    case BPLIST_MARKER_REAL:
+      Object->Type = PLIST_NODE_TYPE_REAL;
+      return TRUE;
+
+    case BPLIST_MARKER_DATE:
+      Object->Type = PLIST_NODE_TYPE_DATE;
+      return TRUE;
+
+    case BPLIST_MARKER_DATA:
+    case BPLIST_MARKER_ASCII:
+    case BPLIST_MARKER_UTF16:
+    case BPLIST_MARKER_ARRAY:
+    case BPLIST_MARKER_DICT:
+      if (!ReadLength (Plist, Low, &Position, &Object->Count)) {
+        return FALSE;
+      }
+      break;
+
+    default:
+      return FALSE;
+  }
+
+  switch (Marker >> 4) {
+    case BPLIST_MARKER_DATA:
+      Object->Type = PLIST_NODE_TYPE_DATA;
+      Bytes = Object->Count;
+      break;
+
+    case BPLIST_MARKER_ASCII:
+      Object->Type = PLIST_NODE_TYPE_STRING;
+      Bytes = Object->Count;
+      break;
+
+    case BPLIST_MARKER_UTF16:
+      Object->Type = PLIST_NODE_TYPE_STRING;
+      Object->Utf16 = TRUE;
+      if (Object->Count > MAX_UINT32 / 2) {
+        return FALSE;
+      }
+      Bytes = Object->Count * 2;
+      break;
+
+    case BPLIST_MARKER_ARRAY:
+      Object->Type = PLIST_NODE_TYPE_ARRAY;
+      if (Object->Count > MAX_UINT32 / Plist->RefSize) {
+        return FALSE;
+      }
+      Bytes = Object->Count * Plist->RefSize;
+      break;
+
+    default:
+      Object->Type = PLIST_NODE_TYPE_DICT;
+      if (Object->Count > MAX_UINT32 / 2 / Plist->RefSize) {
+        return FALSE;
+      }
+      Bytes = Object->Count * 2 * Plist->RefSize;
+      break;
+  }
+
+  if (Plist->OffsetTable - Position < Bytes) {
+    return FALSE;
+  }
+
+  Object->Data = &Plist->Buffer[Position];
+  return TRUE;
+}
+
+//
+// Reference to the Index'th object of an ARRAY or DICT; DICT keys come first, then values.
+//
+STATIC
+UINT64
+GetRef (
+  IN BPLIST               *Plist,
+  IN CONST BPLIST_OBJECT  *Object,
+  IN UINT32               Index
+  )
+{
+  return ReadBigEndian (&Object->Data[Index * Plist->RefSize], Plist->RefSize);
+}
+
+STATIC
+UINT16
+GetUnit (
+  IN CONST BPLIST_OBJECT  *Object,
+  IN UINT32               Index
+  )
+{
+  return (UINT16) ((Object->Data[Index * 2] << 8) | Object->Data[Index * 2 + 1]);
+}
+
+//
+// Size as UTF-8 including terminator, which is how configuration strings are held; zero if invalid.
+//
+STATIC
+UINT32
+StringSize (
+  IN CONST BPLIST_OBJECT  *Object
+  )
+{
+  UINT32  Index;
+  UINT32  Size;
+  UINT16  Unit;
+
+  if (!Object->Utf16) {
+    if (ScanMem8 (Object->Data, Object->Count, '\0') != NULL) {
+      return 0;
+    }
+    return Object->Count + 1;
+  }
+
+  Size = 1;
+  for (Index = 0; Index < Object->Count; Index++) {
+    Unit = GetUnit (Object, Index);
+    if (Unit == 0) {
+      return 0;
+    } else if (Unit < 0x80) {
+      Size += 1;
+    } else if (Unit < 0x800) {
+      Size += 2;
+    } else if (Unit >= 0xD800 && Unit < 0xDC00) {
+      if (Index + 1 == Object->Count || GetUnit (Object, Index + 1) < 0xDC00 || GetUnit (Object, Index + 1) >= 0xE000) {
+        return 0;
+      }
+      ++Index;
+      Size += 4;
+    } else if (Unit >= 0xDC00 && Unit < 0xE000) {
+      return 0;
+    } else {
+      Size += 3;
+    }
+  }
+
+  return Size;
+}
+
+//
+// Copy string as UTF-8 with terminator into Buffer of exactly StringSize bytes.
+//
+STATIC
+VOID
+StringCopy (
+  IN  CONST BPLIST_OBJECT   *Object,
+  OUT CHAR8                 *Buffer
+  )
+{
+  UINT32  Index;
+  UINT32  Code;
+  UINT8   *Walker;
+
+  if (!Object->Utf16) {
+    CopyMem (Buffer, Object->Data, Object->Count);
+    Buffer[Object->Count] = '\0';
+    return;
+  }
+
+  Walker = (UINT8 *) Buffer;
+  for (Index = 0; Index < Object->Count; Index++) {
+    Code = GetUnit (Object, Index);
+    if (Code >= 0xD800 && Code < 0xDC00) {
+      Code = 0x10000 + ((Code - 0xD800) << 10) + (GetUnit (Object, ++Index) - 0xDC00);
+    }
+
+    if (Code < 0x80) {
+      *Walker++ = (UINT8) Code;
+    } else if (Code < 0x800) {
+      *Walker++ = (UINT8) (0xC0 | (Code >> 6));
+      *Walker++ = (UINT8) (0x80 | (Code & 0x3F));
+    } else if (Code < 0x10000) {
+      *Walker++ = (UINT8) (0xE0 | (Code >> 12));
+      *Walker++ = (UINT8) (0x80 | ((Code >> 6) & 0x3F));
+      *Walker++ = (UINT8) (0x80 | (Code & 0x3F));
+    } else {
+      *Walker++ = (UINT8) (0xF0 | (Code >> 18));
+      *Walker++ = (UINT8) (0x80 | ((Code >> 12) & 0x3F));
+      *Walker++ = (UINT8) (0x80 | ((Code >> 6) & 0x3F));
+      *Walker++ = (UINT8) (0x80 | (Code & 0x3F));
+    }
+  }
+  *Walker = '\0';
+}
+
+//
+// Compare key object with Name in the byte order generated schemas are sorted in; UTF-16 keys
+// are compared by unit, since schema names are ASCII.
+//
+STATIC
+INTN
+CompareKey (
+  IN CONST BPLIST_OBJECT  *Key,
+  IN CONST CHAR8          *Name
+  )
+{
+  UINT32  Index;
+  UINT16  Unit;
+
+  for (Index = 0; Index < Key->Count; Index++) {
+    //
+    // Stop at the end of Name even if the key holds an embedded NUL.
+    //
+    if (Name[Index] == '\0') {
+      return 1;
+    }
+
+    Unit = Key->Utf16 ? GetUnit (Key, Index) : Key->Data[Index];
+    if ((UINT8) Name[Index] != Unit) {
+      return (INTN) Unit - (UINT8) Name[Index];
+    }
+  }
+
+  return Name[Index] == '\0' ? 0 : -1;
+}
+
+//
+// As LookupConfigSchema, without needing a terminated copy of the key.
+//
+STATIC
+OC_SCHEMA *
+LookupSchema (
+  IN OC_SCHEMA            *Schema,
+  IN UINT32               SchemaSize,
+  IN CONST BPLIST_OBJECT  *Key
+  )
+{
+  UINT32  Start;
+  UINT32  End;
+  UINT32  Middle;
+  INTN    Result;
+
+  Start = 0;
+  End = SchemaSize;
+  while (Start < End) {
+    Middle = Start + (End - Start) / 2;
+    Result = CompareKey (Key, Schema[Middle].Name);
+    if (Result == 0) {
+      return &Schema[Middle];
+    } else if (Result < 0) {
+      End = Middle;
+    } else {
+      Start = Middle + 1;
+    }
+  }
+
+  return NULL;
+}
+
+STATIC
+BOOLEAN
+TypeMatches (
+  IN PLIST_NODE_TYPE  Expected,
+  IN PLIST_NODE_TYPE  Actual
+  )
+{
+  return Expected == PLIST_NODE_TYPE_ANY || Expected == Actual;
+}
+
+//
+// Store integer in Size bytes, if it fits either as signed or unsigned.
+//
+STATIC
+BOOLEAN
+IntegerStore (
+  IN  UINT64    Value,
+  OUT VOID      *Field,
+  IN  UINT32    Size
+  )
+{
+  UINT64  Max;
+
+  if (Size < sizeof (UINT64)) {
+    Max = LShiftU64 (1, Size * 8) - 1;
+    if (Value > Max && ((INT64) Value >= 0 || (INT64) Value < -(INT64) RShiftU64 (Max, 1) - 1)) {
+      return FALSE;
+    }
+  }
+
+  switch (Size) {
+    case sizeof (UINT8):
+      *(UINT8 *) Field = (UINT8) Value;
+      return TRUE;
+    case sizeof (UINT16):
+      WriteUnaligned16 (Field, (UINT16) Value);
+      return TRUE;
+    case sizeof (UINT32):
+      WriteUnaligned32 (Field, (UINT32) Value);
+      return TRUE;
+    case sizeof (UINT64):
+      WriteUnaligned64 (Field, Value);
+      return TRUE;
+    default:
+      return FALSE;
+  }
+}
+
+//
+// Size of a value which may be given as data, string, integer or boolean, as the XML
+// multi-data readers size them: strings keep their terminator, integers are 32-bit.
+//
+STATIC
+UINT32
+MultiDataSize (
+  IN CONST BPLIST_OBJECT  *Object
+  )
+{
+  switch (Object->Type) {
+    case PLIST_NODE_TYPE_DATA:
+      return Object->Count;
+    case PLIST_NODE_TYPE_STRING:
+      return StringSize (Object);
+    case PLIST_NODE_TYPE_INTEGER:
+      return sizeof (UINT32);
+    case PLIST_NODE_TYPE_TRUE:
+    case PLIST_NODE_TYPE_FALSE:
+      return sizeof (BOOLEAN);
+    default:
+      return 0;
+  }
+}
+
+STATIC
+BOOLEAN
+MultiDataCopy (
+  IN  CONST BPLIST_OBJECT   *Object,
+  OUT VOID                  *Buffer
+  )
+{
+  switch (Object->Type) {
+    case PLIST_NODE_TYPE_DATA:
+      CopyMem (Buffer, Object->Data, Object->Count);
+      return TRUE;
+    case PLIST_NODE_TYPE_STRING:
+      StringCopy (Object, Buffer);
+      return TRUE;
+    case PLIST_NODE_TYPE_INTEGER:
+      return IntegerStore (Object->Integer, Buffer, sizeof (UINT32));
+    case PLIST_NODE_TYPE_TRUE:
+    case PLIST_NODE_TYPE_FALSE:
+      *(BOOLEAN *) Buffer = Object->Type == PLIST_NODE_TYPE_TRUE;
+      return TRUE;
+    default:
+      return FALSE;
+  }
+}
+
+STATIC
+BOOLEAN
+ParseValue (
+  OUT VOID                  *Serialized,
+  IN  CONST BPLIST_OBJECT   *Object,
+  IN  OC_SCHEMA_INFO        *Info
+  )
+{
+  UINT8   *Field;
+  UINT32  Size;
+
+  Field = (UINT8 *) Serialized + Info->Value.Field;
+
+  switch (Info->Value.Type) {
+    case OC_SCHEMA_VALUE_BOOLEAN:
+      if (Object->Type != PLIST_NODE_TYPE_TRUE && Object->Type != PLIST_NODE_TYPE_FALSE) {
+        return FALSE;
+      }
+      *(BOOLEAN *) Field = Object->Type == PLIST_NODE_TYPE_TRUE;
+      return TRUE;
+
+    case OC_SCHEMA_VALUE_INTEGER:
+      return Object->Type == PLIST_NODE_TYPE_INTEGER
+        && IntegerStore (Object->Integer, Field, Info->Value.FieldSize);
+
+    case OC_SCHEMA_VALUE_DATA:
+      if (Object->Type != PLIST_NODE_TYPE_DATA || Object->Count > Info->Value.FieldSize) {
+        return FALSE;
+      }
+      CopyMem (Field, Object->Data, Object->Count);
+      return TRUE;
+
+    case OC_SCHEMA_VALUE_STRING:
+      if (Object->Type != PLIST_NODE_TYPE_STRING) {
+        return FALSE;
+      }
+      Size = StringSize (Object);
+      if (Size == 0 || Size > Info->Value.FieldSize) {
+        return FALSE;
+      }
+      StringCopy (Object, (CHAR8 *) Field);
+      return TRUE;
+
+    case OC_SCHEMA_VALUE_MDATA:
+      Size = MultiDataSize (Object);
+      if (Size > Info->Value.FieldSize
+        || (Size == 0 && Object->Type != PLIST_NODE_TYPE_DATA)) {
+        return FALSE;
+      }
+      return MultiDataCopy (Object, Field);
+
+    default:
+      return FALSE;
+  }
+}
+
+STATIC
+BOOLEAN
+ParseBlob (
+  OUT VOID                  *Serialized,
+  IN  CONST BPLIST_OBJECT   *Object,
+  IN  OC_SCHEMA_INFO        *Info
+  )
+{
+  VOID    *Field;
+  VOID    *Storage;
+  UINT32  Size;
+
+  switch (Info->Blob.Type) {
+    case OC_SCHEMA_BLOB_DATA:
+      if (Object->Type != PLIST_NODE_TYPE_DATA) {
+        return FALSE;
+      }
+      Size = Object->Count;
+      break;
+
+    case OC_SCHEMA_BLOB_STRING:
+      if (Object->Type != PLIST_NODE_TYPE_STRING) {
+        return FALSE;
+      }
+      Size = StringSize (Object);
+      if (Size == 0) {
+        return FALSE;
+      }
+      break;
+
+    case OC_SCHEMA_BLOB_MDATA:
+      Size = MultiDataSize (Object);
+      if (Size == 0 && Object->Type != PLIST_NODE_TYPE_DATA) {
+        return FALSE;
+      }
+      break;
+
+    default:
+      return FALSE;
+  }
+
+  Field = (UINT8 *) Serialized + Info->Blob.Field;
+  Storage = OC_BLOB_ALLOCATE (Field, Size);
+  if (Storage == NULL) {
+    return FALSE;
+  }
+
+  return MultiDataCopy (Object, Storage);
+}
+
+STATIC
+VOID
+ParseDict (
+  IN OUT BPLIST               *Plist,
+  OUT    VOID                 *Serialized,
+  IN     CONST BPLIST_OBJECT  *Object,
+  IN     OC_SCHEMA_INFO       *Info,
+  IN     CONST CHAR8          *Context
+  )
+{
+  UINT32          Index;
+  BPLIST_OBJECT   Key;
+  OC_SCHEMA       *Schema;
+  CHAR8           Name[64];
+
+  for (Index = 0; Index < Object->Count; Index++) {
+    if (!GetObject (Plist, GetRef (Plist, Object, Index), &Key) || Key.Type != PLIST_NODE_TYPE_STRING) {
+      DEBUG ((DEBUG_WARN, "BH: Bplist bad key %u in <%a>\n", Index, Context));
+      continue;
+    }
+
+    Schema = LookupSchema (Info->Dict.Schema, Info->Dict.SchemaSize, &Key);
+    if (Schema == NULL) {
+      if (StringSize (&Key) != 0 && StringSize (&Key) <= sizeof (Name)) {
+        StringCopy (&Key, Name);
+      } else {
+        Name[0] = '?';
+        Name[1] = '\0';
+      }
+      DEBUG ((DEBUG_WARN, "BH: Bplist unknown key %a in <%a>\n", Name, Context));
+      continue;
+    }
+
+    ApplySchema (Plist, Serialized, GetRef (Plist, Object, Object->Count + Index), Schema, Schema->Name);
+  }
+}
+
+//
+// Array and map entries are allocated as the XML parser allocates them, then filled from the
+// element schema with the new entry as base.
+//
+STATIC
+VOID
+ParseList (
+  IN OUT BPLIST               *Plist,
+  OUT    VOID                 *Serialized,
+  IN     CONST BPLIST_OBJECT  *Object,
+  IN     OC_SCHEMA_INFO       *Info,
+  IN     BOOLEAN              IsMap,
+  IN     CONST CHAR8          *Context
+  )
+{
+  UINT32          Index;
+  UINT64          ValueRef;
+  BPLIST_OBJECT   Key;
+  BPLIST_OBJECT   Value;
+  VOID            *List;
+  VOID            *NewValue;
+  VOID            *NewKey;
+  VOID            *KeyStorage;
+  UINT32          KeySize;
+
+  List = (UINT8 *) Serialized + Info->List.Field;
+  ZeroMem (&Key, sizeof (Key));
+  NewKey = NULL;
+
+  for (Index = 0; Index < Object->Count; Index++) {
+    KeySize = 0;
+    if (IsMap) {
+      if (!GetObject (Plist, GetRef (Plist, Object, Index), &Key)
+        || Key.Type != PLIST_NODE_TYPE_STRING
+        || (KeySize = StringSize (&Key)) == 0) {
+        DEBUG ((DEBUG_WARN, "BH: Bplist bad key %u in <%a>\n", Index, Context));
+        continue;
+      }
+      ValueRef = GetRef (Plist, Object, Object->Count + Index);
+    } else {
+      ValueRef = GetRef (Plist, Object, Index);
+    }
+
+    if (!GetObject (Plist, ValueRef, &Value) || !TypeMatches (Info->List.Schema->Type, Value.Type)) {
+      DEBUG ((DEBUG_WARN, "BH: Bplist bad entry %u in <%a>\n", Index, Context));
+      continue;
+    }
+
+    if (!OcListEntryAllocate (List, &NewValue, IsMap ? &NewKey : NULL)) {
+      DEBUG ((DEBUG_WARN, "BH: Bplist cannot allocate entry %u in <%a>\n", Index, Context));
+      return;
+    }
+
+    if (IsMap) {
+      KeyStorage = OC_BLOB_ALLOCATE (NewKey, KeySize);
+      if (KeyStorage == NULL) {
+        return;
+      }
+      StringCopy (&Key, KeyStorage);
+    }
+
+    ApplySchema (Plist, NewValue, ValueRef, Info->List.Schema, Context);
+  }
+}
+
+STATIC
+VOID
+ApplySchema (
+  IN OUT BPLIST       *Plist,
+  OUT    VOID         *Serialized,
+  IN     UINT64       Ref,
+  IN     OC_SCHEMA    *Schema,
+  IN     CONST CHAR8  *Context
+  )
+{
+  BPLIST_OBJECT   Object;
+  BOOLEAN         Success;
+
+  if (Context == NULL) {
+    Context = "entry";
+  }
+
+  if (!GetObject (Plist, Ref, &Object) || !TypeMatches (Schema->Type, Object.Type)) {
+    DEBUG ((DEBUG_WARN, "BH: Bplist bad value for <%a>\n", Context));
+    return;
+  }
+
+  Success = TRUE;
+
+  if (Schema->Apply == ParseSchemaValue) {
+    Success = ParseValue (Serialized, &Object, &Schema->Info);
+  } else if (Schema->Apply == ParseSchemaBlob) {
+    Success = ParseBlob (Serialized, &Object, &Schema->Info);
+  } else if (Plist->Depth >= BH_BPLIST_MAX_DEPTH) {
+    Success = FALSE;
+  } else {
+    ++Plist->Depth;
+    if (Schema->Apply == ParseSchemaDict && Object.Type == PLIST_NODE_TYPE_DICT) {
+      ParseDict (Plist, Serialized, &Object, &Schema->Info, Context);
+    } else if (Schema->Apply == ParseSchemaArray && Object.Type == PLIST_NODE_TYPE_ARRAY) {
+      ParseList (Plist, Serialized, &Object, &Schema->Info, FALSE, Context);
+    } else if (Schema->Apply == ParseSchemaMap && Object.Type == PLIST_NODE_TYPE_DICT) {
+      ParseList (Plist, Serialized, &Object, &Schema->Info, TRUE, Context);
+    } else {
+      Success = FALSE;
+    }
+    --Plist->Depth;
+  }
+
+  if (!Success) {
+    DEBUG ((DEBUG_WARN, "BH: Bplist cannot apply value for <%a>\n", Context));
+  }
+}
+
+BOOLEAN
+BhBplistIsBinary (
+  IN CONST VOID     *Buffer,
+  IN UINT32         Size
+  )
+{
+  return Size >= BH_BPLIST_MAGIC_SIZE
+    && CompareMem (Buffer, BH_BPLIST_MAGIC, BH_BPLIST_MAGIC_SIZE) == 0;
+}
+
+BOOLEAN
+BhBplistParseSerialized (
+  OUT VOID            *Serialized,
+  IN  OC_SCHEMA_INFO  *RootSchema,
+  IN  CONST VOID      *Buffer,
+  IN  UINT32          Size
+  )
+{
+  BPLIST          Plist;
+  CONST UINT8     *Trailer;
+  UINT64          ObjectCount;
+  UINT64          TopObject;
+  UINT64          OffsetTable;
+  BPLIST_OBJECT   Root;
+
+  if (Size < BH_BPLIST_MAGIC_SIZE + 1 + BPLIST_TRAILER_SIZE || !BhBplistIsBinary (Buffer, Size)) {
+    return FALSE;
+  }
+
+  //
+  // Trailer: 6 unused bytes, offset size, reference size, then object count, top object
+  // and offset table position, each 64-bit big-endian.
+  //
+  Trailer = (CONST UINT8 *) Buffer + Size - BPLIST_TRAILER_SIZE;
+  Plist.Buffer = Buffer;
+  Plist.OffsetSize = Trailer[6];
+  Plist.RefSize = Trailer[7];
+  ObjectCount = ReadBigEndian (&Trailer[8], 8);
+  TopObject = ReadBigEndian (&Trailer[16], 8);
+  OffsetTable = ReadBigEndian (&Trailer[24], 8);
+  Plist.Depth = 0;
+
+  if (Plist.OffsetSize == 0 || Plist.OffsetSize > 8
+    || Plist.RefSize == 0 || Plist.RefSize > 8
+    || ObjectCount == 0 || ObjectCount > Size
+    || TopObject >= ObjectCount
+    || OffsetTable <= BH_BPLIST_MAGIC_SIZE
+    || OffsetTable > Size - BPLIST_TRAILER_SIZE
+    || ObjectCount * Plist.OffsetSize > Size - BPLIST_TRAILER_SIZE - OffsetTable) {
+    DEBUG ((DEBUG_WARN, "BH: Bplist bad trailer\n"));
+    return FALSE;
+  }
+
+  Plist.ObjectCount = (UINT32) ObjectCount;
+  Plist.OffsetTable = (UINT32) OffsetTable;
+
+  if (!GetObject (&Plist, TopObject, &Root) || Root.Type != PLIST_NODE_TYPE_DICT) {
+    DEBUG ((DEBUG_WARN, "BH: Bplist root is not a dictionary\n"));
+    return FALSE;
+  }
+
+  ParseDict (&Plist, Serialized, &Root, RootSchema, "root");
+
+  return TRUE;
+}
@@ -0,0 +1,51 @@
+/** @file
+  Declaration of binary plist (bplist00) configuration reader.
+
+  Copyright (c) 2020, Mike Beaton. All rights reserved.<BR>
+  SPDX-License-Identifier: BSD-3-Clause
+
+**/
+
+#ifndef __BH__BPLIST__
+#define __BH__BPLIST__
+
+//
+// Basic UEFI Libraries
+//
+#include <Uefi.h>
+#include <Library/UefiLib.h>
+
+//
+// OC Libraries
+//
+#include <Library/OcSerializeLib.h>
+#include <Library/OcXmlLib.h>
+
+#define BH_BPLIST_MAGIC             "bplist00"
+#define BH_BPLIST_MAGIC_SIZE        8
+
+//
+// Nesting deeper than this is rejected, which also stops reference cycles.
+//
+#define BH_BPLIST_MAX_DEPTH         32
+
+// Return TRUE if Buffer starts with the binary plist magic, e.g. from plutil -convert binary1
+BOOLEAN
+BhBplistIsBinary (
+  IN CONST VOID     *Buffer,
+  IN UINT32         Size
+  );
+
+// Parse a binary plist into Serialized following RootSchema, as ParseSerialized does for XML:
+// the object table is read in place with no intermediate document, and only values are copied
+// out into the configuration. Unknown keys and values of the wrong type are skipped with a
+// warning; returns FALSE only if the file structure or root object is invalid.
+BOOLEAN
+BhBplistParseSerialized (
+  OUT VOID            *Serialized,
+  IN  OC_SCHEMA_INFO  *RootSchema,
+  IN  CONST VOID      *Buffer,
+  IN  UINT32          Size
+  );
+
+#endif
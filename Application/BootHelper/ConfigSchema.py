@@ -0,0 +1,94 @@
+#!/usr/bin/env python3
+#  Copyright (c) 2020, Mike Beaton. All rights reserved.
+#  SPDX-License-Identifier: BSD-3-Clause
+
+"""
+Add a root schema accessor to the configuration code generated by PlistToConfig.py.
+
+PlistToConfig.py makes the schema STATIC; this appends BhConfigurationSchema to the
+generated C file and declares it in the generated header, so that parsers other than
+ParseSerialized (Bplist.c) can use the schema without either file being edited by hand.
+Run by make config straight after PlistToConfig.py; running it again changes nothing.
+
+Usage:
+  ConfigSchema.py BhConfig.c BhConfig.h
+"""
+
+import argparse
+import sys
+
+ACCESSOR = 'BhConfigurationSchema'
+ROOT_INFO = 'mRootConfigurationInfo'
+HEADER_END = '#endif // BH_CONFIGURATION_LIB_H'
+
+C_TEXT = '''
+///
+/// Appended by ConfigSchema.py, do not edit
+///
+
+OC_SCHEMA_INFO *
+%s (
+  VOID
+  )
+{
+  return &%s;
+}
+''' % (ACCESSOR, ROOT_INFO)
+
+H_TEXT = '''/**
+  Root configuration schema, for parsers other than ParseSerialized.
+  Appended by ConfigSchema.py, do not edit.
+
+  @retval  Schema passed to ParseSerialized by BhConfigurationInit.
+**/
+OC_SCHEMA_INFO *
+%s (
+  VOID
+  );
+
+''' % ACCESSOR
+
+
+class SchemaError(Exception):
+    pass
+
+
+def add_accessor(c_text, h_text):
+    """Return the generated C and header text with the accessor added, if not already there."""
+    if ROOT_INFO not in c_text:
+        raise SchemaError('%s not found in C file' % ROOT_INFO)
+    if HEADER_END not in h_text:
+        raise SchemaError('header does not end with %s' % HEADER_END)
+    if ACCESSOR not in c_text:
+        c_text += C_TEXT
+    if ACCESSOR not in h_text:
+        h_text = h_text.replace(HEADER_END, H_TEXT + HEADER_END)
+    return c_text, h_text
+
+
+def main(argv=None):
+    parser = argparse.ArgumentParser(description='BootHelper configuration schema accessor', add_help=False)
+    parser.add_argument('--help', action='help', help='show this help message and exit')
+    parser.add_argument('c_file', help='C file generated by PlistToConfig.py')
+    parser.add_argument('h_file', help='header generated by PlistToConfig.py')
+    args = parser.parse_args(argv)
+
+    try:
+        with open(args.c_file) as f:
+            c_text = f.read()
+        with open(args.h_file) as f:
+            h_text = f.read()
+        c_text, h_text = add_accessor(c_text, h_text)
+    except (OSError, SchemaError) as e:
+        print('ConfigSchema: %s' % e, file=sys.stderr)
+        return 1
+
+    with open(args.c_file, 'w') as f:
+        f.write(c_text)
+    with open(args.h_file, 'w') as f:
+        f.write(h_text)
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
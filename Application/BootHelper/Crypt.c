@@ -0,0 +1,484 @@
+/** @file
+  Passphrase encryption of exported files.
+
+  Exports such as NVRAM snapshots can hold account tokens, so they may be
+  written encrypted for carrying on shared drives: AES-256-CTR with an
+  HMAC-SHA256 tag over the whole file, keyed from a passphrase by
+  PBKDF2-HMAC-SHA256 with a random salt.
+
+  Copyright (c) 2020, Mike Beaton. All rights reserved.<BR>
+  SPDX-License-Identifier: BSD-3-Clause
+
+**/
+
+//
+// Basic UEFI Libraries
+//
+#include <Uefi.h>
+#include <Library/UefiLib.h>
+#include <Library/BaseLib.h>
+#include <Library/BaseMemoryLib.h>
+#include <Library/MemoryAllocationLib.h>
+#include <Library/TimerLib.h>
+
+//
+// Boot and Runtime Services
+//
+#include <Library/UefiBootServicesTableLib.h>
+#include <Library/UefiRuntimeServicesTableLib.h>
+
+#include <Protocol/Rng.h>
+
+//
+// OC Libraries
+//
+#include <Library/OcCryptoLib.h>
+#include <Library/OcDebugLogLib.h>
+
+//
+// Local includes
+//
+#include "Crypt.h"
+#include "EzKb.h"
+#include "FileUtils.h"
+#include "Timing.h"
+
+STATIC_ASSERT (CONFIG_AES_KEY_SIZE == BH_CRYPT_KEY_SIZE, "OcCryptoLib must be built for AES-256");
+STATIC_ASSERT (BH_CRYPT_CHUNK_SIZE % AES_BLOCK_SIZE == 0, "Chunks must be whole AES blocks");
+
+#define CRYPT_HMAC_BLOCK_SIZE       64
+
+typedef struct CRYPT_HMAC_ {
+  SHA256_CONTEXT  Inner;
+  SHA256_CONTEXT  Outer;
+} CRYPT_HMAC;
+
+STATIC CONST CHAR8  *mConfiguredPassphrase  = NULL;
+STATIC CHAR8        mTypedPassphrase[BH_CRYPT_MAX_PASSPHRASE + 1];
+STATIC UINT8        mRandomState[SHA256_DIGEST_SIZE];
+STATIC UINT32       mRandomCounter          = 0;
+STATIC UINT8        mChunk[BH_CRYPT_CHUNK_SIZE];
+
+STATIC
+VOID
+HmacInit (
+  OUT CRYPT_HMAC      *Hmac,
+  IN  CONST UINT8     *Key,
+  IN  UINTN           KeySize
+  )
+{
+  UINT8   Block[CRYPT_HMAC_BLOCK_SIZE];
+  UINTN   Index;
+
+  ZeroMem (Block, sizeof (Block));
+  if (KeySize > sizeof (Block)) {
+    Sha256 (Block, Key, KeySize);
+  } else {
+    CopyMem (Block, Key, KeySize);
+  }
+
+  for (Index = 0; Index < sizeof (Block); Index++) {
+    Block[Index] ^= 0x36;
+  }
+  Sha256Init (&Hmac->Inner);
+  Sha256Update (&Hmac->Inner, Block, sizeof (Block));
+
+  for (Index = 0; Index < sizeof (Block); Index++) {
+    Block[Index] ^= 0x36 ^ 0x5C;
+  }
+  Sha256Init (&Hmac->Outer);
+  Sha256Update (&Hmac->Outer, Block, sizeof (Block));
+
+  ZeroMem (Block, sizeof (Block));
+}
+
+STATIC
+VOID
+HmacFinal (
+  IN OUT CRYPT_HMAC   *Hmac,
+  OUT    UINT8        *Tag
+  )
+{
+  UINT8   Digest[SHA256_DIGEST_SIZE];
+
+  Sha256Final (&Hmac->Inner, Digest);
+  Sha256Update (&Hmac->Outer, Digest, sizeof (Digest));
+  Sha256Final (&Hmac->Outer, Tag);
+}
+
+//
+// PBKDF2-HMAC-SHA256, RFC 8018, for two blocks: the encryption key then the MAC key.
+// The keyed HMAC state is computed once and copied for each iteration.
+//
+STATIC
+VOID
+DeriveKeys (
+  IN  CONST CHAR8     *Passphrase,
+  IN  CONST UINT8     *Salt,
+  IN  UINT32          Iterations,
+  OUT UINT8           *Keys
+  )
+{
+  CRYPT_HMAC  Keyed;
+  CRYPT_HMAC  Hmac;
+  UINT8       Counter[4];
+  UINT8       U[SHA256_DIGEST_SIZE];
+  UINT8       *T;
+  UINT32      Block;
+  UINT32      Iteration;
+  UINTN       Index;
+
+  HmacInit (&Keyed, (CONST UINT8 *) Passphrase, AsciiStrLen (Passphrase));
+
+  for (Block = 0; Block < 2; Block++) {
+    T = &Keys[Block * SHA256_DIGEST_SIZE];
+
+    Counter[0] = 0;
+    Counter[1] = 0;
+    Counter[2] = 0;
+    Counter[3] = (UINT8) (Block + 1);
+
+    CopyMem (&Hmac, &Keyed, sizeof (Hmac));
+    Sha256Update (&Hmac.Inner, Salt, BH_CRYPT_SALT_SIZE);
+    Sha256Update (&Hmac.Inner, Counter, sizeof (Counter));
+    HmacFinal (&Hmac, U);
+    CopyMem (T, U, sizeof (U));
+
+    for (Iteration = 1; Iteration < Iterations; Iteration++) {
+      CopyMem (&Hmac, &Keyed, sizeof (Hmac));
+      Sha256Update (&Hmac.Inner, U, sizeof (U));
+      HmacFinal (&Hmac, U);
+      for (Index = 0; Index < sizeof (U); Index++) {
+        T[Index] ^= U[Index];
+      }
+    }
+  }
+
+  ZeroMem (&Keyed, sizeof (Keyed));
+  ZeroMem (&Hmac, sizeof (Hmac));
+  ZeroMem (U, sizeof (U));
+}
+
+//
+// Salt and IV only need to be unique, not secret; where the firmware has no RNG protocol
+// (most Macs), a hash chain over the timer and clock is used instead.
+//
+STATIC
+VOID
+GetRandom (
+  OUT UINT8   *Buffer,
+  IN  UINTN   Size
+  )
+{
+  EFI_STATUS          Status;
+  EFI_RNG_PROTOCOL    *Rng;
+  SHA256_CONTEXT      Context;
+  UINT64              Counter;
+  EFI_TIME            Time;
+
+  ASSERT (Size <= sizeof (mRandomState));
+
+  Status = gBS->LocateProtocol (&gEfiRngProtocolGuid, NULL, (VOID **) &Rng);
+  if (!EFI_ERROR (Status)) {
+    Status = Rng->GetRNG (Rng, NULL, Size, Buffer);
+    if (!EFI_ERROR (Status)) {
+      return;
+    }
+  }
+
+  ZeroMem (&Time, sizeof (Time));
+  gRT->GetTime (&Time, NULL);
+  Counter = GetPerformanceCounter ();
+  mRandomCounter++;
+
+  Sha256Init (&Context);
+  Sha256Update (&Context, mRandomState, sizeof (mRandomState));
+  Sha256Update (&Context, (UINT8 *) &mRandomCounter, sizeof (mRandomCounter));
+  Sha256Update (&Context, (UINT8 *) &Counter, sizeof (Counter));
+  Sha256Update (&Context, (UINT8 *) &Time, sizeof (Time));
+  Sha256Final (&Context, mRandomState);
+
+  CopyMem (Buffer, mRandomState, Size);
+}
+
+STATIC
+EFI_STATUS
+ReadPassphrase (
+  IN  CONST CHAR16    *Prompt,
+  OUT CHAR8           *Passphrase
+  )
+{
+  EFI_INPUT_KEY   Key;
+  UINTN           Length;
+
+  Print (L"%s (Esc to cancel): ", Prompt);
+
+  Length = 0;
+  while (TRUE) {
+    getkeystroke (&Key);
+
+    if (Key.ScanCode == SCAN_ESC) {
+      Length = 0;
+      break;
+    }
+
+    if (Key.UnicodeChar == CHAR_CARRIAGE_RETURN) {
+      break;
+    }
+
+    if (Key.UnicodeChar == CHAR_BACKSPACE) {
+      if (Length > 0) {
+        Length--;
+        Print (L"\b \b");
+      }
+    } else if (Key.UnicodeChar >= L' ' && Key.UnicodeChar < 0x7F && Length < BH_CRYPT_MAX_PASSPHRASE) {
+      Passphrase[Length++] = (CHAR8) Key.UnicodeChar;
+      Print (L"*");
+    }
+  }
+
+  Print (L"\n");
+
+  ZeroMem (&Passphrase[Length], BH_CRYPT_MAX_PASSPHRASE + 1 - Length);
+
+  return Length == 0 ? EFI_ABORTED : EFI_SUCCESS;
+}
+
+VOID
+BhCryptSetPassphrase (
+  IN CONST CHAR8    *Passphrase OPTIONAL
+  )
+{
+  mConfiguredPassphrase = (Passphrase != NULL && Passphrase[0] != '\0') ? Passphrase : NULL;
+}
+
+BOOLEAN
+BhCryptConfigured (
+  VOID
+  )
+{
+  return mConfiguredPassphrase != NULL;
+}
+
+EFI_STATUS
+BhCryptGetPassphrase (
+  IN  BOOLEAN       Confirm,
+  OUT CONST CHAR8   **Passphrase
+  )
+{
+  EFI_STATUS  Status;
+  CHAR8       Again[BH_CRYPT_MAX_PASSPHRASE + 1];
+
+  if (mConfiguredPassphrase != NULL) {
+    *Passphrase = mConfiguredPassphrase;
+    return EFI_SUCCESS;
+  }
+
+  if (mTypedPassphrase[0] == '\0') {
+    Status = ReadPassphrase (L"Passphrase", mTypedPassphrase);
+    if (EFI_ERROR (Status)) {
+      return Status;
+    }
+
+    if (Confirm) {
+      Status = ReadPassphrase (L"Passphrase again", Again);
+      if (!EFI_ERROR (Status) && AsciiStrCmp (Again, mTypedPassphrase) != 0) {
+        Print (L"Passphrases do not match.\n");
+        Status = EFI_ABORTED;
+      }
+      ZeroMem (Again, sizeof (Again));
+
+      if (EFI_ERROR (Status)) {
+        BhCryptForget ();
+        return Status;
+      }
+    }
+  }
+
+  *Passphrase = mTypedPassphrase;
+  return EFI_SUCCESS;
+}
+
+VOID
+BhCryptForget (
+  VOID
+  )
+{
+  ZeroMem (mTypedPassphrase, sizeof (mTypedPassphrase));
+}
+
+STATIC
+EFI_STATUS
+WriteAll (
+  IN EFI_FILE_PROTOCOL    *File,
+  IN CONST VOID           *Buffer,
+  IN UINTN                Size
+  )
+{
+  EFI_STATUS  Status;
+  UINTN       Written;
+
+  Written = Size;
+  Status = File->Write (File, &Written, (VOID *) Buffer);
+  if (!EFI_ERROR (Status) && Written != Size) {
+    Status = EFI_VOLUME_FULL;
+  }
+
+  return Status;
+}
+
+EFI_STATUS
+BhCryptWriteFile (
+  IN EFI_FILE_PROTOCOL    *Directory,
+  IN CONST CHAR16         *Path,
+  IN CONST CHAR8          *Passphrase,
+  IN CONST VOID           *Buffer,
+  IN UINTN                Size
+  )
+{
+  EFI_STATUS          Status;
+  EFI_FILE_PROTOCOL   *File;
+  BH_CRYPT_HEADER     Header;
+  UINT8               Keys[2 * BH_CRYPT_KEY_SIZE];
+  AES_CONTEXT         Aes;
+  CRYPT_HMAC          Hmac;
+  UINT8               Tag[BH_CRYPT_TAG_SIZE];
+  UINTN               Offset;
+  UINTN               Chunk;
+  UINT64              Start;
+
+  Start = BhTimeNs ();
+
+  ZeroMem (&Header, sizeof (Header));
+  Header.Signature = BH_CRYPT_SIGNATURE;
+  Header.Version = BH_CRYPT_VERSION;
+  Header.HeaderSize = sizeof (Header);
+  Header.Iterations = BH_CRYPT_ITERATIONS;
+  GetRandom (Header.Salt, sizeof (Header.Salt));
+  GetRandom (Header.Iv, sizeof (Header.Iv));
+
+  //
+  // As BhWriteFile, delete any existing file first so that no stale tail is left.
+  //
+  Status = BhOpenFile (Directory, Path, &File, TRUE);
+  if (!EFI_ERROR (Status)) {
+    File->Delete (File);
+    Status = BhOpenFile (Directory, Path, &File, TRUE);
+  }
+  if (EFI_ERROR (Status)) {
+    return Status;
+  }
+
+  DeriveKeys (Passphrase, Header.Salt, Header.Iterations, Keys);
+  AesInitCtxIv (&Aes, Keys, Header.Iv);
+  HmacInit (&Hmac, &Keys[BH_CRYPT_KEY_SIZE], BH_CRYPT_KEY_SIZE);
+  ZeroMem (Keys, sizeof (Keys));
+
+  Sha256Update (&Hmac.Inner, (UINT8 *) &Header, sizeof (Header));
+  Status = WriteAll (File, &Header, sizeof (Header));
+
+  for (Offset = 0; !EFI_ERROR (Status) && Offset < Size; Offset += Chunk) {
+    Chunk = MIN (Size - Offset, sizeof (mChunk));
+    CopyMem (mChunk, (CONST UINT8 *) Buffer + Offset, Chunk);
+    AesCtrXcryptBuffer (&Aes, mChunk, (UINT32) Chunk);
+    Sha256Update (&Hmac.Inner, mChunk, Chunk);
+    Status = WriteAll (File, mChunk, Chunk);
+  }
+
+  if (!EFI_ERROR (Status)) {
+    HmacFinal (&Hmac, Tag);
+    Status = WriteAll (File, Tag, sizeof (Tag));
+  }
+
+  File->Close (File);
+
+  ZeroMem (&Aes, sizeof (Aes));
+  ZeroMem (&Hmac, sizeof (Hmac));
+  ZeroMem (mChunk, sizeof (mChunk));
+
+  DEBUG ((
+    DEBUG_INFO,
+    "BH: Encrypted %s, %u bytes in %lu us - %r\n",
+    Path,
+    (UINT32) Size,
+    DivU64x32 (BhTimeNs () - Start, 1000),
+    Status
+    ));
+
+  return Status;
+}
+
+EFI_STATUS
+BhCryptReadFile (
+  IN  EFI_FILE_PROTOCOL   *Directory,
+  IN  CONST CHAR16        *Path,
+  IN  CONST CHAR8         *Passphrase,
+  OUT VOID                **Buffer,
+  OUT UINTN               *Size
+  )
+{
+  EFI_STATUS          Status;
+  UINT8               *Data;
+  UINTN               DataSize;
+  BH_CRYPT_HEADER     Header;
+  UINT8               Keys[2 * BH_CRYPT_KEY_SIZE];
+  AES_CONTEXT         Aes;
+  CRYPT_HMAC          Hmac;
+  UINT8               Tag[BH_CRYPT_TAG_SIZE];
+  UINTN               Offset;
+  UINTN               End;
+  UINTN               Chunk;
+
+  Status = BhReadFile (Directory, Path, (VOID **) &Data, &DataSize);
+  if (EFI_ERROR (Status)) {
+    return Status;
+  }
+
+  if (DataSize >= sizeof (Header)) {
+    CopyMem (&Header, Data, sizeof (Header));
+  }
+  if (DataSize < sizeof (Header) + BH_CRYPT_TAG_SIZE
+    || Header.Signature != BH_CRYPT_SIGNATURE
+    || Header.Version != BH_CRYPT_VERSION
+    || Header.HeaderSize < sizeof (Header)
+    || Header.HeaderSize > DataSize - BH_CRYPT_TAG_SIZE
+    || Header.Iterations == 0
+    || Header.Iterations > BH_CRYPT_MAX_ITERATIONS) {
+    DEBUG ((DEBUG_WARN, "BH: Ignoring invalid encrypted file %s\n", Path));
+    FreePool (Data);
+    return EFI_VOLUME_CORRUPTED;
+  }
+
+  End = DataSize - BH_CRYPT_TAG_SIZE;
+
+  DeriveKeys (Passphrase, Header.Salt, Header.Iterations, Keys);
+  AesInitCtxIv (&Aes, Keys, Header.Iv);
+  HmacInit (&Hmac, &Keys[BH_CRYPT_KEY_SIZE], BH_CRYPT_KEY_SIZE);
+  ZeroMem (Keys, sizeof (Keys));
+
+  //
+  // Nothing is decrypted unless the whole file authenticates.
+  //
+  Sha256Update (&Hmac.Inner, Data, End);
+  HmacFinal (&Hmac, Tag);
+  ZeroMem (&Hmac, sizeof (Hmac));
+
+  if (CompareMem (Tag, &Data[End], sizeof (Tag)) != 0) {
+    DEBUG ((DEBUG_WARN, "BH: Encrypted file %s does not authenticate\n", Path));
+    ZeroMem (&Aes, sizeof (Aes));
+    FreePool (Data);
+    return EFI_SECURITY_VIOLATION;
+  }
+
+  for (Offset = Header.HeaderSize; Offset < End; Offset += Chunk) {
+    Chunk = MIN (End - Offset, BH_CRYPT_CHUNK_SIZE);
+    AesCtrXcryptBuffer (&Aes, &Data[Offset], (UINT32) Chunk);
+  }
+  ZeroMem (&Aes, sizeof (Aes));
+
+  *Size = End - Header.HeaderSize;
+  CopyMem (Data, &Data[Header.HeaderSize], *Size);
+  *Buffer = Data;
+
+  return EFI_SUCCESS;
+}
@@ -0,0 +1,116 @@
+/** @file
+  Declaration of passphrase encryption of exported files.
+
+  Copyright (c) 2020, Mike Beaton. All rights reserved.<BR>
+  SPDX-License-Identifier: BSD-3-Clause
+
+**/
+
+#ifndef __BH__CRYPT__
+#define __BH__CRYPT__
+
+//
+// Basic UEFI Libraries
+//
+#include <Uefi.h>
+#include <Library/UefiLib.h>
+
+#include <Protocol/SimpleFileSystem.h>
+
+//
+// Appended to the name of the file which was encrypted, e.g. .bhsnap.bhenc
+//
+#define BH_CRYPT_EXTENSION          L".bhenc"
+
+#define BH_CRYPT_SIGNATURE          SIGNATURE_32 ('B', 'H', 'E', 'N')
+#define BH_CRYPT_VERSION            1
+
+#define BH_CRYPT_SALT_SIZE          16
+#define BH_CRYPT_KEY_SIZE           32
+#define BH_CRYPT_TAG_SIZE           32
+#define BH_CRYPT_ITERATIONS         10000
+
+//
+// Files asking for more PBKDF2 rounds than this are rejected rather than hanging on them.
+//
+#define BH_CRYPT_MAX_ITERATIONS     (16 * BH_CRYPT_ITERATIONS)
+
+//
+// Size of each encrypt and write, one fixed buffer; must be a multiple of the AES block size.
+//
+#define BH_CRYPT_CHUNK_SIZE         SIZE_64KB
+
+#define BH_CRYPT_MAX_PASSPHRASE     64
+
+//
+// Encrypted file layout, all values little-endian:
+//   BH_CRYPT_HEADER
+//   UINT8 Ciphertext[]             AES-256-CTR, counter block starting at Iv, big-endian increment
+//   UINT8 Tag[BH_CRYPT_TAG_SIZE]   HMAC-SHA256 of header and ciphertext
+// Encryption and MAC keys are the two halves of 64 bytes of PBKDF2-HMAC-SHA256 of the
+// passphrase (ASCII, no terminator) with Salt and Iterations.
+// Utilities/BhFleet/bhdecrypt.py reads this format on the host; keep them in step.
+//
+#pragma pack(1)
+typedef struct BH_CRYPT_HEADER_ {
+  UINT32    Signature;
+  UINT16    Version;
+  UINT16    HeaderSize;
+  UINT32    Iterations;
+  UINT32    Reserved;
+  UINT8     Salt[BH_CRYPT_SALT_SIZE];
+  UINT8     Iv[16];
+} BH_CRYPT_HEADER;
+#pragma pack()
+
+// Use Passphrase from BootHelper configuration (empty or NULL for none) instead of prompting;
+// it must stay valid until BhCryptForget
+VOID
+BhCryptSetPassphrase (
+  IN CONST CHAR8    *Passphrase OPTIONAL
+  );
+
+// Return TRUE if a passphrase is set in configuration
+BOOLEAN
+BhCryptConfigured (
+  VOID
+  );
+
+// Return the configured passphrase, or one already typed this session, or else prompt for one
+// (typed twice if Confirm); EFI_ABORTED if the prompt is cancelled
+EFI_STATUS
+BhCryptGetPassphrase (
+  IN  BOOLEAN       Confirm,
+  OUT CONST CHAR8   **Passphrase
+  );
+
+// Forget any typed passphrase, e.g. after it has failed to decrypt a file
+VOID
+BhCryptForget (
+  VOID
+  );
+
+// Encrypt Buffer with Passphrase into a file created or replaced at Path relative to Directory,
+// streamed through one fixed buffer; Buffer is not modified
+EFI_STATUS
+BhCryptWriteFile (
+  IN EFI_FILE_PROTOCOL    *Directory,
+  IN CONST CHAR16         *Path,
+  IN CONST CHAR8          *Passphrase,
+  IN CONST VOID           *Buffer,
+  IN UINTN                Size
+  );
+
+// Read, authenticate and decrypt the file at Path into an allocated buffer, which must be freed
+// by the caller using FreePool; EFI_SECURITY_VIOLATION if the passphrase is wrong or the file
+// has been altered
+EFI_STATUS
+BhCryptReadFile (
+  IN  EFI_FILE_PROTOCOL   *Directory,
+  IN  CONST CHAR16        *Path,
+  IN  CONST CHAR8         *Passphrase,
+  OUT VOID                **Buffer,
+  OUT UINTN               *Size
+  );
+
+#endif
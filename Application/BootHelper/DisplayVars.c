@@ -13,6 +13,7 @@
 #include <Library/UefiLib.h>
 #include <Library/MemoryAllocationLib.h>
 #include <Library/BaseMemoryLib.h>
+#include <Library/PrintLib.h>
 
 //
 // Boot and Runtime Services
@@ -30,7 +31,12 @@
 //
 #include "BootHelper.h"
 #include "EzKb.h"
+#include "Plugins.h"
+#include "Progress.h"
+#include "Usage.h"
 #include "Utils.h"
+#include "VarEngine.h"
+#include "VarStore.h"
 
 #define EFI_QEMU_C16_GUID_1 \
   { 0x158DEF5A, 0xF656, 0x419C, {0xB0, 0x27, 0x7A, 0x31, 0x92, 0xC0, 0x79, 0xD2} }
@@ -40,6 +46,11 @@
 STATIC EFI_GUID gEfiQemuC16lGuid1 = EFI_QEMU_C16_GUID_1;
 STATIC EFI_GUID gEfiQemuC16lGuid2 = EFI_QEMU_C16_GUID_2;
 
+//
+// Room for scalar suffix " 0x%016lx" and terminator
+//
+#define FORMAT_SCALAR_SIZE  (24 * sizeof (CHAR16))
+
 CHAR16 HexChar(
   CHAR16 c
   )
@@ -48,84 +59,143 @@ CHAR16 HexChar(
   else return c - 10 + L'a';
 }
 
-// Display NVRAM var as a CHAR8 string
-VOID
-DisplayVarC8 (
+// Format NVRAM var as a CHAR8 string
+STATIC
+CHAR16 *
+FormatVarC8 (
   IN CHAR8    *Data,
   UINTN       CharSize,
-  BOOLEAN     isString
+  BOOLEAN     isString,
+  OUT CHAR16  *Out
   )
 {
-  Print (L"\"");
+  *Out++ = L'"';
   for (UINTN i = 0; i < CharSize; i++) {
     CHAR8 c = Data[i];
     if (isString && c >= 32 && c < 127) {
-      Print (L"%c", (CHAR16)c);
-      if (c == '%') Print(L"%%"); // escape % so that representation is unambiguous & reversible
+      *Out++ = (CHAR16)c;
+      if (c == '%') *Out++ = L'%'; // escape % so that representation is unambiguous & reversible
     } else {
-      Print (L"%%");
-      Print (L"%c", HexChar((Data[i] >> 4) & 0xF));
-      Print (L"%c", HexChar(Data[i] & 0xF));
+      *Out++ = L'%';
+      *Out++ = HexChar((Data[i] >> 4) & 0xF);
+      *Out++ = HexChar(Data[i] & 0xF);
     }
   }
-  Print (L"\"");
+  *Out++ = L'"';
 
   if (CharSize == 8) {
-    Print (L" 0x%016lx", ((UINT64*)Data)[0]);
+    Out += UnicodeSPrint (Out, FORMAT_SCALAR_SIZE, L" 0x%016lx", ((UINT64*)Data)[0]);
   } else if (CharSize == 4) {
-    Print (L" 0x%08x", ((UINT32*)Data)[0]);
+    Out += UnicodeSPrint (Out, FORMAT_SCALAR_SIZE, L" 0x%08x", ((UINT32*)Data)[0]);
   } else if (CharSize == 2) {
-    Print (L" 0x%04x", ((UINT16*)Data)[0]);
+    Out += UnicodeSPrint (Out, FORMAT_SCALAR_SIZE, L" 0x%04x", ((UINT16*)Data)[0]);
   } else if (CharSize == 1) {
-    Print (L" 0x%02x", ((UINT8*)Data)[0]);
+    Out += UnicodeSPrint (Out, FORMAT_SCALAR_SIZE, L" 0x%02x", ((UINT8*)Data)[0]);
   }
+
+  return Out;
 }
 
-// Display NVRAM var as a CHAR16 string
-VOID
-DisplayVarC16 (
+// Format NVRAM var as a CHAR16 string
+STATIC
+CHAR16 *
+FormatVarC16 (
   IN CHAR16*  Data,
   UINTN       CharSize,
-  BOOLEAN     isString
+  BOOLEAN     isString,
+  OUT CHAR16  *Out
   )
 {
-  Print (L"L\"");
+  *Out++ = L'L';
+  *Out++ = L'"';
   for (UINTN i = 0; i < CharSize; i++) {
     CHAR16 c = Data[i];
     if (isString && c >= 32) {
-      Print (L"%c", c);
-      if (c == L'%') Print (L"%%"); // escape % so that representation is unambiguous & reversible
+      *Out++ = c;
+      if (c == L'%') *Out++ = L'%'; // escape % so that representation is unambiguous & reversible
     } else {
-      Print (L"%%");
-      Print (L"%c", HexChar((Data[i] >> 12) & 0xF));
-      Print (L"%c", HexChar((Data[i] >> 8) & 0xF));
-      Print (L"%c", HexChar((Data[i] >> 4) & 0xF));
-      Print (L"%c", HexChar(Data[i] & 0xF));
+      *Out++ = L'%';
+      *Out++ = HexChar((Data[i] >> 12) & 0xF);
+      *Out++ = HexChar((Data[i] >> 8) & 0xF);
+      *Out++ = HexChar((Data[i] >> 4) & 0xF);
+      *Out++ = HexChar(Data[i] & 0xF);
     }
   }
-  Print (L"\"");
+  *Out++ = L'"';
+
+  return Out;
 }
 
-// Display NVRAM var, automatically deciding (based on GUID) whether it is likely to be a CHAR8 or CHAR16 string
+// Format NVRAM var, automatically deciding (based on GUID) whether it is likely to be a CHAR8 or CHAR16 string
 // (Only some QEMU vars are currently displayed as CHAR16, but it is nice to be able to read the relevant strings easily.)
-VOID
-DisplayVar (
+CHAR16 *
+FormatVar (
   IN EFI_GUID     *Guid,
   IN VOID         *Data,
   UINTN           DataSize,
   BOOLEAN         isString
   )
 {
+  CHAR16 *Text;
+  CHAR16 *End;
+
+  //
+  // Worst case is every byte escaped as %xx, plus quotes, scalar suffix and terminator.
+  //
+  Text = AllocatePool ((DataSize * 3 + 3) * sizeof (CHAR16) + FORMAT_SCALAR_SIZE);
+  if (Text == NULL) {
+    return NULL;
+  }
+
   // some known guid's which seem to have only CHAR16 strings Data them
   // don't even try to display it as CHAR16 string if byte size is odd
   if ((DataSize & 1) == 0 && (
     CompareMem (Guid, &gEfiQemuC16lGuid1, sizeof(EFI_GUID)) == 0 ||
     CompareMem (Guid, &gEfiQemuC16lGuid2, sizeof(EFI_GUID)) == 0
   )) {
-    DisplayVarC16 ((CHAR16 *)Data, DataSize >> 1, isString);
+    End = FormatVarC16 ((CHAR16 *)Data, DataSize >> 1, isString, Text);
   } else {
-    DisplayVarC8 ((CHAR8 *)Data, DataSize, isString);
+    End = FormatVarC8 ((CHAR8 *)Data, DataSize, isString, Text);
+  }
+
+  *End = L'\0';
+  return Text;
+}
+
+// Display NVRAM var, formatted as above
+VOID
+DisplayVar (
+  IN EFI_GUID     *Guid,
+  IN VOID         *Data,
+  UINTN           DataSize,
+  BOOLEAN         isString
+  )
+{
+  CHAR16 *Text;
+
+  Text = FormatVar (Guid, Data, DataSize, isString);
+  if (Text != NULL) {
+    Print (L"%s", Text);
+    FreePool (Text);
+  }
+}
+
+CHAR16 *
+FormatNvramValue (
+  IN CONST CHAR16 *Name,
+  IN EFI_GUID     *Guid,
+  IN VOID         *Data,
+  UINTN           DataSize
+  )
+{
+  CHAR16 *Text;
+
+  Text = BhPluginDecode (Name, Guid, Data, DataSize);
+  if (Text == NULL) {
+    Text = FormatVar (Guid, Data, DataSize, TRUE);
   }
+
+  return Text;
 }
 
 EFI_STATUS
@@ -184,6 +254,7 @@ DisplayNvramValueOptionalGuid (
   UINT32 Attributes;
   UINTN DataSize;
   VOID *Data;
+  CHAR16 *Text;
 
   if (displayGuid) {
       Print(L"%g:", Name);
@@ -204,7 +275,11 @@ DisplayNvramValueOptionalGuid (
     }
 
     Print(L" = ");
-    DisplayVar(Guid, Data, DataSize, TRUE);
+  Text = FormatNvramValue (Name, Guid, Data, DataSize);
+  if (Text != NULL) {
+    Print(L"%s", Text);
+    FreePool(Text);
+  }
   if ((Attributes & EFI_VARIABLE_NON_VOLATILE) == 0) {
     Print(L" (non-persistent)");
   }
@@ -284,6 +359,14 @@ ListVars ()
       return Status;
     }
 
+    //
+    // Stop between variables if cancelled (only active inside BhProgressBegin/End)
+    //
+    if (BhProgressCancelled ()) {
+      FreePool (Name);
+      return EFI_ABORTED;
+    }
+
     //
     // Display var
     //
@@ -307,6 +390,10 @@ ListVars ()
       CHAR16 c = key.UnicodeChar;
       if (c >= 'A' && c <= 'Z') c = c - 'A' + 'a';
       if (c == 'q' || c == 'x') {
+        //
+        // Stopping on a variable is taken as having looked for it.
+        //
+        BhUsageNote (Name, &Guid);
         FreePool (Name);
         return EFI_SUCCESS;
       } else if (c == 'a') {
@@ -316,7 +403,95 @@ ListVars ()
   }
 }
 
-STATIC UINT32 gFlags = EFI_VARIABLE_BOOTSERVICE_ACCESS | EFI_VARIABLE_RUNTIME_ACCESS | EFI_VARIABLE_NON_VOLATILE;
+typedef struct LIST_STORE_CONTEXT_ {
+  BH_VAR_STORE  *Store;
+  UINT32        NextEntry;
+  BOOLEAN       ShowAll;
+  EFI_STATUS    Status;
+} LIST_STORE_CONTEXT;
+
+//
+// Names are visited in id order, and entries are sorted by name id, so this
+// walks the entries in order.
+//
+STATIC
+BOOLEAN
+ListStoreName (
+  IN VOID           *Context,
+  IN UINT32         Id,
+  IN CONST CHAR16   *Name
+  )
+{
+  LIST_STORE_CONTEXT  *List;
+  BH_VAR_ENTRY        *Entry;
+  CHAR16              *Text;
+  EFI_INPUT_KEY       Key;
+  CHAR16              c;
+
+  List = Context;
+
+  while (List->NextEntry < List->Store->EntryCount
+    && List->Store->Entries[List->NextEntry].NameId == Id) {
+    Entry = &List->Store->Entries[List->NextEntry++];
+
+    if (BhProgressCancelled ()) {
+      List->Status = EFI_ABORTED;
+      return FALSE;
+    }
+
+    Print (L"%g:%s = ", &List->Store->Guids[Entry->GuidIndex], Name);
+    Text = FormatNvramValue (
+      Name,
+      &List->Store->Guids[Entry->GuidIndex],
+      List->Store->Data + Entry->DataOffset,
+      Entry->DataSize
+      );
+    if (Text != NULL) {
+      Print (L"%s", Text);
+      FreePool (Text);
+    }
+    if ((Entry->Attributes & EFI_VARIABLE_NON_VOLATILE) == 0) {
+      Print (L" (non-persistent)");
+    }
+    Print (L"\n");
+
+    if (!List->ShowAll) {
+      getkeystroke (&Key);
+
+      c = Key.UnicodeChar;
+      if (c >= 'A' && c <= 'Z') c = c - 'A' + 'a';
+      if (c == 'q' || c == 'x') {
+        List->Status = EFI_SUCCESS;
+        return FALSE;
+      } else if (c == 'a') {
+        List->ShowAll = TRUE;
+      }
+    }
+  }
+
+  return TRUE;
+}
+
+EFI_STATUS
+ListStoreVars (
+  IN BH_VAR_STORE   *Store
+  )
+{
+  EFI_STATUS          Status;
+  LIST_STORE_CONTEXT  List;
+
+  List.Store = Store;
+  List.NextEntry = 0;
+  List.ShowAll = FALSE;
+  List.Status = EFI_NOT_FOUND;
+
+  Status = BhNameDictIteratePrefix (&Store->Names, L"", ListStoreName, &List);
+  if (EFI_ERROR (Status)) {
+    return Status;
+  }
+
+  return List.Status;
+}
 
 EFI_STATUS
 ToggleOrSetVar(
@@ -328,43 +503,23 @@ ToggleOrSetVar(
   )
 {
   EFI_STATUS Status;
-  UINT32 Attr;
-  UINTN DataSize;
-  VOID *Data;
-
-  Status = GetNvramValue (Name, Guid, &Attr, &DataSize, &Data);
-
-  if (Status != EFI_NOT_FOUND && EFI_ERROR (Status)) {
-    return Status;
-  }
+  BOOLEAN Changed;
+  BOOLEAN Deleted;
 
   if (!mInteractive) SetColour(EFI_LIGHTGREEN);
 
-  if (Status != EFI_NOT_FOUND &&
-      DataSize == PreferredSize &&
-    CompareMem (PreferredValue, Data, DataSize) == 0)
+  if (Toggle)
   {
-    if (Toggle)
-    {
-      gRT->SetVariable (Name, Guid, gFlags, 0, NULL);
-      if (!mInteractive) Print(L"Deleting %s\n", Name);
-    }
-    else
-    {
-      if (!mInteractive) Print(L"Not setting %s, already set\n", Name);
-    }
+    Status = BhVarToggle (Name, Guid, BH_VAR_DEFAULT_ATTRIBUTES, PreferredSize, PreferredValue, &Deleted);
+    if (!mInteractive && !EFI_ERROR (Status)) Print(Deleted ? L"Deleting %s\n" : L"Setting %s\n", Name);
   }
   else
   {
-    gRT->SetVariable (Name, Guid, gFlags, PreferredSize, PreferredValue);
-    if (!mInteractive) Print(L"Setting %s\n", Name);
-  }
-
-  if (Status != EFI_NOT_FOUND) {
-    FreePool (Data);
+    Status = BhVarWrite (Name, Guid, BH_VAR_DEFAULT_ATTRIBUTES, PreferredSize, PreferredValue, &Changed);
+    if (!mInteractive && !EFI_ERROR (Status)) Print(Changed ? L"Setting %s\n" : L"Not setting %s, already set\n", Name);
   }
 
   if (!mInteractive) SetColour(EFI_WHITE);
 
-  return EFI_SUCCESS;
+  return Status;
 }
@@ -15,6 +15,11 @@
 #include <Uefi.h>
 #include <Library/UefiLib.h>
 
+//
+// Local includes
+//
+#include "VarStore.h"
+
 // Return an NVRAM value, the allocated buffer for the data must be freed by the caller using FreePool
 EFI_STATUS
 GetNvramValue (
@@ -25,6 +30,25 @@ GetNvramValue (
   OUT VOID      **Data
   );
 
+// Format an NVRAM value for display, the returned string must be freed by the caller using FreePool
+CHAR16 *
+FormatVar (
+  IN EFI_GUID   *Guid,
+  IN VOID       *Data,
+  UINTN         DataSize,
+  BOOLEAN       isString
+  );
+
+// Format an NVRAM value for display with its plug-in decoder if there is one, otherwise as FormatVar;
+// the returned string must be freed by the caller using FreePool
+CHAR16 *
+FormatNvramValue (
+  IN CONST CHAR16 *Name,
+  IN EFI_GUID     *Guid,
+  IN VOID         *Data,
+  UINTN           DataSize
+  );
+
 // Display an NVRAM value, allocating and freeing the buffer needed for the data (always display GUID)
 EFI_STATUS
 DisplayNvramValue (
@@ -45,6 +69,12 @@ DisplayNvramValueWithoutGuid (
 EFI_STATUS
 ListVars ();
 
+// List all vars held in a store snapshot (live or from a file), with the same keyboard control as ListVars
+EFI_STATUS
+ListStoreVars (
+  IN BH_VAR_STORE   *Store
+  );
+
 // Toggle or set NVRAM var
 EFI_STATUS
 ToggleOrSetVar (
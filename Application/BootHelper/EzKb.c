@@ -18,11 +18,53 @@
 #include <Library/UefiBootServicesTableLib.h>
 #include <Library/UefiRuntimeServicesTableLib.h>
 
+//
+// Local includes
+//
+#include "EzKb.h"
+
+//
+// Keys read ahead by queuekeys, returned before any newer key.
+//
+#define EZKB_QUEUE_SIZE     16
+
+STATIC EZKB_IDLE mWaitIdle = NULL;
+
+STATIC EFI_INPUT_KEY mQueue[EZKB_QUEUE_SIZE];
+STATIC UINTN mQueueHead = 0;
+STATIC UINTN mQueueCount = 0;
+
+VOID
+queuekeys (
+  VOID
+  )
+{
+  EFI_INPUT_KEY Key;
+
+  while (gST->ConIn->ReadKeyStroke (gST->ConIn, &Key) == EFI_SUCCESS) {
+    if (mQueueCount == EZKB_QUEUE_SIZE) {
+      //
+      // Keep the oldest keys, so that a held key cannot push out what was typed first.
+      //
+      continue;
+    }
+    mQueue[(mQueueHead + mQueueCount) % EZKB_QUEUE_SIZE] = Key;
+    ++mQueueCount;
+  }
+}
+
 EFI_STATUS
 kbhit (
   EFI_INPUT_KEY *Key
   )
 {
+  if (mQueueCount != 0) {
+    *Key = mQueue[mQueueHead];
+    mQueueHead = (mQueueHead + 1) % EZKB_QUEUE_SIZE;
+    --mQueueCount;
+    return EFI_SUCCESS;
+  }
+
   return gST->ConIn->ReadKeyStroke (gST->ConIn, Key);
 }
 
@@ -31,6 +73,51 @@ getkeystroke (
   EFI_INPUT_KEY *Key
   )
 {
+  EFI_STATUS Status;
+
+  if (mQueueCount != 0) {
+    return kbhit (Key);
+  }
+
+  while (mWaitIdle != NULL) {
+    Status = kbhit (Key);
+    if (Status != EFI_NOT_READY) {
+      return Status;
+    }
+    if (!mWaitIdle ()) {
+      break;
+    }
+  }
+
   gBS->WaitForEvent (1, &gST->ConIn->WaitForKey, 0);
   return gST->ConIn->ReadKeyStroke (gST->ConIn, Key);
 }
+
+EFI_STATUS
+getkeystrokeidle (
+  EFI_INPUT_KEY *Key,
+  EZKB_IDLE     Idle
+  )
+{
+  EFI_STATUS Status;
+
+  while (Idle != NULL) {
+    Status = kbhit (Key);
+    if (Status != EFI_NOT_READY) {
+      return Status;
+    }
+    if (!Idle ()) {
+      break;
+    }
+  }
+
+  return getkeystroke (Key);
+}
+
+VOID
+setkeywaitidle (
+  EZKB_IDLE     Idle
+  )
+{
+  mWaitIdle = Idle;
+}
@@ -15,6 +15,13 @@
 #include <Uefi.h>
 #include <Library/UefiLib.h>
 
+// Read keys already typed into a small queue, so that keys pressed during long steps (e.g. startup)
+// are kept in order and returned first by kbhit and getkeystroke
+VOID
+queuekeys (
+  VOID
+  );
+
 // ReadKeyStroke returns EFI_NOT_READY if no key available
 // ReadKeyStroke returns EFI_SUCCESS if a key is available
 // It will not wait for a key to be available.
@@ -29,4 +36,25 @@ getkeystroke (
   EFI_INPUT_KEY *Key
   );
 
+// Idle work, one short slice per call; returns FALSE when there is nothing left to do
+typedef
+BOOLEAN
+(*EZKB_IDLE) (
+  VOID
+  );
+
+// As getkeystroke, but run Idle slices while no key is available, until Idle has nothing left to do
+EFI_STATUS
+getkeystrokeidle (
+  EFI_INPUT_KEY *Key,
+  EZKB_IDLE     Idle
+  );
+
+// Run Idle slices (NULL for none) in every getkeystroke before it waits, e.g. to send output which
+// was deferred while drawing
+VOID
+setkeywaitidle (
+  EZKB_IDLE     Idle
+  );
+
 #endif
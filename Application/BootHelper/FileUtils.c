@@ -0,0 +1,545 @@
+/** @file
+  BootHelper file writing functions.
+
+  Copyright (c) 2020, Mike Beaton. All rights reserved.<BR>
+  SPDX-License-Identifier: BSD-3-Clause
+
+**/
+
+//
+// Basic UEFI Libraries
+//
+#include <Uefi.h>
+#include <Library/UefiLib.h>
+#include <Library/BaseLib.h>
+#include <Library/BaseMemoryLib.h>
+#include <Library/MemoryAllocationLib.h>
+
+//
+// OC Libraries
+//
+#include <Library/OcDebugLogLib.h>
+#include <Library/OcFileLib.h>
+
+#include <Guid/FileInfo.h>
+
+//
+// Local includes
+//
+#include "FileUtils.h"
+
+//
+// Create each missing directory in Path, up to but not including the final component.
+//
+STATIC
+EFI_STATUS
+CreateParentDirectories (
+  IN EFI_FILE_PROTOCOL    *Directory,
+  IN CONST CHAR16         *Path
+  )
+{
+  EFI_STATUS          Status;
+  CHAR16              *Partial;
+  UINTN               Index;
+  EFI_FILE_PROTOCOL   *SubDirectory;
+
+  Partial = AllocateCopyPool (StrSize (Path), Path);
+  if (Partial == NULL) {
+    return EFI_OUT_OF_RESOURCES;
+  }
+
+  Status = EFI_SUCCESS;
+
+  for (Index = 0; Partial[Index] != L'\0'; Index++) {
+    if (Partial[Index] != L'\\' || Index == 0) {
+      continue;
+    }
+
+    Partial[Index] = L'\0';
+    Status = Directory->Open (
+      Directory,
+      &SubDirectory,
+      Partial,
+      EFI_FILE_MODE_READ | EFI_FILE_MODE_WRITE | EFI_FILE_MODE_CREATE,
+      EFI_FILE_DIRECTORY
+      );
+    Partial[Index] = L'\\';
+
+    if (EFI_ERROR (Status)) {
+      DEBUG ((DEBUG_WARN, "BH: Cannot create directory for %s - %r\n", Path, Status));
+      break;
+    }
+
+    SubDirectory->Close (SubDirectory);
+  }
+
+  FreePool (Partial);
+  return Status;
+}
+
+EFI_STATUS
+BhOpenFile (
+  IN  EFI_FILE_PROTOCOL   *Directory,
+  IN  CONST CHAR16        *Path,
+  OUT EFI_FILE_PROTOCOL   **File,
+  IN  BOOLEAN             Create
+  )
+{
+  EFI_STATUS  Status;
+
+  if (Directory == NULL) {
+    return EFI_NOT_READY;
+  }
+
+  if (!Create) {
+    return Directory->Open (Directory, File, (CHAR16 *) Path, EFI_FILE_MODE_READ, 0);
+  }
+
+  Status = CreateParentDirectories (Directory, Path);
+  if (EFI_ERROR (Status)) {
+    return Status;
+  }
+
+  return Directory->Open (
+    Directory,
+    File,
+    (CHAR16 *) Path,
+    EFI_FILE_MODE_READ | EFI_FILE_MODE_WRITE | EFI_FILE_MODE_CREATE,
+    0
+    );
+}
+
+EFI_STATUS
+BhCreateDirectory (
+  IN EFI_FILE_PROTOCOL    *Directory,
+  IN CONST CHAR16         *Path
+  )
+{
+  EFI_STATUS          Status;
+  EFI_FILE_PROTOCOL   *SubDirectory;
+
+  Status = CreateParentDirectories (Directory, Path);
+  if (EFI_ERROR (Status)) {
+    return Status;
+  }
+
+  Status = Directory->Open (
+    Directory,
+    &SubDirectory,
+    (CHAR16 *) Path,
+    EFI_FILE_MODE_READ | EFI_FILE_MODE_WRITE | EFI_FILE_MODE_CREATE,
+    EFI_FILE_DIRECTORY
+    );
+  if (EFI_ERROR (Status)) {
+    DEBUG ((DEBUG_WARN, "BH: Cannot create directory %s - %r\n", Path, Status));
+    return Status;
+  }
+
+  SubDirectory->Close (SubDirectory);
+  return EFI_SUCCESS;
+}
+
+EFI_STATUS
+BhWriteFile (
+  IN EFI_FILE_PROTOCOL    *Directory,
+  IN CONST CHAR16         *Path,
+  IN CONST VOID           *Buffer,
+  IN UINTN                Size
+  )
+{
+  EFI_STATUS          Status;
+  EFI_FILE_PROTOCOL   *File;
+  UINTN               WriteSize;
+
+  //
+  // Delete any existing file first, so that a shorter file does not keep a stale tail.
+  //
+  Status = BhOpenFile (Directory, Path, &File, TRUE);
+  if (EFI_ERROR (Status)) {
+    return Status;
+  }
+  File->Delete (File);
+
+  Status = BhOpenFile (Directory, Path, &File, TRUE);
+  if (EFI_ERROR (Status)) {
+    return Status;
+  }
+
+  WriteSize = Size;
+  Status = File->Write (File, &WriteSize, (VOID *) Buffer);
+  if (!EFI_ERROR (Status) && WriteSize != Size) {
+    Status = EFI_VOLUME_FULL;
+  }
+
+  File->Close (File);
+
+  if (EFI_ERROR (Status)) {
+    DEBUG ((DEBUG_ERROR, "BH: Failed to write %s - %r\n", Path, Status));
+  }
+
+  return Status;
+}
+
+EFI_STATUS
+BhAppendFile (
+  IN EFI_FILE_PROTOCOL    *Directory,
+  IN CONST CHAR16         *Path,
+  IN CONST VOID           *Buffer,
+  IN UINTN                Size
+  )
+{
+  EFI_STATUS          Status;
+  EFI_FILE_PROTOCOL   *File;
+  UINTN               WriteSize;
+
+  Status = BhOpenFile (Directory, Path, &File, TRUE);
+  if (EFI_ERROR (Status)) {
+    return Status;
+  }
+
+  //
+  // 0xFFFFFFFFFFFFFFFF is end of file.
+  //
+  Status = File->SetPosition (File, MAX_UINT64);
+  if (!EFI_ERROR (Status)) {
+    WriteSize = Size;
+    Status = File->Write (File, &WriteSize, (VOID *) Buffer);
+    if (!EFI_ERROR (Status) && WriteSize != Size) {
+      Status = EFI_VOLUME_FULL;
+    }
+  }
+
+  File->Close (File);
+
+  if (EFI_ERROR (Status)) {
+    DEBUG ((DEBUG_ERROR, "BH: Failed to append to %s - %r\n", Path, Status));
+  }
+
+  return Status;
+}
+
+EFI_STATUS
+BhReadFile (
+  IN  EFI_FILE_PROTOCOL   *Directory,
+  IN  CONST CHAR16        *Path,
+  OUT VOID                **Buffer,
+  OUT UINTN               *Size
+  )
+{
+  EFI_STATUS          Status;
+  EFI_FILE_PROTOCOL   *File;
+  UINT32              FileSize;
+
+  *Buffer = NULL;
+  *Size = 0;
+
+  Status = BhOpenFile (Directory, Path, &File, FALSE);
+  if (EFI_ERROR (Status)) {
+    return Status;
+  }
+
+  Status = GetFileSize (File, &FileSize);
+  if (!EFI_ERROR (Status)) {
+    *Buffer = AllocatePool (MAX (FileSize, 1));
+    if (*Buffer == NULL) {
+      Status = EFI_OUT_OF_RESOURCES;
+    } else {
+      Status = GetFileData (File, 0, FileSize, *Buffer);
+      if (EFI_ERROR (Status)) {
+        FreePool (*Buffer);
+        *Buffer = NULL;
+      } else {
+        *Size = FileSize;
+      }
+    }
+  }
+
+  File->Close (File);
+  return Status;
+}
+
+//
+// Final component of Path.
+//
+STATIC
+CONST CHAR16 *
+LeafName (
+  IN CONST CHAR16   *Path
+  )
+{
+  CONST CHAR16  *Leaf;
+
+  for (Leaf = Path; *Path != L'\0'; Path++) {
+    if (*Path == L'\\') {
+      Leaf = Path + 1;
+    }
+  }
+
+  return Leaf;
+}
+
+//
+// Rename Path, relative to Directory, to NewName within the same directory.
+//
+STATIC
+EFI_STATUS
+RenameFile (
+  IN EFI_FILE_PROTOCOL    *Directory,
+  IN CONST CHAR16         *Path,
+  IN CONST CHAR16         *NewName
+  )
+{
+  EFI_STATUS          Status;
+  EFI_FILE_PROTOCOL   *File;
+  EFI_FILE_INFO       *Info;
+  EFI_FILE_INFO       *NewInfo;
+  UINTN               NewInfoSize;
+
+  Status = Directory->Open (Directory, &File, (CHAR16 *) Path, EFI_FILE_MODE_READ | EFI_FILE_MODE_WRITE, 0);
+  if (EFI_ERROR (Status)) {
+    return Status;
+  }
+
+  Info = GetFileInfo (File, &gEfiFileInfoGuid, SIZE_OF_EFI_FILE_INFO, NULL);
+  if (Info == NULL) {
+    File->Close (File);
+    return EFI_DEVICE_ERROR;
+  }
+
+  //
+  // A FileName without a leading \ is taken as relative to the file's own directory.
+  //
+  NewInfoSize = SIZE_OF_EFI_FILE_INFO + StrSize (NewName);
+  NewInfo = AllocatePool (NewInfoSize);
+  if (NewInfo == NULL) {
+    Status = EFI_OUT_OF_RESOURCES;
+  } else {
+    CopyMem (NewInfo, Info, SIZE_OF_EFI_FILE_INFO);
+    NewInfo->Size = NewInfoSize;
+    CopyMem (NewInfo->FileName, NewName, StrSize (NewName));
+    Status = File->SetInfo (File, &gEfiFileInfoGuid, NewInfoSize, NewInfo);
+    FreePool (NewInfo);
+  }
+
+  FreePool (Info);
+  File->Close (File);
+
+  return Status;
+}
+
+VOID
+BhDeleteFile (
+  IN EFI_FILE_PROTOCOL    *Directory,
+  IN CONST CHAR16         *Path
+  )
+{
+  EFI_FILE_PROTOCOL   *File;
+
+  if (!EFI_ERROR (Directory->Open (Directory, &File, (CHAR16 *) Path, EFI_FILE_MODE_READ | EFI_FILE_MODE_WRITE, 0))) {
+    File->Delete (File);
+  }
+}
+
+EFI_STATUS
+BhReplaceFile (
+  IN EFI_FILE_PROTOCOL    *Directory,
+  IN CONST CHAR16         *NewPath,
+  IN CONST CHAR16         *Path
+  )
+{
+  EFI_STATUS          Status;
+  CHAR16              *OldPath;
+  BOOLEAN             MovedAside;
+
+  OldPath = CatSPrint (NULL, L"%s%s", Path, BH_FILE_OLD_SUFFIX);
+  if (OldPath == NULL) {
+    return EFI_OUT_OF_RESOURCES;
+  }
+
+  //
+  // Rename cannot overwrite, so the existing file is moved aside, not deleted, until the
+  // new one is in place.
+  //
+  BhDeleteFile (Directory, OldPath);
+
+  MovedAside = FALSE;
+  Status = RenameFile (Directory, Path, LeafName (OldPath));
+  if (!EFI_ERROR (Status)) {
+    MovedAside = TRUE;
+  } else if (Status == EFI_NOT_FOUND) {
+    Status = EFI_SUCCESS;
+  }
+
+  if (!EFI_ERROR (Status)) {
+    Status = RenameFile (Directory, NewPath, LeafName (Path));
+    if (EFI_ERROR (Status) && MovedAside) {
+      RenameFile (Directory, OldPath, LeafName (Path));
+      MovedAside = FALSE;
+    }
+  }
+
+  if (MovedAside) {
+    BhDeleteFile (Directory, OldPath);
+  }
+
+  if (EFI_ERROR (Status)) {
+    DEBUG ((DEBUG_ERROR, "BH: Failed to replace %s - %r\n", Path, Status));
+  }
+
+  FreePool (OldPath);
+  return Status;
+}
+
+EFI_STATUS
+BhCopyFile (
+  IN  EFI_FILE_PROTOCOL   *SourceDirectory,
+  IN  CONST CHAR16        *SourceName,
+  IN  EFI_FILE_PROTOCOL   *Directory,
+  IN  CONST CHAR16        *Path,
+  IN  VOID                *Buffer,
+  IN  UINTN               BufferSize,
+  OUT UINT64              *Copied
+  )
+{
+  EFI_STATUS          Status;
+  EFI_FILE_PROTOCOL   *Source;
+  EFI_FILE_PROTOCOL   *File;
+  CHAR16              *TempPath;
+  UINTN               ReadSize;
+  UINTN               WriteSize;
+
+  *Copied = 0;
+
+  TempPath = CatSPrint (NULL, L"%s%s", Path, BH_FILE_TEMP_SUFFIX);
+  if (TempPath == NULL) {
+    return EFI_OUT_OF_RESOURCES;
+  }
+
+  Status = SourceDirectory->Open (SourceDirectory, &Source, (CHAR16 *) SourceName, EFI_FILE_MODE_READ, 0);
+  if (EFI_ERROR (Status)) {
+    FreePool (TempPath);
+    return Status;
+  }
+
+  //
+  // Path itself is untouched until the copy is complete. As BhWriteFile, clear any leftover
+  // temporary file first so that no stale tail is kept.
+  //
+  Status = BhOpenFile (Directory, TempPath, &File, TRUE);
+  if (!EFI_ERROR (Status)) {
+    File->Delete (File);
+    Status = BhOpenFile (Directory, TempPath, &File, TRUE);
+  }
+  if (EFI_ERROR (Status)) {
+    Source->Close (Source);
+    FreePool (TempPath);
+    return Status;
+  }
+
+  while (TRUE) {
+    ReadSize = BufferSize;
+    Status = Source->Read (Source, &ReadSize, Buffer);
+    if (EFI_ERROR (Status) || ReadSize == 0) {
+      break;
+    }
+
+    WriteSize = ReadSize;
+    Status = File->Write (File, &WriteSize, Buffer);
+    if (!EFI_ERROR (Status) && WriteSize != ReadSize) {
+      Status = EFI_VOLUME_FULL;
+    }
+    if (EFI_ERROR (Status)) {
+      break;
+    }
+
+    *Copied += WriteSize;
+  }
+
+  Source->Close (Source);
+
+  if (EFI_ERROR (Status)) {
+    File->Delete (File);
+  } else {
+    Status = File->Close (File);
+    if (!EFI_ERROR (Status)) {
+      Status = BhReplaceFile (Directory, TempPath, Path);
+    }
+    if (EFI_ERROR (Status)) {
+      BhDeleteFile (Directory, TempPath);
+    }
+  }
+
+  if (EFI_ERROR (Status)) {
+    DEBUG ((DEBUG_ERROR, "BH: Failed to copy %s to %s - %r\n", SourceName, Path, Status));
+  }
+
+  FreePool (TempPath);
+  return Status;
+}
+
+EFI_STATUS
+BhForEachFile (
+  IN EFI_FILE_PROTOCOL    *Directory,
+  IN CONST CHAR16         *Path,
+  IN BH_FILE_VISIT        Visit,
+  IN VOID                 *Context
+  )
+{
+  EFI_STATUS          Status;
+  EFI_FILE_PROTOCOL   *SubDirectory;
+  EFI_FILE_INFO       *Info;
+  UINTN               InfoAllocSize;
+  UINTN               InfoSize;
+
+  Status = BhOpenFile (Directory, Path, &SubDirectory, FALSE);
+  if (EFI_ERROR (Status)) {
+    return Status;
+  }
+
+  //
+  // One entry buffer, grown as needed, for the whole walk.
+  //
+  InfoAllocSize = SIZE_OF_EFI_FILE_INFO + 256 * sizeof (CHAR16);
+  Info = AllocatePool (InfoAllocSize);
+  if (Info == NULL) {
+    SubDirectory->Close (SubDirectory);
+    return EFI_OUT_OF_RESOURCES;
+  }
+
+  while (TRUE) {
+    InfoSize = InfoAllocSize;
+    Status = SubDirectory->Read (SubDirectory, &InfoSize, Info);
+    if (Status == EFI_BUFFER_TOO_SMALL) {
+      FreePool (Info);
+      Info = AllocatePool (InfoSize);
+      if (Info == NULL) {
+        Status = EFI_OUT_OF_RESOURCES;
+        break;
+      }
+      InfoAllocSize = InfoSize;
+      continue;
+    }
+
+    //
+    // Zero size read is end of directory.
+    //
+    if (EFI_ERROR (Status) || InfoSize == 0) {
+      break;
+    }
+
+    if (StrCmp (Info->FileName, L".") == 0 || StrCmp (Info->FileName, L"..") == 0) {
+      continue;
+    }
+
+    if (!Visit (Context, SubDirectory, Info)) {
+      break;
+    }
+  }
+
+  if (Info != NULL) {
+    FreePool (Info);
+  }
+  SubDirectory->Close (SubDirectory);
+
+  return Status;
+}
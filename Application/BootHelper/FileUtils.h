@@ -0,0 +1,120 @@
+/** @file
+  Declaration of BootHelper file writing functions.
+
+  Copyright (c) 2020, Mike Beaton. All rights reserved.<BR>
+  SPDX-License-Identifier: BSD-3-Clause
+
+**/
+
+#ifndef __BH__FILE_UTILS__
+#define __BH__FILE_UTILS__
+
+//
+// Basic UEFI Libraries
+//
+#include <Uefi.h>
+#include <Library/UefiLib.h>
+
+#include <Guid/FileInfo.h>
+#include <Protocol/SimpleFileSystem.h>
+
+//
+// Suffixes of the files, beside the target, which BhCopyFile writes to and BhReplaceFile
+// moves the old file to; left behind only if BootHelper is stopped part way.
+//
+#define BH_FILE_TEMP_SUFFIX         L".bhtmp"
+#define BH_FILE_OLD_SUFFIX          L".bhold"
+
+// Called for each entry visited by BhForEachFile, with the open directory; return FALSE to stop
+typedef
+BOOLEAN
+(*BH_FILE_VISIT) (
+  IN VOID                 *Context,
+  IN EFI_FILE_PROTOCOL    *Directory,
+  IN CONST EFI_FILE_INFO  *Info
+  );
+
+// Open file relative to Directory, creating it and any missing parent directories if Create is set
+EFI_STATUS
+BhOpenFile (
+  IN  EFI_FILE_PROTOCOL   *Directory,
+  IN  CONST CHAR16        *Path,
+  OUT EFI_FILE_PROTOCOL   **File,
+  IN  BOOLEAN             Create
+  );
+
+// Create the directory at Path relative to Directory, and any missing parent directories
+EFI_STATUS
+BhCreateDirectory (
+  IN EFI_FILE_PROTOCOL    *Directory,
+  IN CONST CHAR16         *Path
+  );
+
+// Create or replace a file with Buffer, as a single write
+EFI_STATUS
+BhWriteFile (
+  IN EFI_FILE_PROTOCOL    *Directory,
+  IN CONST CHAR16         *Path,
+  IN CONST VOID           *Buffer,
+  IN UINTN                Size
+  );
+
+// Append Buffer to a file, creating it if needed
+EFI_STATUS
+BhAppendFile (
+  IN EFI_FILE_PROTOCOL    *Directory,
+  IN CONST CHAR16         *Path,
+  IN CONST VOID           *Buffer,
+  IN UINTN                Size
+  );
+
+// Read whole file into an allocated buffer, which must be freed by the caller using FreePool
+EFI_STATUS
+BhReadFile (
+  IN  EFI_FILE_PROTOCOL   *Directory,
+  IN  CONST CHAR16        *Path,
+  OUT VOID                **Buffer,
+  OUT UINTN               *Size
+  );
+
+// Move NewPath over Path, both relative to Directory and in the same directory; any existing
+// file at Path is renamed aside first and put back if NewPath cannot be renamed, so Path is
+// never left missing
+EFI_STATUS
+BhReplaceFile (
+  IN EFI_FILE_PROTOCOL    *Directory,
+  IN CONST CHAR16         *NewPath,
+  IN CONST CHAR16         *Path
+  );
+
+// Delete Path relative to Directory, if present
+VOID
+BhDeleteFile (
+  IN EFI_FILE_PROTOCOL    *Directory,
+  IN CONST CHAR16         *Path
+  );
+
+// Copy SourceName in SourceDirectory to Path relative to Directory, creating or replacing it, streamed
+// through Buffer in sequential reads and writes of up to BufferSize; Copied is set to the bytes copied.
+// The copy is written beside Path and only replaces it once the whole source has been copied.
+EFI_STATUS
+BhCopyFile (
+  IN  EFI_FILE_PROTOCOL   *SourceDirectory,
+  IN  CONST CHAR16        *SourceName,
+  IN  EFI_FILE_PROTOCOL   *Directory,
+  IN  CONST CHAR16        *Path,
+  IN  VOID                *Buffer,
+  IN  UINTN               BufferSize,
+  OUT UINT64              *Copied
+  );
+
+// Visit each entry of the directory at Path relative to Directory, in directory order, skipping . and ..
+EFI_STATUS
+BhForEachFile (
+  IN EFI_FILE_PROTOCOL    *Directory,
+  IN CONST CHAR16         *Path,
+  IN BH_FILE_VISIT        Visit,
+  IN VOID                 *Context
+  );
+
+#endif
@@ -0,0 +1,173 @@
+/** @file
+  First paint of the menu frame during startup.
+
+  Storage, configuration and the startup checks take long enough on some
+  firmware that a blank screen looks like a hang. The static parts of the
+  menu are painted before any of them, then a status line and the reserved
+  value lines are rewritten in place as each step completes. Keys typed
+  meanwhile are read ahead at each step, so they answer the menu once it is
+  ready instead of being dropped.
+
+  Copyright (c) 2020, Mike Beaton. All rights reserved.<BR>
+  SPDX-License-Identifier: BSD-3-Clause
+
+**/
+
+//
+// Basic UEFI Libraries
+//
+#include <Uefi.h>
+#include <Library/UefiLib.h>
+#include <Library/BaseLib.h>
+
+//
+// Boot and Runtime Services
+//
+#include <Library/UefiBootServicesTableLib.h>
+
+//
+// Local includes
+//
+#include "BhScreen.h"
+#include "EzKb.h"
+#include "FirstPaint.h"
+#include "Utils.h"
+
+STATIC BOOLEAN  mPainted = FALSE;
+STATIC UINTN    mColumns;
+STATIC UINT32   mLines;
+STATIC INT32    mStatusRow;
+STATIC INT32    mEndRow;
+
+STATIC
+INT32
+CountLines (
+  IN CONST BH_SCREEN    *Screen
+  )
+{
+  UINTN         Index;
+  CONST CHAR16  *Walker;
+  INT32         Lines;
+
+  Lines = 0;
+  for (Index = 0; Index < Screen->Count; Index++) {
+    for (Walker = Screen->Runs[Index].Text; *Walker != L'\0'; Walker++) {
+      if (*Walker == L'\n') {
+        ++Lines;
+      }
+    }
+  }
+
+  return Lines;
+}
+
+STATIC
+VOID
+BlankRow (
+  IN INT32    Row
+  )
+{
+  UINTN   Index;
+
+  gST->ConOut->SetCursorPosition (gST->ConOut, 0, Row);
+  for (Index = 0; Index < mColumns - 1; Index++) {
+    gST->ConOut->OutputString (gST->ConOut, L" ");
+  }
+  gST->ConOut->SetCursorPosition (gST->ConOut, 0, Row);
+}
+
+VOID
+BhFirstPaintBegin (
+  IN CONST CHAR16 *CONST  *Labels,
+  IN UINT32               Count
+  )
+{
+  UINT32  Index;
+  UINTN   Rows;
+
+  if (EFI_ERROR (gST->ConOut->QueryMode (gST->ConOut, gST->ConOut->Mode->Mode, &mColumns, &Rows))
+    || mColumns < 20) {
+    mColumns = 80;
+  }
+
+  mLines = MIN (Count, BH_FIRST_PAINT_MAX_LINES);
+
+  gST->ConOut->ClearScreen (gST->ConOut);
+
+  BhScreenShow (&gBhScreenBanner);
+
+  SetColour (EFI_LIGHTCYAN);
+  Print (L"Starting...\n");
+  SetColour (EFI_WHITE);
+
+  for (Index = 0; Index < mLines; Index++) {
+    Print (L"%s ...\n", Labels[Index]);
+  }
+
+  BhScreenShow (&gBhScreenMenu);
+  SetColour (EFI_WHITE);
+
+  //
+  // Worked back from the cursor, as in the most used panel, in case the frame scrolled;
+  // if the status line scrolled off, the frame is left as painted.
+  //
+  mEndRow = gST->ConOut->Mode->CursorRow;
+  mStatusRow = mEndRow - CountLines (&gBhScreenMenu) - (INT32) mLines - 1;
+  mPainted = mStatusRow >= 0;
+
+  queuekeys ();
+}
+
+BOOLEAN
+BhFirstPaintSeek (
+  IN UINT32               Index
+  )
+{
+  if (!mPainted || Index >= mLines) {
+    return FALSE;
+  }
+
+  queuekeys ();
+
+  BlankRow (mStatusRow + 1 + (INT32) Index);
+
+  return TRUE;
+}
+
+VOID
+BhFirstPaintStatus (
+  IN CONST CHAR16         *Status
+  )
+{
+  if (!mPainted) {
+    return;
+  }
+
+  queuekeys ();
+
+  BlankRow (mStatusRow);
+  SetColour (EFI_LIGHTCYAN);
+  Print (L"%s", Status);
+  SetColour (EFI_WHITE);
+  gST->ConOut->SetCursorPosition (gST->ConOut, 0, mEndRow);
+}
+
+VOID
+BhFirstPaintEnd (
+  IN BOOLEAN              Clear
+  )
+{
+  if (!mPainted) {
+    return;
+  }
+
+  queuekeys ();
+
+  if (Clear) {
+    gST->ConOut->ClearScreen (gST->ConOut);
+  } else {
+    gST->ConOut->SetCursorPosition (gST->ConOut, 0, mEndRow);
+  }
+
+  mPainted = FALSE;
+}
@@ -0,0 +1,52 @@
+/** @file
+  Declaration of first paint of the menu frame during startup.
+
+  Copyright (c) 2020, Mike Beaton. All rights reserved.<BR>
+  SPDX-License-Identifier: BSD-3-Clause
+
+**/
+
+#ifndef __BH__FIRST_PAINT__
+#define __BH__FIRST_PAINT__
+
+//
+// Basic UEFI Libraries
+//
+#include <Uefi.h>
+#include <Library/UefiLib.h>
+
+//
+// Most lines reserved for values filled in during startup.
+//
+#define BH_FIRST_PAINT_MAX_LINES    8
+
+// Clear the screen and paint the static banner, a status line, one placeholder line per label
+// ("label ...") and the static menu legend, before anything is read from storage
+VOID
+BhFirstPaintBegin (
+  IN CONST CHAR16 *CONST  *Labels,
+  IN UINT32               Count
+  );
+
+// Blank reserved line Index and leave the cursor at its start, for the caller to print one line;
+// returns FALSE, leaving the cursor alone, if there is no first paint or no such line
+BOOLEAN
+BhFirstPaintSeek (
+  IN UINT32               Index
+  );
+
+// Replace the status line with Status (e.g. L"Loading configuration...") and read ahead any keys
+// typed so far (queuekeys); does nothing after BhFirstPaintEnd
+VOID
+BhFirstPaintStatus (
+  IN CONST CHAR16         *Status
+  );
+
+// End the first paint; Clear to clear the screen for the full menu, otherwise the cursor is left
+// below the frame so that later output (e.g. a startup error) follows it
+VOID
+BhFirstPaintEnd (
+  IN BOOLEAN              Clear
+  );
+
+#endif
@@ -0,0 +1,311 @@
+/** @file
+  Stale hibernation state detector and cleaner.
+
+  Leftover hibernation variables from an abandoned or failed resume can make
+  later boots slow or fail. They are found in a single store enumeration,
+  checked for consistency with each other, with the configured hibernate mode
+  and with the devices actually present, and can be deleted together.
+
+  Copyright (c) 2020, Mike Beaton. All rights reserved.<BR>
+  SPDX-License-Identifier: BSD-3-Clause
+
+**/
+
+//
+// Basic UEFI Libraries
+//
+#include <Uefi.h>
+#include <Library/UefiLib.h>
+#include <Library/BaseLib.h>
+#include <Library/BaseMemoryLib.h>
+#include <Library/DevicePathLib.h>
+#include <Library/MemoryAllocationLib.h>
+
+//
+// Boot and Runtime Services
+//
+#include <Library/UefiBootServicesTableLib.h>
+
+#include <Protocol/BlockIo.h>
+
+//
+// OC Libraries
+//
+#include <Library/OcDebugLogLib.h>
+
+//
+// Local includes
+//
+#include "Hibernate.h"
+#include "Utils.h"
+#include "VarEngine.h"
+
+#define APPLE_BOOT_VARIABLE_GUID \
+  { 0x7c436110, 0xab2a, 0x4bbb, {0xa8, 0x80, 0xfe, 0x41, 0x99, 0x5c, 0x9f, 0x82} }
+STATIC EFI_GUID mAppleBootVariableGuid = APPLE_BOOT_VARIABLE_GUID;
+
+//
+// Layout of IOHibernateRTCVariables, as written by macOS.
+//
+#define HIBERNATE_RTC_SIGNATURE   SIGNATURE_32 ('A', 'A', 'P', 'L')
+
+#pragma pack(1)
+
+typedef struct HIBERNATE_RTC_VARS_ {
+  UINT32    Signature;
+  UINT32    Revision;
+  UINT8     BooterSignature[20];
+  UINT8     WiredCryptKey[16];
+} HIBERNATE_RTC_VARS;
+
+#pragma pack()
+
+//
+// Indexed by BH_HIBERNATE_VAR_*.
+//
+STATIC
+CONST CHAR16 *
+mHibernateVarNames[BH_HIBERNATE_VAR_COUNT] = {
+  L"boot-image",
+  L"boot-image-key",
+  L"boot-signature",
+  L"boot-switch-vars",
+  L"IOHibernateRTCVariables"
+};
+
+STATIC
+CONST CHAR16 *
+mStaleReasons[] = {
+  L"HibernateMode is None",
+  L"resume data without boot-image",
+  L"boot-image is not a valid device path",
+  L"boot-image device not present",
+  L"IOHibernateRTCVariables is invalid",
+  L"HibernateMode is NVRAM but no key is in NVRAM"
+};
+
+STATIC
+VOID
+CheckImage (
+  IN OUT BH_HIBERNATE_STATE *State,
+  IN     CONST UINT8        *Data,
+  IN     UINT32             Size
+  )
+{
+  EFI_STATUS                Status;
+  EFI_DEVICE_PATH_PROTOCOL  *DevicePath;
+  EFI_DEVICE_PATH_PROTOCOL  *Remaining;
+  EFI_HANDLE                Handle;
+
+  //
+  // Store data is not aligned; device path helpers expect an allocation.
+  //
+  DevicePath = AllocateCopyPool (Size, Data);
+  if (DevicePath == NULL) {
+    return;
+  }
+
+  if (!IsDevicePathValid (DevicePath, Size)) {
+    State->Stale |= BH_HIBERNATE_STALE_BAD_IMAGE_PATH;
+  } else {
+    State->ImagePath = ConvertDevicePathToText (DevicePath, FALSE, FALSE);
+
+    //
+    // The image is read by block from its partition, so that is what must be present.
+    //
+    Remaining = DevicePath;
+    Status = gBS->LocateDevicePath (&gEfiBlockIoProtocolGuid, &Remaining, &Handle);
+    if (EFI_ERROR (Status)) {
+      State->Stale |= BH_HIBERNATE_STALE_NO_DEVICE;
+    }
+  }
+
+  FreePool (DevicePath);
+}
+
+STATIC
+VOID
+CheckRtc (
+  IN OUT BH_HIBERNATE_STATE *State,
+  IN     CONST UINT8        *Data,
+  IN     UINT32             Size
+  )
+{
+  HIBERNATE_RTC_VARS  RtcVars;
+
+  if (Size != sizeof (RtcVars)) {
+    State->Stale |= BH_HIBERNATE_STALE_BAD_RTC;
+    return;
+  }
+
+  CopyMem (&RtcVars, Data, sizeof (RtcVars));
+  if (RtcVars.Signature != HIBERNATE_RTC_SIGNATURE) {
+    State->Stale |= BH_HIBERNATE_STALE_BAD_RTC;
+    return;
+  }
+
+  State->RtcRevision = RtcVars.Revision;
+}
+
+EFI_STATUS
+BhHibernateScan (
+  IN  CONST CHAR8           *Mode,
+  OUT BH_HIBERNATE_STATE    *State
+  )
+{
+  EFI_STATUS        Status;
+  BH_VAR_STORE      *Store;
+  BH_VAR_ENTRY      *Entry;
+  BH_HIBERNATE_VAR  *Vars;
+  UINT32            Index;
+
+  ZeroMem (State, sizeof (*State));
+  Vars = State->Vars;
+
+  //
+  // One fresh enumeration; every lookup after that is in the snapshot.
+  //
+  BhVarCacheInvalidate ();
+  Status = BhVarCacheGet (&Store);
+  if (EFI_ERROR (Status)) {
+    return Status;
+  }
+
+  for (Index = 0; Index < BH_HIBERNATE_VAR_COUNT; Index++) {
+    Entry = BhVarStoreFind (Store, mHibernateVarNames[Index], &mAppleBootVariableGuid);
+    if (Entry == NULL) {
+      continue;
+    }
+
+    Vars[Index].Present = TRUE;
+    Vars[Index].Attributes = Entry->Attributes;
+    Vars[Index].Size = Entry->DataSize;
+    State->PresentCount++;
+
+    if (Index == BH_HIBERNATE_VAR_IMAGE) {
+      CheckImage (State, Store->Data + Entry->DataOffset, Entry->DataSize);
+    } else if (Index == BH_HIBERNATE_VAR_RTC) {
+      CheckRtc (State, Store->Data + Entry->DataOffset, Entry->DataSize);
+    }
+  }
+
+  if (State->PresentCount == 0) {
+    return EFI_SUCCESS;
+  }
+
+  if (!Vars[BH_HIBERNATE_VAR_IMAGE].Present) {
+    State->Stale |= BH_HIBERNATE_STALE_NO_IMAGE;
+  }
+
+  if (AsciiStrCmp (Mode, "None") == 0) {
+    State->Stale |= BH_HIBERNATE_STALE_NOT_EXPECTED;
+  } else if (AsciiStrCmp (Mode, "NVRAM") == 0
+    && !Vars[BH_HIBERNATE_VAR_IMAGE_KEY].Present
+    && !Vars[BH_HIBERNATE_VAR_RTC].Present) {
+    State->Stale |= BH_HIBERNATE_STALE_NO_KEY;
+  }
+
+  DEBUG ((
+    DEBUG_INFO,
+    "BH: Hibernation %u vars, mode %a, stale 0x%x\n",
+    State->PresentCount,
+    Mode,
+    State->Stale
+    ));
+
+  return EFI_SUCCESS;
+}
+
+VOID
+BhHibernateShow (
+  IN CONST BH_HIBERNATE_STATE *State
+  )
+{
+  UINT32  Index;
+
+  if (State->PresentCount == 0) {
+    SetColour (EFI_LIGHTGREEN);
+    Print (L"No hibernation state\n");
+    SetColour (EFI_WHITE);
+    return;
+  }
+
+  for (Index = 0; Index < BH_HIBERNATE_VAR_COUNT; Index++) {
+    if (!State->Vars[Index].Present) {
+      continue;
+    }
+
+    Print (L"%s: %u bytes", mHibernateVarNames[Index], State->Vars[Index].Size);
+    if (Index == BH_HIBERNATE_VAR_IMAGE && State->ImagePath != NULL) {
+      Print (L" %s", State->ImagePath);
+    } else if (Index == BH_HIBERNATE_VAR_RTC && (State->Stale & BH_HIBERNATE_STALE_BAD_RTC) == 0) {
+      Print (L" revision %u", State->RtcRevision);
+    }
+    Print (L"\n");
+  }
+
+  if (State->Stale == 0) {
+    SetColour (EFI_YELLOW);
+    Print (L"Hibernation state looks current\n");
+  } else {
+    SetColour (EFI_LIGHTRED);
+    Print (L"Stale hibernation state:\n");
+    for (Index = 0; Index < ARRAY_SIZE (mStaleReasons); Index++) {
+      if ((State->Stale & (1U << Index)) != 0) {
+        Print (L"  %s\n", mStaleReasons[Index]);
+      }
+    }
+  }
+  SetColour (EFI_WHITE);
+}
+
+EFI_STATUS
+BhHibernateClear (
+  IN  CONST BH_HIBERNATE_STATE  *State,
+  OUT UINT32                    *DeleteCount
+  )
+{
+  EFI_STATUS  Status;
+  EFI_STATUS  FirstError;
+  UINT32      Index;
+  BOOLEAN     Changed;
+
+  FirstError = EFI_SUCCESS;
+  *DeleteCount = 0;
+
+  //
+  // Delete the whole set, even after a failure, so that no partial resume state is left
+  // behind where it can be avoided.
+  //
+  for (Index = 0; Index < BH_HIBERNATE_VAR_COUNT; Index++) {
+    if (!State->Vars[Index].Present) {
+      continue;
+    }
+
+    Status = BhVarWrite (
+      mHibernateVarNames[Index],
+      &mAppleBootVariableGuid,
+      State->Vars[Index].Attributes,
+      0,
+      NULL,
+      &Changed
+      );
+    *DeleteCount += Changed;
+    if (EFI_ERROR (Status) && !EFI_ERROR (FirstError)) {
+      FirstError = Status;
+    }
+  }
+
+  return FirstError;
+}
+
+VOID
+BhHibernateFree (
+  IN OUT BH_HIBERNATE_STATE *State
+  )
+{
+  if (State->ImagePath != NULL) {
+    FreePool (State->ImagePath);
+    State->ImagePath = NULL;
+  }
+}
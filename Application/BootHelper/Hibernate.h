@@ -0,0 +1,79 @@
+/** @file
+  Declaration of stale hibernation state detector and cleaner.
+
+  Copyright (c) 2020, Mike Beaton. All rights reserved.<BR>
+  SPDX-License-Identifier: BSD-3-Clause
+
+**/
+
+#ifndef __BH__HIBERNATE__
+#define __BH__HIBERNATE__
+
+//
+// Basic UEFI Libraries
+//
+#include <Uefi.h>
+#include <Library/UefiLib.h>
+
+//
+// Hibernation variables looked for, all under the Apple boot variable GUID.
+//
+#define BH_HIBERNATE_VAR_IMAGE          0
+#define BH_HIBERNATE_VAR_IMAGE_KEY      1
+#define BH_HIBERNATE_VAR_SIGNATURE      2
+#define BH_HIBERNATE_VAR_SWITCH_VARS    3
+#define BH_HIBERNATE_VAR_RTC            4
+#define BH_HIBERNATE_VAR_COUNT          5
+
+//
+// Reasons for hibernation state to be considered stale.
+//
+#define BH_HIBERNATE_STALE_NOT_EXPECTED   BIT0    ///< Misc/Boot/HibernateMode is None
+#define BH_HIBERNATE_STALE_NO_IMAGE       BIT1    ///< Resume data without boot-image
+#define BH_HIBERNATE_STALE_BAD_IMAGE_PATH BIT2    ///< boot-image is not a valid device path
+#define BH_HIBERNATE_STALE_NO_DEVICE      BIT3    ///< boot-image device is not present
+#define BH_HIBERNATE_STALE_BAD_RTC        BIT4    ///< IOHibernateRTCVariables has wrong size or signature
+#define BH_HIBERNATE_STALE_NO_KEY         BIT5    ///< HibernateMode NVRAM, but no key in NVRAM
+
+typedef struct BH_HIBERNATE_VAR_ {
+  BOOLEAN       Present;
+  UINT32        Attributes;
+  UINT32        Size;
+} BH_HIBERNATE_VAR;
+
+typedef struct BH_HIBERNATE_STATE_ {
+  BH_HIBERNATE_VAR  Vars[BH_HIBERNATE_VAR_COUNT];
+  UINT32            PresentCount;
+  CHAR16            *ImagePath;           ///< Decoded boot-image, or NULL
+  UINT32            RtcRevision;          ///< Valid if IOHibernateRTCVariables present without BH_HIBERNATE_STALE_BAD_RTC
+  UINT32            Stale;                ///< BH_HIBERNATE_STALE_* reasons, zero if not stale
+} BH_HIBERNATE_STATE;
+
+// Find and decode hibernation variables in one store enumeration, checking them against
+// Mode (Misc/Boot/HibernateMode); free with BhHibernateFree
+EFI_STATUS
+BhHibernateScan (
+  IN  CONST CHAR8           *Mode,
+  OUT BH_HIBERNATE_STATE    *State
+  );
+
+// Display scan result
+VOID
+BhHibernateShow (
+  IN CONST BH_HIBERNATE_STATE *State
+  );
+
+// Delete every hibernation variable found by the scan, as one batch; DeleteCount is set to the number deleted
+EFI_STATUS
+BhHibernateClear (
+  IN  CONST BH_HIBERNATE_STATE  *State,
+  OUT UINT32                    *DeleteCount
+  );
+
+// Free scan result
+VOID
+BhHibernateFree (
+  IN OUT BH_HIBERNATE_STATE *State
+  );
+
+#endif
@@ -0,0 +1,706 @@
+/** @file
+  OpenCore ESP integrity check.
+
+  Every file under EFI\OC and EFI\BOOT is hashed and compared against a
+  manifest shipped on the BootHelper drive, before anything is changed. Each
+  directory is opened once, relative to its parent, and each file is read
+  sequentially in large chunks into a single buffer, so that the check runs
+  at close to raw read speed.
+
+  Copyright (c) 2020, Mike Beaton. All rights reserved.<BR>
+  SPDX-License-Identifier: BSD-3-Clause
+
+**/
+
+//
+// Basic UEFI Libraries
+//
+#include <Uefi.h>
+#include <Library/UefiLib.h>
+#include <Library/BaseLib.h>
+#include <Library/BaseMemoryLib.h>
+#include <Library/DevicePathLib.h>
+#include <Library/MemoryAllocationLib.h>
+
+//
+// Boot and Runtime Services
+//
+#include <Library/UefiBootServicesTableLib.h>
+
+//
+// OC Libraries
+//
+#include <Library/OcCryptoLib.h>
+#include <Library/OcDebugLogLib.h>
+
+//
+// Local includes
+//
+#include "FileUtils.h"
+#include "Integrity.h"
+#include "Progress.h"
+#include "Timing.h"
+#include "Utils.h"
+
+#define SHA256_HEX_LENGTH   (2 * SHA256_DIGEST_SIZE)
+
+typedef struct MANIFEST_ENTRY_ {
+  CHAR16    *Path;                ///< Relative to volume root, with backslashes
+  UINT8     Hash[SHA256_DIGEST_SIZE];
+  BOOLEAN   Seen;
+} MANIFEST_ENTRY;
+
+typedef struct MANIFEST_ {
+  MANIFEST_ENTRY  *Entries;       ///< Sorted by path, without regard to case
+  UINT32          Count;
+  CHAR16          *Paths;
+} MANIFEST;
+
+typedef struct INTEGRITY_WALK_ {
+  MANIFEST              *Manifest;
+  BH_INTEGRITY_RESULT   Result;
+  UINT8                 *Buffer;
+  CHAR16                *Volume;
+  BOOLEAN               VolumeShown;
+  CHAR16                Path[BH_INTEGRITY_MAX_PATH];
+  UINTN                 PathLength;
+  EFI_STATUS            Status;
+} INTEGRITY_WALK;
+
+//
+// Directories checked on each volume; EFI\OC must be present for the volume to be checked.
+//
+STATIC
+CONST CHAR16 *
+mIntegrityRoots[] = {
+  L"EFI\\OC",
+  L"EFI\\BOOT"
+};
+
+STATIC
+INTN
+ComparePaths (
+  IN CONST CHAR16   *Left,
+  IN CONST CHAR16   *Right
+  )
+{
+  CHAR16  L;
+  CHAR16  R;
+
+  do {
+    L = CharToUpper (*Left++);
+    R = CharToUpper (*Right++);
+  } while (L == R && L != L'\0');
+
+  return (INTN) L - (INTN) R;
+}
+
+STATIC
+INTN
+CompareEntries (
+  IN VOID       *Context,
+  IN CONST VOID *Left,
+  IN CONST VOID *Right
+  )
+{
+  return ComparePaths (((CONST MANIFEST_ENTRY *) Left)->Path, ((CONST MANIFEST_ENTRY *) Right)->Path);
+}
+
+STATIC
+MANIFEST_ENTRY *
+FindEntry (
+  IN MANIFEST       *Manifest,
+  IN CONST CHAR16   *Path
+  )
+{
+  UINT32  Low;
+  UINT32  High;
+  UINT32  Middle;
+  INTN    Order;
+
+  Low = 0;
+  High = Manifest->Count;
+  while (Low < High) {
+    Middle = Low + (High - Low) / 2;
+    Order = ComparePaths (Path, Manifest->Entries[Middle].Path);
+    if (Order == 0) {
+      return &Manifest->Entries[Middle];
+    }
+    if (Order < 0) {
+      High = Middle;
+    } else {
+      Low = Middle + 1;
+    }
+  }
+
+  return NULL;
+}
+
+//
+// TRUE if the manifest lists Path, or for a directory anything under it.
+//
+STATIC
+BOOLEAN
+IsListed (
+  IN MANIFEST       *Manifest,
+  IN CHAR16         *Path,
+  IN UINTN          PathLength,
+  IN BOOLEAN        IsDirectory
+  )
+{
+  UINT32  Low;
+  UINT32  High;
+  UINT32  Middle;
+  UINTN   Index;
+  INTN    Order;
+
+  if (!IsDirectory) {
+    return FindEntry (Manifest, Path) != NULL;
+  }
+
+  //
+  // Entries under the directory sort together; compare only the length of Path and a backslash.
+  //
+  Low = 0;
+  High = Manifest->Count;
+  while (Low < High) {
+    Middle = Low + (High - Low) / 2;
+    Order = 0;
+    for (Index = 0; Index <= PathLength && Order == 0; Index++) {
+      Order = (INTN) CharToUpper (Index < PathLength ? Path[Index] : L'\\')
+        - (INTN) CharToUpper (Manifest->Entries[Middle].Path[Index]);
+      if (Manifest->Entries[Middle].Path[Index] == L'\0') {
+        break;
+      }
+    }
+    if (Order == 0) {
+      return TRUE;
+    }
+    if (Order < 0) {
+      High = Middle;
+    } else {
+      Low = Middle + 1;
+    }
+  }
+
+  return FALSE;
+}
+
+STATIC
+BOOLEAN
+ParseHash (
+  IN  CONST CHAR8   *Hex,
+  OUT UINT8         *Hash
+  )
+{
+  UINTN   Index;
+  UINT8   Nibble;
+  CHAR8   c;
+
+  for (Index = 0; Index < SHA256_HEX_LENGTH; Index++) {
+    c = Hex[Index];
+    if (c >= '0' && c <= '9') {
+      Nibble = (UINT8) (c - '0');
+    } else if ((c | 0x20) >= 'a' && (c | 0x20) <= 'f') {
+      Nibble = (UINT8) ((c | 0x20) - 'a' + 10);
+    } else {
+      return FALSE;
+    }
+
+    if ((Index & 1) == 0) {
+      Hash[Index / 2] = (UINT8) (Nibble << 4);
+    } else {
+      Hash[Index / 2] |= Nibble;
+    }
+  }
+
+  return TRUE;
+}
+
+//
+// Parse one manifest line, "<hash> <path>" or "<hash> *<path>"; Line is not terminated.
+//
+STATIC
+BOOLEAN
+ParseLine (
+  IN OUT MANIFEST       *Manifest,
+  IN     CONST CHAR8    *Line,
+  IN     UINTN          Length,
+  IN OUT CHAR16         **NextPath
+  )
+{
+  MANIFEST_ENTRY  *Entry;
+  CHAR16          *Path;
+  UINTN           Index;
+
+  if (Length < SHA256_HEX_LENGTH + 3 || Line[SHA256_HEX_LENGTH] != ' '
+    || (Line[SHA256_HEX_LENGTH + 1] != ' ' && Line[SHA256_HEX_LENGTH + 1] != '*')) {
+    return FALSE;
+  }
+
+  Entry = &Manifest->Entries[Manifest->Count];
+  if (!ParseHash (Line, Entry->Hash)) {
+    return FALSE;
+  }
+
+  Index = SHA256_HEX_LENGTH + 2;
+  if (Length - Index >= 2 && Line[Index] == '.' && Line[Index + 1] == '/') {
+    Index += 2;
+  }
+  while (Index < Length && Line[Index] == '/') {
+    Index++;
+  }
+  if (Index == Length) {
+    return FALSE;
+  }
+
+  Path = *NextPath;
+  Entry->Path = Path;
+  for (; Index < Length; Index++) {
+    *Path++ = Line[Index] == '/' ? L'\\' : (CHAR16) (UINT8) Line[Index];
+  }
+  *Path++ = L'\0';
+  *NextPath = Path;
+
+  Entry->Seen = FALSE;
+  Manifest->Count++;
+
+  return TRUE;
+}
+
+STATIC
+EFI_STATUS
+LoadManifest (
+  IN  EFI_FILE_PROTOCOL   *Root,
+  OUT MANIFEST            *Manifest
+  )
+{
+  EFI_STATUS  Status;
+  CHAR8       *Data;
+  UINTN       Size;
+  UINTN       Start;
+  UINTN       End;
+  UINTN       LineCount;
+  UINTN       Index;
+  CHAR16      *NextPath;
+
+  ZeroMem (Manifest, sizeof (*Manifest));
+
+  Status = BhReadFile (Root, BH_INTEGRITY_MANIFEST_PATH, (VOID **) &Data, &Size);
+  if (EFI_ERROR (Status)) {
+    return Status;
+  }
+
+  LineCount = 1;
+  for (Index = 0; Index < Size; Index++) {
+    LineCount += Data[Index] == '\n';
+  }
+
+  //
+  // Paths need at most one character (and terminator) per manifest byte.
+  //
+  Manifest->Entries = AllocatePool (LineCount * sizeof (MANIFEST_ENTRY));
+  Manifest->Paths = AllocatePool ((Size + LineCount) * sizeof (CHAR16));
+  if (Manifest->Entries == NULL || Manifest->Paths == NULL) {
+    FreePool (Data);
+    return EFI_OUT_OF_RESOURCES;
+  }
+
+  NextPath = Manifest->Paths;
+  for (Start = 0; Start < Size; Start = End + 1) {
+    for (End = Start; End < Size && Data[End] != '\n'; End++) {
+    }
+
+    Index = End;
+    while (Index > Start && (Data[Index - 1] == '\r' || Data[Index - 1] == ' ')) {
+      Index--;
+    }
+    if (Index == Start || Data[Start] == '#') {
+      continue;
+    }
+
+    if (!ParseLine (Manifest, &Data[Start], Index - Start, &NextPath)) {
+      DEBUG ((DEBUG_WARN, "BH: Ignoring invalid manifest line at offset %u\n", (UINT32) Start));
+    }
+  }
+
+  FreePool (Data);
+
+  BhSort (Manifest->Entries, Manifest->Count, sizeof (MANIFEST_ENTRY), CompareEntries, NULL);
+
+  DEBUG ((DEBUG_INFO, "BH: Manifest has %u files\n", Manifest->Count));
+
+  return EFI_SUCCESS;
+}
+
+STATIC
+VOID
+FreeManifest (
+  IN OUT MANIFEST   *Manifest
+  )
+{
+  if (Manifest->Entries != NULL) {
+    FreePool (Manifest->Entries);
+  }
+  if (Manifest->Paths != NULL) {
+    FreePool (Manifest->Paths);
+  }
+  ZeroMem (Manifest, sizeof (*Manifest));
+}
+
+STATIC
+VOID
+ShowVolume (
+  IN OUT INTEGRITY_WALK   *Walk
+  )
+{
+  if (!Walk->VolumeShown) {
+    Print (L"%s\n", Walk->Volume);
+    Walk->VolumeShown = TRUE;
+  }
+}
+
+STATIC
+VOID
+ShowFile (
+  IN OUT INTEGRITY_WALK   *Walk,
+  IN     UINTN            Colour,
+  IN     CONST CHAR16     *Change,
+  IN     CONST CHAR16     *Path
+  )
+{
+  ShowVolume (Walk);
+  SetColour (Colour);
+  Print (L"  %-8s %s\n", Change, Path);
+  SetColour (EFI_WHITE);
+}
+
+EFI_STATUS
+BhHashFile (
+  IN     EFI_FILE_PROTOCOL    *Directory,
+  IN     CONST CHAR16         *Name,
+  IN     VOID                 *Buffer,
+  IN     UINTN                BufferSize,
+  OUT    UINT8                *Hash,
+  IN OUT UINT64               *Bytes
+  )
+{
+  EFI_STATUS          Status;
+  EFI_FILE_PROTOCOL   *File;
+  SHA256_CONTEXT      Context;
+  UINTN               ReadSize;
+
+  Status = Directory->Open (Directory, &File, (CHAR16 *) Name, EFI_FILE_MODE_READ, 0);
+  if (EFI_ERROR (Status)) {
+    return Status;
+  }
+
+  Sha256Init (&Context);
+
+  while (TRUE) {
+    ReadSize = BufferSize;
+    Status = File->Read (File, &ReadSize, Buffer);
+    if (EFI_ERROR (Status) || ReadSize == 0) {
+      break;
+    }
+
+    Sha256Update (&Context, Buffer, ReadSize);
+    *Bytes += ReadSize;
+  }
+
+  File->Close (File);
+
+  Sha256Final (&Context, Hash);
+
+  return Status;
+}
+
+STATIC
+BOOLEAN
+CheckEntry (
+  IN VOID                 *Context,
+  IN EFI_FILE_PROTOCOL    *Directory,
+  IN CONST EFI_FILE_INFO  *Info
+  )
+{
+  EFI_STATUS          Status;
+  INTEGRITY_WALK      *Walk;
+  UINTN               PathLength;
+  UINTN               NameLength;
+  MANIFEST_ENTRY      *Entry;
+  UINT8               Hash[SHA256_DIGEST_SIZE];
+
+  Walk = Context;
+
+  PathLength = Walk->PathLength;
+  NameLength = StrLen (Info->FileName);
+  if (PathLength + 1 + NameLength >= BH_INTEGRITY_MAX_PATH) {
+    DEBUG ((DEBUG_WARN, "BH: Skipping %s\\%s, path too long\n", Walk->Path, Info->FileName));
+    return TRUE;
+  }
+
+  Walk->Path[PathLength] = L'\\';
+  CopyMem (&Walk->Path[PathLength + 1], Info->FileName, (NameLength + 1) * sizeof (CHAR16));
+  Walk->PathLength = PathLength + 1 + NameLength;
+
+  //
+  // Skip metadata which macOS leaves whenever it mounts the ESP (._*, .DS_Store, .fseventsd),
+  // unless it is in the manifest.
+  //
+  if (Info->FileName[0] == L'.'
+    && !IsListed (Walk->Manifest, Walk->Path, Walk->PathLength, (Info->Attribute & EFI_FILE_DIRECTORY) != 0)) {
+    Walk->PathLength = PathLength;
+    Walk->Path[PathLength] = L'\0';
+    return TRUE;
+  }
+
+  if ((Info->Attribute & EFI_FILE_DIRECTORY) != 0) {
+    //
+    // Opened relative to the directory already open, never again from the root.
+    //
+    Status = BhForEachFile (Directory, Info->FileName, CheckEntry, Walk);
+    if (EFI_ERROR (Status)) {
+      DEBUG ((DEBUG_WARN, "BH: Cannot read %s - %r\n", Walk->Path, Status));
+      Walk->Result.Unread++;
+      ShowFile (Walk, EFI_LIGHTRED, L"Unread", Walk->Path);
+    }
+  } else {
+    Walk->Result.Files++;
+    Entry = FindEntry (Walk->Manifest, Walk->Path);
+
+    Status = BhHashFile (
+      Directory,
+      Info->FileName,
+      Walk->Buffer,
+      BH_INTEGRITY_READ_SIZE,
+      Hash,
+      &Walk->Result.Bytes
+      );
+
+    //
+    // Each file counts once. An unread file is present, so not missing, but cannot be
+    // counted as matching, modified or added.
+    //
+    if (Entry != NULL) {
+      Entry->Seen = TRUE;
+    }
+    if (EFI_ERROR (Status)) {
+      DEBUG ((DEBUG_WARN, "BH: Cannot read %s - %r\n", Walk->Path, Status));
+      Walk->Result.Unread++;
+      ShowFile (Walk, EFI_LIGHTRED, L"Unread", Walk->Path);
+    } else if (Entry == NULL) {
+      Walk->Result.Added++;
+      ShowFile (Walk, EFI_YELLOW, L"Added", Walk->Path);
+    } else if (CompareMem (Hash, Entry->Hash, sizeof (Hash)) != 0) {
+      Walk->Result.Modified++;
+      ShowFile (Walk, EFI_LIGHTRED, L"Modified", Walk->Path);
+    }
+
+    if (BhProgressUpdate (Walk->Result.Files, Walk->Manifest->Count)) {
+      Walk->Status = EFI_ABORTED;
+    }
+  }
+
+  Walk->PathLength = PathLength;
+  Walk->Path[PathLength] = L'\0';
+
+  return Walk->Status != EFI_ABORTED;
+}
+
+STATIC
+VOID
+ShowResult (
+  IN OUT INTEGRITY_WALK   *Walk
+  )
+{
+  BH_INTEGRITY_RESULT   *Result;
+  UINT32                Index;
+  UINT64                Milliseconds;
+  UINT64                KilobytesPerSecond;
+
+  Result = &Walk->Result;
+
+  for (Index = 0; Index < Walk->Manifest->Count; Index++) {
+    if (!Walk->Manifest->Entries[Index].Seen) {
+      Result->Missing++;
+      ShowFile (Walk, EFI_LIGHTRED, L"Missing", Walk->Manifest->Entries[Index].Path);
+    }
+  }
+
+  ShowVolume (Walk);
+
+  Milliseconds = DivU64x32 (Result->ElapsedNs, 1000000);
+  KilobytesPerSecond = Result->ElapsedNs == 0 ? 0 : DivU64x64Remainder (MultU64x32 (Result->Bytes, 1000000), Result->ElapsedNs, NULL);
+
+  if (Result->Modified == 0 && Result->Missing == 0 && Result->Added == 0 && Result->Unread == 0) {
+    SetColour (EFI_LIGHTGREEN);
+    Print (L"  All %u files match\n", Result->Files);
+  } else {
+    SetColour (EFI_LIGHTRED);
+    Print (
+      L"  %u modified, %u missing, %u added, %u unread\n",
+      Result->Modified,
+      Result->Missing,
+      Result->Added,
+      Result->Unread
+      );
+  }
+  SetColour (EFI_WHITE);
+
+  Print (
+    L"  %u files, %lu KB in %lu ms (%lu KB/s)\n",
+    Result->Files,
+    DivU64x32 (Result->Bytes, 1024),
+    Milliseconds,
+    KilobytesPerSecond
+    );
+
+  DEBUG ((
+    DEBUG_INFO,
+    "BH: Integrity %s %u files %lu bytes %lu ms, %u/%u/%u/%u\n",
+    Walk->Volume,
+    Result->Files,
+    Result->Bytes,
+    Milliseconds,
+    Result->Modified,
+    Result->Missing,
+    Result->Added,
+    Result->Unread
+    ));
+}
+
+STATIC
+EFI_STATUS
+CheckVolume (
+  IN OUT INTEGRITY_WALK     *Walk,
+  IN     EFI_HANDLE         Handle,
+  OUT    BOOLEAN            *Checked
+  )
+{
+  EFI_STATUS                        Status;
+  EFI_SIMPLE_FILE_SYSTEM_PROTOCOL   *FileSystem;
+  EFI_FILE_PROTOCOL                 *VolumeRoot;
+  UINT32                            Index;
+  UINT64                            Start;
+
+  *Checked = FALSE;
+
+  Status = gBS->HandleProtocol (Handle, &gEfiSimpleFileSystemProtocolGuid, (VOID **) &FileSystem);
+  if (EFI_ERROR (Status)) {
+    return Status;
+  }
+
+  Status = FileSystem->OpenVolume (FileSystem, &VolumeRoot);
+  if (EFI_ERROR (Status)) {
+    return Status;
+  }
+
+  for (Index = 0; Index < Walk->Manifest->Count; Index++) {
+    Walk->Manifest->Entries[Index].Seen = FALSE;
+  }
+  ZeroMem (&Walk->Result, sizeof (Walk->Result));
+  Walk->Volume = ConvertDevicePathToText (DevicePathFromHandle (Handle), FALSE, FALSE);
+  Walk->VolumeShown = FALSE;
+  Walk->Status = EFI_SUCCESS;
+
+  Start = BhTimeNs ();
+
+  for (Index = 0; Index < ARRAY_SIZE (mIntegrityRoots); Index++) {
+    StrCpyS (Walk->Path, ARRAY_SIZE (Walk->Path), mIntegrityRoots[Index]);
+    Walk->PathLength = StrLen (Walk->Path);
+
+    Status = BhForEachFile (VolumeRoot, mIntegrityRoots[Index], CheckEntry, Walk);
+    if (Index == 0 && Status == EFI_NOT_FOUND) {
+      break;
+    }
+    *Checked = TRUE;
+
+    if (Walk->Status == EFI_ABORTED) {
+      break;
+    }
+  }
+
+  Walk->Result.ElapsedNs = BhTimeNs () - Start;
+
+  if (*Checked && Walk->Status != EFI_ABORTED) {
+    ShowResult (Walk);
+  }
+
+  VolumeRoot->Close (VolumeRoot);
+  if (Walk->Volume != NULL) {
+    FreePool (Walk->Volume);
+    Walk->Volume = NULL;
+  }
+
+  return Walk->Status;
+}
+
+EFI_STATUS
+BhIntegrityCheck (
+  IN EFI_FILE_PROTOCOL  *Root
+  )
+{
+  EFI_STATUS      Status;
+  MANIFEST        Manifest;
+  INTEGRITY_WALK  *Walk;
+  EFI_HANDLE      *Handles;
+  UINTN           HandleCount;
+  UINTN           Index;
+  UINT32          VolumeCount;
+  BOOLEAN         Checked;
+
+  Status = LoadManifest (Root, &Manifest);
+  if (Status == EFI_NOT_FOUND) {
+    Print (L"No manifest %s\n", BH_INTEGRITY_MANIFEST_PATH);
+    return EFI_SUCCESS;
+  }
+  if (EFI_ERROR (Status)) {
+    FreeManifest (&Manifest);
+    return Status;
+  }
+
+  Walk = AllocateZeroPool (sizeof (*Walk));
+  if (Walk != NULL) {
+    Walk->Buffer = AllocatePool (BH_INTEGRITY_READ_SIZE);
+  }
+  if (Walk == NULL || Walk->Buffer == NULL) {
+    if (Walk != NULL) {
+      FreePool (Walk);
+    }
+    FreeManifest (&Manifest);
+    return EFI_OUT_OF_RESOURCES;
+  }
+  Walk->Manifest = &Manifest;
+
+  Status = gBS->LocateHandleBuffer (
+    ByProtocol,
+    &gEfiSimpleFileSystemProtocolGuid,
+    NULL,
+    &HandleCount,
+    &Handles
+    );
+
+  VolumeCount = 0;
+  if (!EFI_ERROR (Status)) {
+    for (Index = 0; Index < HandleCount; Index++) {
+      Status = CheckVolume (Walk, Handles[Index], &Checked);
+      VolumeCount += Checked;
+      if (Status == EFI_ABORTED) {
+        break;
+      }
+      Status = EFI_SUCCESS;
+    }
+
+    FreePool (Handles);
+
+    if (VolumeCount == 0 && !EFI_ERROR (Status)) {
+      Print (L"No OpenCore found\n");
+    }
+  }
+
+  FreePool (Walk->Buffer);
+  FreePool (Walk);
+  FreeManifest (&Manifest);
+
+  return Status;
+}
@@ -0,0 +1,65 @@
+/** @file
+  Declaration of OpenCore ESP integrity check.
+
+  Copyright (c) 2020, Mike Beaton. All rights reserved.<BR>
+  SPDX-License-Identifier: BSD-3-Clause
+
+**/
+
+#ifndef __BH__INTEGRITY__
+#define __BH__INTEGRITY__
+
+//
+// Basic UEFI Libraries
+//
+#include <Uefi.h>
+#include <Library/UefiLib.h>
+
+#include <Protocol/SimpleFileSystem.h>
+
+//
+// Manifest under the BootHelper root, in the format written by shasum -a 256 (or sha256sum)
+// run from the root of a known good ESP, e.g.
+//   find EFI/OC EFI/BOOT -type f ! -name '.*' -exec shasum -a 256 {} +
+// Lines starting with # are ignored; paths are matched without regard to case.
+//
+#define BH_INTEGRITY_MANIFEST_PATH  L"OpenCore.sha256"
+
+//
+// Size of each sequential read while hashing, one buffer for the whole check.
+//
+#define BH_INTEGRITY_READ_SIZE      SIZE_1MB
+
+#define BH_INTEGRITY_MAX_PATH       256
+
+typedef struct BH_INTEGRITY_RESULT_ {
+  UINT32    Files;
+  UINT32    Modified;
+  UINT32    Missing;
+  UINT32    Added;
+  UINT32    Unread;             ///< Files and directories which could not be read
+  UINT64    Bytes;
+  UINT64    ElapsedNs;
+} BH_INTEGRITY_RESULT;
+
+// SHA-256 of Name in Directory, streamed through Buffer in sequential reads of up to BufferSize;
+// Bytes is increased by the number of bytes read
+EFI_STATUS
+BhHashFile (
+  IN     EFI_FILE_PROTOCOL    *Directory,
+  IN     CONST CHAR16         *Name,
+  IN     VOID                 *Buffer,
+  IN     UINTN                BufferSize,
+  OUT    UINT8                *Hash,
+  IN OUT UINT64               *Bytes
+  );
+
+// Check EFI\OC and EFI\BOOT on every volume which has EFI\OC against the manifest under Root,
+// printing each added, missing and modified file and a summary per volume; cancellable
+// within BhProgressBegin/End, returning EFI_ABORTED
+EFI_STATUS
+BhIntegrityCheck (
+  IN EFI_FILE_PROTOCOL  *Root
+  );
+
+#endif
@@ -0,0 +1,428 @@
+/** @file
+  Memory map analyzer.
+
+  Copyright (c) 2020, Mike Beaton. All rights reserved.<BR>
+  SPDX-License-Identifier: BSD-3-Clause
+
+**/
+
+//
+// Basic UEFI Libraries
+//
+#include <Uefi.h>
+#include <Library/UefiLib.h>
+#include <Library/BaseLib.h>
+#include <Library/BaseMemoryLib.h>
+#include <Library/MemoryAllocationLib.h>
+#include <Library/PrintLib.h>
+
+//
+// Boot and Runtime Services
+//
+#include <Library/UefiBootServicesTableLib.h>
+#include <Library/UefiRuntimeServicesTableLib.h>
+
+//
+// OC Libraries
+//
+#include <Library/OcDebugLogLib.h>
+
+//
+// Local includes
+//
+#include "FileUtils.h"
+#include "MemMap.h"
+#include "Platform.h"
+#include "Utils.h"
+
+//
+// Spare descriptors allowed for in the capture buffer, since the map will
+// grow a little between preallocation and capture.
+//
+#define MEMMAP_HEADROOM     64
+
+//
+// Export line, e.g. "RuntimeServicesData  0x0000000012345000-0x0000000012345FFF 0x0000000000000001 0x800000000000000F\r\n"
+//
+#define MEMMAP_LINE_SIZE    112
+
+STATIC EFI_MEMORY_DESCRIPTOR  *mMapBuffer     = NULL;
+STATIC UINTN                  mMapBufferSize  = 0;
+STATIC UINTN                  mMapSize        = 0;
+STATIC UINTN                  mDescriptorSize = 0;
+
+STATIC CONST CHAR8 *mMemoryTypeNames[] = {
+  "Reserved",
+  "LoaderCode",
+  "LoaderData",
+  "BootServicesCode",
+  "BootServicesData",
+  "RuntimeServicesCode",
+  "RuntimeServicesData",
+  "Conventional",
+  "Unusable",
+  "ACPIReclaim",
+  "ACPIMemoryNVS",
+  "MMIO",
+  "MMIOPortSpace",
+  "PalCode",
+  "Persistent"
+};
+
+STATIC
+CONST CHAR8 *
+MemoryTypeName (
+  IN UINT32   Type
+  )
+{
+  if (Type < ARRAY_SIZE (mMemoryTypeNames)) {
+    return mMemoryTypeNames[Type];
+  }
+
+  return "Other";
+}
+
+EFI_STATUS
+BhMemMapInit (
+  VOID
+  )
+{
+  EFI_STATUS  Status;
+  UINTN       MapSize;
+  UINTN       MapKey;
+  UINT32      DescriptorVersion;
+
+  if (mMapBuffer != NULL) {
+    return EFI_SUCCESS;
+  }
+
+  MapSize = 0;
+  Status = gBS->GetMemoryMap (&MapSize, NULL, &MapKey, &mDescriptorSize, &DescriptorVersion);
+  if (Status != EFI_BUFFER_TOO_SMALL) {
+    return EFI_ERROR (Status) ? Status : EFI_UNSUPPORTED;
+  }
+
+  mMapBufferSize = MapSize + MEMMAP_HEADROOM * mDescriptorSize;
+  mMapBuffer = AllocatePool (mMapBufferSize);
+  if (mMapBuffer == NULL) {
+    mMapBufferSize = 0;
+    return EFI_OUT_OF_RESOURCES;
+  }
+
+  return EFI_SUCCESS;
+}
+
+VOID
+BhMemMapFree (
+  VOID
+  )
+{
+  if (mMapBuffer != NULL) {
+    FreePool (mMapBuffer);
+    mMapBuffer = NULL;
+    mMapBufferSize = 0;
+    mMapSize = 0;
+  }
+}
+
+STATIC
+INTN
+CompareDescriptors (
+  IN VOID       *Context,
+  IN CONST VOID *Left,
+  IN CONST VOID *Right
+  )
+{
+  EFI_PHYSICAL_ADDRESS  LeftStart;
+  EFI_PHYSICAL_ADDRESS  RightStart;
+
+  LeftStart = ((CONST EFI_MEMORY_DESCRIPTOR *) Left)->PhysicalStart;
+  RightStart = ((CONST EFI_MEMORY_DESCRIPTOR *) Right)->PhysicalStart;
+
+  return LeftStart < RightStart ? -1 : (LeftStart > RightStart ? 1 : 0);
+}
+
+//
+// Keep the BH_MEMMAP_LARGEST largest regions, largest first.
+//
+STATIC
+VOID
+AddLargest (
+  IN OUT BH_MEMMAP_REGION     *Largest,
+  IN     EFI_PHYSICAL_ADDRESS Start,
+  IN     UINT64               Pages
+  )
+{
+  UINTN   Index;
+
+  for (Index = 0; Index < BH_MEMMAP_LARGEST; Index++) {
+    if (Pages > Largest[Index].Pages) {
+      CopyMem (&Largest[Index + 1], &Largest[Index], (BH_MEMMAP_LARGEST - Index - 1) * sizeof (*Largest));
+      Largest[Index].Start = Start;
+      Largest[Index].Pages = Pages;
+      return;
+    }
+  }
+}
+
+EFI_STATUS
+BhMemMapCapture (
+  OUT BH_MEMMAP_SUMMARY   *Summary
+  )
+{
+  EFI_STATUS            Status;
+  UINTN                 MapKey;
+  UINT32                DescriptorVersion;
+  UINTN                 Count;
+  UINTN                 Index;
+  UINT8                 *Read;
+  UINT8                 *Write;
+  EFI_MEMORY_DESCRIPTOR *Current;
+  EFI_MEMORY_DESCRIPTOR *Previous;
+  EFI_PHYSICAL_ADDRESS  End;
+
+  ZeroMem (Summary, sizeof (*Summary));
+
+  Status = BhMemMapInit ();
+  if (EFI_ERROR (Status)) {
+    return Status;
+  }
+
+  mMapSize = mMapBufferSize;
+  Status = gBS->GetMemoryMap (&mMapSize, mMapBuffer, &MapKey, &mDescriptorSize, &DescriptorVersion);
+  if (Status == EFI_BUFFER_TOO_SMALL) {
+    //
+    // Map outgrew the headroom; this capture is lost, but grow for next time.
+    //
+    DEBUG ((DEBUG_WARN, "BH: Memory map grew beyond preallocated buffer\n"));
+    BhMemMapFree ();
+    BhMemMapInit ();
+  }
+  if (EFI_ERROR (Status)) {
+    mMapSize = 0;
+    return Status;
+  }
+
+  Count = mMapSize / mDescriptorSize;
+  Summary->DescriptorCount = Count;
+
+  //
+  // Sort and coalesce in place; descriptor stride is mDescriptorSize, not sizeof (EFI_MEMORY_DESCRIPTOR).
+  //
+  BhSort (mMapBuffer, Count, mDescriptorSize, CompareDescriptors, NULL);
+
+  Write = (UINT8 *) mMapBuffer;
+  Read = (UINT8 *) mMapBuffer;
+  for (Index = 0; Index < Count; Index++, Read += mDescriptorSize) {
+    Current = (EFI_MEMORY_DESCRIPTOR *) Read;
+    if (Write != (UINT8 *) mMapBuffer) {
+      Previous = (EFI_MEMORY_DESCRIPTOR *) (Write - mDescriptorSize);
+      if (Previous->Type == Current->Type
+        && Previous->Attribute == Current->Attribute
+        && Previous->PhysicalStart + EFI_PAGES_TO_SIZE (Previous->NumberOfPages) == Current->PhysicalStart) {
+        Previous->NumberOfPages += Current->NumberOfPages;
+        continue;
+      }
+    }
+    if (Write != Read) {
+      CopyMem (Write, Read, mDescriptorSize);
+    }
+    Write += mDescriptorSize;
+  }
+
+  mMapSize = Write - (UINT8 *) mMapBuffer;
+  Count = mMapSize / mDescriptorSize;
+  Summary->CoalescedCount = Count;
+
+  Current = mMapBuffer;
+  for (Index = 0; Index < Count; Index++, Current = NEXT_MEMORY_DESCRIPTOR (Current, mDescriptorSize)) {
+    End = Current->PhysicalStart + EFI_PAGES_TO_SIZE (Current->NumberOfPages);
+
+    if (Current->Type == EfiRuntimeServicesCode || Current->Type == EfiRuntimeServicesData) {
+      Summary->RuntimePages += Current->NumberOfPages;
+      Summary->RuntimeRegions++;
+    } else if (Current->Type == EfiConventionalMemory) {
+      Summary->FreePages += Current->NumberOfPages;
+
+      //
+      // A region straddling 4 GB counts towards both lists.
+      //
+      if (Current->PhysicalStart < BH_MEMMAP_4G) {
+        AddLargest (
+          Summary->LargestBelow4G,
+          Current->PhysicalStart,
+          EFI_SIZE_TO_PAGES (MIN (End, BH_MEMMAP_4G) - Current->PhysicalStart)
+          );
+      }
+      if (End > BH_MEMMAP_4G) {
+        AddLargest (
+          Summary->LargestAbove4G,
+          MAX (Current->PhysicalStart, BH_MEMMAP_4G),
+          EFI_SIZE_TO_PAGES (End - MAX (Current->PhysicalStart, BH_MEMMAP_4G))
+          );
+      }
+    }
+  }
+
+  return EFI_SUCCESS;
+}
+
+STATIC
+VOID
+ShowLargest (
+  IN CONST CHAR16             *Label,
+  IN CONST BH_MEMMAP_REGION   *Largest
+  )
+{
+  UINTN   Index;
+
+  Print (L"Largest free %s:\n", Label);
+  for (Index = 0; Index < BH_MEMMAP_LARGEST && Largest[Index].Pages != 0; Index++) {
+    Print (
+      L"  0x%010lx  %8lu KiB (0x%lx pages)\n",
+      Largest[Index].Start,
+      MultU64x32 (Largest[Index].Pages, EFI_PAGE_SIZE / SIZE_1KB),
+      Largest[Index].Pages
+      );
+  }
+  if (Index == 0) {
+    Print (L"  none\n");
+  }
+}
+
+VOID
+BhMemMapShow (
+  IN CONST BH_MEMMAP_SUMMARY  *Summary
+  )
+{
+  Print (
+    L"Descriptors: %Lu (%Lu after coalescing)\n",
+    (UINT64) Summary->DescriptorCount,
+    (UINT64) Summary->CoalescedCount
+    );
+  Print (L"Free: %lu MiB\n", RShiftU64 (Summary->FreePages, 20 - EFI_PAGE_SHIFT));
+  Print (
+    L"Runtime services: %lu KiB in %Lu regions\n",
+    MultU64x32 (Summary->RuntimePages, EFI_PAGE_SIZE / SIZE_1KB),
+    (UINT64) Summary->RuntimeRegions
+    );
+  ShowLargest (L"below 4 GB", Summary->LargestBelow4G);
+  ShowLargest (L"above 4 GB", Summary->LargestAbove4G);
+}
+
+STATIC
+UINTN
+FormatLargest (
+  OUT CHAR8                   *Out,
+  IN  UINTN                   OutSize,
+  IN  CONST CHAR8             *Label,
+  IN  CONST BH_MEMMAP_REGION  *Largest
+  )
+{
+  UINTN   Index;
+  UINTN   Length;
+
+  Length = 0;
+  for (Index = 0; Index < BH_MEMMAP_LARGEST && Largest[Index].Pages != 0; Index++) {
+    Length += AsciiSPrint (
+      Out + Length,
+      OutSize - Length,
+      "# Largest free %a: 0x%016lx 0x%lx pages\r\n",
+      Label,
+      Largest[Index].Start,
+      Largest[Index].Pages
+      );
+  }
+
+  return Length;
+}
+
+EFI_STATUS
+BhMemMapExport (
+  IN  EFI_FILE_PROTOCOL         *Root,
+  IN  CONST BH_MEMMAP_SUMMARY   *Summary,
+  OUT CHAR16                    *FileName OPTIONAL,
+  IN  UINTN                     FileNameSize
+  )
+{
+  EFI_STATUS            Status;
+  EFI_TIME              Now;
+  CHAR16                Path[128];
+  CHAR8                 *Text;
+  UINTN                 TextSize;
+  UINTN                 Length;
+  UINTN                 Index;
+  UINTN                 Count;
+  EFI_MEMORY_DESCRIPTOR *Current;
+
+  if (mMapSize == 0) {
+    return EFI_NOT_READY;
+  }
+
+  Count = mMapSize / mDescriptorSize;
+
+  //
+  // Allocated only after capture, so it does not show in the exported map.
+  //
+  TextSize = (Count + 2 * BH_MEMMAP_LARGEST + 8) * MEMMAP_LINE_SIZE;
+  Text = AllocatePool (TextSize);
+  if (Text == NULL) {
+    return EFI_OUT_OF_RESOURCES;
+  }
+
+  if (EFI_ERROR (gRT->GetTime (&Now, NULL))) {
+    ZeroMem (&Now, sizeof (Now));
+  }
+
+  Length = AsciiSPrint (
+    Text,
+    TextSize,
+    "# Descriptors %Lu coalesced %Lu\r\n# Free pages 0x%lx\r\n# Runtime pages 0x%lx regions %Lu\r\n",
+    (UINT64) Summary->DescriptorCount,
+    (UINT64) Summary->CoalescedCount,
+    Summary->FreePages,
+    Summary->RuntimePages,
+    (UINT64) Summary->RuntimeRegions
+    );
+  Length += FormatLargest (Text + Length, TextSize - Length, "below 4GB", Summary->LargestBelow4G);
+  Length += FormatLargest (Text + Length, TextSize - Length, "above 4GB", Summary->LargestAbove4G);
+
+  Current = mMapBuffer;
+  for (Index = 0; Index < Count; Index++, Current = NEXT_MEMORY_DESCRIPTOR (Current, mDescriptorSize)) {
+    Length += AsciiSPrint (
+      Text + Length,
+      TextSize - Length,
+      "%-20a 0x%016lx-0x%016lx 0x%016lx 0x%016lx\r\n",
+      MemoryTypeName (Current->Type),
+      Current->PhysicalStart,
+      Current->PhysicalStart + EFI_PAGES_TO_SIZE (Current->NumberOfPages) - 1,
+      Current->NumberOfPages,
+      Current->Attribute
+      );
+  }
+
+  UnicodeSPrint (
+    Path,
+    sizeof (Path),
+    L"%s\\%g-%04u%02u%02u-%02u%02u%02u.txt",
+    BH_MEMMAP_DIRECTORY,
+    &BhGetPlatformInfo ()->SystemUuid,
+    Now.Year,
+    Now.Month,
+    Now.Day,
+    Now.Hour,
+    Now.Minute,
+    Now.Second
+    );
+
+  Status = BhWriteFile (Root, Path, Text, Length);
+  FreePool (Text);
+
+  DEBUG ((DEBUG_INFO, "BH: Memory map %s - %r\n", Path, Status));
+
+  if (!EFI_ERROR (Status) && FileName != NULL) {
+    StrCpyS (FileName, FileNameSize / sizeof (CHAR16), Path);
+  }
+
+  return Status;
+}
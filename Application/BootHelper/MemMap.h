@@ -0,0 +1,72 @@
+/** @file
+  Declaration of memory map analyzer.
+
+  Copyright (c) 2020, Mike Beaton. All rights reserved.<BR>
+  SPDX-License-Identifier: BSD-3-Clause
+
+**/
+
+#ifndef __BH__MEM_MAP__
+#define __BH__MEM_MAP__
+
+//
+// Basic UEFI Libraries
+//
+#include <Uefi.h>
+#include <Library/UefiLib.h>
+
+#include <Protocol/SimpleFileSystem.h>
+
+#define BH_MEMMAP_DIRECTORY     L"MemoryMaps"
+#define BH_MEMMAP_LARGEST       4
+#define BH_MEMMAP_4G            BASE_4GB
+
+typedef struct BH_MEMMAP_REGION_ {
+  EFI_PHYSICAL_ADDRESS  Start;
+  UINT64                Pages;
+} BH_MEMMAP_REGION;
+
+typedef struct BH_MEMMAP_SUMMARY_ {
+  UINTN             DescriptorCount;      ///< As returned by GetMemoryMap
+  UINTN             CoalescedCount;       ///< After merging adjacent descriptors of same type and attributes
+  UINT64            FreePages;            ///< EfiConventionalMemory
+  UINT64            RuntimePages;         ///< EfiRuntimeServicesCode and Data
+  UINTN             RuntimeRegions;
+  BH_MEMMAP_REGION  LargestBelow4G[BH_MEMMAP_LARGEST];
+  BH_MEMMAP_REGION  LargestAbove4G[BH_MEMMAP_LARGEST];
+} BH_MEMMAP_SUMMARY;
+
+// Preallocate the capture buffer, so that later captures do not themselves change the memory map
+EFI_STATUS
+BhMemMapInit (
+  VOID
+  );
+
+// Free capture buffer
+VOID
+BhMemMapFree (
+  VOID
+  );
+
+// Capture the memory map with a single GetMemoryMap call into the preallocated buffer, then sort, coalesce and summarise it
+EFI_STATUS
+BhMemMapCapture (
+  OUT BH_MEMMAP_SUMMARY   *Summary
+  );
+
+// Display summary of the last capture
+VOID
+BhMemMapShow (
+  IN CONST BH_MEMMAP_SUMMARY  *Summary
+  );
+
+// Write summary and coalesced map of the last capture to MemoryMaps\<machine>-<time>.txt under the BootHelper root
+EFI_STATUS
+BhMemMapExport (
+  IN  EFI_FILE_PROTOCOL         *Root,
+  IN  CONST BH_MEMMAP_SUMMARY   *Summary,
+  OUT CHAR16                    *FileName OPTIONAL,
+  IN  UINTN                     FileNameSize
+  );
+
+#endif
@@ -0,0 +1,646 @@
+/** @file
+  Sorted, front-coded NVRAM variable name dictionary.
+
+  Copyright (c) 2020, Mike Beaton. All rights reserved.<BR>
+  SPDX-License-Identifier: BSD-3-Clause
+
+**/
+
+//
+// Basic UEFI Libraries
+//
+#include <Uefi.h>
+#include <Library/BaseLib.h>
+#include <Library/BaseMemoryLib.h>
+#include <Library/MemoryAllocationLib.h>
+
+//
+// OC Libraries
+//
+#include <Library/OcDebugLogLib.h>
+
+//
+// Local includes
+//
+#include "NameDict.h"
+#include "Utils.h"
+
+//
+// Stack buffer for encoding lookup keys; longer keys are allocated.
+//
+#define NAME_DICT_KEY_BUFFER_SIZE   256
+
+typedef struct NAME_DICT_SORT_ENTRY_ {
+  UINT32    Offset;
+  UINT32    Length;
+} NAME_DICT_SORT_ENTRY;
+
+STATIC
+UINTN
+EncodedNameSize (
+  IN CONST CHAR16 *Name
+  )
+{
+  UINTN Size;
+
+  for (Size = 0; *Name != L'\0'; Name++) {
+    if (*Name < 0x80) {
+      Size += 1;
+    } else if (*Name < 0x800) {
+      Size += 2;
+    } else {
+      Size += 3;
+    }
+  }
+
+  return Size;
+}
+
+STATIC
+UINTN
+EncodeName (
+  IN  CONST CHAR16  *Name,
+  OUT UINT8         *Out
+  )
+{
+  UINT8 *Start;
+
+  Start = Out;
+
+  for (; *Name != L'\0'; Name++) {
+    if (*Name < 0x80) {
+      *Out++ = (UINT8) *Name;
+    } else if (*Name < 0x800) {
+      *Out++ = (UINT8) (0xC0 | (*Name >> 6));
+      *Out++ = (UINT8) (0x80 | (*Name & 0x3F));
+    } else {
+      *Out++ = (UINT8) (0xE0 | (*Name >> 12));
+      *Out++ = (UINT8) (0x80 | ((*Name >> 6) & 0x3F));
+      *Out++ = (UINT8) (0x80 | (*Name & 0x3F));
+    }
+  }
+
+  return Out - Start;
+}
+
+//
+// Returns number of CHAR16 written, excluding terminator, or MAX_UINTN if Buffer is too small.
+//
+STATIC
+UINTN
+DecodeName (
+  IN  CONST UINT8   *In,
+  IN  UINTN         Length,
+  OUT CHAR16        *Buffer,
+  IN  UINTN         BufferSize
+  )
+{
+  CONST UINT8 *End;
+  UINTN       Count;
+  UINTN       MaxCount;
+
+  End = In + Length;
+  MaxCount = BufferSize / sizeof (CHAR16);
+  Count = 0;
+
+  while (In < End) {
+    if (Count + 1 >= MaxCount) {
+      return MAX_UINTN;
+    }
+    if (*In < 0x80) {
+      Buffer[Count] = *In;
+      In += 1;
+    } else if (*In < 0xE0) {
+      Buffer[Count] = (CHAR16) (((In[0] & 0x1F) << 6) | (In[1] & 0x3F));
+      In += 2;
+    } else {
+      Buffer[Count] = (CHAR16) (((In[0] & 0x0F) << 12) | ((In[1] & 0x3F) << 6) | (In[2] & 0x3F));
+      In += 3;
+    }
+    Count++;
+  }
+
+  if (MaxCount == 0) {
+    return MAX_UINTN;
+  }
+
+  Buffer[Count] = L'\0';
+  return Count;
+}
+
+STATIC
+UINT8 *
+WriteVarint (
+  OUT UINT8   *Out,
+  IN  UINT32  Value
+  )
+{
+  while (Value >= 0x80) {
+    *Out++ = (UINT8) (0x80 | (Value & 0x7F));
+    Value >>= 7;
+  }
+  *Out++ = (UINT8) Value;
+  return Out;
+}
+
+STATIC
+CONST UINT8 *
+ReadVarint (
+  IN  CONST UINT8   *In,
+  OUT UINT32        *Value
+  )
+{
+  UINT32  Shift;
+
+  *Value = 0;
+  Shift = 0;
+  do {
+    *Value |= (UINT32) (*In & 0x7F) << Shift;
+    Shift += 7;
+  } while ((*In++ & 0x80) != 0);
+
+  return In;
+}
+
+STATIC
+INTN
+CompareEncoded (
+  IN CONST UINT8  *Left,
+  IN UINTN        LeftLength,
+  IN CONST UINT8  *Right,
+  IN UINTN        RightLength
+  )
+{
+  INTN  Result;
+
+  Result = CompareMem (Left, Right, MIN (LeftLength, RightLength));
+  if (Result != 0) {
+    return Result;
+  }
+
+  return (INTN) LeftLength - (INTN) RightLength;
+}
+
+STATIC
+INTN
+CompareSortEntries (
+  IN VOID       *Context,
+  IN CONST VOID *Left,
+  IN CONST VOID *Right
+  )
+{
+  CONST UINT8                 *Encoded;
+  CONST NAME_DICT_SORT_ENTRY  *LeftEntry;
+  CONST NAME_DICT_SORT_ENTRY  *RightEntry;
+
+  Encoded = Context;
+  LeftEntry = Left;
+  RightEntry = Right;
+
+  return CompareEncoded (
+    Encoded + LeftEntry->Offset,
+    LeftEntry->Length,
+    Encoded + RightEntry->Offset,
+    RightEntry->Length
+    );
+}
+
+EFI_STATUS
+BhNameDictBuild (
+  OUT BH_NAME_DICT  *Dict,
+  IN  CHAR16        **Names,
+  IN  UINT32        NameCount
+  )
+{
+  UINT8                 *Encoded;
+  UINTN                 EncodedSize;
+  NAME_DICT_SORT_ENTRY  *Entries;
+  UINT32                Index;
+  UINT32                Count;
+  UINT32                Shared;
+  UINT8                 *Out;
+  CONST UINT8           *Previous;
+  UINT32                PreviousLength;
+  CONST UINT8           *Current;
+  UINT32                CurrentLength;
+  UINT8                 *NewData;
+
+  ZeroMem (Dict, sizeof (*Dict));
+
+  EncodedSize = 0;
+  for (Index = 0; Index < NameCount; Index++) {
+    EncodedSize += EncodedNameSize (Names[Index]);
+  }
+
+  if (EncodedSize > MAX_UINT32 / 2) {
+    return EFI_OUT_OF_RESOURCES;
+  }
+
+  Encoded = AllocatePool (MAX (EncodedSize, 1));
+  Entries = AllocatePool (MAX (NameCount, 1) * sizeof (NAME_DICT_SORT_ENTRY));
+  if (Encoded == NULL || Entries == NULL) {
+    if (Encoded != NULL) {
+      FreePool (Encoded);
+    }
+    if (Entries != NULL) {
+      FreePool (Entries);
+    }
+    return EFI_OUT_OF_RESOURCES;
+  }
+
+  EncodedSize = 0;
+  for (Index = 0; Index < NameCount; Index++) {
+    Entries[Index].Offset = (UINT32) EncodedSize;
+    Entries[Index].Length = (UINT32) EncodeName (Names[Index], Encoded + EncodedSize);
+    EncodedSize += Entries[Index].Length;
+  }
+
+  BhSort (Entries, NameCount, sizeof (*Entries), CompareSortEntries, Encoded);
+
+  //
+  // Collapse duplicates (the same name is commonly present under several GUIDs).
+  //
+  Count = 0;
+  for (Index = 0; Index < NameCount; Index++) {
+    if (Count == 0 || CompareSortEntries (Encoded, &Entries[Count - 1], &Entries[Index]) != 0) {
+      Entries[Count++] = Entries[Index];
+    }
+  }
+
+  //
+  // Worst case is no shared prefixes and two maximum size varints per entry.
+  //
+  Dict->Count = Count;
+  Dict->BucketCount = (Count + BH_NAME_DICT_BUCKET_SIZE - 1) / BH_NAME_DICT_BUCKET_SIZE;
+  Dict->Data = AllocatePool (EncodedSize + (UINTN) Count * 10 + 1);
+  Dict->Buckets = AllocatePool (MAX (Dict->BucketCount, 1) * sizeof (UINT32));
+  if (Dict->Data == NULL || Dict->Buckets == NULL) {
+    FreePool (Encoded);
+    FreePool (Entries);
+    BhNameDictFree (Dict);
+    return EFI_OUT_OF_RESOURCES;
+  }
+
+  Out = Dict->Data;
+  Previous = NULL;
+  PreviousLength = 0;
+
+  for (Index = 0; Index < Count; Index++) {
+    Current = Encoded + Entries[Index].Offset;
+    CurrentLength = Entries[Index].Length;
+
+    if (CurrentLength > Dict->MaxEncodedSize) {
+      Dict->MaxEncodedSize = CurrentLength;
+    }
+
+    if (Index % BH_NAME_DICT_BUCKET_SIZE == 0) {
+      Dict->Buckets[Index / BH_NAME_DICT_BUCKET_SIZE] = (UINT32) (Out - Dict->Data);
+      Out = WriteVarint (Out, CurrentLength);
+      CopyMem (Out, Current, CurrentLength);
+      Out += CurrentLength;
+    } else {
+      for (Shared = 0; Shared < PreviousLength && Shared < CurrentLength; Shared++) {
+        if (Previous[Shared] != Current[Shared]) {
+          break;
+        }
+      }
+      Out = WriteVarint (Out, Shared);
+      Out = WriteVarint (Out, CurrentLength - Shared);
+      CopyMem (Out, Current + Shared, CurrentLength - Shared);
+      Out += CurrentLength - Shared;
+    }
+
+    Previous = Current;
+    PreviousLength = CurrentLength;
+  }
+
+  Dict->DataSize = (UINT32) (Out - Dict->Data);
+
+  //
+  // Trim to the encoded size; if that fails the larger buffer is still valid, so keep it.
+  //
+  NewData = ReallocatePool (EncodedSize + (UINTN) Count * 10 + 1, MAX (Dict->DataSize, 1), Dict->Data);
+  if (NewData != NULL) {
+    Dict->Data = NewData;
+  }
+  Dict->Scratch = AllocatePool (MAX (Dict->MaxEncodedSize, 1));
+
+  FreePool (Encoded);
+  FreePool (Entries);
+
+  if (Dict->Data == NULL || Dict->Scratch == NULL) {
+    BhNameDictFree (Dict);
+    return EFI_OUT_OF_RESOURCES;
+  }
+
+  DEBUG ((
+    DEBUG_INFO,
+    "BH: Name dictionary %u names (%u input) in %u bytes\n",
+    Dict->Count,
+    NameCount,
+    (UINT32) BhNameDictMemorySize (Dict)
+    ));
+
+  return EFI_SUCCESS;
+}
+
+VOID
+BhNameDictFree (
+  IN OUT BH_NAME_DICT *Dict
+  )
+{
+  if (Dict->Data != NULL) {
+    FreePool (Dict->Data);
+  }
+  if (Dict->Buckets != NULL) {
+    FreePool (Dict->Buckets);
+  }
+  if (Dict->Scratch != NULL) {
+    FreePool (Dict->Scratch);
+  }
+  ZeroMem (Dict, sizeof (*Dict));
+}
+
+//
+// Head of bucket, which is always stored in full.
+//
+STATIC
+CONST UINT8 *
+BucketHead (
+  IN  BH_NAME_DICT  *Dict,
+  IN  UINT32        Bucket,
+  OUT UINT32        *Length
+  )
+{
+  return ReadVarint (Dict->Data + Dict->Buckets[Bucket], Length);
+}
+
+//
+// Last bucket whose head is <= Key, or 0 if Key sorts before everything.
+//
+STATIC
+UINT32
+FindBucket (
+  IN BH_NAME_DICT   *Dict,
+  IN CONST UINT8    *Key,
+  IN UINTN          KeyLength
+  )
+{
+  UINT32        Low;
+  UINT32        High;
+  UINT32        Middle;
+  CONST UINT8   *Head;
+  UINT32        HeadLength;
+
+  Low = 0;
+  High = Dict->BucketCount;
+
+  while (High - Low > 1) {
+    Middle = Low + (High - Low) / 2;
+    Head = BucketHead (Dict, Middle, &HeadLength);
+    if (CompareEncoded (Head, HeadLength, Key, KeyLength) <= 0) {
+      Low = Middle;
+    } else {
+      High = Middle;
+    }
+  }
+
+  return Low;
+}
+
+//
+// Cursor over entries, reconstructing each full encoded name into Dict->Scratch.
+//
+typedef struct NAME_DICT_CURSOR_ {
+  BH_NAME_DICT  *Dict;
+  UINT32        Id;
+  CONST UINT8   *Next;
+  UINT32        Length;
+} NAME_DICT_CURSOR;
+
+STATIC
+VOID
+CursorStart (
+  OUT NAME_DICT_CURSOR  *Cursor,
+  IN  BH_NAME_DICT      *Dict,
+  IN  UINT32            Bucket
+  )
+{
+  Cursor->Dict = Dict;
+  Cursor->Id = Bucket * BH_NAME_DICT_BUCKET_SIZE;
+  Cursor->Next = Dict->Data + Dict->Buckets[Bucket];
+  Cursor->Length = 0;
+}
+
+STATIC
+BOOLEAN
+CursorNext (
+  IN OUT NAME_DICT_CURSOR *Cursor
+  )
+{
+  UINT32  Shared;
+  UINT32  Suffix;
+
+  if (Cursor->Id >= Cursor->Dict->Count) {
+    return FALSE;
+  }
+
+  if (Cursor->Id % BH_NAME_DICT_BUCKET_SIZE == 0) {
+    Shared = 0;
+    Cursor->Next = ReadVarint (Cursor->Next, &Suffix);
+  } else {
+    Cursor->Next = ReadVarint (Cursor->Next, &Shared);
+    Cursor->Next = ReadVarint (Cursor->Next, &Suffix);
+  }
+
+  CopyMem (Cursor->Dict->Scratch + Shared, Cursor->Next, Suffix);
+  Cursor->Next += Suffix;
+  Cursor->Length = Shared + Suffix;
+  Cursor->Id++;
+
+  return TRUE;
+}
+
+//
+// Encode Key into Buffer, or into an allocated buffer if it does not fit.
+//
+STATIC
+UINT8 *
+EncodeKey (
+  IN  CONST CHAR16  *Name,
+  IN  UINT8         *Buffer,
+  OUT UINTN         *Length
+  )
+{
+  UINTN   Size;
+  UINT8   *Key;
+
+  Size = EncodedNameSize (Name);
+  if (Size <= NAME_DICT_KEY_BUFFER_SIZE) {
+    Key = Buffer;
+  } else {
+    Key = AllocatePool (Size);
+    if (Key == NULL) {
+      return NULL;
+    }
+  }
+
+  *Length = EncodeName (Name, Key);
+  return Key;
+}
+
+BOOLEAN
+BhNameDictFind (
+  IN  BH_NAME_DICT  *Dict,
+  IN  CONST CHAR16  *Name,
+  OUT UINT32        *Id
+  )
+{
+  UINT8             Buffer[NAME_DICT_KEY_BUFFER_SIZE];
+  UINT8             *Key;
+  UINTN             KeyLength;
+  NAME_DICT_CURSOR  Cursor;
+  UINT32            End;
+  INTN              Result;
+  BOOLEAN           Found;
+
+  if (Dict->Count == 0) {
+    return FALSE;
+  }
+
+  Key = EncodeKey (Name, Buffer, &KeyLength);
+  if (Key == NULL) {
+    return FALSE;
+  }
+
+  Found = FALSE;
+
+  if (KeyLength <= Dict->MaxEncodedSize) {
+    CursorStart (&Cursor, Dict, FindBucket (Dict, Key, KeyLength));
+    End = Cursor.Id + BH_NAME_DICT_BUCKET_SIZE;
+
+    while (Cursor.Id < End && CursorNext (&Cursor)) {
+      Result = CompareEncoded (Dict->Scratch, Cursor.Length, Key, KeyLength);
+      if (Result >= 0) {
+        if (Result == 0) {
+          *Id = Cursor.Id - 1;
+          Found = TRUE;
+        }
+        break;
+      }
+    }
+  }
+
+  if (Key != Buffer) {
+    FreePool (Key);
+  }
+
+  return Found;
+}
+
+EFI_STATUS
+BhNameDictGet (
+  IN  BH_NAME_DICT  *Dict,
+  IN  UINT32        Id,
+  OUT CHAR16        *Buffer,
+  IN  UINTN         BufferSize
+  )
+{
+  NAME_DICT_CURSOR  Cursor;
+
+  if (Id >= Dict->Count) {
+    return EFI_NOT_FOUND;
+  }
+
+  CursorStart (&Cursor, Dict, Id / BH_NAME_DICT_BUCKET_SIZE);
+  do {
+    CursorNext (&Cursor);
+  } while (Cursor.Id <= Id);
+
+  if (DecodeName (Dict->Scratch, Cursor.Length, Buffer, BufferSize) == MAX_UINTN) {
+    return EFI_BUFFER_TOO_SMALL;
+  }
+
+  return EFI_SUCCESS;
+}
+
+UINTN
+BhNameDictMaxNameSize (
+  IN BH_NAME_DICT   *Dict
+  )
+{
+  //
+  // Every encoded byte decodes to at most one CHAR16.
+  //
+  return ((UINTN) Dict->MaxEncodedSize + 1) * sizeof (CHAR16);
+}
+
+EFI_STATUS
+BhNameDictIteratePrefix (
+  IN BH_NAME_DICT         *Dict,
+  IN CONST CHAR16         *Prefix,
+  IN BH_NAME_DICT_VISIT   Visit,
+  IN VOID                 *Context
+  )
+{
+  UINT8             Buffer[NAME_DICT_KEY_BUFFER_SIZE];
+  UINT8             *Key;
+  UINTN             KeyLength;
+  NAME_DICT_CURSOR  Cursor;
+  CHAR16            *Name;
+  UINTN             NameSize;
+  INTN              Result;
+  EFI_STATUS        Status;
+
+  if (Dict->Count == 0) {
+    return EFI_SUCCESS;
+  }
+
+  Key = EncodeKey (Prefix, Buffer, &KeyLength);
+  NameSize = BhNameDictMaxNameSize (Dict);
+  Name = AllocatePool (NameSize);
+  if (Key == NULL || Name == NULL) {
+    Status = EFI_OUT_OF_RESOURCES;
+  } else {
+    Status = EFI_SUCCESS;
+    CursorStart (&Cursor, Dict, FindBucket (Dict, Key, KeyLength));
+
+    while (CursorNext (&Cursor)) {
+      if (Cursor.Length >= KeyLength
+        && CompareMem (Dict->Scratch, Key, KeyLength) == 0) {
+        DecodeName (Dict->Scratch, Cursor.Length, Name, NameSize);
+        if (!Visit (Context, Cursor.Id - 1, Name)) {
+          break;
+        }
+      } else {
+        //
+        // Names before the first match are skipped; the first non-match after it ends the run.
+        //
+        Result = CompareEncoded (Dict->Scratch, Cursor.Length, Key, KeyLength);
+        if (Result > 0) {
+          break;
+        }
+      }
+    }
+  }
+
+  if (Key != NULL && Key != Buffer) {
+    FreePool (Key);
+  }
+  if (Name != NULL) {
+    FreePool (Name);
+  }
+
+  return Status;
+}
+
+UINTN
+BhNameDictMemorySize (
+  IN BH_NAME_DICT   *Dict
+  )
+{
+  return sizeof (*Dict)
+    + Dict->DataSize
+    + (UINTN) Dict->BucketCount * sizeof (UINT32)
+    + Dict->MaxEncodedSize;
+}
@@ -0,0 +1,103 @@
+/** @file
+  Declaration of sorted, front-coded NVRAM variable name dictionary.
+
+  Copyright (c) 2020, Mike Beaton. All rights reserved.<BR>
+  SPDX-License-Identifier: BSD-3-Clause
+
+**/
+
+#ifndef __BH__NAME_DICT__
+#define __BH__NAME_DICT__
+
+//
+// Basic UEFI Libraries
+//
+#include <Uefi.h>
+#include <Library/UefiLib.h>
+
+//
+// Number of names per front-coded bucket; the first name in each bucket is
+// stored in full and acts as the binary search key for the bucket.
+//
+#define BH_NAME_DICT_BUCKET_SIZE    16
+
+//
+// Names are held as an order-preserving byte encoding of their CHAR16 code
+// units: plain ASCII is one byte, wider chars are escaped as a two or three
+// byte sequence whose lead byte is >= 0xC0 (UTF-8 style). Byte order of the
+// encoded form therefore matches StrCmp order of the original names, so
+// searching never needs to decode more than one bucket.
+//
+typedef struct BH_NAME_DICT_ {
+  UINT8     *Data;              ///< Concatenated front-coded buckets
+  UINT32    DataSize;
+  UINT32    *Buckets;           ///< Offset of each bucket head within Data
+  UINT32    BucketCount;
+  UINT32    Count;              ///< Number of distinct names
+  UINT32    MaxEncodedSize;     ///< Longest encoded name, in bytes
+  UINT8     *Scratch;           ///< MaxEncodedSize bytes, used while scanning a bucket
+} BH_NAME_DICT;
+
+// Called for each name visited by BhNameDictIteratePrefix; return FALSE to stop
+typedef
+BOOLEAN
+(*BH_NAME_DICT_VISIT) (
+  IN VOID           *Context,
+  IN UINT32         Id,
+  IN CONST CHAR16   *Name
+  );
+
+// Build dictionary from an unsorted array of names; duplicate names are stored once.
+// Ids are assigned in sorted order, 0 to Dict->Count - 1.
+EFI_STATUS
+BhNameDictBuild (
+  OUT BH_NAME_DICT  *Dict,
+  IN  CHAR16        **Names,
+  IN  UINT32        NameCount
+  );
+
+// Free dictionary storage
+VOID
+BhNameDictFree (
+  IN OUT BH_NAME_DICT *Dict
+  );
+
+// Look up Id of a name, by binary search over the compressed form
+BOOLEAN
+BhNameDictFind (
+  IN  BH_NAME_DICT  *Dict,
+  IN  CONST CHAR16  *Name,
+  OUT UINT32        *Id
+  );
+
+// Decode the name with the given Id into Buffer (BufferSize in bytes, including terminator)
+EFI_STATUS
+BhNameDictGet (
+  IN  BH_NAME_DICT  *Dict,
+  IN  UINT32        Id,
+  OUT CHAR16        *Buffer,
+  IN  UINTN         BufferSize
+  );
+
+// Size in bytes of a buffer large enough for any name returned by BhNameDictGet
+UINTN
+BhNameDictMaxNameSize (
+  IN BH_NAME_DICT   *Dict
+  );
+
+// Visit all names starting with Prefix in sorted order, decoding only the buckets which can match
+EFI_STATUS
+BhNameDictIteratePrefix (
+  IN BH_NAME_DICT         *Dict,
+  IN CONST CHAR16         *Prefix,
+  IN BH_NAME_DICT_VISIT   Visit,
+  IN VOID                 *Context
+  );
+
+// Total bytes held by the dictionary
+UINTN
+BhNameDictMemorySize (
+  IN BH_NAME_DICT   *Dict
+  );
+
+#endif
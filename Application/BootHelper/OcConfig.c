@@ -0,0 +1,905 @@
+/** @file
+  OpenCore config.plist access and validation.
+
+  The machine's OpenCore configuration is read and parsed with OcConfigurationLib
+  the first time any screen needs it, and the parsed result is kept for the rest
+  of the session. Validation checks the plist structure and then the settings
+  themselves, in the manner of ocvalidate, and reports each problem with its key
+  path.
+
+  Copyright (c) 2020, Mike Beaton. All rights reserved.<BR>
+  SPDX-License-Identifier: BSD-3-Clause
+
+**/
+
+//
+// Basic UEFI Libraries
+//
+#include <Uefi.h>
+#include <Library/UefiLib.h>
+#include <Library/BaseLib.h>
+#include <Library/BaseMemoryLib.h>
+#include <Library/DevicePathLib.h>
+#include <Library/MemoryAllocationLib.h>
+#include <Library/PrintLib.h>
+
+//
+// Boot and Runtime Services
+//
+#include <Library/UefiBootServicesTableLib.h>
+
+//
+// OC Libraries
+//
+#include <Library/OcDebugLogLib.h>
+#include <Library/OcXmlLib.h>
+
+//
+// Local includes
+//
+#include "DisplayVars.h"
+#include "FileUtils.h"
+#include "OcConfig.h"
+#include "Utils.h"
+#include "VarEngine.h"
+
+#define NO_INDEX                    MAX_UINT32
+#define OC_CONFIG_MAX_PATH          256
+#define OC_CONFIG_MAX_NAME          128
+
+#define APPLE_BOOT_VARIABLE_GUID \
+  { 0x7c436110, 0xab2a, 0x4bbb, {0xa8, 0x80, 0xfe, 0x41, 0x99, 0x5c, 0x9f, 0x82} }
+STATIC EFI_GUID mAppleBootVariableGuid = APPLE_BOOT_VARIABLE_GUID;
+
+//
+// Top level sections of OpenCore config.plist.
+//
+STATIC
+CONST CHAR8 *
+mOcSections[] = {
+  "ACPI",
+  "Booter",
+  "DeviceProperties",
+  "Kernel",
+  "Misc",
+  "NVRAM",
+  "PlatformInfo",
+  "UEFI"
+};
+
+STATIC CONST CHAR8 *mVaultChoices[]           = { "Optional", "Basic", "Secure", NULL };
+STATIC CONST CHAR8 *mDmgLoadingChoices[]      = { "Disabled", "Signed", "Any", NULL };
+STATIC CONST CHAR8 *mBootProtectChoices[]     = { "None", "Bootstrap", "BootstrapShort", NULL };
+STATIC CONST CHAR8 *mHibernateModeChoices[]   = { "None", "Auto", "RTC", "NVRAM", NULL };
+STATIC CONST CHAR8 *mPickerModeChoices[]      = { "Builtin", "External", "Apple", NULL };
+
+//
+// Apple boot variables which are normally already set when OpenCore starts, so that
+// NVRAM/Add has no effect on them unless they are also in NVRAM/Delete. Other Add
+// entries without Delete are routine (e.g. prev-lang:kbd in Sample.plist).
+//
+STATIC CONST CHAR8 *mPresetAppleVars[]        = { "boot-args", "csr-active-config", NULL };
+
+//
+// OC_SCAN_* bits known to ScanPolicy.
+//
+#define OC_CONFIG_SCAN_POLICY_KNOWN 0x01FF7F03U
+
+STATIC EFI_HANDLE         mPreferredHandle    = NULL;
+STATIC EFI_STATUS         mOcConfigStatus     = EFI_NOT_STARTED;
+STATIC OC_GLOBAL_CONFIG   mOcConfig;
+STATIC EFI_FILE_PROTOCOL  *mOcRoot            = NULL;
+STATIC CHAR16             *mOcVolume          = NULL;
+STATIC UINT32             mOcConfigSize       = 0;
+STATIC BOOLEAN            mOcConfigIsPlist    = FALSE;
+STATIC UINT32             mMissingSections    = 0;
+STATIC CHAR8              *mUnknownKeys[BH_OC_MAX_UNKNOWN_KEYS];
+STATIC UINT32             mUnknownKeyCount    = 0;
+STATIC UINT32             mProblemCount       = 0;
+
+STATIC
+VOID
+Problem (
+  IN CONST CHAR8    *Section,
+  IN UINT32         Index,
+  IN CONST CHAR8    *Field OPTIONAL,
+  IN CONST CHAR8    *Value OPTIONAL,
+  IN CONST CHAR16   *Message
+  )
+{
+  mProblemCount++;
+
+  SetColour (EFI_LIGHTRED);
+  Print (L"  %a", Section);
+  if (Index != NO_INDEX) {
+    Print (L"[%u]", Index);
+  }
+  if (Field != NULL) {
+    Print (L"/%a", Field);
+  }
+  if (Value != NULL) {
+    Print (L" %a", Value);
+  }
+  Print (L": %s\n", Message);
+  SetColour (EFI_WHITE);
+}
+
+//
+// Check for a file under EFI\OC\Directory (or EFI\OC if Directory is NULL), given its OpenCore
+// relative path, which uses / or \.
+//
+STATIC
+BOOLEAN
+OcFileExists (
+  IN CONST CHAR16   *Directory OPTIONAL,
+  IN CONST CHAR8    *Name,
+  IN CONST CHAR8    *SubPath OPTIONAL
+  )
+{
+  EFI_STATUS          Status;
+  EFI_FILE_PROTOCOL   *File;
+  CHAR16              Path[OC_CONFIG_MAX_PATH];
+  UINTN               Index;
+
+  UnicodeSPrint (
+    Path,
+    sizeof (Path),
+    L"%s%s%s\\%a%a%a",
+    BH_OC_DIRECTORY,
+    Directory == NULL ? L"" : L"\\",
+    Directory == NULL ? L"" : Directory,
+    Name,
+    SubPath == NULL ? "" : "\\",
+    SubPath == NULL ? "" : SubPath
+    );
+
+  for (Index = 0; Path[Index] != L'\0'; Index++) {
+    if (Path[Index] == L'/') {
+      Path[Index] = L'\\';
+    }
+  }
+
+  Status = BhOpenFile (mOcRoot, Path, &File, FALSE);
+  if (EFI_ERROR (Status)) {
+    return FALSE;
+  }
+
+  File->Close (File);
+  return TRUE;
+}
+
+STATIC
+VOID
+CheckChoice (
+  IN CONST CHAR8    *Section,
+  IN CONST CHAR8    *Field,
+  IN CONST OC_STRING *Value,
+  IN CONST CHAR8    **Choices
+  )
+{
+  CONST CHAR8   *String;
+  UINT32        Index;
+
+  String = OC_BLOB_GET (Value);
+  for (Index = 0; Choices[Index] != NULL; Index++) {
+    if (AsciiStrCmp (String, Choices[Index]) == 0) {
+      return;
+    }
+  }
+
+  Problem (Section, NO_INDEX, Field, String, L"is not a recognised value");
+}
+
+//
+// Report each repeated name among Names; NULL names (disabled entries) are not compared.
+//
+STATIC
+VOID
+CheckDuplicates (
+  IN CONST CHAR8    *Section,
+  IN CONST CHAR8    *Field OPTIONAL,
+  IN CONST CHAR8    **Names,
+  IN UINT32         Count
+  )
+{
+  UINT32  Index;
+  UINT32  Earlier;
+
+  for (Index = 1; Index < Count; Index++) {
+    if (Names[Index] == NULL) {
+      continue;
+    }
+    for (Earlier = 0; Earlier < Index; Earlier++) {
+      if (Names[Earlier] != NULL && AsciiStrCmp (Names[Index], Names[Earlier]) == 0) {
+        Problem (Section, Index, Field, Names[Index], L"is a duplicate");
+        break;
+      }
+    }
+  }
+}
+
+STATIC
+VOID
+CheckAcpi (
+  IN CONST OC_GLOBAL_CONFIG *Config
+  )
+{
+  CONST OC_ACPI_ADD_ENTRY   *Entry;
+  CONST CHAR8               **Names;
+  CONST CHAR8               *Path;
+  UINT32                    Index;
+
+  Names = AllocateZeroPool (MAX (Config->Acpi.Add.Count, 1) * sizeof (*Names));
+  if (Names == NULL) {
+    return;
+  }
+
+  for (Index = 0; Index < Config->Acpi.Add.Count; Index++) {
+    Entry = Config->Acpi.Add.Values[Index];
+    if (!Entry->Enabled) {
+      continue;
+    }
+
+    Path = OC_BLOB_GET (&Entry->Path);
+    Names[Index] = Path;
+    if (Path[0] == '\0') {
+      Problem ("ACPI/Add", Index, "Path", NULL, L"is empty");
+    } else if (!OcFileExists (L"ACPI", Path, NULL)) {
+      Problem ("ACPI/Add", Index, "Path", Path, L"not found in EFI\\OC\\ACPI");
+    }
+  }
+
+  CheckDuplicates ("ACPI/Add", "Path", Names, Config->Acpi.Add.Count);
+  FreePool ((VOID *) Names);
+}
+
+STATIC
+VOID
+CheckKernel (
+  IN CONST OC_GLOBAL_CONFIG *Config
+  )
+{
+  CONST OC_KERNEL_ADD_ENTRY   *Entry;
+  CONST CHAR8                 **Names;
+  CONST CHAR8                 *Bundle;
+  CONST CHAR8                 *Executable;
+  CONST CHAR8                 *Plist;
+  UINT32                      Index;
+
+  Names = AllocateZeroPool (MAX (Config->Kernel.Add.Count, 1) * sizeof (*Names));
+  if (Names == NULL) {
+    return;
+  }
+
+  for (Index = 0; Index < Config->Kernel.Add.Count; Index++) {
+    Entry = Config->Kernel.Add.Values[Index];
+    if (!Entry->Enabled) {
+      continue;
+    }
+
+    Bundle = OC_BLOB_GET (&Entry->BundlePath);
+    Executable = OC_BLOB_GET (&Entry->ExecutablePath);
+    Plist = OC_BLOB_GET (&Entry->PlistPath);
+    Names[Index] = Bundle;
+
+    if (Bundle[0] == '\0') {
+      Problem ("Kernel/Add", Index, "BundlePath", NULL, L"is empty");
+      continue;
+    }
+
+    if (Plist[0] == '\0') {
+      Problem ("Kernel/Add", Index, "PlistPath", NULL, L"is empty");
+    } else if (!OcFileExists (L"Kexts", Bundle, Plist)) {
+      Problem ("Kernel/Add", Index, "PlistPath", Plist, L"not found in bundle");
+    }
+
+    //
+    // Codeless kexts have no executable.
+    //
+    if (Executable[0] != '\0' && !OcFileExists (L"Kexts", Bundle, Executable)) {
+      Problem ("Kernel/Add", Index, "ExecutablePath", Executable, L"not found in bundle");
+    }
+  }
+
+  CheckDuplicates ("Kernel/Add", "BundlePath", Names, Config->Kernel.Add.Count);
+  FreePool ((VOID *) Names);
+}
+
+STATIC
+VOID
+CheckUefi (
+  IN CONST OC_GLOBAL_CONFIG *Config
+  )
+{
+  CONST CHAR8   **Names;
+  CONST CHAR8   *Driver;
+  UINT32        Index;
+
+  Names = AllocateZeroPool (MAX (Config->Uefi.Drivers.Count, 1) * sizeof (*Names));
+  if (Names == NULL) {
+    return;
+  }
+
+  for (Index = 0; Index < Config->Uefi.Drivers.Count; Index++) {
+    Driver = OC_BLOB_GET (Config->Uefi.Drivers.Values[Index]);
+
+    //
+    // OpenCore skips drivers starting with #, as a way to disable them.
+    //
+    if (Driver[0] == '#') {
+      continue;
+    }
+
+    Names[Index] = Driver;
+    if (Driver[0] == '\0') {
+      Problem ("UEFI/Drivers", Index, NULL, NULL, L"is empty");
+    } else if (!OcFileExists (L"Drivers", Driver, NULL)) {
+      Problem ("UEFI/Drivers", Index, NULL, Driver, L"not found in EFI\\OC\\Drivers");
+    }
+  }
+
+  CheckDuplicates ("UEFI/Drivers", NULL, Names, Config->Uefi.Drivers.Count);
+  FreePool ((VOID *) Names);
+}
+
+STATIC
+VOID
+CheckMisc (
+  IN CONST OC_GLOBAL_CONFIG *Config
+  )
+{
+  CONST OC_MISC_TOOLS_ENTRY   *Entry;
+  CONST CHAR8                 *Vault;
+  CONST CHAR8                 *Path;
+  UINT32                      Index;
+
+  CheckChoice ("Misc/Boot", "HibernateMode", &Config->Misc.Boot.HibernateMode, mHibernateModeChoices);
+  CheckChoice ("Misc/Boot", "PickerMode", &Config->Misc.Boot.PickerMode, mPickerModeChoices);
+  CheckChoice ("Misc/Security", "BootProtect", &Config->Misc.Security.BootProtect, mBootProtectChoices);
+  CheckChoice ("Misc/Security", "DmgLoading", &Config->Misc.Security.DmgLoading, mDmgLoadingChoices);
+  CheckChoice ("Misc/Security", "Vault", &Config->Misc.Security.Vault, mVaultChoices);
+
+  if ((Config->Misc.Security.ScanPolicy & ~OC_CONFIG_SCAN_POLICY_KNOWN) != 0) {
+    Problem ("Misc/Security", NO_INDEX, "ScanPolicy", NULL, L"has unknown bits set");
+  }
+
+  //
+  // With a vault, OpenCore will not start at all if the vault files are missing.
+  //
+  Vault = OC_BLOB_GET (&Config->Misc.Security.Vault);
+  if (AsciiStrCmp (Vault, "Optional") != 0) {
+    if (!OcFileExists (NULL, "vault.plist", NULL)) {
+      Problem ("Misc/Security", NO_INDEX, "Vault", Vault, L"needs EFI\\OC\\vault.plist, which is not present");
+    }
+    if (AsciiStrCmp (Vault, "Secure") == 0 && !OcFileExists (NULL, "vault.sig", NULL)) {
+      Problem ("Misc/Security", NO_INDEX, "Vault", Vault, L"needs EFI\\OC\\vault.sig, which is not present");
+    }
+  }
+
+  for (Index = 0; Index < Config->Misc.Tools.Count; Index++) {
+    Entry = Config->Misc.Tools.Values[Index];
+    if (!Entry->Enabled) {
+      continue;
+    }
+
+    Path = OC_BLOB_GET (&Entry->Path);
+    if (Path[0] == '\0') {
+      Problem ("Misc/Tools", Index, "Path", NULL, L"is empty");
+    } else if (!OcFileExists (L"Tools", Path, NULL)) {
+      Problem ("Misc/Tools", Index, "Path", Path, L"not found in EFI\\OC\\Tools");
+    }
+  }
+
+  for (Index = 0; Index < Config->Misc.Entries.Count; Index++) {
+    Entry = Config->Misc.Entries.Values[Index];
+    if (Entry->Enabled && OC_BLOB_GET (&Entry->Path)[0] == '\0') {
+      Problem ("Misc/Entries", Index, "Path", NULL, L"is empty");
+    }
+  }
+}
+
+STATIC
+BOOLEAN
+IsDeleted (
+  IN CONST OC_GLOBAL_CONFIG *Config,
+  IN CONST EFI_GUID         *Guid,
+  IN CONST CHAR8            *Name
+  )
+{
+  CONST OC_NVRAM_DELETE_ENTRY   *Delete;
+  EFI_GUID                      DeleteGuid;
+  UINT32                        Index;
+  UINT32                        Entry;
+
+  for (Index = 0; Index < Config->Nvram.Delete.Count; Index++) {
+    if (EFI_ERROR (AsciiStrToGuid (OC_BLOB_GET (Config->Nvram.Delete.Keys[Index]), &DeleteGuid))
+      || !CompareGuid (&DeleteGuid, Guid)) {
+      continue;
+    }
+
+    Delete = Config->Nvram.Delete.Values[Index];
+    for (Entry = 0; Entry < Delete->Count; Entry++) {
+      if (AsciiStrCmp (OC_BLOB_GET (Delete->Values[Entry]), Name) == 0) {
+        return TRUE;
+      }
+    }
+  }
+
+  return FALSE;
+}
+
+STATIC
+BOOLEAN
+IsPresetAppleVar (
+  IN CONST CHAR8  *Name
+  )
+{
+  UINT32  Index;
+
+  for (Index = 0; mPresetAppleVars[Index] != NULL; Index++) {
+    if (AsciiStrCmp (mPresetAppleVars[Index], Name) == 0) {
+      return TRUE;
+    }
+  }
+
+  return FALSE;
+}
+
+STATIC
+VOID
+CheckNvram (
+  IN CONST OC_GLOBAL_CONFIG *Config
+  )
+{
+  CONST OC_ASSOC  *Vars;
+  CONST CHAR8     *GuidString;
+  CONST CHAR8     *Name;
+  EFI_GUID        Guid;
+  UINT32          Index;
+  UINT32          Var;
+
+  for (Index = 0; Index < Config->Nvram.Add.Count; Index++) {
+    GuidString = OC_BLOB_GET (Config->Nvram.Add.Keys[Index]);
+    if (EFI_ERROR (AsciiStrToGuid (GuidString, &Guid))) {
+      Problem ("NVRAM/Add", NO_INDEX, GuidString, NULL, L"is not a valid GUID");
+      continue;
+    }
+
+    Vars = Config->Nvram.Add.Values[Index];
+    for (Var = 0; Var < Vars->Count; Var++) {
+      Name = OC_BLOB_GET (Vars->Keys[Var]);
+
+      if (CompareGuid (&Guid, &mAppleBootVariableGuid)
+        && AsciiStrCmp (Name, "csr-active-config") == 0
+        && Vars->Values[Var]->Size != sizeof (UINT32)) {
+        Problem ("NVRAM/Add", NO_INDEX, GuidString, Name, L"should be 4 bytes of data");
+      }
+
+      //
+      // OpenCore does not overwrite a variable which already exists unless it is deleted first.
+      //
+      if (CompareGuid (&Guid, &mAppleBootVariableGuid)
+        && IsPresetAppleVar (Name)
+        && !IsDeleted (Config, &Guid, Name)) {
+        Problem ("NVRAM/Add", NO_INDEX, GuidString, Name, L"is not in NVRAM/Delete, so will not replace an existing value");
+      }
+    }
+  }
+}
+
+//
+// Find top level sections in the raw plist, on a copy, as parsing modifies the buffer.
+//
+STATIC
+VOID
+CheckStructure (
+  IN CONST VOID   *Data,
+  IN UINT32       Size
+  )
+{
+  CHAR8           *Copy;
+  XML_DOCUMENT    *Document;
+  XML_NODE        *Root;
+  XML_NODE        *Value;
+  CONST CHAR8     *Key;
+  UINT32          Found;
+  UINT32          Index;
+  UINT32          Section;
+
+  Copy = AllocateCopyPool (Size, Data);
+  if (Copy == NULL) {
+    return;
+  }
+
+  Document = XmlDocumentParse (Copy, Size, FALSE);
+  Root = Document == NULL ? NULL : PlistNodeCast (PlistDocumentRoot (Document), PLIST_NODE_TYPE_DICT);
+  mOcConfigIsPlist = Root != NULL;
+
+  Found = 0;
+  if (Root != NULL) {
+    for (Index = 0; Index < PlistDictChildren (Root); Index++) {
+      Key = PlistKeyValue (PlistDictChild (Root, Index, &Value));
+      if (Key == NULL || Key[0] == '#') {
+        continue;
+      }
+
+      for (Section = 0; Section < ARRAY_SIZE (mOcSections); Section++) {
+        if (AsciiStrCmp (Key, mOcSections[Section]) == 0) {
+          Found |= 1U << Section;
+          break;
+        }
+      }
+
+      if (Section == ARRAY_SIZE (mOcSections) && mUnknownKeyCount < BH_OC_MAX_UNKNOWN_KEYS) {
+        mUnknownKeys[mUnknownKeyCount] = AllocateCopyPool (AsciiStrSize (Key), Key);
+        if (mUnknownKeys[mUnknownKeyCount] != NULL) {
+          mUnknownKeyCount++;
+        }
+      }
+    }
+
+    mMissingSections = ((1U << ARRAY_SIZE (mOcSections)) - 1) & ~Found;
+  }
+
+  if (Document != NULL) {
+    XmlDocumentFree (Document);
+  }
+  FreePool (Copy);
+}
+
+STATIC
+EFI_STATUS
+ReadFromVolume (
+  IN  EFI_HANDLE          Handle,
+  OUT VOID                **Data,
+  OUT UINTN               *Size
+  )
+{
+  EFI_STATUS                        Status;
+  EFI_SIMPLE_FILE_SYSTEM_PROTOCOL   *FileSystem;
+  EFI_FILE_PROTOCOL                 *Root;
+
+  Status = gBS->HandleProtocol (Handle, &gEfiSimpleFileSystemProtocolGuid, (VOID **) &FileSystem);
+  if (EFI_ERROR (Status)) {
+    return Status;
+  }
+
+  Status = FileSystem->OpenVolume (FileSystem, &Root);
+  if (EFI_ERROR (Status)) {
+    return Status;
+  }
+
+  Status = BhReadFile (Root, BH_OC_CONFIG_PATH, Data, Size);
+  if (EFI_ERROR (Status)) {
+    Root->Close (Root);
+    return Status;
+  }
+
+  //
+  // Volume is kept open for checking files referenced by the configuration.
+  //
+  mOcRoot = Root;
+  mOcVolume = ConvertDevicePathToText (DevicePathFromHandle (Handle), FALSE, FALSE);
+
+  return EFI_SUCCESS;
+}
+
+STATIC
+EFI_STATUS
+ReadConfig (
+  OUT VOID                **Data,
+  OUT UINTN               *Size
+  )
+{
+  EFI_STATUS    Status;
+  EFI_HANDLE    *Handles;
+  UINTN         HandleCount;
+  UINTN         Index;
+
+  if (mPreferredHandle != NULL) {
+    Status = ReadFromVolume (mPreferredHandle, Data, Size);
+    if (!EFI_ERROR (Status)) {
+      return Status;
+    }
+  }
+
+  Status = gBS->LocateHandleBuffer (
+    ByProtocol,
+    &gEfiSimpleFileSystemProtocolGuid,
+    NULL,
+    &HandleCount,
+    &Handles
+    );
+  if (EFI_ERROR (Status)) {
+    return Status;
+  }
+
+  Status = EFI_NOT_FOUND;
+  for (Index = 0; Index < HandleCount; Index++) {
+    if (Handles[Index] == mPreferredHandle) {
+      continue;
+    }
+
+    Status = ReadFromVolume (Handles[Index], Data, Size);
+    if (!EFI_ERROR (Status)) {
+      break;
+    }
+    Status = EFI_NOT_FOUND;
+  }
+
+  FreePool (Handles);
+  return Status;
+}
+
+VOID
+BhOcConfigInit (
+  IN EFI_HANDLE   PreferredHandle OPTIONAL
+  )
+{
+  mPreferredHandle = PreferredHandle;
+}
+
+EFI_STATUS
+BhOcConfigGet (
+  OUT CONST OC_GLOBAL_CONFIG  **Config
+  )
+{
+  VOID    *Data;
+  UINTN   Size;
+
+  *Config = &mOcConfig;
+
+  if (mOcConfigStatus != EFI_NOT_STARTED) {
+    return mOcConfigStatus;
+  }
+
+  mOcConfigStatus = ReadConfig (&Data, &Size);
+  if (EFI_ERROR (mOcConfigStatus)) {
+    DEBUG ((DEBUG_INFO, "BH: No OpenCore configuration - %r\n", mOcConfigStatus));
+    return mOcConfigStatus;
+  }
+
+  mOcConfigSize = (UINT32) Size;
+  CheckStructure (Data, mOcConfigSize);
+
+  mOcConfigStatus = OcConfigurationInit (&mOcConfig, Data, mOcConfigSize);
+  FreePool (Data);
+
+  DEBUG ((DEBUG_INFO, "BH: OpenCore configuration %u bytes on %s - %r\n", mOcConfigSize, mOcVolume, mOcConfigStatus));
+
+  return mOcConfigStatus;
+}
+
+EFI_STATUS
+BhOcConfigVolume (
+  OUT EFI_FILE_PROTOCOL       **Root,
+  OUT CONST CHAR16            **Volume OPTIONAL
+  )
+{
+  CONST OC_GLOBAL_CONFIG  *Config;
+
+  BhOcConfigGet (&Config);
+
+  if (mOcRoot == NULL) {
+    return EFI_NOT_FOUND;
+  }
+
+  *Root = mOcRoot;
+  if (Volume != NULL) {
+    *Volume = mOcVolume != NULL ? mOcVolume : L"(unknown)";
+  }
+
+  return EFI_SUCCESS;
+}
+
+EFI_STATUS
+BhOcConfigValidate (
+  OUT UINT32                  *ProblemCount
+  )
+{
+  EFI_STATUS              Status;
+  CONST OC_GLOBAL_CONFIG  *Config;
+  UINT32                  Index;
+
+  *ProblemCount = 0;
+  mProblemCount = 0;
+
+  Status = BhOcConfigGet (&Config);
+  if (Status == EFI_NOT_FOUND) {
+    Print (L"No %s on any volume\n", BH_OC_CONFIG_PATH);
+    return EFI_SUCCESS;
+  }
+
+  if (mOcRoot == NULL) {
+    return Status;
+  }
+
+  Print (L"%s on %s, %u bytes\n", BH_OC_CONFIG_PATH, mOcVolume, mOcConfigSize);
+
+  if (!mOcConfigIsPlist) {
+    Problem ("config.plist", NO_INDEX, NULL, NULL, L"is not a valid plist with a dictionary at the root");
+  }
+
+  for (Index = 0; Index < ARRAY_SIZE (mOcSections); Index++) {
+    if ((mMissingSections & (1U << Index)) != 0) {
+      Problem (mOcSections[Index], NO_INDEX, NULL, NULL, L"section is missing");
+    }
+  }
+
+  for (Index = 0; Index < mUnknownKeyCount; Index++) {
+    Problem (mUnknownKeys[Index], NO_INDEX, NULL, NULL, L"is not a known section");
+  }
+
+  if (!EFI_ERROR (Status)) {
+    CheckAcpi (Config);
+    CheckKernel (Config);
+    CheckMisc (Config);
+    CheckNvram (Config);
+    CheckUefi (Config);
+  } else if (mOcConfigIsPlist) {
+    Problem ("config.plist", NO_INDEX, NULL, NULL, L"could not be parsed");
+  }
+
+  if (mProblemCount == 0) {
+    SetColour (EFI_LIGHTGREEN);
+    Print (L"No problems found\n");
+  } else {
+    SetColour (EFI_LIGHTRED);
+    Print (L"%u problems found\n", mProblemCount);
+  }
+  SetColour (EFI_WHITE);
+
+  *ProblemCount = mProblemCount;
+  return EFI_SUCCESS;
+}
+
+STATIC
+VOID
+ShowNvramValue (
+  IN CONST CHAR16   *Label,
+  IN CONST CHAR16   *Name,
+  IN EFI_GUID       *Guid,
+  IN CONST VOID     *Data,
+  IN UINTN          Size
+  )
+{
+  CHAR16  *Value;
+
+  Value = FormatNvramValue (Name, Guid, (VOID *) Data, Size);
+  Print (L"  %s %s\n", Label, Value == NULL ? L"?" : Value);
+  if (Value != NULL) {
+    FreePool (Value);
+  }
+}
+
+EFI_STATUS
+BhOcConfigShowNvram (
+  VOID
+  )
+{
+  EFI_STATUS              Status;
+  CONST OC_GLOBAL_CONFIG  *Config;
+  BH_VAR_STORE            *Store;
+  BH_VAR_ENTRY            *Entry;
+  CONST OC_ASSOC          *Vars;
+  CONST OC_DATA           *Value;
+  CONST CHAR8             *Name;
+  CHAR16                  Name16[OC_CONFIG_MAX_NAME];
+  EFI_GUID                Guid;
+  UINT32                  Index;
+  UINT32                  Var;
+  UINTN                   Char;
+
+  Status = BhOcConfigGet (&Config);
+  if (EFI_ERROR (Status)) {
+    return Status;
+  }
+
+  Status = BhVarCacheGet (&Store);
+  if (EFI_ERROR (Status)) {
+    return Status;
+  }
+
+  for (Index = 0; Index < Config->Nvram.Add.Count; Index++) {
+    if (EFI_ERROR (AsciiStrToGuid (OC_BLOB_GET (Config->Nvram.Add.Keys[Index]), &Guid))) {
+      continue;
+    }
+
+    Vars = Config->Nvram.Add.Values[Index];
+    for (Var = 0; Var < Vars->Count; Var++) {
+      Name = OC_BLOB_GET (Vars->Keys[Var]);
+      Value = Vars->Values[Var];
+
+      for (Char = 0; Char < ARRAY_SIZE (Name16) - 1 && Name[Char] != '\0'; Char++) {
+        Name16[Char] = (CHAR16) (UINT8) Name[Char];
+      }
+      Name16[Char] = L'\0';
+
+      Entry = BhVarStoreFind (Store, Name16, &Guid);
+      if (Entry == NULL) {
+        SetColour (EFI_YELLOW);
+        Print (L"absent  %g:%s\n", &Guid, Name16);
+      } else if (Entry->DataSize == Value->Size
+        && CompareMem (Store->Data + Entry->DataOffset, OC_BLOB_GET (Value), Value->Size) == 0) {
+        SetColour (EFI_LIGHTGREEN);
+        Print (L"same    %g:%s\n", &Guid, Name16);
+      } else {
+        SetColour (EFI_LIGHTRED);
+        Print (L"differs %g:%s\n", &Guid, Name16);
+        SetColour (EFI_WHITE);
+        ShowNvramValue (L"live:  ", Name16, &Guid, Store->Data + Entry->DataOffset, Entry->DataSize);
+        ShowNvramValue (L"config:", Name16, &Guid, OC_BLOB_GET (Value), Value->Size);
+      }
+      SetColour (EFI_WHITE);
+    }
+  }
+
+  return EFI_SUCCESS;
+}
+
+EFI_STATUS
+BhOcConfigShowTools (
+  VOID
+  )
+{
+  EFI_STATUS                  Status;
+  CONST OC_GLOBAL_CONFIG      *Config;
+  CONST OC_MISC_TOOLS_ENTRY   *Entry;
+  CONST CHAR8                 *Path;
+  UINT32                      Index;
+
+  Status = BhOcConfigGet (&Config);
+  if (EFI_ERROR (Status)) {
+    return Status;
+  }
+
+  if (Config->Misc.Tools.Count == 0) {
+    Print (L"No Misc/Tools entries\n");
+  }
+
+  for (Index = 0; Index < Config->Misc.Tools.Count; Index++) {
+    Entry = Config->Misc.Tools.Values[Index];
+    Path = OC_BLOB_GET (&Entry->Path);
+
+    SetColour (Entry->Enabled ? EFI_WHITE : EFI_DARKGRAY);
+    Print (
+      L"%c %-24a %a%s\n",
+      Entry->Enabled ? L'*' : L' ',
+      OC_BLOB_GET (&Entry->Name),
+      Path,
+      Path[0] != '\0' && OcFileExists (L"Tools", Path, NULL) ? L"" : L" (missing)"
+      );
+  }
+  SetColour (EFI_WHITE);
+
+  return EFI_SUCCESS;
+}
+
+VOID
+BhOcConfigFree (
+  VOID
+  )
+{
+  UINT32  Index;
+
+  if (mOcConfigStatus == EFI_SUCCESS) {
+    OcConfigurationFree (&mOcConfig);
+  }
+  mOcConfigStatus = EFI_NOT_STARTED;
+
+  if (mOcRoot != NULL) {
+    mOcRoot->Close (mOcRoot);
+    mOcRoot = NULL;
+  }
+
+  if (mOcVolume != NULL) {
+    FreePool (mOcVolume);
+    mOcVolume = NULL;
+  }
+
+  for (Index = 0; Index < mUnknownKeyCount; Index++) {
+    FreePool (mUnknownKeys[Index]);
+  }
+  mUnknownKeyCount = 0;
+  mMissingSections = 0;
+}
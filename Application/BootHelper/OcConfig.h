@@ -0,0 +1,79 @@
+/** @file
+  Declaration of OpenCore config.plist access and validation.
+
+  Copyright (c) 2020, Mike Beaton. All rights reserved.<BR>
+  SPDX-License-Identifier: BSD-3-Clause
+
+**/
+
+#ifndef __BH__OC_CONFIG__
+#define __BH__OC_CONFIG__
+
+//
+// Basic UEFI Libraries
+//
+#include <Uefi.h>
+#include <Library/UefiLib.h>
+
+//
+// OC Libraries
+//
+#include <Library/OcConfigurationLib.h>
+
+#define BH_OC_DIRECTORY             L"EFI\\OC"
+#define BH_OC_CONFIG_PATH           BH_OC_DIRECTORY L"\\config.plist"
+
+//
+// Unknown top level keys kept from the load, for reporting by validation.
+//
+#define BH_OC_MAX_UNKNOWN_KEYS      8
+
+// Set the file system handle to look on first for config.plist (normally the one BootHelper was started
+// from, as OpenCore starts it as a tool); nothing is read until the first BhOcConfigGet
+VOID
+BhOcConfigInit (
+  IN EFI_HANDLE               PreferredHandle OPTIONAL
+  );
+
+// Return OpenCore configuration, read and parsed on first call only; later calls, including
+// after failure, return the cached result for the rest of the session
+EFI_STATUS
+BhOcConfigGet (
+  OUT CONST OC_GLOBAL_CONFIG  **Config
+  );
+
+// Return the open root of the volume config.plist was read from, and its device path text, even
+// if the configuration did not parse; EFI_NOT_FOUND if there is none
+EFI_STATUS
+BhOcConfigVolume (
+  OUT EFI_FILE_PROTOCOL       **Root,
+  OUT CONST CHAR16            **Volume OPTIONAL
+  );
+
+// Check OpenCore configuration, printing each problem with its key path; ProblemCount is set to
+// the number found
+EFI_STATUS
+BhOcConfigValidate (
+  OUT UINT32                  *ProblemCount
+  );
+
+// Show each NVRAM/Add value of the OpenCore configuration next to the live value
+EFI_STATUS
+BhOcConfigShowNvram (
+  VOID
+  );
+
+// Show Misc/Tools entries of the OpenCore configuration, and whether each tool is present
+EFI_STATUS
+BhOcConfigShowTools (
+  VOID
+  );
+
+// Free cached configuration; it is read again on the next BhOcConfigGet, e.g. after files
+// under EFI\OC have been replaced
+VOID
+BhOcConfigFree (
+  VOID
+  );
+
+#endif
@@ -0,0 +1,463 @@
+/** @file
+  Post-reboot NVRAM persistence verification.
+
+  Writes made in one run are recorded as (name, GUID, attributes, size, SHA-256)
+  together with a fresh canary variable, and checked against the live store at
+  the start of the next run. A missing canary means that the store as a whole
+  was not saved (e.g. emulated NVRAM not written back); individual failures with
+  the canary present mean that those writes were reverted or filtered.
+
+  Copyright (c) 2020, Mike Beaton. All rights reserved.<BR>
+  SPDX-License-Identifier: BSD-3-Clause
+
+**/
+
+//
+// Basic UEFI Libraries
+//
+#include <Uefi.h>
+#include <Library/UefiLib.h>
+#include <Library/BaseLib.h>
+#include <Library/BaseMemoryLib.h>
+#include <Library/MemoryAllocationLib.h>
+#include <Library/PrintLib.h>
+#include <Library/TimerLib.h>
+
+//
+// Boot and Runtime Services
+//
+#include <Library/UefiRuntimeServicesTableLib.h>
+
+//
+// OC Libraries
+//
+#include <Library/OcCryptoLib.h>
+#include <Library/OcDebugLogLib.h>
+
+//
+// Local includes
+//
+#include "FileUtils.h"
+#include "Persist.h"
+#include "Utils.h"
+#include "VarEngine.h"
+
+//
+// Most failures listed on screen; all are written to the debug log.
+//
+#define PERSIST_MAX_SHOWN   8
+
+//
+// Writes made in this run, latest value per variable.
+//
+STATIC BH_PERSIST_RECORD  *mNotes         = NULL;
+STATIC CHAR16             **mNoteNames    = NULL;
+STATIC UINT32             mNoteCount      = 0;
+STATIC UINT32             mNoteCapacity   = 0;
+
+//
+// Result of verifying the previous run.
+//
+STATIC BOOLEAN            mVerified       = FALSE;
+STATIC BOOLEAN            mCanaryLost     = FALSE;
+STATIC EFI_TIME           mSavedTime;
+STATIC UINT32             mChecked        = 0;
+STATIC UINT32             mFailedCount    = 0;
+STATIC CHAR16             *mFailed[PERSIST_MAX_SHOWN];
+
+STATIC
+BOOLEAN
+IsCanary (
+  IN CONST CHAR16     *Name,
+  IN CONST EFI_GUID   *Guid
+  )
+{
+  return CompareGuid (Guid, &gBootHelperVariableGuid)
+    && StrCmp (Name, BH_PERSIST_CANARY_NAME) == 0;
+}
+
+STATIC
+VOID
+NoteWrite (
+  IN CONST CHAR16     *Name,
+  IN CONST EFI_GUID   *Guid,
+  IN UINT32           Attributes,
+  IN UINTN            Size,
+  IN CONST VOID       *Data
+  )
+{
+  UINT32              Index;
+  BH_PERSIST_RECORD   *Record;
+  VOID                *NewBuffer;
+
+  for (Index = 0; Index < mNoteCount; Index++) {
+    if (CompareGuid (&mNotes[Index].Guid, Guid) && StrCmp (mNoteNames[Index], Name) == 0) {
+      break;
+    }
+  }
+
+  if (Index == mNoteCount) {
+    if (mNoteCount == mNoteCapacity) {
+      NewBuffer = ReallocatePool (
+        mNoteCapacity * sizeof (*mNotes),
+        (mNoteCapacity + 16) * sizeof (*mNotes),
+        mNotes
+        );
+      if (NewBuffer == NULL) {
+        return;
+      }
+      mNotes = NewBuffer;
+
+      NewBuffer = ReallocatePool (
+        mNoteCapacity * sizeof (*mNoteNames),
+        (mNoteCapacity + 16) * sizeof (*mNoteNames),
+        mNoteNames
+        );
+      if (NewBuffer == NULL) {
+        return;
+      }
+      mNoteNames = NewBuffer;
+
+      mNoteCapacity += 16;
+    }
+
+    mNoteNames[Index] = AllocateCopyPool (StrSize (Name), Name);
+    if (mNoteNames[Index] == NULL) {
+      return;
+    }
+    mNoteCount++;
+  }
+
+  Record = &mNotes[Index];
+  ZeroMem (Record, sizeof (*Record));
+  CopyGuid (&Record->Guid, Guid);
+  Record->NameSize = (UINT16) StrSize (mNoteNames[Index]);
+
+  if (Size == 0) {
+    Record->Flags = BH_PERSIST_RECORD_DELETED;
+  } else {
+    Record->Attributes = Attributes;
+    Record->DataSize = (UINT32) Size;
+    Sha256 (Record->Hash, Data, Size);
+  }
+}
+
+//
+// Check one recorded write against the live value; returns NULL if it survived,
+// or a static description of how it failed.
+//
+STATIC
+CONST CHAR16 *
+CheckRecord (
+  IN CONST BH_PERSIST_RECORD    *Record,
+  IN CONST CHAR16               *Name
+  )
+{
+  EFI_STATUS    Status;
+  UINT32        Attributes;
+  UINTN         Size;
+  VOID          *Data;
+  UINT8         Hash[SHA256_DIGEST_SIZE];
+  CONST CHAR16  *Failure;
+
+  Status = BhVarRead (Name, &Record->Guid, &Attributes, &Size, &Data);
+
+  if ((Record->Flags & BH_PERSIST_RECORD_DELETED) != 0) {
+    Failure = Status == EFI_NOT_FOUND ? NULL : L"deleted, but present";
+  } else if (EFI_ERROR (Status)) {
+    Failure = L"missing";
+  } else if (Attributes != Record->Attributes) {
+    Failure = L"attributes changed";
+  } else if (Size != Record->DataSize) {
+    Failure = L"value changed";
+  } else {
+    Sha256 (Hash, Data, Size);
+    Failure = CompareMem (Hash, Record->Hash, sizeof (Hash)) == 0 ? NULL : L"value changed";
+  }
+
+  if (!EFI_ERROR (Status) && Data != NULL) {
+    FreePool (Data);
+  }
+
+  return Failure;
+}
+
+STATIC
+VOID
+DeletePending (
+  IN EFI_FILE_PROTOCOL  *Root
+  )
+{
+  EFI_FILE_PROTOCOL   *File;
+
+  if (!EFI_ERROR (BhOpenFile (Root, BH_PERSIST_PENDING_PATH, &File, FALSE))) {
+    File->Delete (File);
+  }
+}
+
+EFI_STATUS
+BhPersistVerify (
+  IN EFI_FILE_PROTOCOL  *Root
+  )
+{
+  EFI_STATUS                Status;
+  UINT8                     *Buffer;
+  UINTN                     Size;
+  UINTN                     Offset;
+  UINT32                    Index;
+  CONST BH_PERSIST_HEADER   *Header;
+  CONST BH_PERSIST_RECORD   *Record;
+  CONST CHAR16              *Name;
+  CONST CHAR16              *Failure;
+
+  Status = BhReadFile (Root, BH_PERSIST_PENDING_PATH, (VOID **) &Buffer, &Size);
+
+  if (!EFI_ERROR (Status)) {
+    Header = (CONST BH_PERSIST_HEADER *) Buffer;
+    if (Size < sizeof (*Header)
+      || Header->Signature != BH_PERSIST_SIGNATURE
+      || Header->Version != BH_PERSIST_VERSION
+      || Header->HeaderSize < sizeof (*Header)
+      || Header->HeaderSize > Size) {
+      DEBUG ((DEBUG_WARN, "BH: Ignoring invalid %s\n", BH_PERSIST_PENDING_PATH));
+      Status = EFI_VOLUME_CORRUPTED;
+    } else {
+      //
+      // Start from a fresh store snapshot, which the first check takes (unless
+      // enumeration is slow, when each variable is read directly).
+      //
+      BhVarCacheInvalidate ();
+    }
+
+    if (!EFI_ERROR (Status)) {
+      CopyMem (&mSavedTime, &Header->Time, sizeof (mSavedTime));
+      mVerified = TRUE;
+      Offset = Header->HeaderSize;
+
+      for (Index = 0; Index < Header->EntryCount; Index++) {
+        if (Size - Offset < sizeof (*Record)) {
+          break;
+        }
+        Record = (CONST BH_PERSIST_RECORD *) (Buffer + Offset);
+        Offset += sizeof (*Record);
+
+        if (Record->NameSize < sizeof (CHAR16)
+          || (Record->NameSize & 1) != 0
+          || Size - Offset < Record->NameSize) {
+          break;
+        }
+        Name = (CONST CHAR16 *) (Buffer + Offset);
+        Offset += Record->NameSize;
+
+        if (Name[Record->NameSize / sizeof (CHAR16) - 1] != L'\0') {
+          break;
+        }
+
+        Failure = CheckRecord (Record, Name);
+
+        if (IsCanary (Name, &Record->Guid)) {
+          mCanaryLost = Failure != NULL;
+          continue;
+        }
+
+        mChecked++;
+        if (Failure != NULL) {
+          DEBUG ((DEBUG_WARN, "BH: Write did not survive restart: %g:%s - %s\n", &Record->Guid, Name, Failure));
+          if (mFailedCount < PERSIST_MAX_SHOWN) {
+            mFailed[mFailedCount] = CatSPrint (NULL, L"%g:%s - %s", &Record->Guid, Name, Failure);
+          }
+          mFailedCount++;
+        }
+      }
+
+      if (Index < Header->EntryCount) {
+        DEBUG ((DEBUG_WARN, "BH: Truncated %s at record %u\n", BH_PERSIST_PENDING_PATH, Index));
+      }
+
+      DEBUG ((DEBUG_INFO, "BH: Verified %u writes, %u failed, canary %a\n", mChecked, mFailedCount, mCanaryLost ? "lost" : "ok"));
+    }
+
+    FreePool (Buffer);
+
+    //
+    // Checked once only, whatever the result.
+    //
+    DeletePending (Root);
+    BhVarWrite (BH_PERSIST_CANARY_NAME, &gBootHelperVariableGuid, BH_VAR_DEFAULT_ATTRIBUTES, 0, NULL, NULL);
+  } else if (Status == EFI_NOT_FOUND) {
+    Status = EFI_SUCCESS;
+  }
+
+  BhVarAddWriteNotify (NoteWrite);
+
+  return Status;
+}
+
+VOID
+BhPersistShowReport (
+  VOID
+  )
+{
+  UINT32  Index;
+
+  if (!mVerified) {
+    return;
+  }
+
+  if (mCanaryLost) {
+    SetColour (EFI_LIGHTRED);
+    Print (L"NVRAM changes from %02u:%02u were not saved at all (canary missing)\n", mSavedTime.Hour, mSavedTime.Minute);
+  } else if (mFailedCount == 0) {
+    SetColour (EFI_LIGHTGREEN);
+    Print (L"All %u NVRAM changes from %02u:%02u survived restart\n", mChecked, mSavedTime.Hour, mSavedTime.Minute);
+  } else {
+    SetColour (EFI_YELLOW);
+    Print (L"%u of %u NVRAM changes from %02u:%02u did not survive restart:\n", mFailedCount, mChecked, mSavedTime.Hour, mSavedTime.Minute);
+    for (Index = 0; Index < MIN (mFailedCount, PERSIST_MAX_SHOWN); Index++) {
+      if (mFailed[Index] != NULL) {
+        Print (L"  %s\n", mFailed[Index]);
+      }
+    }
+    if (mFailedCount > PERSIST_MAX_SHOWN) {
+      Print (L"  ...and %u more (see log)\n", mFailedCount - PERSIST_MAX_SHOWN);
+    }
+  }
+
+  SetColour (EFI_WHITE);
+}
+
+BOOLEAN
+BhPersistGetResult (
+  OUT UINT32            *Checked,
+  OUT UINT32            *Failed,
+  OUT BOOLEAN           *CanaryLost
+  )
+{
+  *Checked = mChecked;
+  *Failed = mFailedCount;
+  *CanaryLost = mCanaryLost;
+
+  return mVerified;
+}
+
+VOID
+BhPersistForget (
+  IN CONST CHAR16       *Name,
+  IN CONST EFI_GUID     *Guid
+  )
+{
+  UINT32  Index;
+
+  for (Index = 0; Index < mNoteCount; Index++) {
+    if (CompareGuid (&mNotes[Index].Guid, Guid) && StrCmp (mNoteNames[Index], Name) == 0) {
+      FreePool (mNoteNames[Index]);
+      --mNoteCount;
+      mNotes[Index] = mNotes[mNoteCount];
+      mNoteNames[Index] = mNoteNames[mNoteCount];
+      return;
+    }
+  }
+}
+
+EFI_STATUS
+BhPersistCommit (
+  IN EFI_FILE_PROTOCOL  *Root
+  )
+{
+  EFI_STATUS          Status;
+  UINT64              Canary;
+  EFI_TIME            Now;
+  UINTN               Size;
+  UINT32              Index;
+  UINT8               *Buffer;
+  UINT8               *Walker;
+  BH_PERSIST_HEADER   *Header;
+
+  if (mNoteCount == 0) {
+    return EFI_SUCCESS;
+  }
+
+  if (EFI_ERROR (gRT->GetTime (&Now, NULL))) {
+    ZeroMem (&Now, sizeof (Now));
+  }
+
+  //
+  // Fresh value each run, so that a canary left over from an earlier run cannot pass.
+  //
+  Canary = GetPerformanceCounter () + LShiftU64 (Now.Second + 60 * (Now.Minute + 60 * (Now.Hour + 24 * Now.Day)), 40);
+  Status = BhVarWrite (BH_PERSIST_CANARY_NAME, &gBootHelperVariableGuid, BH_VAR_DEFAULT_ATTRIBUTES, sizeof (Canary), &Canary, NULL);
+  if (EFI_ERROR (Status)) {
+    DEBUG ((DEBUG_WARN, "BH: Cannot set canary - %r\n", Status));
+  }
+
+  Size = sizeof (*Header);
+  for (Index = 0; Index < mNoteCount; Index++) {
+    Size += sizeof (*mNotes) + mNotes[Index].NameSize;
+  }
+
+  Buffer = AllocateZeroPool (Size);
+  if (Buffer == NULL) {
+    return EFI_OUT_OF_RESOURCES;
+  }
+
+  Header = (BH_PERSIST_HEADER *) Buffer;
+  Header->Signature = BH_PERSIST_SIGNATURE;
+  Header->Version = BH_PERSIST_VERSION;
+  Header->HeaderSize = sizeof (*Header);
+  CopyMem (&Header->Time, &Now, sizeof (Now));
+  Header->EntryCount = mNoteCount;
+
+  Walker = Buffer + sizeof (*Header);
+  for (Index = 0; Index < mNoteCount; Index++) {
+    CopyMem (Walker, &mNotes[Index], sizeof (*mNotes));
+    Walker += sizeof (*mNotes);
+    CopyMem (Walker, mNoteNames[Index], mNotes[Index].NameSize);
+    Walker += mNotes[Index].NameSize;
+  }
+
+  Status = BhWriteFile (Root, BH_PERSIST_PENDING_PATH, Buffer, Size);
+  FreePool (Buffer);
+
+  DEBUG ((DEBUG_INFO, "BH: Recorded %u writes for verification - %r\n", mNoteCount, Status));
+
+  return Status;
+}
+
+VOID
+BhPersistFree (
+  VOID
+  )
+{
+  UINT32  Index;
+
+  BhVarRemoveWriteNotify (NoteWrite);
+
+  for (Index = 0; Index < mNoteCount; Index++) {
+    FreePool (mNoteNames[Index]);
+  }
+
+  if (mNotes != NULL) {
+    FreePool (mNotes);
+    mNotes = NULL;
+  }
+
+  if (mNoteNames != NULL) {
+    FreePool (mNoteNames);
+    mNoteNames = NULL;
+  }
+
+  mNoteCount = 0;
+  mNoteCapacity = 0;
+
+  for (Index = 0; Index < MIN (mFailedCount, PERSIST_MAX_SHOWN); Index++) {
+    if (mFailed[Index] != NULL) {
+      FreePool (mFailed[Index]);
+      mFailed[Index] = NULL;
+    }
+  }
+
+  mFailedCount = 0;
+  mChecked = 0;
+  mVerified = FALSE;
+  mCanaryLost = FALSE;
+}
@@ -0,0 +1,105 @@
+/** @file
+  Declaration of post-reboot NVRAM persistence verification.
+
+  Copyright (c) 2020, Mike Beaton. All rights reserved.<BR>
+  SPDX-License-Identifier: BSD-3-Clause
+
+**/
+
+#ifndef __BH__PERSIST__
+#define __BH__PERSIST__
+
+//
+// Basic UEFI Libraries
+//
+#include <Uefi.h>
+#include <Library/UefiLib.h>
+
+//
+// OC Libraries
+//
+#include <Library/OcCryptoLib.h>
+
+#include <Protocol/SimpleFileSystem.h>
+
+#define BH_PERSIST_PENDING_PATH     L"Verify\\Pending.bhver"
+#define BH_PERSIST_CANARY_NAME      L"BootHelperCanary"
+
+#define BH_PERSIST_SIGNATURE        SIGNATURE_32 ('B', 'H', 'P', 'V')
+#define BH_PERSIST_VERSION          1
+
+//
+// Record has been deleted, and should still be absent.
+//
+#define BH_PERSIST_RECORD_DELETED   BIT0
+
+//
+// Pending verification file layout, all values little-endian:
+//   BH_PERSIST_HEADER
+//   EntryCount x (BH_PERSIST_RECORD, CHAR16 Name[NameSize / 2])
+// The canary variable is one of the records.
+//
+#pragma pack(1)
+
+typedef struct BH_PERSIST_HEADER_ {
+  UINT32    Signature;
+  UINT16    Version;
+  UINT16    HeaderSize;
+  EFI_TIME  Time;
+  UINT32    EntryCount;
+  UINT32    Reserved;
+} BH_PERSIST_HEADER;
+
+typedef struct BH_PERSIST_RECORD_ {
+  EFI_GUID  Guid;
+  UINT32    Attributes;
+  UINT16    NameSize;           ///< In bytes, including terminator
+  UINT16    Flags;
+  UINT32    DataSize;
+  UINT8     Hash[SHA256_DIGEST_SIZE];
+} BH_PERSIST_RECORD;
+
+#pragma pack()
+
+// Verify writes recorded by the previous run, if any, in one pass over a single store snapshot;
+// then start recording writes made in this run
+EFI_STATUS
+BhPersistVerify (
+  IN EFI_FILE_PROTOCOL  *Root
+  );
+
+// Print result of startup verification, if there was anything to verify
+VOID
+BhPersistShowReport (
+  VOID
+  );
+
+// Return TRUE if writes from the previous run were verified at startup, with the counts found
+BOOLEAN
+BhPersistGetResult (
+  OUT UINT32            *Checked,
+  OUT UINT32            *Failed,
+  OUT BOOLEAN           *CanaryLost
+  );
+
+// Stop recording a write made in this run, for one-shot variables which firmware consumes at the
+// next boot and so would otherwise be reported as lost
+VOID
+BhPersistForget (
+  IN CONST CHAR16       *Name,
+  IN CONST EFI_GUID     *Guid
+  );
+
+// If any variables were changed in this run, set a new canary and save expected values for the next run
+EFI_STATUS
+BhPersistCommit (
+  IN EFI_FILE_PROTOCOL  *Root
+  );
+
+// Stop recording writes and free all verification state
+VOID
+BhPersistFree (
+  VOID
+  );
+
+#endif
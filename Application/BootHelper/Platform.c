@@ -0,0 +1,160 @@
+/** @file
+  Platform identity functions.
+
+  Copyright (c) 2020, Mike Beaton. All rights reserved.<BR>
+  SPDX-License-Identifier: BSD-3-Clause
+
+**/
+
+//
+// Basic UEFI Libraries
+//
+#include <Uefi.h>
+#include <Library/UefiLib.h>
+#include <Library/BaseLib.h>
+#include <Library/BaseMemoryLib.h>
+
+//
+// OC Libraries
+//
+#include <Library/OcDebugLogLib.h>
+
+#include <Guid/SmBios.h>
+#include <IndustryStandard/SmBios.h>
+
+//
+// Local includes
+//
+#include "Platform.h"
+
+STATIC BOOLEAN          mPlatformInfoValid = FALSE;
+STATIC BH_PLATFORM_INFO mPlatformInfo;
+
+//
+// Copy string number Index (1-based) from the string set following Structure.
+//
+STATIC
+VOID
+CopySmbiosString (
+  IN  CONST SMBIOS_STRUCTURE  *Structure,
+  IN  CONST UINT8             *TableEnd,
+  IN  UINT8                   Index,
+  OUT CHAR8                   *Buffer
+  )
+{
+  CONST CHAR8 *String;
+  UINTN       Length;
+
+  Buffer[0] = '\0';
+
+  if (Index == 0) {
+    return;
+  }
+
+  String = (CONST CHAR8 *) Structure + Structure->Length;
+  while (--Index > 0) {
+    while ((CONST UINT8 *) String < TableEnd && *String != '\0') {
+      String++;
+    }
+    String++;
+  }
+
+  for (Length = 0; (CONST UINT8 *) String + Length < TableEnd && String[Length] != '\0'; Length++) {
+    if (Length + 1 == BH_PLATFORM_STRING_SIZE) {
+      break;
+    }
+    Buffer[Length] = String[Length];
+  }
+
+  Buffer[Length] = '\0';
+}
+
+STATIC
+VOID
+ParseSmbios (
+  IN CONST UINT8  *Table,
+  IN UINTN        TableSize
+  )
+{
+  CONST UINT8             *TableEnd;
+  CONST SMBIOS_STRUCTURE  *Structure;
+  CONST UINT8             *Next;
+
+  TableEnd = Table + TableSize;
+  Next = Table;
+
+  while (Next + sizeof (SMBIOS_STRUCTURE) <= TableEnd) {
+    Structure = (CONST SMBIOS_STRUCTURE *) Next;
+
+    if (Structure->Type == SMBIOS_TYPE_END_OF_TABLE || Structure->Length < sizeof (SMBIOS_STRUCTURE)) {
+      break;
+    }
+
+    if (Structure->Type == SMBIOS_TYPE_BIOS_INFORMATION
+      && Structure->Length >= OFFSET_OF (SMBIOS_TABLE_TYPE0, BiosSegment)) {
+      CopySmbiosString (
+        Structure,
+        TableEnd,
+        ((CONST SMBIOS_TABLE_TYPE0 *) Structure)->BiosVersion,
+        mPlatformInfo.BiosVersion
+        );
+    } else if (Structure->Type == SMBIOS_TYPE_SYSTEM_INFORMATION
+      && Structure->Length >= OFFSET_OF (SMBIOS_TABLE_TYPE1, WakeUpType)) {
+      CopySmbiosString (
+        Structure,
+        TableEnd,
+        ((CONST SMBIOS_TABLE_TYPE1 *) Structure)->ProductName,
+        mPlatformInfo.ProductName
+        );
+      CopyMem (&mPlatformInfo.SystemUuid, &((CONST SMBIOS_TABLE_TYPE1 *) Structure)->Uuid, sizeof (EFI_GUID));
+    }
+
+    //
+    // Skip formatted area and double-NUL terminated string set.
+    //
+    Next += Structure->Length;
+    while (Next + 1 < TableEnd && (Next[0] != 0 || Next[1] != 0)) {
+      Next++;
+    }
+    Next += 2;
+  }
+}
+
+CONST BH_PLATFORM_INFO *
+BhGetPlatformInfo (
+  VOID
+  )
+{
+  EFI_STATUS                    Status;
+  SMBIOS_TABLE_3_0_ENTRY_POINT  *Smbios3;
+  SMBIOS_TABLE_ENTRY_POINT      *Smbios;
+
+  if (mPlatformInfoValid) {
+    return &mPlatformInfo;
+  }
+
+  ZeroMem (&mPlatformInfo, sizeof (mPlatformInfo));
+  mPlatformInfoValid = TRUE;
+
+  Status = EfiGetSystemConfigurationTable (&gEfiSmbios3TableGuid, (VOID **) &Smbios3);
+  if (!EFI_ERROR (Status) && Smbios3 != NULL) {
+    ParseSmbios ((CONST UINT8 *) (UINTN) Smbios3->TableAddress, Smbios3->TableMaximumSize);
+  } else {
+    Status = EfiGetSystemConfigurationTable (&gEfiSmbiosTableGuid, (VOID **) &Smbios);
+    if (!EFI_ERROR (Status) && Smbios != NULL) {
+      ParseSmbios ((CONST UINT8 *) (UINTN) Smbios->TableAddress, Smbios->TableLength);
+    } else {
+      DEBUG ((DEBUG_WARN, "BH: No SMBIOS table\n"));
+    }
+  }
+
+  DEBUG ((
+    DEBUG_INFO,
+    "BH: Platform %a BIOS %a UUID %g\n",
+    mPlatformInfo.ProductName,
+    mPlatformInfo.BiosVersion,
+    &mPlatformInfo.SystemUuid
+    ));
+
+  return &mPlatformInfo;
+}
@@ -0,0 +1,32 @@
+/** @file
+  Declaration of platform identity functions.
+
+  Copyright (c) 2020, Mike Beaton. All rights reserved.<BR>
+  SPDX-License-Identifier: BSD-3-Clause
+
+**/
+
+#ifndef __BH__PLATFORM__
+#define __BH__PLATFORM__
+
+//
+// Basic UEFI Libraries
+//
+#include <Uefi.h>
+#include <Library/UefiLib.h>
+
+#define BH_PLATFORM_STRING_SIZE     64
+
+typedef struct BH_PLATFORM_INFO_ {
+  EFI_GUID  SystemUuid;                             ///< SMBIOS type 1 UUID, zero if not present
+  CHAR8     ProductName[BH_PLATFORM_STRING_SIZE];   ///< SMBIOS type 1 product name, e.g. MacBookPro11,1
+  CHAR8     BiosVersion[BH_PLATFORM_STRING_SIZE];   ///< SMBIOS type 0 BIOS version
+} BH_PLATFORM_INFO;
+
+// Return platform identity from SMBIOS; parsed once and then cached for the session
+CONST BH_PLATFORM_INFO *
+BhGetPlatformInfo (
+  VOID
+  );
+
+#endif
@@ -0,0 +1,505 @@
+/** @file
+  BootHelper plug-in manager: manifest lookup and load on first use.
+
+  Copyright (c) 2020, Mike Beaton. All rights reserved.<BR>
+  SPDX-License-Identifier: BSD-3-Clause
+
+**/
+
+//
+// Basic UEFI Libraries
+//
+#include <Uefi.h>
+#include <Library/UefiLib.h>
+#include <Library/BaseLib.h>
+#include <Library/BaseMemoryLib.h>
+#include <Library/MemoryAllocationLib.h>
+#include <Library/PrintLib.h>
+
+//
+// Boot and Runtime Services
+//
+#include <Library/UefiBootServicesTableLib.h>
+#include <Protocol/LoadedImage.h>
+
+//
+// OC Libraries
+//
+#include <Library/OcDebugLogLib.h>
+
+//
+// Local includes
+//
+#include "BhPlugin.h"
+#include "BootHelper.h"
+#include "Plugins.h"
+#include "VarEngine.h"
+
+EFI_GUID gBootHelperPluginProtocolGuid = BOOT_HELPER_PLUGIN_PROTOCOL_GUID;
+
+//
+// Length of GUID string in manifest decoder entries.
+//
+#define PLUGIN_GUID_LENGTH  36
+
+typedef struct PLUGIN_DECODER_ {
+  EFI_GUID      Guid;
+  CONST CHAR8   *Name;            ///< NULL to decode every variable with Guid
+  UINT32        Plugin;
+} PLUGIN_DECODER;
+
+typedef struct PLUGIN_STATE_ {
+  EFI_HANDLE                    Image;
+  BOOT_HELPER_PLUGIN_PROTOCOL   *Protocol;
+  BOOLEAN                       LoadFailed;
+} PLUGIN_STATE;
+
+STATIC BH_MISC_PLUGIN_ARRAY   *mPlugins     = NULL;
+STATIC OC_STORAGE_CONTEXT     *mStorage     = NULL;
+STATIC EFI_HANDLE             mParentImage  = NULL;
+STATIC CONST CHAR8            *mReservedKeys = "";
+
+//
+// Built on first use, so that startup cost does not depend on the manifest.
+//
+STATIC PLUGIN_STATE           *mPluginState = NULL;
+STATIC PLUGIN_DECODER         *mDecoders    = NULL;
+STATIC UINT32                 mDecoderCount = 0;
+STATIC BOOLEAN                mDecodersBuilt = FALSE;
+
+STATIC
+BOOLEAN
+PluginEnabled (
+  IN UINT32   Index
+  )
+{
+  return mPlugins->Values[Index]->Enabled
+    && mPlugins->Values[Index]->Path.Size > 1;
+}
+
+//
+// Manifest action entries are "K:Title"; return the key in lower case, or zero if the
+// entry is malformed.
+//
+STATIC
+CHAR16
+ActionKey (
+  IN CONST CHAR8    *Entry
+  )
+{
+  CHAR16  Key;
+
+  if (Entry[0] == '\0' || Entry[1] != ':') {
+    return 0;
+  }
+
+  Key = Entry[0];
+  if (Key >= 'A' && Key <= 'Z') {
+    Key = Key - 'A' + 'a';
+  }
+
+  return Key;
+}
+
+STATIC
+BOOLEAN
+KeyReserved (
+  IN CHAR16   Key
+  )
+{
+  CONST CHAR8   *Reserved;
+
+  for (Reserved = mReservedKeys; *Reserved != '\0'; Reserved++) {
+    if ((CHAR16) *Reserved == Key) {
+      return TRUE;
+    }
+  }
+
+  return FALSE;
+}
+
+VOID
+BhPluginInit (
+  IN BH_MISC_PLUGIN_ARRAY   *Plugins,
+  IN OC_STORAGE_CONTEXT     *Storage,
+  IN EFI_HANDLE             ParentImage,
+  IN CONST CHAR8            *ReservedKeys
+  )
+{
+  UINT32                        Plugin;
+  UINT32                        Index;
+  BH_MISC_PLUGIN_ACTION_ARRAY   *Actions;
+  CONST CHAR8                   *Entry;
+
+  mPlugins = Plugins;
+  mStorage = Storage;
+  mParentImage = ParentImage;
+  mReservedKeys = ReservedKeys;
+
+  //
+  // Only the manifest is checked here; an action on a built-in key would otherwise be
+  // listed but never run.
+  //
+  for (Plugin = 0; Plugin < mPlugins->Count; Plugin++) {
+    if (!PluginEnabled (Plugin)) {
+      continue;
+    }
+
+    Actions = &mPlugins->Values[Plugin]->Actions;
+    for (Index = 0; Index < Actions->Count; Index++) {
+      Entry = OC_BLOB_GET (Actions->Values[Index]);
+      if (KeyReserved (ActionKey (Entry))) {
+        DEBUG ((
+          DEBUG_WARN,
+          "BH: Plug-in %a action %a ignored, key is built in\n",
+          OC_BLOB_GET (&mPlugins->Values[Plugin]->Path),
+          Entry
+          ));
+      }
+    }
+  }
+}
+
+VOID
+BhPluginFree (
+  VOID
+  )
+{
+  UINT32  Index;
+
+  if (mPluginState != NULL) {
+    for (Index = 0; Index < mPlugins->Count; Index++) {
+      if (mPluginState[Index].Image != NULL) {
+        gBS->UnloadImage (mPluginState[Index].Image);
+      }
+    }
+    FreePool (mPluginState);
+    mPluginState = NULL;
+  }
+
+  if (mDecoders != NULL) {
+    FreePool (mDecoders);
+    mDecoders = NULL;
+  }
+
+  mDecoderCount = 0;
+  mDecodersBuilt = FALSE;
+  mPlugins = NULL;
+}
+
+//
+// Parse "GUID" or "GUID:Name" manifest decoder entry.
+//
+STATIC
+BOOLEAN
+ParseDecoder (
+  IN  CONST CHAR8     *Entry,
+  OUT PLUGIN_DECODER  *Decoder
+  )
+{
+  CHAR8   GuidString[PLUGIN_GUID_LENGTH + 1];
+
+  if (AsciiStrLen (Entry) < PLUGIN_GUID_LENGTH) {
+    return FALSE;
+  }
+
+  CopyMem (GuidString, Entry, PLUGIN_GUID_LENGTH);
+  GuidString[PLUGIN_GUID_LENGTH] = '\0';
+
+  if (EFI_ERROR (AsciiStrToGuid (GuidString, &Decoder->Guid))) {
+    return FALSE;
+  }
+
+  Entry += PLUGIN_GUID_LENGTH;
+  if (*Entry == '\0' || (Entry[0] == ':' && Entry[1] == '\0')) {
+    Decoder->Name = NULL;
+  } else if (*Entry == ':') {
+    Decoder->Name = Entry + 1;
+  } else {
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
+STATIC
+VOID
+BuildDecoders (
+  VOID
+  )
+{
+  UINT32                        Plugin;
+  UINT32                        Index;
+  UINT32                        Total;
+  BH_MISC_PLUGIN_DECODER_ARRAY  *Decoders;
+
+  mDecodersBuilt = TRUE;
+
+  Total = 0;
+  for (Plugin = 0; Plugin < mPlugins->Count; Plugin++) {
+    if (PluginEnabled (Plugin)) {
+      Total += mPlugins->Values[Plugin]->Decoders.Count;
+    }
+  }
+
+  if (Total == 0) {
+    return;
+  }
+
+  mDecoders = AllocatePool (Total * sizeof (PLUGIN_DECODER));
+  if (mDecoders == NULL) {
+    return;
+  }
+
+  for (Plugin = 0; Plugin < mPlugins->Count; Plugin++) {
+    if (!PluginEnabled (Plugin)) {
+      continue;
+    }
+
+    Decoders = &mPlugins->Values[Plugin]->Decoders;
+    for (Index = 0; Index < Decoders->Count; Index++) {
+      if (ParseDecoder (OC_BLOB_GET (Decoders->Values[Index]), &mDecoders[mDecoderCount])) {
+        mDecoders[mDecoderCount].Plugin = Plugin;
+        mDecoderCount++;
+      } else {
+        DEBUG ((DEBUG_WARN, "BH: Bad plug-in decoder %a\n", OC_BLOB_GET (Decoders->Values[Index])));
+      }
+    }
+  }
+}
+
+STATIC
+BOOT_HELPER_PLUGIN_PROTOCOL *
+LoadPlugin (
+  IN UINT32   Index
+  )
+{
+  EFI_STATUS                  Status;
+  PLUGIN_STATE                *State;
+  CHAR16                      Path[128];
+  VOID                        *Image;
+  UINT32                      ImageSize;
+  EFI_LOADED_IMAGE_PROTOCOL   *LoadedImage;
+
+  if (mPluginState == NULL) {
+    mPluginState = AllocateZeroPool (mPlugins->Count * sizeof (PLUGIN_STATE));
+    if (mPluginState == NULL) {
+      return NULL;
+    }
+  }
+
+  State = &mPluginState[Index];
+  if (State->Protocol != NULL || State->LoadFailed) {
+    return State->Protocol;
+  }
+
+  //
+  // Do not retry a plug-in which failed, whatever the outcome below.
+  //
+  State->LoadFailed = TRUE;
+
+  UnicodeSPrint (Path, sizeof (Path), L"%s%a", BOOT_HELPER_PLUGINS_PATH, OC_BLOB_GET (&mPlugins->Values[Index]->Path));
+
+  Image = OcStorageReadFileUnicode (mStorage, Path, &ImageSize);
+  if (Image == NULL) {
+    DEBUG ((DEBUG_WARN, "BH: Cannot read plug-in %s\n", Path));
+    return NULL;
+  }
+
+  Status = gBS->LoadImage (FALSE, mParentImage, NULL, Image, ImageSize, &State->Image);
+  FreePool (Image);
+
+  //
+  // Firmware unloads an application as soon as StartImage returns, which would leave the
+  // protocol pointing into freed memory; only boot services drivers stay resident.
+  //
+  if (!EFI_ERROR (Status)) {
+    Status = gBS->HandleProtocol (State->Image, &gEfiLoadedImageProtocolGuid, (VOID **) &LoadedImage);
+    if (!EFI_ERROR (Status) && LoadedImage->ImageCodeType != EfiBootServicesCode) {
+      DEBUG ((DEBUG_WARN, "BH: Plug-in %s is not a boot services driver\n", Path));
+      Status = EFI_UNSUPPORTED;
+    }
+  }
+
+  if (!EFI_ERROR (Status)) {
+    Status = gBS->StartImage (State->Image, NULL, NULL);
+  }
+
+  if (!EFI_ERROR (Status)) {
+    Status = gBS->HandleProtocol (State->Image, &gBootHelperPluginProtocolGuid, (VOID **) &State->Protocol);
+  }
+
+  if (!EFI_ERROR (Status) && State->Protocol->Revision < BOOT_HELPER_PLUGIN_PROTOCOL_REVISION) {
+    Status = EFI_INCOMPATIBLE_VERSION;
+  }
+
+  DEBUG ((DEBUG_INFO, "BH: Load plug-in %s - %r\n", Path, Status));
+
+  if (EFI_ERROR (Status)) {
+    State->Protocol = NULL;
+    if (State->Image != NULL) {
+      gBS->UnloadImage (State->Image);
+      State->Image = NULL;
+    }
+    return NULL;
+  }
+
+  State->LoadFailed = FALSE;
+  return State->Protocol;
+}
+
+STATIC
+BOOLEAN
+NameMatches (
+  IN CONST CHAR16   *Name,
+  IN CONST CHAR8    *AsciiName
+  )
+{
+  while (*Name != L'\0' && *Name == (CHAR16) *AsciiName) {
+    Name++;
+    AsciiName++;
+  }
+
+  return *Name == L'\0' && *AsciiName == '\0';
+}
+
+CHAR16 *
+BhPluginDecode (
+  IN CONST CHAR16     *Name,
+  IN CONST EFI_GUID   *Guid,
+  IN CONST VOID       *Data,
+  IN UINTN            DataSize
+  )
+{
+  EFI_STATUS                    Status;
+  UINT32                        Index;
+  BOOT_HELPER_PLUGIN_PROTOCOL   *Protocol;
+  CHAR16                        *Text;
+
+  if (mPlugins == NULL) {
+    return NULL;
+  }
+
+  if (!mDecodersBuilt) {
+    BuildDecoders ();
+  }
+
+  for (Index = 0; Index < mDecoderCount; Index++) {
+    if (!CompareGuid (&mDecoders[Index].Guid, Guid)
+      || (mDecoders[Index].Name != NULL && !NameMatches (Name, mDecoders[Index].Name))) {
+      continue;
+    }
+
+    Protocol = LoadPlugin (mDecoders[Index].Plugin);
+    if (Protocol == NULL) {
+      continue;
+    }
+
+    Text = NULL;
+    Status = Protocol->Decode (Protocol, Name, Guid, Data, DataSize, &Text);
+    if (!EFI_ERROR (Status) && Text != NULL) {
+      return Text;
+    }
+  }
+
+  return NULL;
+}
+
+STATIC
+BOOLEAN
+ActionMatches (
+  IN CONST CHAR8    *Entry,
+  IN CHAR16         Key
+  )
+{
+  CHAR16  EntryKey;
+
+  EntryKey = ActionKey (Entry);
+
+  return EntryKey != 0 && EntryKey == Key && !KeyReserved (EntryKey);
+}
+
+EFI_STATUS
+BhPluginRunAction (
+  IN CHAR16           Key
+  )
+{
+  EFI_STATUS                    Status;
+  UINT32                        Plugin;
+  UINT32                        Index;
+  BH_MISC_PLUGIN_ACTION_ARRAY   *Actions;
+  BOOT_HELPER_PLUGIN_PROTOCOL   *Protocol;
+
+  if (mPlugins == NULL) {
+    return EFI_NOT_FOUND;
+  }
+
+  for (Plugin = 0; Plugin < mPlugins->Count; Plugin++) {
+    if (!PluginEnabled (Plugin)) {
+      continue;
+    }
+
+    Actions = &mPlugins->Values[Plugin]->Actions;
+    for (Index = 0; Index < Actions->Count; Index++) {
+      if (!ActionMatches (OC_BLOB_GET (Actions->Values[Index]), Key)) {
+        continue;
+      }
+
+      Protocol = LoadPlugin (Plugin);
+      if (Protocol == NULL) {
+        return EFI_LOAD_ERROR;
+      }
+
+      Status = Protocol->RunAction (Protocol, Key, BhProtocolInterface ());
+
+      //
+      // Plug-in may also have written variables directly.
+      //
+      BhVarCacheInvalidate ();
+
+      return Status;
+    }
+  }
+
+  return EFI_NOT_FOUND;
+}
+
+VOID
+BhPluginPrintActions (
+  VOID
+  )
+{
+  UINT32                        Plugin;
+  UINT32                        Index;
+  BH_MISC_PLUGIN_ACTION_ARRAY   *Actions;
+  CONST CHAR8                   *Entry;
+  CHAR16                        Key;
+  BOOLEAN                       Any;
+
+  if (mPlugins == NULL) {
+    return;
+  }
+
+  Any = FALSE;
+
+  for (Plugin = 0; Plugin < mPlugins->Count; Plugin++) {
+    if (!PluginEnabled (Plugin)) {
+      continue;
+    }
+
+    Actions = &mPlugins->Values[Plugin]->Actions;
+    for (Index = 0; Index < Actions->Count; Index++) {
+      Entry = OC_BLOB_GET (Actions->Values[Index]);
+      Key = ActionKey (Entry);
+      if (Key == 0 || KeyReserved (Key)) {
+        continue;
+      }
+      Print (L"%s[%c] %a", Any ? L"; " : L"", (CHAR16) Entry[0], Entry + 2);
+      Any = TRUE;
+    }
+  }
+
+  if (Any) {
+    Print (L"\n");
+  }
+}
@@ -0,0 +1,68 @@
+/** @file
+  Declaration of BootHelper plug-in manager.
+
+  Copyright (c) 2020, Mike Beaton. All rights reserved.<BR>
+  SPDX-License-Identifier: BSD-3-Clause
+
+**/
+
+#ifndef __BH__PLUGINS__
+#define __BH__PLUGINS__
+
+//
+// Basic UEFI Libraries
+//
+#include <Uefi.h>
+#include <Library/UefiLib.h>
+
+//
+// OC Libraries
+//
+#include <Library/OcStorageLib.h>
+
+//
+// Local includes
+//
+#include "BhConfig.h"
+
+#define BOOT_HELPER_PLUGINS_PATH    L"Plugins\\"
+
+// Record the plug-in manifest; nothing is read or loaded until a decoder or action is first used.
+// Actions on any of ReservedKeys (lower case, built-in menu keys) are ignored, with a warning.
+VOID
+BhPluginInit (
+  IN BH_MISC_PLUGIN_ARRAY   *Plugins,
+  IN OC_STORAGE_CONTEXT     *Storage,
+  IN EFI_HANDLE             ParentImage,
+  IN CONST CHAR8            *ReservedKeys
+  );
+
+// Unload any plug-ins which were loaded, and forget the manifest
+VOID
+BhPluginFree (
+  VOID
+  );
+
+// Return plug-in formatted value, or NULL if no plug-in decodes this variable;
+// the returned string must be freed by the caller using FreePool
+CHAR16 *
+BhPluginDecode (
+  IN CONST CHAR16     *Name,
+  IN CONST EFI_GUID   *Guid,
+  IN CONST VOID       *Data,
+  IN UINTN            DataSize
+  );
+
+// Run plug-in action bound to (lower case) Key, EFI_NOT_FOUND if there is none
+EFI_STATUS
+BhPluginRunAction (
+  IN CHAR16           Key
+  );
+
+// Print menu legend for plug-in actions, if there are any
+VOID
+BhPluginPrintActions (
+  VOID
+  );
+
+#endif
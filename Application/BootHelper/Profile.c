@@ -0,0 +1,349 @@
+/** @file
+  Timer interrupt sampling profiler.
+
+  The local APIC timer is free on firmware which drives its own tick from the
+  8254 or HPET (including OVMF), so it is programmed to interrupt periodically
+  on an unused vector, with a handler registered through the CPU architectural
+  protocol. The handler only stores the interrupted instruction pointer into a
+  buffer allocated up front and signals end of interrupt.
+
+  Copyright (c) 2020, Mike Beaton. All rights reserved.<BR>
+  SPDX-License-Identifier: BSD-3-Clause
+
+**/
+
+//
+// Basic UEFI Libraries
+//
+#include <Uefi.h>
+#include <Library/UefiLib.h>
+#include <Library/BaseLib.h>
+#include <Library/IoLib.h>
+#include <Library/MemoryAllocationLib.h>
+
+//
+// Boot and Runtime Services
+//
+#include <Library/UefiBootServicesTableLib.h>
+
+#include <Protocol/Cpu.h>
+
+//
+// OC Libraries
+//
+#include <Library/OcDebugLogLib.h>
+
+//
+// Local includes
+//
+#include "FileUtils.h"
+#include "Profile.h"
+
+#if defined (BH_PROFILE) && (defined (MDE_CPU_X64) || defined (MDE_CPU_IA32))
+
+#define APIC_BASE_MSR               0x1B
+#define APIC_BASE_ENABLE            BIT11
+#define APIC_BASE_X2APIC            BIT10
+#define APIC_BASE_ADDRESS_MASK      0xFFFFFF000ULL
+#define X2APIC_MSR_BASE             0x800
+
+#define APIC_EOI                    0x0B0
+#define APIC_LVT_TIMER              0x320
+#define APIC_INITIAL_COUNT          0x380
+#define APIC_CURRENT_COUNT          0x390
+#define APIC_DIVIDE                 0x3E0
+
+#define APIC_LVT_MASKED             BIT16
+#define APIC_LVT_PERIODIC           BIT17
+#define APIC_DIVIDE_BY_1            0x0B
+
+//
+// Vectors tried for the sampling interrupt, highest first, avoiding firmware's usual
+// legacy IRQ range and the top vectors which some firmware reserves.
+//
+#define PROFILE_VECTOR_FIRST        0xDF
+#define PROFILE_VECTOR_LAST         0x80
+
+#define PROFILE_CALIBRATE_US        10000
+
+STATIC EFI_CPU_ARCH_PROTOCOL    *mCpu = NULL;
+STATIC BOOLEAN                  mRunning = FALSE;
+STATIC BOOLEAN                  mX2Apic;
+STATIC UINTN                    mApicBase;
+STATIC EFI_EXCEPTION_TYPE       mVector;
+STATIC UINT32                   mSavedLvtTimer;
+STATIC UINT32                   mSavedDivide;
+STATIC UINT32                   mSavedInitialCount;
+
+//
+// Header and samples are one allocation, written out as is.
+//
+STATIC BH_PROFILE_HEADER        *mProfile = NULL;
+STATIC UINT64                   *mSamples;
+
+STATIC
+UINT32
+ReadApic (
+  IN UINT32   Register
+  )
+{
+  if (mX2Apic) {
+    return (UINT32) AsmReadMsr64 (X2APIC_MSR_BASE + (Register >> 4));
+  }
+
+  return MmioRead32 (mApicBase + Register);
+}
+
+STATIC
+VOID
+WriteApic (
+  IN UINT32   Register,
+  IN UINT32   Value
+  )
+{
+  if (mX2Apic) {
+    AsmWriteMsr64 (X2APIC_MSR_BASE + (Register >> 4), Value);
+  } else {
+    MmioWrite32 (mApicBase + Register, Value);
+  }
+}
+
+STATIC
+VOID
+EFIAPI
+SampleHandler (
+  IN EFI_EXCEPTION_TYPE   InterruptType,
+  IN EFI_SYSTEM_CONTEXT   SystemContext
+  )
+{
+  UINT64    Ip;
+
+#if defined (MDE_CPU_X64)
+  Ip = SystemContext.SystemContextX64->Rip;
+#else
+  Ip = SystemContext.SystemContextIa32->Eip;
+#endif
+
+  if (mProfile->Count < BH_PROFILE_MAX_SAMPLES) {
+    mSamples[mProfile->Count++] = Ip;
+  } else {
+    ++mProfile->Dropped;
+  }
+
+  WriteApic (APIC_EOI, 0);
+}
+
+//
+// Timer count for one sampling interval, from the count elapsed over a timed stall.
+//
+STATIC
+UINT32
+CalibrateInterval (
+  VOID
+  )
+{
+  UINT64    Elapsed;
+
+  WriteApic (APIC_DIVIDE, APIC_DIVIDE_BY_1);
+  WriteApic (APIC_LVT_TIMER, APIC_LVT_MASKED | mVector);
+  WriteApic (APIC_INITIAL_COUNT, MAX_UINT32);
+  gBS->Stall (PROFILE_CALIBRATE_US);
+  Elapsed = MAX_UINT32 - ReadApic (APIC_CURRENT_COUNT);
+  WriteApic (APIC_INITIAL_COUNT, 0);
+
+  return (UINT32) MIN (
+    DivU64x32 (MultU64x32 (Elapsed, BH_PROFILE_INTERVAL_US), PROFILE_CALIBRATE_US),
+    MAX_UINT32
+    );
+}
+
+//
+// Put back firmware's timer setup; needed once anything has been written to the timer,
+// whether or not sampling started.
+//
+STATIC
+VOID
+RestoreTimer (
+  VOID
+  )
+{
+  WriteApic (APIC_LVT_TIMER, APIC_LVT_MASKED | mVector);
+  WriteApic (APIC_INITIAL_COUNT, 0);
+  WriteApic (APIC_DIVIDE, mSavedDivide);
+  WriteApic (APIC_LVT_TIMER, mSavedLvtTimer);
+  WriteApic (APIC_INITIAL_COUNT, mSavedInitialCount);
+}
+
+STATIC
+VOID
+StopSampling (
+  VOID
+  )
+{
+  if (!mRunning) {
+    return;
+  }
+
+  RestoreTimer ();
+
+  mCpu->RegisterInterruptHandler (mCpu, mVector, NULL);
+
+  mRunning = FALSE;
+
+  DEBUG ((DEBUG_INFO, "BH: Profiler stopped, %u samples, %u dropped\n", mProfile->Count, mProfile->Dropped));
+}
+
+EFI_STATUS
+BhProfileStart (
+  IN VOID     *ImageBase,
+  IN UINT64   ImageSize
+  )
+{
+  EFI_STATUS    Status;
+  UINT64        ApicBaseMsr;
+  UINT32        Interval;
+
+  if (mProfile != NULL) {
+    return EFI_ALREADY_STARTED;
+  }
+
+  Status = gBS->LocateProtocol (&gEfiCpuArchProtocolGuid, NULL, (VOID **) &mCpu);
+  if (EFI_ERROR (Status)) {
+    DEBUG ((DEBUG_WARN, "BH: Profiler needs CPU arch protocol - %r\n", Status));
+    return Status;
+  }
+
+  ApicBaseMsr = AsmReadMsr64 (APIC_BASE_MSR);
+  if ((ApicBaseMsr & APIC_BASE_ENABLE) == 0) {
+    DEBUG ((DEBUG_WARN, "BH: Profiler needs local APIC\n"));
+    return EFI_UNSUPPORTED;
+  }
+  mX2Apic = (ApicBaseMsr & APIC_BASE_X2APIC) != 0;
+  mApicBase = (UINTN) (ApicBaseMsr & APIC_BASE_ADDRESS_MASK);
+
+  mSavedLvtTimer = ReadApic (APIC_LVT_TIMER);
+  mSavedDivide = ReadApic (APIC_DIVIDE);
+  mSavedInitialCount = ReadApic (APIC_INITIAL_COUNT);
+  if ((mSavedLvtTimer & APIC_LVT_MASKED) == 0 && mSavedInitialCount != 0) {
+    DEBUG ((DEBUG_WARN, "BH: Profiler cannot run, local APIC timer is in use by firmware\n"));
+    return EFI_UNSUPPORTED;
+  }
+
+  mProfile = AllocateZeroPool (sizeof (BH_PROFILE_HEADER) + BH_PROFILE_MAX_SAMPLES * sizeof (UINT64));
+  if (mProfile == NULL) {
+    return EFI_OUT_OF_RESOURCES;
+  }
+  mSamples = (UINT64 *) (mProfile + 1);
+
+  mProfile->Signature = BH_PROFILE_SIGNATURE;
+  mProfile->Version = BH_PROFILE_VERSION;
+  mProfile->HeaderSize = sizeof (BH_PROFILE_HEADER);
+  mProfile->ImageBase = (UINT64) (UINTN) ImageBase;
+  mProfile->ImageSize = ImageSize;
+  mProfile->IntervalUs = BH_PROFILE_INTERVAL_US;
+
+  for (mVector = PROFILE_VECTOR_FIRST; mVector >= PROFILE_VECTOR_LAST; --mVector) {
+    Status = mCpu->RegisterInterruptHandler (mCpu, mVector, SampleHandler);
+    if (!EFI_ERROR (Status)) {
+      break;
+    }
+  }
+
+  if (EFI_ERROR (Status)) {
+    DEBUG ((DEBUG_WARN, "BH: Profiler found no free interrupt vector - %r\n", Status));
+    BhProfileStop ();
+    return Status;
+  }
+
+  Interval = CalibrateInterval ();
+  if (Interval == 0) {
+    DEBUG ((DEBUG_WARN, "BH: Profiler found local APIC timer not counting\n"));
+    RestoreTimer ();
+    mCpu->RegisterInterruptHandler (mCpu, mVector, NULL);
+    BhProfileStop ();
+    return EFI_DEVICE_ERROR;
+  }
+
+  mRunning = TRUE;
+  WriteApic (APIC_LVT_TIMER, APIC_LVT_PERIODIC | mVector);
+  WriteApic (APIC_INITIAL_COUNT, Interval);
+
+  DEBUG ((
+    DEBUG_INFO,
+    "BH: Profiler sampling every %uus on vector 0x%x (%u APIC ticks%a)\n",
+    BH_PROFILE_INTERVAL_US,
+    (UINT32) mVector,
+    Interval,
+    mX2Apic ? ", x2APIC" : ""
+    ));
+
+  return EFI_SUCCESS;
+}
+
+EFI_STATUS
+BhProfileSave (
+  IN EFI_FILE_PROTOCOL  *Root
+  )
+{
+  EFI_STATUS    Status;
+
+  if (mProfile == NULL) {
+    return EFI_NOT_STARTED;
+  }
+
+  StopSampling ();
+
+  Status = BhWriteFile (
+    Root,
+    BH_PROFILE_FILE,
+    mProfile,
+    sizeof (BH_PROFILE_HEADER) + mProfile->Count * sizeof (UINT64)
+    );
+
+  DEBUG ((DEBUG_INFO, "BH: Profile saved to %s - %r\n", BH_PROFILE_FILE, Status));
+
+  return Status;
+}
+
+VOID
+BhProfileStop (
+  VOID
+  )
+{
+  if (mProfile == NULL) {
+    return;
+  }
+
+  StopSampling ();
+
+  FreePool (mProfile);
+  mProfile = NULL;
+}
+
+#else
+
+EFI_STATUS
+BhProfileStart (
+  IN VOID     *ImageBase,
+  IN UINT64   ImageSize
+  )
+{
+  return EFI_UNSUPPORTED;
+}
+
+EFI_STATUS
+BhProfileSave (
+  IN EFI_FILE_PROTOCOL  *Root
+  )
+{
+  return EFI_NOT_STARTED;
+}
+
+VOID
+BhProfileStop (
+  VOID
+  )
+{
+}
+
+#endif
@@ -0,0 +1,73 @@
+/** @file
+  Declaration of timer interrupt sampling profiler.
+
+  Copyright (c) 2020, Mike Beaton. All rights reserved.<BR>
+  SPDX-License-Identifier: BSD-3-Clause
+
+**/
+
+#ifndef __BH__PROFILE__
+#define __BH__PROFILE__
+
+//
+// Basic UEFI Libraries
+//
+#include <Uefi.h>
+#include <Library/UefiLib.h>
+
+#include <Protocol/SimpleFileSystem.h>
+
+//
+// Sampling is only built in with -D BH_PROFILE=TRUE on the build command line (see
+// BootHelperPkg.dsc); otherwise BhProfileStart returns EFI_UNSUPPORTED.
+//
+#define BH_PROFILE_FILE             L"Profile.bhprof"
+
+#define BH_PROFILE_SIGNATURE        SIGNATURE_32 ('B', 'H', 'P', 'R')
+#define BH_PROFILE_VERSION          1
+
+#define BH_PROFILE_INTERVAL_US      1000
+#define BH_PROFILE_MAX_SAMPLES      (512 * 1024)
+
+//
+// Profile file layout, all values little-endian:
+//   BH_PROFILE_HEADER
+//   UINT64 Samples[Count]          interrupted instruction pointer, absolute
+// Utilities/BhFleet/bhprof.py reads this format on the host; keep them in step.
+//
+#pragma pack(1)
+typedef struct BH_PROFILE_HEADER_ {
+  UINT32    Signature;
+  UINT16    Version;
+  UINT16    HeaderSize;
+  UINT64    ImageBase;
+  UINT64    ImageSize;
+  UINT32    IntervalUs;
+  UINT32    Count;
+  UINT32    Dropped;            ///< Samples not stored because the buffer was full
+  UINT32    Reserved;
+} BH_PROFILE_HEADER;
+#pragma pack()
+
+// Start sampling the instruction pointer every BH_PROFILE_INTERVAL_US from a local APIC timer
+// interrupt registered through the CPU architectural protocol; ImageBase and ImageSize are
+// recorded so that samples can be symbolised against this image
+EFI_STATUS
+BhProfileStart (
+  IN VOID     *ImageBase,
+  IN UINT64   ImageSize
+  );
+
+// Stop sampling and write the samples to BH_PROFILE_FILE under Root
+EFI_STATUS
+BhProfileSave (
+  IN EFI_FILE_PROTOCOL  *Root
+  );
+
+// Stop sampling if still running and free the sample buffer; must be called before exit
+VOID
+BhProfileStop (
+  VOID
+  );
+
+#endif
@@ -0,0 +1,222 @@
+/** @file
+  Cancellable progress reporting for long operations.
+
+  Esc and Ctrl+C are registered with SimpleTextInputEx key notification, so a
+  cancel request is seen on the next progress update without the operation
+  itself reading keys. Where key notification is not available, the console
+  is polled instead.
+
+  Copyright (c) 2020, Mike Beaton. All rights reserved.<BR>
+  SPDX-License-Identifier: BSD-3-Clause
+
+**/
+
+//
+// Basic UEFI Libraries
+//
+#include <Uefi.h>
+#include <Library/UefiLib.h>
+#include <Library/BaseMemoryLib.h>
+
+//
+// Boot and Runtime Services
+//
+#include <Library/UefiBootServicesTableLib.h>
+
+#include <Protocol/SimpleTextInEx.h>
+
+//
+// OC Libraries
+//
+#include <Library/OcDebugLogLib.h>
+
+//
+// Local includes
+//
+#include "EzKb.h"
+#include "Progress.h"
+#include "Timing.h"
+
+#define CTRL_C                      ((CHAR16) 0x03)
+#define PROGRESS_MAX_NOTIFY         4
+
+STATIC UINT32                               mDepth = 0;
+STATIC CONST CHAR16                         *mTitle;
+STATIC volatile BOOLEAN                     mCancelRequested;
+STATIC EFI_SIMPLE_TEXT_INPUT_EX_PROTOCOL    *mTextInEx;
+STATIC VOID                                 *mNotifyHandles[PROGRESS_MAX_NOTIFY];
+STATIC UINT32                               mNotifyCount;
+STATIC UINT64                               mLastDraw;
+STATIC UINT32                               mDone;
+STATIC UINT32                               mTotal;
+
+STATIC
+EFI_STATUS
+EFIAPI
+CancelKeyNotify (
+  IN EFI_KEY_DATA   *KeyData
+  )
+{
+  mCancelRequested = TRUE;
+  return EFI_SUCCESS;
+}
+
+STATIC
+VOID
+RegisterCancelKey (
+  IN UINT16         ScanCode,
+  IN CHAR16         UnicodeChar,
+  IN UINT32         ShiftState
+  )
+{
+  EFI_STATUS    Status;
+  EFI_KEY_DATA  KeyData;
+
+  ZeroMem (&KeyData, sizeof (KeyData));
+  KeyData.Key.ScanCode = ScanCode;
+  KeyData.Key.UnicodeChar = UnicodeChar;
+  KeyData.KeyState.KeyShiftState = ShiftState;
+
+  Status = mTextInEx->RegisterKeyNotify (
+    mTextInEx,
+    &KeyData,
+    CancelKeyNotify,
+    &mNotifyHandles[mNotifyCount]
+    );
+  if (!EFI_ERROR (Status)) {
+    mNotifyCount++;
+  }
+}
+
+STATIC
+VOID
+Draw (
+  VOID
+  )
+{
+  mLastDraw = BhTimeNs ();
+  if (mTitle == NULL) {
+    return;
+  }
+
+  if (mTotal == 0) {
+    Print (L"\r%s: %u", mTitle, mDone);
+  } else {
+    Print (L"\r%s: %u/%u", mTitle, mDone, mTotal);
+  }
+}
+
+VOID
+BhProgressBegin (
+  IN CONST CHAR16   *Title
+  )
+{
+  EFI_STATUS  Status;
+
+  if (mDepth++ > 0) {
+    return;
+  }
+
+  mTitle = Title;
+  mCancelRequested = FALSE;
+  mNotifyCount = 0;
+  mDone = 0;
+  mTotal = 0;
+
+  Status = gBS->HandleProtocol (
+    gST->ConsoleInHandle,
+    &gEfiSimpleTextInputExProtocolGuid,
+    (VOID **) &mTextInEx
+    );
+  if (EFI_ERROR (Status)) {
+    mTextInEx = NULL;
+  } else {
+    //
+    // Shift state zero matches the key with any modifiers; some consoles deliver Ctrl+C
+    // as the control character and some as 'c' with control held.
+    //
+    RegisterCancelKey (SCAN_ESC, CHAR_NULL, 0);
+    RegisterCancelKey (SCAN_NULL, CTRL_C, 0);
+    RegisterCancelKey (SCAN_NULL, L'c', EFI_SHIFT_STATE_VALID | EFI_LEFT_CONTROL_PRESSED);
+    RegisterCancelKey (SCAN_NULL, L'c', EFI_SHIFT_STATE_VALID | EFI_RIGHT_CONTROL_PRESSED);
+  }
+
+  DEBUG ((DEBUG_INFO, "BH: Progress %s, %u key notifies\n", Title != NULL ? Title : L"-", mNotifyCount));
+
+  Draw ();
+}
+
+BOOLEAN
+BhProgressCancelled (
+  VOID
+  )
+{
+  EFI_INPUT_KEY Key;
+
+  if (mDepth == 0) {
+    return FALSE;
+  }
+
+  //
+  // Without key notification, other keys pressed during the operation are discarded.
+  //
+  if (mNotifyCount == 0) {
+    while (!mCancelRequested && kbhit (&Key) == EFI_SUCCESS) {
+      if (Key.ScanCode == SCAN_ESC || Key.UnicodeChar == CTRL_C) {
+        mCancelRequested = TRUE;
+      }
+    }
+  }
+
+  return mCancelRequested;
+}
+
+BOOLEAN
+BhProgressUpdate (
+  IN UINT32         Done,
+  IN UINT32         Total
+  )
+{
+  if (mDepth == 0) {
+    return FALSE;
+  }
+
+  mDone = Done;
+  mTotal = Total;
+
+  if (BhTimeNs () - mLastDraw >= BH_PROGRESS_REDRAW_NS) {
+    Draw ();
+  }
+
+  return BhProgressCancelled ();
+}
+
+VOID
+BhProgressEnd (
+  VOID
+  )
+{
+  UINT32  Index;
+
+  if (mDepth == 0 || --mDepth > 0) {
+    return;
+  }
+
+  for (Index = 0; Index < mNotifyCount; Index++) {
+    mTextInEx->UnregisterKeyNotify (mTextInEx, mNotifyHandles[Index]);
+  }
+  mNotifyCount = 0;
+
+  if (mCancelRequested) {
+    //
+    // Notified keys are still queued; do not let them answer the next prompt.
+    //
+    gST->ConIn->Reset (gST->ConIn, FALSE);
+    DEBUG ((DEBUG_INFO, "BH: Progress cancelled after %u\n", mDone));
+  }
+
+  if (mTitle != NULL) {
+    Draw ();
+    Print (mCancelRequested ? L" - cancelled\n" : L"\n");
+  }
+}
@@ -0,0 +1,50 @@
+/** @file
+  Declaration of cancellable progress reporting for long operations.
+
+  Copyright (c) 2020, Mike Beaton. All rights reserved.<BR>
+  SPDX-License-Identifier: BSD-3-Clause
+
+**/
+
+#ifndef __BH__PROGRESS__
+#define __BH__PROGRESS__
+
+//
+// Basic UEFI Libraries
+//
+#include <Uefi.h>
+#include <Library/UefiLib.h>
+
+//
+// Minimum time between progress redraws.
+//
+#define BH_PROGRESS_REDRAW_NS       250000000ULL
+
+// Start a cancellable operation, watching for Esc or Ctrl+C; Title NULL for no progress line, for
+// operations which print their own output; calls may nest, only the outermost is shown
+VOID
+BhProgressBegin (
+  IN CONST CHAR16   *Title
+  );
+
+// Report items done out of Total (zero if unknown), redrawing at most every BH_PROGRESS_REDRAW_NS;
+// returns TRUE if the operation should stop; does nothing and returns FALSE outside Begin/End
+BOOLEAN
+BhProgressUpdate (
+  IN UINT32         Done,
+  IN UINT32         Total
+  );
+
+// Return TRUE if cancel has been requested since the outermost BhProgressBegin
+BOOLEAN
+BhProgressCancelled (
+  VOID
+  );
+
+// End a cancellable operation; the outermost call prints the final count and discards pending keys if cancelled
+VOID
+BhProgressEnd (
+  VOID
+  );
+
+#endif
@@ -0,0 +1,198 @@
+/** @file
+  Firmware quirk database.
+
+  Firmware is identified by vendor string, firmware revision and SMBIOS product
+  name. Built-in entries and entries from Misc/Quirks are scanned once at startup
+  for the most specific match.
+
+  Copyright (c) 2020, Mike Beaton. All rights reserved.<BR>
+  SPDX-License-Identifier: BSD-3-Clause
+
+**/
+
+//
+// Basic UEFI Libraries
+//
+#include <Uefi.h>
+#include <Library/UefiLib.h>
+#include <Library/BaseLib.h>
+
+//
+// Boot and Runtime Services
+//
+#include <Library/UefiBootServicesTableLib.h>
+
+//
+// OC Libraries
+//
+#include <Library/OcDebugLogLib.h>
+
+//
+// Local includes
+//
+#include "Platform.h"
+#include "Quirks.h"
+
+#define QUIRK_VENDOR_SIZE   64
+
+typedef struct QUIRK_ENTRY_ {
+  CONST CHAR8   *Vendor;        ///< Firmware vendor, exact match
+  CONST CHAR8   *Model;         ///< SMBIOS product name prefix, "" for any
+  UINT32        MinRevision;
+  UINT32        MaxRevision;
+  UINT32        Quirks;
+} QUIRK_ENTRY;
+
+//
+// Entries from Misc/Quirks take precedence over these at equal specificity. Slow
+// enumeration is only set from Misc/Quirks, for firmware where it has been measured,
+// since it turns off the shared store snapshot.
+//
+STATIC
+CONST QUIRK_ENTRY
+mBuiltinQuirks[] = {
+  //
+  // Aptio deletes fail with the variable's own attributes on some boards.
+  //
+  { "American Megatrends",  "",   0, MAX_UINT32, BH_QUIRK_DELETE_ZERO_ATTRIBUTES },
+};
+
+STATIC UINT32   mQuirks = 0;
+
+STATIC
+UINT32
+ConfigQuirks (
+  IN BH_MISC_QUIRK_ENTRY  *Entry
+  )
+{
+  UINT32  Quirks;
+
+  Quirks = 0;
+  if (Entry->DeleteZeroAttributes) {
+    Quirks |= BH_QUIRK_DELETE_ZERO_ATTRIBUTES;
+  }
+  if (Entry->DeleteBeforeWrite) {
+    Quirks |= BH_QUIRK_DELETE_BEFORE_WRITE;
+  }
+  if (Entry->SlowEnumeration) {
+    Quirks |= BH_QUIRK_SLOW_ENUMERATION;
+  }
+
+  return Quirks;
+}
+
+//
+// Higher is more specific; zero if Entry does not match.
+//
+STATIC
+UINT32
+MatchScore (
+  IN CONST QUIRK_ENTRY  *Entry,
+  IN CONST CHAR8        *Vendor,
+  IN UINT32             Revision,
+  IN CONST CHAR8        *Model
+  )
+{
+  UINTN   ModelLength;
+  UINT32  Score;
+
+  if (AsciiStrCmp (Entry->Vendor, Vendor) != 0
+    || Revision < Entry->MinRevision
+    || Revision > Entry->MaxRevision) {
+    return 0;
+  }
+
+  Score = 1;
+
+  ModelLength = AsciiStrLen (Entry->Model);
+  if (ModelLength > 0) {
+    if (AsciiStrnCmp (Entry->Model, Model, ModelLength) != 0) {
+      return 0;
+    }
+    Score += 4;
+  }
+
+  if (Entry->MinRevision != 0 || Entry->MaxRevision != MAX_UINT32) {
+    Score += 2;
+  }
+
+  return Score;
+}
+
+VOID
+BhQuirksInit (
+  IN BH_MISC_QUIRK_ARRAY  *Quirks OPTIONAL
+  )
+{
+  UINT32              Index;
+  UINT32              Score;
+  UINT32              BestScore;
+  UINT32              Revision;
+  QUIRK_ENTRY         Entry;
+  CHAR8               Vendor[QUIRK_VENDOR_SIZE];
+  CONST CHAR8         *Model;
+  BH_MISC_QUIRK_ENTRY *ConfigEntry;
+
+  mQuirks = 0;
+
+  //
+  // Firmware vendor is only matched on its ASCII content.
+  //
+  Vendor[0] = '\0';
+  if (gST->FirmwareVendor != NULL) {
+    for (Index = 0; Index < QUIRK_VENDOR_SIZE - 1 && gST->FirmwareVendor[Index] != L'\0'; Index++) {
+      Vendor[Index] = (CHAR8) gST->FirmwareVendor[Index];
+    }
+    Vendor[Index] = '\0';
+  }
+  Revision = gST->FirmwareRevision;
+  Model = BhGetPlatformInfo ()->ProductName;
+
+  //
+  // Later (configuration) entries win at equal score.
+  //
+  BestScore = 0;
+  for (Index = 0; Index < ARRAY_SIZE (mBuiltinQuirks); Index++) {
+    Score = MatchScore (&mBuiltinQuirks[Index], Vendor, Revision, Model);
+    if (Score > 0 && Score >= BestScore) {
+      BestScore = Score;
+      mQuirks = mBuiltinQuirks[Index].Quirks;
+    }
+  }
+
+  for (Index = 0; Quirks != NULL && Index < Quirks->Count; Index++) {
+    ConfigEntry = Quirks->Values[Index];
+    if (!ConfigEntry->Enabled) {
+      continue;
+    }
+    Entry.Vendor      = OC_BLOB_GET (&ConfigEntry->Vendor);
+    Entry.Model       = OC_BLOB_GET (&ConfigEntry->Model);
+    Entry.MinRevision = ConfigEntry->MinRevision;
+    Entry.MaxRevision = ConfigEntry->MaxRevision;
+    Entry.Quirks      = ConfigQuirks (ConfigEntry);
+
+    Score = MatchScore (&Entry, Vendor, Revision, Model);
+    if (Score > 0 && Score >= BestScore) {
+      BestScore = Score;
+      mQuirks = Entry.Quirks;
+    }
+  }
+
+  DEBUG ((
+    DEBUG_INFO,
+    "BH: Firmware %a rev 0x%x model %a - quirks 0x%x%a\n",
+    Vendor,
+    Revision,
+    Model,
+    mQuirks,
+    BestScore == 0 ? " (no match)" : ""
+    ));
+}
+
+UINT32
+BhQuirks (
+  VOID
+  )
+{
+  return mQuirks;
+}
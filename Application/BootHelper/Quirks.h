@@ -0,0 +1,50 @@
+/** @file
+  Declaration of firmware quirk database.
+
+  Copyright (c) 2020, Mike Beaton. All rights reserved.<BR>
+  SPDX-License-Identifier: BSD-3-Clause
+
+**/
+
+#ifndef __BH__QUIRKS__
+#define __BH__QUIRKS__
+
+//
+// Basic UEFI Libraries
+//
+#include <Uefi.h>
+#include <Library/UefiLib.h>
+
+//
+// Local includes
+//
+#include "BhConfig.h"
+
+//
+// Delete variables with Attributes == 0, rather than with their attributes.
+//
+#define BH_QUIRK_DELETE_ZERO_ATTRIBUTES   BIT0
+//
+// Delete a variable before rewriting it with a different size or attributes.
+//
+#define BH_QUIRK_DELETE_BEFORE_WRITE      BIT1
+//
+// GetNextVariableName is slow: read single variables directly instead of
+// taking a full store snapshot just to look them up.
+//
+#define BH_QUIRK_SLOW_ENUMERATION         BIT2
+
+// Identify firmware and look up its quirks, in the built-in table and in Quirks from the
+// configuration, if any; the best match (model, then revision range, then configuration) wins
+VOID
+BhQuirksInit (
+  IN BH_MISC_QUIRK_ARRAY  *Quirks OPTIONAL
+  );
+
+// Return quirks found by BhQuirksInit, or zero if it has not been called
+UINT32
+BhQuirks (
+  VOID
+  );
+
+#endif
@@ -0,0 +1,347 @@
+/** @file
+  Session report published to NVRAM.
+
+  A compact binary summary of the run (tool version, variables changed,
+  verification of the previous run, startup timings) is written once, at
+  exit, to a variable which can be read from macOS without mounting the ESP.
+
+  Copyright (c) 2020, Mike Beaton. All rights reserved.<BR>
+  SPDX-License-Identifier: BSD-3-Clause
+
+**/
+
+//
+// Basic UEFI Libraries
+//
+#include <Uefi.h>
+#include <Library/UefiLib.h>
+#include <Library/BaseLib.h>
+#include <Library/BaseMemoryLib.h>
+
+//
+// Boot and Runtime Services
+//
+#include <Library/UefiRuntimeServicesTableLib.h>
+
+//
+// OC Libraries
+//
+#include <Library/OcDebugLogLib.h>
+
+//
+// Local includes
+//
+#include "BootHelper.h"
+#include "Persist.h"
+#include "Report.h"
+#include "Timing.h"
+#include "VarEngine.h"
+
+//
+// Allowance for the firmware's own per-variable header.
+//
+#define REPORT_VARIABLE_OVERHEAD    64
+
+typedef struct REPORT_ACTION_ {
+  UINT8     Kind;
+  UINT8     Length;
+  CHAR8     Name[BH_REPORT_MAX_NAME];
+} REPORT_ACTION;
+
+typedef struct REPORT_WRITER_ {
+  UINT8               *Buffer;
+  UINTN               Size;
+  UINTN               MaxSize;
+  BH_REPORT_SECTION   *Section;
+  BOOLEAN             Truncated;
+} REPORT_WRITER;
+
+STATIC REPORT_ACTION  mActions[BH_REPORT_MAX_ACTIONS];
+STATIC UINT32         mActionCount  = 0;
+STATIC UINT32         mActionTotal  = 0;
+STATIC BOOLEAN        mPublished    = FALSE;
+
+STATIC
+UINT8
+AsciiName (
+  IN  CONST CHAR16  *Name,
+  OUT CHAR8         *Out
+  )
+{
+  UINT8   Length;
+
+  for (Length = 0; Length < BH_REPORT_MAX_NAME && Name[Length] != L'\0'; Length++) {
+    Out[Length] = Name[Length] < 0x80 ? (CHAR8) Name[Length] : '?';
+  }
+
+  return Length;
+}
+
+STATIC
+VOID
+NoteAction (
+  IN CONST CHAR16     *Name,
+  IN CONST EFI_GUID   *Guid,
+  IN UINT32           Attributes,
+  IN UINTN            Size,
+  IN CONST VOID       *Data
+  )
+{
+  //
+  // BootHelper's own bookkeeping variables are not actions.
+  //
+  if (CompareGuid (Guid, &gBootHelperVariableGuid)) {
+    return;
+  }
+
+  mActionTotal++;
+  if (mActionCount < BH_REPORT_MAX_ACTIONS) {
+    mActions[mActionCount].Kind = Size == 0 ? BH_REPORT_ACTION_DELETE : BH_REPORT_ACTION_WRITE;
+    mActions[mActionCount].Length = AsciiName (Name, mActions[mActionCount].Name);
+    mActionCount++;
+  }
+}
+
+//
+// Sections are only started if there is room for their first item, MinSize bytes.
+//
+STATIC
+BOOLEAN
+BeginSection (
+  IN OUT REPORT_WRITER  *Writer,
+  IN     UINT8          Type,
+  IN     UINTN          MinSize
+  )
+{
+  BH_REPORT_HEADER  *Header;
+
+  if (Writer->MaxSize - Writer->Size < sizeof (BH_REPORT_SECTION) + MinSize) {
+    Writer->Truncated = TRUE;
+    return FALSE;
+  }
+
+  Writer->Section = (BH_REPORT_SECTION *) (Writer->Buffer + Writer->Size);
+  Writer->Section->Type = Type;
+  Writer->Section->Reserved = 0;
+  Writer->Section->Size = 0;
+  Writer->Size += sizeof (BH_REPORT_SECTION);
+
+  Header = (BH_REPORT_HEADER *) Writer->Buffer;
+  Header->SectionCount++;
+
+  return TRUE;
+}
+
+//
+// Items are added whole or not at all.
+//
+STATIC
+BOOLEAN
+AddItem (
+  IN OUT REPORT_WRITER  *Writer,
+  IN     CONST VOID     *Fixed,
+  IN     UINTN          FixedSize,
+  IN     CONST CHAR8    *Name OPTIONAL,
+  IN     UINT8          NameLength
+  )
+{
+  if (Writer->MaxSize - Writer->Size < FixedSize + NameLength) {
+    Writer->Truncated = TRUE;
+    return FALSE;
+  }
+
+  CopyMem (Writer->Buffer + Writer->Size, Fixed, FixedSize);
+  Writer->Size += FixedSize;
+  if (NameLength > 0) {
+    CopyMem (Writer->Buffer + Writer->Size, Name, NameLength);
+    Writer->Size += NameLength;
+  }
+  Writer->Section->Size = (UINT16) (Writer->Section->Size + FixedSize + NameLength);
+
+  return TRUE;
+}
+
+STATIC
+VOID
+AddVerify (
+  IN OUT REPORT_WRITER  *Writer,
+  IN OUT UINT16         *Flags
+  )
+{
+  BH_REPORT_VERIFY  Verify;
+  BOOLEAN           CanaryLost;
+
+  if (!BhPersistGetResult (&Verify.Checked, &Verify.Failed, &CanaryLost)) {
+    return;
+  }
+
+  *Flags |= BH_REPORT_FLAG_VERIFIED;
+  if (CanaryLost) {
+    *Flags |= BH_REPORT_FLAG_CANARY_LOST;
+  }
+
+  if (BeginSection (Writer, BH_REPORT_SECTION_VERIFY, sizeof (Verify))) {
+    AddItem (Writer, &Verify, sizeof (Verify), NULL, 0);
+  }
+}
+
+STATIC
+VOID
+AddActions (
+  IN OUT REPORT_WRITER  *Writer
+  )
+{
+  UINT16  Total;
+  UINT32  Index;
+
+  if (mActionTotal == 0 || !BeginSection (Writer, BH_REPORT_SECTION_ACTIONS, sizeof (Total))) {
+    return;
+  }
+
+  Total = (UINT16) MIN (mActionTotal, MAX_UINT16);
+  if (!AddItem (Writer, &Total, sizeof (Total), NULL, 0)) {
+    return;
+  }
+
+  for (Index = 0; Index < mActionCount; Index++) {
+    if (!AddItem (Writer, &mActions[Index].Kind, 2 * sizeof (UINT8), mActions[Index].Name, mActions[Index].Length)) {
+      return;
+    }
+  }
+
+  if (mActionTotal > mActionCount) {
+    Writer->Truncated = TRUE;
+  }
+}
+
+STATIC
+VOID
+AddTimings (
+  IN OUT REPORT_WRITER  *Writer
+  )
+{
+  CONST BH_SPAN   *Spans;
+  UINT32          Count;
+  UINT32          Index;
+  UINT8           Fixed[sizeof (UINT32) + sizeof (UINT8)];
+  UINT32          Microseconds;
+  CHAR8           Name[BH_REPORT_MAX_NAME];
+
+  Spans = BhSpans (&Count);
+  if (Count == 0 || !BeginSection (Writer, BH_REPORT_SECTION_TIMINGS, sizeof (Fixed))) {
+    return;
+  }
+
+  for (Index = 0; Index < Count; Index++) {
+    if (Spans[Index].End == 0) {
+      continue;
+    }
+
+    Microseconds = (UINT32) MIN (DivU64x32 (Spans[Index].End - Spans[Index].Start, 1000), MAX_UINT32);
+    CopyMem (Fixed, &Microseconds, sizeof (Microseconds));
+    Fixed[sizeof (UINT32)] = AsciiName (Spans[Index].Name, Name);
+
+    if (!AddItem (Writer, Fixed, sizeof (Fixed), Name, Fixed[sizeof (UINT32)])) {
+      return;
+    }
+  }
+}
+
+EFI_STATUS
+BhReportStart (
+  VOID
+  )
+{
+  mActionCount = 0;
+  mActionTotal = 0;
+
+  return BhVarAddWriteNotify (NoteAction);
+}
+
+EFI_STATUS
+BhReportPublish (
+  VOID
+  )
+{
+  EFI_STATUS        Status;
+  UINT8             Buffer[BH_REPORT_MAX_SIZE];
+  REPORT_WRITER     Writer;
+  BH_REPORT_HEADER  *Header;
+  UINT16            Flags;
+  UINT64            MaxStorageSize;
+  UINT64            RemainingStorageSize;
+  UINT64            MaxVariableSize;
+
+  BhVarRemoveWriteNotify (NoteAction);
+
+  if (mPublished) {
+    return EFI_ALREADY_STARTED;
+  }
+  mPublished = TRUE;
+
+  Writer.Buffer = Buffer;
+  Writer.Size = sizeof (BH_REPORT_HEADER);
+  Writer.MaxSize = sizeof (Buffer);
+  Writer.Section = NULL;
+  Writer.Truncated = FALSE;
+
+  //
+  // Fit within what the firmware will accept, where it says; QueryVariableInfo is
+  // not present in EFI 1.x runtime services, as on older Macs.
+  //
+  Status = EFI_UNSUPPORTED;
+  if (gRT->Hdr.Revision >= EFI_2_00_SYSTEM_TABLE_REVISION) {
+    Status = gRT->QueryVariableInfo (
+      BH_VAR_DEFAULT_ATTRIBUTES,
+      &MaxStorageSize,
+      &RemainingStorageSize,
+      &MaxVariableSize
+      );
+  }
+  if (!EFI_ERROR (Status)
+    && MaxVariableSize > sizeof (BH_REPORT_VARIABLE_NAME) + REPORT_VARIABLE_OVERHEAD + sizeof (BH_REPORT_HEADER)) {
+    Writer.MaxSize = (UINTN) MIN (
+      MaxVariableSize - sizeof (BH_REPORT_VARIABLE_NAME) - REPORT_VARIABLE_OVERHEAD,
+      sizeof (Buffer)
+      );
+  }
+
+  Header = (BH_REPORT_HEADER *) Buffer;
+  ZeroMem (Header, sizeof (*Header));
+  Header->Signature = BH_REPORT_SIGNATURE;
+  Header->Version = BH_REPORT_VERSION;
+  Header->HeaderSize = sizeof (*Header);
+  Header->ToolVersion = BOOT_HELPER_VERSION_NUMBER;
+  gRT->GetTime (&Header->Time, NULL);
+
+  Flags = 0;
+  AddVerify (&Writer, &Flags);
+  AddActions (&Writer);
+  AddTimings (&Writer);
+
+  if (Writer.Truncated) {
+    Flags |= BH_REPORT_FLAG_TRUNCATED;
+  }
+  Header->Flags = Flags;
+
+  Status = BhVarWrite (
+    BH_REPORT_VARIABLE_NAME,
+    &gBootHelperVariableGuid,
+    BH_VAR_DEFAULT_ATTRIBUTES,
+    Writer.Size,
+    Buffer,
+    NULL
+    );
+
+  DEBUG ((
+    DEBUG_INFO,
+    "BH: Report %u bytes (max %u), %u actions, flags 0x%x - %r\n",
+    (UINT32) Writer.Size,
+    (UINT32) Writer.MaxSize,
+    mActionTotal,
+    Flags,
+    Status
+    ));
+
+  return Status;
+}
@@ -0,0 +1,92 @@
+/** @file
+  Declaration of session report published to NVRAM.
+
+  Copyright (c) 2020, Mike Beaton. All rights reserved.<BR>
+  SPDX-License-Identifier: BSD-3-Clause
+
+**/
+
+#ifndef __BH__REPORT__
+#define __BH__REPORT__
+
+//
+// Basic UEFI Libraries
+//
+#include <Uefi.h>
+#include <Library/UefiLib.h>
+
+//
+// Report is under gBootHelperVariableGuid, readable from macOS with
+// nvram 9D1C7A34-52E8-4B6F-A10E-6C83F2475D19:BootHelperReport
+//
+#define BH_REPORT_VARIABLE_NAME     L"BootHelperReport"
+
+#define BH_REPORT_SIGNATURE         SIGNATURE_32 ('B', 'H', 'R', 'P')
+#define BH_REPORT_VERSION           1
+
+//
+// Upper bound on report size; less is used if the firmware maximum variable size is smaller.
+//
+#define BH_REPORT_MAX_SIZE          1024
+#define BH_REPORT_MAX_ACTIONS       16
+#define BH_REPORT_MAX_NAME          31
+
+#define BH_REPORT_FLAG_TRUNCATED    BIT0    ///< Some actions or timings did not fit
+#define BH_REPORT_FLAG_VERIFIED     BIT1    ///< Writes from the previous run were verified
+#define BH_REPORT_FLAG_CANARY_LOST  BIT2    ///< Previous run's writes were not saved at all
+
+#define BH_REPORT_SECTION_VERIFY    1
+#define BH_REPORT_SECTION_ACTIONS   2
+#define BH_REPORT_SECTION_TIMINGS   3
+
+#define BH_REPORT_ACTION_WRITE      1
+#define BH_REPORT_ACTION_DELETE     2
+
+//
+// Report layout, all values little-endian:
+//   BH_REPORT_HEADER
+//   SectionCount x (BH_REPORT_SECTION, UINT8 Payload[Size])
+// VERIFY payload:  BH_REPORT_VERIFY
+// ACTIONS payload: UINT16 Total, then up to BH_REPORT_MAX_ACTIONS x (UINT8 Kind, UINT8 Length, CHAR8 Name[Length])
+// TIMINGS payload: Count x (UINT32 Microseconds, UINT8 Length, CHAR8 Name[Length])
+// Names are ASCII, truncated to BH_REPORT_MAX_NAME, and not terminated.
+// Utilities/BhFleet/bhreport.py reads this format on the host; keep them in step.
+//
+#pragma pack(1)
+
+typedef struct BH_REPORT_HEADER_ {
+  UINT32    Signature;
+  UINT16    Version;
+  UINT16    HeaderSize;
+  UINT32    ToolVersion;        ///< BOOT_HELPER_VERSION_NUMBER
+  EFI_TIME  Time;
+  UINT16    Flags;
+  UINT16    SectionCount;
+} BH_REPORT_HEADER;
+
+typedef struct BH_REPORT_SECTION_ {
+  UINT8     Type;
+  UINT8     Reserved;
+  UINT16    Size;               ///< Payload size in bytes
+} BH_REPORT_SECTION;
+
+typedef struct BH_REPORT_VERIFY_ {
+  UINT32    Checked;
+  UINT32    Failed;
+} BH_REPORT_VERIFY;
+
+#pragma pack()
+
+// Start recording variable writes made in this run, as the actions taken
+EFI_STATUS
+BhReportStart (
+  VOID
+  );
+
+// Stop recording, and write the report variable; does nothing after the first call
+EFI_STATUS
+BhReportPublish (
+  VOID
+  );
+
+#endif
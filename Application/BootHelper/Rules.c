@@ -0,0 +1,1013 @@
+/** @file
+  NVRAM provisioning rules.
+
+  Misc/Rules is compiled once, at configuration load, into a flat array of fixed
+  size instructions, with variable names and literal values moved into small
+  tables. Each rule starts with a RULE instruction holding the index of the next
+  rule, followed by its tests and then its actions.
+
+  Evaluation reads each variable used by any rule once (one store snapshot, unless
+  the firmware has BH_QUIRK_SLOW_ENUMERATION), and tests always see those values,
+  so rules do not depend on each other's order. Actions change a working copy,
+  and only variables touched by a matching rule are written, once each, at the end.
+
+  Copyright (c) 2020, Mike Beaton. All rights reserved.<BR>
+  SPDX-License-Identifier: BSD-3-Clause
+
+**/
+
+//
+// Basic UEFI Libraries
+//
+#include <Uefi.h>
+#include <Library/UefiLib.h>
+#include <Library/BaseLib.h>
+#include <Library/BaseMemoryLib.h>
+#include <Library/MemoryAllocationLib.h>
+
+//
+// Boot and Runtime Services
+//
+#include <Library/UefiBootServicesTableLib.h>
+
+//
+// OC Libraries
+//
+#include <Library/OcDebugLogLib.h>
+
+//
+// Local includes
+//
+#include "Platform.h"
+#include "Rules.h"
+#include "Utils.h"
+#include "VarEngine.h"
+
+#define RULE_OP_RULE                0x01
+#define RULE_OP_END                 0x02
+
+//
+// Tests; literal is UINT64 values for SCALAR and MASK_*, otherwise bytes.
+//
+#define RULE_OP_PRESENT             0x10
+#define RULE_OP_SCALAR              0x11
+#define RULE_OP_MASK_ANY            0x12
+#define RULE_OP_MASK_EQUAL          0x13
+#define RULE_OP_BYTES               0x14
+#define RULE_OP_STRING              0x15
+#define RULE_OP_PREFIX              0x16
+#define RULE_OP_TOKEN               0x17
+
+//
+// Actions.
+//
+#define RULE_OP_SET                 0x20
+#define RULE_OP_DELETE              0x21
+#define RULE_OP_ADD_TOKEN           0x22
+#define RULE_OP_REMOVE_TOKEN        0x23
+
+#define RULE_OP_NEGATE              0x80
+#define RULE_OP_MASK                0x7F
+
+#define RULE_IS_TEST(Op)            (((Op) & RULE_OP_MASK) >= RULE_OP_PRESENT && ((Op) & RULE_OP_MASK) < RULE_OP_SET)
+
+//
+// Identity pseudo-variables, compared as ASCII text.
+//
+#define RULE_VAR_MODEL              0xF0
+#define RULE_VAR_BIOS               0xF1
+#define RULE_VAR_VENDOR             0xF2
+#define RULE_VAR_IS_IDENTITY(Var)   ((Var) >= RULE_VAR_MODEL)
+
+#define RULE_MAX_TEXT               128
+#define RULE_GUID_LENGTH            36
+#define RULE_VENDOR_SIZE            64
+
+#define APPLE_GUID \
+  { 0x7c436110, 0xab2a, 0x4bbb, {0xa8, 0x80, 0xfe, 0x41, 0x99, 0x5c, 0x9f, 0x82} }
+
+typedef struct RULE_INSN_ {
+  UINT8     Op;
+  UINT8     Var;                ///< Index into mVars, or RULE_VAR_*
+  UINT16    Literal;            ///< Offset into mLiterals; rule number for RULE
+  UINT16    Size;               ///< Literal size
+  UINT16    Next;               ///< RULE only, index of the next rule
+} RULE_INSN;
+
+typedef struct RULE_VAR_ {
+  CHAR16    Name[BH_RULES_MAX_NAME];
+  EFI_GUID  Guid;
+} RULE_VAR;
+
+typedef struct RULE_VALUE_ {
+  BOOLEAN   Present;
+  UINTN     Size;
+  UINT8     *Data;              ///< Allocated
+} RULE_VALUE;
+
+typedef enum {
+  RuleLiteralScalar,
+  RuleLiteralString,
+  RuleLiteralBytes
+} RULE_LITERAL_KIND;
+
+STATIC EFI_GUID         mAppleGuid = APPLE_GUID;
+
+STATIC RULE_INSN        mCode[BH_RULES_MAX_CODE];
+STATIC UINT32           mCodeCount = 0;
+STATIC UINT8            mLiterals[BH_RULES_MAX_LITERALS];
+STATIC UINT32           mLiteralSize = 0;
+STATIC RULE_VAR         mVars[BH_RULES_MAX_VARS];
+STATIC UINT32           mVarCount = 0;
+
+STATIC BH_RULES_RESULT  mResult;
+
+//
+// Compilation.
+//
+
+STATIC
+BOOLEAN
+Emit (
+  IN UINT8    Op,
+  IN UINT8    Var,
+  IN UINT16   Literal,
+  IN UINT16   Size
+  )
+{
+  //
+  // One slot is kept for the final END.
+  //
+  if (mCodeCount >= BH_RULES_MAX_CODE - 1) {
+    return FALSE;
+  }
+
+  mCode[mCodeCount].Op = Op;
+  mCode[mCodeCount].Var = Var;
+  mCode[mCodeCount].Literal = Literal;
+  mCode[mCodeCount].Size = Size;
+  mCode[mCodeCount].Next = 0;
+  ++mCodeCount;
+
+  return TRUE;
+}
+
+STATIC
+BOOLEAN
+AddLiteral (
+  IN  CONST VOID  *Data,
+  IN  UINTN       Size,
+  OUT UINT16      *Offset
+  )
+{
+  if (Size > BH_RULES_MAX_LITERALS - mLiteralSize) {
+    return FALSE;
+  }
+
+  *Offset = (UINT16) mLiteralSize;
+  CopyMem (&mLiterals[mLiteralSize], Data, Size);
+  mLiteralSize += (UINT32) Size;
+
+  return TRUE;
+}
+
+STATIC
+INTN
+HexDigit (
+  IN CHAR8  Char
+  )
+{
+  if (Char >= '0' && Char <= '9') {
+    return Char - '0';
+  }
+  if (Char >= 'a' && Char <= 'f') {
+    return Char - 'a' + 10;
+  }
+  if (Char >= 'A' && Char <= 'F') {
+    return Char - 'A' + 10;
+  }
+  return -1;
+}
+
+//
+// Parse "text", <hex bytes> or an integer into the literal table.
+//
+STATIC
+BOOLEAN
+ParseLiteral (
+  IN  CONST CHAR8         *Text,
+  OUT RULE_LITERAL_KIND   *Kind,
+  OUT UINT16              *Offset,
+  OUT UINT16              *Size
+  )
+{
+  UINTN       Length;
+  UINT8       Bytes[RULE_MAX_TEXT];
+  UINTN       Count;
+  INTN        High;
+  INTN        Low;
+  UINT64      Value;
+  CHAR8       *End;
+  CONST CHAR8 *Last;
+
+  Length = AsciiStrLen (Text);
+
+  if (Length >= 2 && Text[0] == '"' && Text[Length - 1] == '"') {
+    *Kind = RuleLiteralString;
+    *Size = (UINT16) (Length - 2);
+    return AddLiteral (Text + 1, Length - 2, Offset);
+  }
+
+  if (Length >= 2 && Text[0] == '<' && Text[Length - 1] == '>') {
+    Count = 0;
+    Last = Text + Length - 1;
+    for (Text++; Text < Last; Text++) {
+      if (*Text == ' ') {
+        continue;
+      }
+      High = HexDigit (Text[0]);
+      Low = Text + 1 < Last ? HexDigit (Text[1]) : -1;
+      if (High < 0 || Low < 0 || Count >= sizeof (Bytes)) {
+        return FALSE;
+      }
+      Bytes[Count++] = (UINT8) ((High << 4) | Low);
+      Text++;
+    }
+    *Kind = RuleLiteralBytes;
+    *Size = (UINT16) Count;
+    return AddLiteral (Bytes, Count, Offset);
+  }
+
+  if (Length > 2 && Text[0] == '0' && (Text[1] == 'x' || Text[1] == 'X')) {
+    if (EFI_ERROR (AsciiStrHexToUint64S (Text, &End, &Value))) {
+      return FALSE;
+    }
+  } else if (EFI_ERROR (AsciiStrDecimalToUint64S (Text, &End, &Value))) {
+    return FALSE;
+  }
+  if (Length == 0 || *End != '\0') {
+    return FALSE;
+  }
+
+  *Kind = RuleLiteralScalar;
+  *Size = sizeof (Value);
+  return AddLiteral (&Value, sizeof (Value), Offset);
+}
+
+//
+// Find or add the variable named by the Length characters at Text, as NAME, GUID:NAME or @identity.
+//
+STATIC
+BOOLEAN
+ParseName (
+  IN  CONST CHAR8   *Text,
+  IN  UINTN         Length,
+  IN  BOOLEAN       AllowIdentity,
+  OUT UINT8         *Var
+  )
+{
+  CHAR8     GuidText[RULE_GUID_LENGTH + 1];
+  EFI_GUID  Guid;
+  CHAR16    Name[BH_RULES_MAX_NAME];
+  UINTN     Index;
+
+  if (Length > 1 && Text[0] == '@') {
+    if (!AllowIdentity) {
+      return FALSE;
+    }
+    if (Length == 6 && AsciiStrnCmp (Text, "@model", 6) == 0) {
+      *Var = RULE_VAR_MODEL;
+    } else if (Length == 5 && AsciiStrnCmp (Text, "@bios", 5) == 0) {
+      *Var = RULE_VAR_BIOS;
+    } else if (Length == 7 && AsciiStrnCmp (Text, "@vendor", 7) == 0) {
+      *Var = RULE_VAR_VENDOR;
+    } else {
+      return FALSE;
+    }
+    return TRUE;
+  }
+
+  CopyGuid (&Guid, &mAppleGuid);
+  if (Length > RULE_GUID_LENGTH + 1 && Text[RULE_GUID_LENGTH] == ':') {
+    CopyMem (GuidText, Text, RULE_GUID_LENGTH);
+    GuidText[RULE_GUID_LENGTH] = '\0';
+    if (EFI_ERROR (AsciiStrToGuid (GuidText, &Guid))) {
+      return FALSE;
+    }
+    Text += RULE_GUID_LENGTH + 1;
+    Length -= RULE_GUID_LENGTH + 1;
+  }
+
+  if (Length == 0 || Length >= BH_RULES_MAX_NAME) {
+    return FALSE;
+  }
+  for (Index = 0; Index < Length; Index++) {
+    Name[Index] = (CHAR16) Text[Index];
+  }
+  Name[Length] = L'\0';
+
+  for (Index = 0; Index < mVarCount; Index++) {
+    if (StrCmp (mVars[Index].Name, Name) == 0 && CompareGuid (&mVars[Index].Guid, &Guid)) {
+      *Var = (UINT8) Index;
+      return TRUE;
+    }
+  }
+
+  if (mVarCount >= BH_RULES_MAX_VARS) {
+    return FALSE;
+  }
+
+  StrCpyS (mVars[mVarCount].Name, BH_RULES_MAX_NAME, Name);
+  CopyGuid (&mVars[mVarCount].Guid, &Guid);
+  *Var = (UINT8) mVarCount++;
+
+  return TRUE;
+}
+
+STATIC
+BOOLEAN
+CompileCondition (
+  IN CONST CHAR8  *Text
+  )
+{
+  UINT8               Negate;
+  UINTN               Length;
+  UINT8               Var;
+  CHAR8               Mask[RULE_MAX_TEXT];
+  CHAR8               *Expect;
+  RULE_LITERAL_KIND   Kind;
+  UINT16              Offset;
+  UINT16              Size;
+  UINT16              Unused;
+
+  Negate = 0;
+  if (Text[0] == '!') {
+    Negate = RULE_OP_NEGATE;
+    Text++;
+  }
+
+  for (Length = 0; Text[Length] != '\0'; Length++) {
+    if (Text[Length] == '=' || Text[Length] == '&' || Text[Length] == '~'
+      || (Text[Length] == '^' && Text[Length + 1] == '=')) {
+      break;
+    }
+  }
+
+  if (!ParseName (Text, Length, TRUE, &Var)) {
+    return FALSE;
+  }
+  Text += Length;
+
+  if (*Text == '\0') {
+    return Emit (RULE_OP_PRESENT | Negate, Var, 0, 0);
+  }
+
+  if (*Text == '&') {
+    if (RULE_VAR_IS_IDENTITY (Var) || EFI_ERROR (AsciiStrCpyS (Mask, sizeof (Mask), Text + 1))) {
+      return FALSE;
+    }
+    Expect = AsciiStrStr (Mask, "=");
+    if (Expect != NULL) {
+      *Expect++ = '\0';
+    }
+    if (!ParseLiteral (Mask, &Kind, &Offset, &Size) || Kind != RuleLiteralScalar) {
+      return FALSE;
+    }
+    if (Expect == NULL) {
+      return Emit (RULE_OP_MASK_ANY | Negate, Var, Offset, Size);
+    }
+    if (!ParseLiteral (Expect, &Kind, &Unused, &Size) || Kind != RuleLiteralScalar) {
+      return FALSE;
+    }
+    return Emit (RULE_OP_MASK_EQUAL | Negate, Var, Offset, 2 * Size);
+  }
+
+  if (*Text == '=') {
+    if (!ParseLiteral (Text + 1, &Kind, &Offset, &Size)) {
+      return FALSE;
+    }
+    if (Kind == RuleLiteralScalar) {
+      return !RULE_VAR_IS_IDENTITY (Var) && Emit (RULE_OP_SCALAR | Negate, Var, Offset, Size);
+    }
+    return Emit ((Kind == RuleLiteralString ? RULE_OP_STRING : RULE_OP_BYTES) | Negate, Var, Offset, Size);
+  }
+
+  //
+  // Prefix (^=) and token (~) take text.
+  //
+  if (!ParseLiteral (Text + (*Text == '^' ? 2 : 1), &Kind, &Offset, &Size) || Kind == RuleLiteralScalar) {
+    return FALSE;
+  }
+  if (*Text == '^') {
+    return Emit (RULE_OP_PREFIX | Negate, Var, Offset, Size);
+  }
+  if (Size == 0 || ScanMem8 (&mLiterals[Offset], Size, ' ') != NULL) {
+    return FALSE;
+  }
+  return Emit (RULE_OP_TOKEN | Negate, Var, Offset, Size);
+}
+
+STATIC
+BOOLEAN
+CompileAction (
+  IN CONST CHAR8  *Text
+  )
+{
+  UINTN               Length;
+  UINT8               Var;
+  UINT8               Op;
+  RULE_LITERAL_KIND   Kind;
+  UINT16              Offset;
+  UINT16              Size;
+
+  if (Text[0] == '!') {
+    return ParseName (Text + 1, AsciiStrLen (Text + 1), FALSE, &Var)
+      && Emit (RULE_OP_DELETE, Var, 0, 0);
+  }
+
+  for (Length = 0; Text[Length] != '\0' && Text[Length] != '='; Length++) {
+  }
+  if (Text[Length] != '=' || Length == 0) {
+    return FALSE;
+  }
+
+  Op = RULE_OP_SET;
+  if (Text[Length - 1] == '+') {
+    Op = RULE_OP_ADD_TOKEN;
+  } else if (Text[Length - 1] == '-') {
+    Op = RULE_OP_REMOVE_TOKEN;
+  }
+
+  if (!ParseName (Text, Op == RULE_OP_SET ? Length : Length - 1, FALSE, &Var)) {
+    return FALSE;
+  }
+
+  //
+  // Set needs text or <hex>, so that the size of the value is explicit.
+  //
+  if (!ParseLiteral (Text + Length + 1, &Kind, &Offset, &Size) || Kind == RuleLiteralScalar) {
+    return FALSE;
+  }
+
+  if (Op != RULE_OP_SET && (Size == 0 || ScanMem8 (&mLiterals[Offset], Size, ' ') != NULL)) {
+    return FALSE;
+  }
+
+  return Emit (Op, Var, Offset, Size);
+}
+
+VOID
+BhRulesCompile (
+  IN BH_MISC_RULE_ARRAY   *Rules
+  )
+{
+  UINT32              Index;
+  UINT32              Item;
+  BH_MISC_RULE_ENTRY  *Rule;
+  UINT32              Start;
+  UINT32              LiteralMark;
+  UINT32              VarMark;
+  BOOLEAN             Compiled;
+  CONST CHAR8         *Failed;
+
+  mCodeCount = 0;
+  mLiteralSize = 0;
+  mVarCount = 0;
+  ZeroMem (&mResult, sizeof (mResult));
+
+  for (Index = 0; Rules != NULL && Index < Rules->Count; Index++) {
+    Rule = Rules->Values[Index];
+    if (!Rule->Enabled) {
+      continue;
+    }
+
+    Start = mCodeCount;
+    LiteralMark = mLiteralSize;
+    VarMark = mVarCount;
+    Failed = NULL;
+
+    Compiled = Emit (RULE_OP_RULE, 0, (UINT16) Index, 0);
+    for (Item = 0; Compiled && Item < Rule->If.Count; Item++) {
+      Compiled = CompileCondition (OC_BLOB_GET (Rule->If.Values[Item]));
+      if (!Compiled) {
+        Failed = OC_BLOB_GET (Rule->If.Values[Item]);
+      }
+    }
+    for (Item = 0; Compiled && Item < Rule->Then.Count; Item++) {
+      Compiled = CompileAction (OC_BLOB_GET (Rule->Then.Values[Item]));
+      if (!Compiled) {
+        Failed = OC_BLOB_GET (Rule->Then.Values[Item]);
+      }
+    }
+
+    if (!Compiled) {
+      DEBUG ((
+        DEBUG_WARN,
+        "BH: Rule %u (%a) skipped, cannot compile %a\n",
+        Index,
+        OC_BLOB_GET (&Rule->Comment),
+        Failed != NULL ? Failed : "(program full)"
+        ));
+      mCodeCount = Start;
+      mLiteralSize = LiteralMark;
+      mVarCount = VarMark;
+      ++mResult.Skipped;
+      continue;
+    }
+
+    mCode[Start].Next = (UINT16) mCodeCount;
+    ++mResult.Rules;
+  }
+
+  mCode[mCodeCount].Op = RULE_OP_END;
+
+  DEBUG ((
+    DEBUG_INFO,
+    "BH: Compiled %u rules, %u skipped, %u instructions, %u variables, %u literal bytes\n",
+    mResult.Rules,
+    mResult.Skipped,
+    mCodeCount,
+    mVarCount,
+    mLiteralSize
+    ));
+}
+
+//
+// Evaluation.
+//
+
+//
+// Value as a little-endian scalar, as bhindex.py; zero if longer than eight bytes.
+//
+STATIC
+UINT64
+ValueScalar (
+  IN CONST RULE_VALUE   *Value
+  )
+{
+  UINT64  Scalar;
+
+  Scalar = 0;
+  if (Value->Size <= sizeof (Scalar)) {
+    CopyMem (&Scalar, Value->Data, Value->Size);
+  }
+
+  return Scalar;
+}
+
+//
+// Size without any trailing NUL terminators.
+//
+STATIC
+UINTN
+TextSize (
+  IN CONST RULE_VALUE   *Value
+  )
+{
+  UINTN   Size;
+
+  Size = Value->Size;
+  while (Size > 0 && Value->Data[Size - 1] == '\0') {
+    --Size;
+  }
+
+  return Size;
+}
+
+STATIC
+BOOLEAN
+FindToken (
+  IN  CONST RULE_VALUE  *Value,
+  IN  CONST UINT8       *Token,
+  IN  UINTN             TokenSize,
+  OUT UINTN             *Offset OPTIONAL
+  )
+{
+  UINTN   Size;
+  UINTN   Start;
+  UINTN   End;
+
+  Size = TextSize (Value);
+  Start = 0;
+  while (Start < Size) {
+    if (Value->Data[Start] == ' ') {
+      ++Start;
+      continue;
+    }
+    for (End = Start; End < Size && Value->Data[End] != ' '; End++) {
+    }
+    if (End - Start == TokenSize && CompareMem (&Value->Data[Start], Token, TokenSize) == 0) {
+      if (Offset != NULL) {
+        *Offset = Start;
+      }
+      return TRUE;
+    }
+    Start = End;
+  }
+
+  return FALSE;
+}
+
+STATIC
+BOOLEAN
+Test (
+  IN CONST RULE_INSN    *Insn,
+  IN CONST RULE_VALUE   *Value
+  )
+{
+  CONST UINT8   *Literal;
+  UINT64        Scalar;
+  UINT64        Mask;
+  BOOLEAN       Result;
+
+  Literal = &mLiterals[Insn->Literal];
+  Result = FALSE;
+
+  if (Value->Present) {
+    switch (Insn->Op & RULE_OP_MASK) {
+      case RULE_OP_PRESENT:
+        Result = TRUE;
+        break;
+
+      case RULE_OP_SCALAR:
+        CopyMem (&Scalar, Literal, sizeof (Scalar));
+        Result = ValueScalar (Value) == Scalar;
+        break;
+
+      case RULE_OP_MASK_ANY:
+      case RULE_OP_MASK_EQUAL:
+        CopyMem (&Mask, Literal, sizeof (Mask));
+        Scalar = 0;
+        if ((Insn->Op & RULE_OP_MASK) == RULE_OP_MASK_EQUAL) {
+          CopyMem (&Scalar, Literal + sizeof (Mask), sizeof (Scalar));
+          Result = (ValueScalar (Value) & Mask) == Scalar;
+        } else {
+          Result = (ValueScalar (Value) & Mask) != 0;
+        }
+        break;
+
+      case RULE_OP_BYTES:
+        Result = Value->Size == Insn->Size && CompareMem (Value->Data, Literal, Insn->Size) == 0;
+        break;
+
+      case RULE_OP_STRING:
+        //
+        // Terminator optional, as bhindex.py.
+        //
+        Result = (Value->Size == Insn->Size || (Value->Size == Insn->Size + 1U && Value->Data[Insn->Size] == '\0'))
+          && CompareMem (Value->Data, Literal, Insn->Size) == 0;
+        break;
+
+      case RULE_OP_PREFIX:
+        Result = Value->Size >= Insn->Size && CompareMem (Value->Data, Literal, Insn->Size) == 0;
+        break;
+
+      case RULE_OP_TOKEN:
+        Result = FindToken (Value, Literal, Insn->Size, NULL);
+        break;
+
+      default:
+        ASSERT (FALSE);
+        break;
+    }
+  }
+
+  return (Insn->Op & RULE_OP_NEGATE) != 0 ? !Result : Result;
+}
+
+//
+// Replace the working value with Size bytes built by the caller in Data, taking ownership.
+//
+STATIC
+VOID
+Replace (
+  IN OUT RULE_VALUE   *Value,
+  IN     UINT8        *Data,
+  IN     UINTN        Size
+  )
+{
+  if (Value->Data != NULL) {
+    FreePool (Value->Data);
+  }
+
+  Value->Present = TRUE;
+  Value->Data = Data;
+  Value->Size = Size;
+}
+
+STATIC
+EFI_STATUS
+Act (
+  IN     CONST RULE_INSN  *Insn,
+  IN OUT RULE_VALUE       *Value
+  )
+{
+  CONST UINT8   *Literal;
+  UINT8         *Data;
+  UINTN         Size;
+  UINTN         Terminator;
+  UINTN         Offset;
+  UINTN         End;
+
+  Literal = &mLiterals[Insn->Literal];
+
+  switch (Insn->Op) {
+    case RULE_OP_SET:
+      Data = AllocateCopyPool (MAX (Insn->Size, 1), Literal);
+      if (Data == NULL) {
+        return EFI_OUT_OF_RESOURCES;
+      }
+      Replace (Value, Data, Insn->Size);
+      return EFI_SUCCESS;
+
+    case RULE_OP_DELETE:
+      if (Value->Data != NULL) {
+        FreePool (Value->Data);
+      }
+      Value->Present = FALSE;
+      Value->Data = NULL;
+      Value->Size = 0;
+      return EFI_SUCCESS;
+
+    case RULE_OP_ADD_TOKEN:
+      if (!Value->Present) {
+        Value->Size = 0;
+      } else if (FindToken (Value, Literal, Insn->Size, NULL)) {
+        return EFI_SUCCESS;
+      }
+      Size = TextSize (Value);
+      Terminator = Value->Size - Size;
+      if (Size + 1 + Insn->Size + Terminator > BH_RULES_MAX_VALUE) {
+        return EFI_BUFFER_TOO_SMALL;
+      }
+      Data = AllocateZeroPool (Size + 1 + Insn->Size + Terminator);
+      if (Data == NULL) {
+        return EFI_OUT_OF_RESOURCES;
+      }
+      if (Size > 0) {
+        CopyMem (Data, Value->Data, Size);
+        Data[Size++] = ' ';
+      }
+      CopyMem (&Data[Size], Literal, Insn->Size);
+      Replace (Value, Data, Size + Insn->Size + Terminator);
+      return EFI_SUCCESS;
+
+    case RULE_OP_REMOVE_TOKEN:
+      while (Value->Present && FindToken (Value, Literal, Insn->Size, &Offset)) {
+        //
+        // Remove the token and the spaces after it, or before it if it is last.
+        //
+        Size = TextSize (Value);
+        for (End = Offset + Insn->Size; End < Size && Value->Data[End] == ' '; End++) {
+        }
+        if (End == Size) {
+          while (Offset > 0 && Value->Data[Offset - 1] == ' ') {
+            --Offset;
+          }
+        }
+        CopyMem (&Value->Data[Offset], &Value->Data[End], Value->Size - End);
+        Value->Size -= End - Offset;
+      }
+      return EFI_SUCCESS;
+
+    default:
+      ASSERT (FALSE);
+      return EFI_INVALID_PARAMETER;
+  }
+}
+
+//
+// TRUE if any test or action of the rule at Pc uses a variable which could not be read.
+//
+STATIC
+BOOLEAN
+UsesUnreadable (
+  IN UINT32         Pc,
+  IN CONST BOOLEAN  *Unreadable
+  )
+{
+  UINT32  Next;
+
+  for (Next = mCode[Pc].Next, ++Pc; Pc < Next; Pc++) {
+    if (!RULE_VAR_IS_IDENTITY (mCode[Pc].Var) && Unreadable[mCode[Pc].Var]) {
+      return TRUE;
+    }
+  }
+
+  return FALSE;
+}
+
+//
+// Identity pseudo-variable as text, not owned.
+//
+STATIC
+VOID
+GetIdentity (
+  IN  UINT8         Var,
+  IN  CONST CHAR8   *Vendor,
+  OUT RULE_VALUE    *Value
+  )
+{
+  CONST BH_PLATFORM_INFO  *Platform;
+  CONST CHAR8             *Text;
+
+  Platform = BhGetPlatformInfo ();
+
+  if (Var == RULE_VAR_MODEL) {
+    Text = Platform->ProductName;
+  } else if (Var == RULE_VAR_BIOS) {
+    Text = Platform->BiosVersion;
+  } else {
+    Text = Vendor;
+  }
+
+  Value->Present = Text[0] != '\0';
+  Value->Data = (UINT8 *) Text;
+  Value->Size = AsciiStrLen (Text);
+}
+
+EFI_STATUS
+BhRulesApply (
+  VOID
+  )
+{
+  EFI_STATUS        Status;
+  RULE_VALUE        *Original;
+  RULE_VALUE        *Working;
+  UINT32            *Attributes;
+  BOOLEAN           *Touched;
+  BOOLEAN           *Unreadable;
+  RULE_VALUE        Identity;
+  CHAR8             Vendor[RULE_VENDOR_SIZE];
+  UINT32            Index;
+  UINT32            Pc;
+  UINT32            Next;
+  BOOLEAN           Match;
+  BOOLEAN           Changed;
+
+  mResult.Matched = 0;
+  mResult.Writes = 0;
+  mResult.Failed = 0;
+
+  if (mResult.Rules == 0) {
+    return EFI_SUCCESS;
+  }
+
+  Original = AllocateZeroPool (mVarCount * (2 * sizeof (RULE_VALUE) + sizeof (UINT32) + 2 * sizeof (BOOLEAN)) + 1);
+  if (Original == NULL) {
+    return EFI_OUT_OF_RESOURCES;
+  }
+  Working = Original + mVarCount;
+  Attributes = (UINT32 *) (Working + mVarCount);
+  Touched = (BOOLEAN *) (Attributes + mVarCount);
+  Unreadable = Touched + mVarCount;
+
+  Index = 0;
+  if (gST->FirmwareVendor != NULL) {
+    for (; Index < RULE_VENDOR_SIZE - 1 && gST->FirmwareVendor[Index] != L'\0'; Index++) {
+      Vendor[Index] = (CHAR8) gST->FirmwareVendor[Index];
+    }
+  }
+  Vendor[Index] = '\0';
+
+  //
+  // One read of every variable used; with no slow enumeration quirk, the first read takes
+  // the shared snapshot and the rest are served from it. Only EFI_NOT_FOUND means absent:
+  // a variable which cannot be read, or copied, is never tested, changed or written back.
+  //
+  for (Index = 0; Index < mVarCount; Index++) {
+    Attributes[Index] = BH_VAR_DEFAULT_ATTRIBUTES;
+    Status = BhVarRead (
+      mVars[Index].Name,
+      &mVars[Index].Guid,
+      &Attributes[Index],
+      &Original[Index].Size,
+      (VOID **) &Original[Index].Data
+      );
+    Original[Index].Present = !EFI_ERROR (Status);
+    if (EFI_ERROR (Status) && Status != EFI_NOT_FOUND) {
+      DEBUG ((DEBUG_WARN, "BH: Rules cannot read %g:%s - %r\n", &mVars[Index].Guid, mVars[Index].Name, Status));
+      Unreadable[Index] = TRUE;
+      ++mResult.Failed;
+    }
+    if (Original[Index].Present) {
+      Working[Index].Present = TRUE;
+      Working[Index].Size = Original[Index].Size;
+      Working[Index].Data = AllocateCopyPool (MAX (Original[Index].Size, 1), Original[Index].Data);
+      if (Working[Index].Data == NULL) {
+        Working[Index].Present = FALSE;
+        Unreadable[Index] = TRUE;
+        ++mResult.Failed;
+      }
+    }
+  }
+
+  Status = EFI_SUCCESS;
+  Pc = 0;
+  while (mCode[Pc].Op == RULE_OP_RULE) {
+    Next = mCode[Pc].Next;
+    Index = mCode[Pc].Literal;
+
+    if (UsesUnreadable (Pc, Unreadable)) {
+      DEBUG ((DEBUG_WARN, "BH: Rule %u skipped, a variable it uses could not be read\n", Index));
+      Pc = Next;
+      continue;
+    }
+
+    Match = TRUE;
+    for (++Pc; Pc < Next && RULE_IS_TEST (mCode[Pc].Op); Pc++) {
+      if (RULE_VAR_IS_IDENTITY (mCode[Pc].Var)) {
+        GetIdentity (mCode[Pc].Var, Vendor, &Identity);
+        Match = Test (&mCode[Pc], &Identity);
+      } else {
+        Match = Test (&mCode[Pc], &Original[mCode[Pc].Var]);
+      }
+      if (!Match) {
+        break;
+      }
+    }
+
+    if (Match) {
+      DEBUG ((DEBUG_INFO, "BH: Rule %u matched\n", Index));
+      ++mResult.Matched;
+      for (; Pc < Next; Pc++) {
+        Touched[mCode[Pc].Var] = TRUE;
+        Status = Act (&mCode[Pc], &Working[mCode[Pc].Var]);
+        if (EFI_ERROR (Status)) {
+          DEBUG ((DEBUG_WARN, "BH: Rule %u action on %s failed - %r\n", Index, mVars[mCode[Pc].Var].Name, Status));
+          ++mResult.Failed;
+        }
+      }
+    }
+
+    Pc = Next;
+  }
+
+  //
+  // Single batch; BhVarWrite makes no write where the value is already right.
+  //
+  for (Index = 0; Index < mVarCount; Index++) {
+    if (Touched[Index] && !Unreadable[Index]) {
+      Status = BhVarWrite (
+        mVars[Index].Name,
+        &mVars[Index].Guid,
+        Attributes[Index],
+        Working[Index].Present ? Working[Index].Size : 0,
+        Working[Index].Data,
+        &Changed
+        );
+      if (EFI_ERROR (Status)) {
+        DEBUG ((DEBUG_WARN, "BH: Rules write %g:%s failed - %r\n", &mVars[Index].Guid, mVars[Index].Name, Status));
+        ++mResult.Failed;
+      } else if (Changed) {
+        ++mResult.Writes;
+      }
+    }
+
+    if (Original[Index].Data != NULL) {
+      FreePool (Original[Index].Data);
+    }
+    if (Working[Index].Data != NULL) {
+      FreePool (Working[Index].Data);
+    }
+  }
+
+  FreePool (Original);
+
+  DEBUG ((
+    DEBUG_INFO,
+    "BH: Rules %u of %u matched, %u variables changed, %u failed\n",
+    mResult.Matched,
+    mResult.Rules,
+    mResult.Writes,
+    mResult.Failed
+    ));
+
+  return mResult.Failed == 0 ? EFI_SUCCESS : EFI_DEVICE_ERROR;
+}
+
+VOID
+BhRulesShowReport (
+  VOID
+  )
+{
+  if (mResult.Matched == 0 && mResult.Skipped == 0 && mResult.Failed == 0) {
+    return;
+  }
+
+  SetColour ((mResult.Skipped != 0 || mResult.Failed != 0) ? EFI_YELLOW : EFI_LIGHTGREEN);
+  Print (
+    L"Rules: %u of %u matched, %u variables changed",
+    mResult.Matched,
+    mResult.Rules,
+    mResult.Writes
+    );
+  if (mResult.Skipped != 0) {
+    Print (L", %u rules skipped", mResult.Skipped);
+  }
+  if (mResult.Failed != 0) {
+    Print (L", %u failed", mResult.Failed);
+  }
+  Print (L"%a\n", (mResult.Skipped != 0 || mResult.Failed != 0) ? " (see log)" : "");
+  SetColour (EFI_WHITE);
+}
@@ -0,0 +1,67 @@
+/** @file
+  Declaration of NVRAM provisioning rules.
+
+  Copyright (c) 2020, Mike Beaton. All rights reserved.<BR>
+  SPDX-License-Identifier: BSD-3-Clause
+
+**/
+
+#ifndef __BH__RULES__
+#define __BH__RULES__
+
+//
+// Basic UEFI Libraries
+//
+#include <Uefi.h>
+#include <Library/UefiLib.h>
+
+//
+// Local includes
+//
+#include "BhConfig.h"
+
+//
+// Limits of the compiled program; rules which do not fit are skipped, with a warning.
+//
+#define BH_RULES_MAX_CODE           256
+#define BH_RULES_MAX_LITERALS       2048
+#define BH_RULES_MAX_VARS           32
+#define BH_RULES_MAX_NAME           64
+
+//
+// Largest value built by a token action.
+//
+#define BH_RULES_MAX_VALUE          1024
+
+typedef struct BH_RULES_RESULT_ {
+  UINT32    Rules;              ///< Rules compiled
+  UINT32    Skipped;            ///< Enabled rules which did not compile
+  UINT32    Matched;
+  UINT32    Writes;             ///< Variables actually changed
+  UINT32    Failed;             ///< Variable writes which failed
+} BH_RULES_RESULT;
+
+// Compile enabled Misc/Rules entries: conditions in If, over variables (NAME or GUID:NAME,
+// unqualified names are Apple GUID) and @model, @bios, @vendor, with the same predicates as
+// bhindex.py (NAME, !NAME, NAME=0x7f, NAME="text", NAME=<hex>, NAME^="text", NAME&mask[=value])
+// plus NAME~"token" for a space separated token and ! to negate any predicate; actions in Then,
+// NAME="text", NAME=<hex>, !NAME (delete), NAME+="token" and NAME-="token"
+VOID
+BhRulesCompile (
+  IN BH_MISC_RULE_ARRAY   *Rules
+  );
+
+// Evaluate every compiled rule against one read of the variables they use, then write the
+// combined changes of all matching rules as one batch, only where values differ
+EFI_STATUS
+BhRulesApply (
+  VOID
+  );
+
+// Print a one line summary of rules applied at startup, if any rules are configured
+VOID
+BhRulesShowReport (
+  VOID
+  );
+
+#endif
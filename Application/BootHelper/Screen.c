@@ -0,0 +1,38 @@
+/** @file
+  Pre-encoded static screens.
+
+  Copyright (c) 2020, Mike Beaton. All rights reserved.<BR>
+  SPDX-License-Identifier: BSD-3-Clause
+
+**/
+
+//
+// Basic UEFI Libraries
+//
+#include <Uefi.h>
+#include <Library/UefiLib.h>
+
+//
+// Boot and Runtime Services
+//
+#include <Library/UefiBootServicesTableLib.h>
+
+//
+// Local includes
+//
+#include "Screen.h"
+
+VOID
+BhScreenShow (
+  IN CONST BH_SCREEN    *Screen
+  )
+{
+  UINTN   Index;
+
+  for (Index = 0; Index < Screen->Count; Index++) {
+    if (Screen->Runs[Index].Attribute != BH_SCREEN_ATTRIBUTE_NONE) {
+      gST->ConOut->SetAttribute (gST->ConOut, Screen->Runs[Index].Attribute);
+    }
+    gST->ConOut->OutputString (gST->ConOut, (CHAR16 *) Screen->Runs[Index].Text);
+  }
+}
@@ -0,0 +1,43 @@
+/** @file
+  Declaration of pre-encoded static screens.
+
+  Copyright (c) 2020, Mike Beaton. All rights reserved.<BR>
+  SPDX-License-Identifier: BSD-3-Clause
+
+**/
+
+#ifndef __BH__SCREEN__
+#define __BH__SCREEN__
+
+//
+// Basic UEFI Libraries
+//
+#include <Uefi.h>
+#include <Library/UefiLib.h>
+
+//
+// Run shown in whatever attribute is current.
+//
+#define BH_SCREEN_ATTRIBUTE_NONE    MAX_UINTN
+
+//
+// Text in console form (CR LF line ends, no format specifiers) and the attribute to show it in;
+// generated from Screens.txt into BhScreen.c, see ScreenToC.py.
+//
+typedef struct BH_SCREEN_RUN_ {
+  UINTN           Attribute;
+  CONST CHAR16    *Text;
+} BH_SCREEN_RUN;
+
+typedef struct BH_SCREEN_ {
+  CONST BH_SCREEN_RUN   *Runs;
+  UINTN                 Count;
+} BH_SCREEN;
+
+// Write each run of Screen directly to the console, with no formatting
+VOID
+BhScreenShow (
+  IN CONST BH_SCREEN    *Screen
+  );
+
+#endif
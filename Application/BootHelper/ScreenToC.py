@@ -0,0 +1,143 @@
+#!/usr/bin/env python3
+#  Copyright (c) 2020, Mike Beaton. All rights reserved.
+#  SPDX-License-Identifier: BSD-3-Clause
+
+"""
+Compile a BootHelper screen description (Screens.txt) into pre-encoded CHAR16 runs.
+
+Each screen becomes an array of BH_SCREEN_RUN (Screen.h): text already in console
+form (CR LF line ends), merged into one run per attribute span, so that showing it
+is one SetAttribute and one OutputString per span.
+
+Usage:
+  ScreenToC.py Screens.txt -c BhScreen.c -h BhScreen.h
+"""
+
+import argparse
+import os
+import re
+import sys
+
+MACRO = re.compile(r'%([A-Z_][A-Z0-9_]*)%')
+NAME = re.compile(r'^\[([A-Za-z][A-Za-z0-9]*)\]$')
+COLOUR = re.compile(r'^=([A-Z]+)$')
+
+HEADER = '''/** @file
+  Copyright (c) 2020, Mike Beaton. All rights reserved.<BR>
+  SPDX-License-Identifier: BSD-3-Clause
+
+**/
+
+///
+/// This file generated by ScreenToC.py from %s, do not edit
+///
+'''
+
+
+class ScreenError(Exception):
+    pass
+
+
+def parse(lines, source):
+    """Return [(name, [(attribute or None, [piece, ...])])], pieces being text or ('macro', name)."""
+    screens = []
+    runs = None
+    for number, line in enumerate(lines, 1):
+        line = line.rstrip('\r\n')
+        where = '%s:%u' % (source, number)
+        if line == '' or line.startswith('#'):
+            continue
+        match = NAME.match(line)
+        if match:
+            runs = []
+            screens.append((match.group(1), runs))
+            continue
+        if runs is None:
+            raise ScreenError('%s: content before first [Screen]' % where)
+        match = COLOUR.match(line)
+        if match:
+            runs.append(('EFI_' + match.group(1), []))
+            continue
+        if not line.startswith('|'):
+            raise ScreenError('%s: expected [Name], =COLOUR or |text' % where)
+        text = line[1:]
+        if any(ord(c) < 0x20 or ord(c) > 0x7E for c in text):
+            raise ScreenError('%s: only printable ASCII is supported' % where)
+        if not runs:
+            runs.append((None, []))
+        pieces = runs[-1][1]
+        position = 0
+        for macro in MACRO.finditer(text):
+            pieces.append(text[position:macro.start()])
+            pieces.append(('macro', macro.group(1)))
+            position = macro.end()
+        pieces.append(text[position:] + '\r\n')
+    return screens
+
+
+def c_string(text):
+    escaped = text.replace('\\', '\\\\').replace('"', '\\"').replace('\r', '\\r').replace('\n', '\\n')
+    return 'L"%s"' % escaped
+
+
+def c_pieces(pieces):
+    out = []
+    text = ''
+    for piece in pieces:
+        if isinstance(piece, tuple):
+            if text:
+                out.append(c_string(text))
+                text = ''
+            out.append(piece[1])
+        else:
+            text += piece
+    if text or not out:
+        out.append(c_string(text))
+    return ' '.join(out)
+
+
+def generate(screens, source):
+    c = [HEADER % source, '#include "BootHelper.h"', '#include "BhScreen.h"\n']
+    h = [HEADER % source, '#ifndef __BH__BH_SCREEN__', '#define __BH__BH_SCREEN__', '',
+         '#include "Screen.h"', '']
+    for name, runs in screens:
+        runs = [run for run in runs if run[1]]
+        symbol = 'gBhScreen' + name
+        c.append('STATIC CONST BH_SCREEN_RUN m%sRuns[] = {' % name)
+        for attribute, pieces in runs:
+            c.append('  { %s, %s },' % (attribute or 'BH_SCREEN_ATTRIBUTE_NONE', c_pieces(pieces)))
+        c.append('};')
+        c.append('')
+        c.append('CONST BH_SCREEN %s = { m%sRuns, ARRAY_SIZE (m%sRuns) };' % (symbol, name, name))
+        c.append('')
+        h.append('extern CONST BH_SCREEN %s;' % symbol)
+    h += ['', '#endif', '']
+    return '\n'.join(c), '\n'.join(h)
+
+
+def main(argv=None):
+    parser = argparse.ArgumentParser(description='BootHelper screen description compiler', add_help=False)
+    parser.add_argument('--help', action='help', help='show this help message and exit')
+    parser.add_argument('screens', help='screen description, e.g. Screens.txt')
+    parser.add_argument('-c', dest='c_file', required=True, help='output C file')
+    parser.add_argument('-h', dest='h_file', required=True, help='output header')
+    args = parser.parse_args(argv)
+
+    source = os.path.basename(args.screens)
+    try:
+        with open(args.screens) as f:
+            screens = parse(f, source)
+    except (OSError, ScreenError) as e:
+        print('ScreenToC: %s' % e, file=sys.stderr)
+        return 1
+
+    c_text, h_text = generate(screens, source)
+    with open(args.c_file, 'w') as f:
+        f.write(c_text)
+    with open(args.h_file, 'w') as f:
+        f.write(h_text)
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -0,0 +1,409 @@
+/** @file
+  Serial mirror of console output.
+
+  ConOut is hooked so that everything drawn is also queued, in compact form, to a
+  ring buffer; the ring is written to the serial port in slices while waiting for a
+  key, so that the UI never waits on the port at 115200 baud. If the ring would
+  overflow the oldest output is dropped, leaving a marker in its place.
+
+  Copyright (c) 2020, Mike Beaton. All rights reserved.<BR>
+  SPDX-License-Identifier: BSD-3-Clause
+
+**/
+
+//
+// Basic UEFI Libraries
+//
+#include <Uefi.h>
+#include <Library/UefiLib.h>
+#include <Library/BaseLib.h>
+#include <Library/BaseMemoryLib.h>
+#include <Library/PrintLib.h>
+#include <Library/SerialPortLib.h>
+
+//
+// Boot and Runtime Services
+//
+#include <Library/UefiBootServicesTableLib.h>
+
+//
+// OC Libraries
+//
+#include <Library/OcDebugLogLib.h>
+
+//
+// Local includes
+//
+#include "EzKb.h"
+#include "Serial.h"
+
+#define RING_MASK                   (BH_SERIAL_RING_SIZE - 1)
+
+#define ANSI_MAX_SEQUENCE           32
+
+//
+// Room kept for the marker left where output was dropped.
+//
+#define DROP_MARKER_SIZE            48
+
+STATIC_ASSERT ((BH_SERIAL_RING_SIZE & RING_MASK) == 0, "BH_SERIAL_RING_SIZE must be a power of two");
+
+STATIC BOOLEAN                          mActive = FALSE;
+STATIC BOOLEAN                          mAnsi;
+STATIC UINTN                            mAttribute;
+STATIC EFI_SIMPLE_TEXT_OUTPUT_PROTOCOL  *mConOut;
+STATIC EFI_TEXT_STRING                  mOriginalOutputString;
+STATIC EFI_TEXT_SET_ATTRIBUTE           mOriginalSetAttribute;
+STATIC EFI_TEXT_CLEAR_SCREEN            mOriginalClearScreen;
+STATIC EFI_TEXT_SET_CURSOR_POSITION     mOriginalSetCursorPosition;
+
+//
+// Head and tail count all bytes ever queued and written; only the difference is used.
+//
+STATIC UINT8                            mRing[BH_SERIAL_RING_SIZE];
+STATIC UINTN                            mHead;
+STATIC UINTN                            mTail;
+STATIC UINTN                            mMarkerSize;    ///< Drop marker queued at tail, 0 if none
+STATIC UINTN                            mDropped;       ///< Bytes counted by that marker
+STATIC UINTN                            mDroppedTotal;
+STATIC UINT32                           mOverflows;
+
+//
+// EFI colour (low three bits) to ANSI colour.
+//
+STATIC CONST UINT8 mAnsiColours[8] = { 0, 4, 2, 6, 1, 5, 3, 7 };
+
+//
+// Write up to Limit queued bytes, in as few writes as the ring allows.
+//
+STATIC
+VOID
+Drain (
+  IN UINTN          Limit
+  )
+{
+  UINTN     Offset;
+  UINTN     Size;
+
+  while (mHead != mTail && Limit > 0) {
+    Offset = mTail & RING_MASK;
+    Size = MIN (mHead - mTail, BH_SERIAL_RING_SIZE - Offset);
+    Size = MIN (Size, Limit);
+
+    //
+    // SerialPortWrite returns only when the port has taken every byte, so this waits
+    // for Size bytes at the port's speed; only BhSerialStop passes no limit.
+    //
+    SerialPortWrite (&mRing[Offset], Size);
+
+    mTail += Size;
+    Limit -= Size;
+
+    //
+    // Any marker at the tail has now started to go out, so the next drop needs its own.
+    //
+    mMarkerSize = 0;
+    mDropped = 0;
+  }
+}
+
+//
+// Drop the oldest queued output to leave room for Size more bytes, and put a marker
+// saying how much was lost in its place.
+//
+STATIC
+VOID
+DropOldest (
+  IN UINTN          Size
+  )
+{
+  CHAR8     Marker[DROP_MARKER_SIZE];
+  UINTN     Free;
+  UINTN     Drop;
+  UINTN     Length;
+  UINTN     Offset;
+  UINTN     Part;
+
+  //
+  // A marker not yet written is replaced by one with the new total.
+  //
+  mTail += mMarkerSize;
+  mMarkerSize = 0;
+
+  Free = BH_SERIAL_RING_SIZE - (mHead - mTail);
+  Drop = Size + DROP_MARKER_SIZE > Free ? MIN (Size + DROP_MARKER_SIZE - Free, mHead - mTail) : 0;
+  mTail += Drop;
+  mDropped += Drop;
+  mDroppedTotal += Drop;
+  ++mOverflows;
+
+  AsciiSPrint (Marker, sizeof (Marker), "\r\n[%Lu bytes dropped]\r\n", (UINT64) mDropped);
+  Length = AsciiStrLen (Marker);
+
+  mTail -= Length;
+  Offset = mTail & RING_MASK;
+  Part = MIN (Length, BH_SERIAL_RING_SIZE - Offset);
+  CopyMem (&mRing[Offset], Marker, Part);
+  CopyMem (mRing, Marker + Part, Length - Part);
+  mMarkerSize = Length;
+}
+
+STATIC
+VOID
+Queue (
+  IN CONST UINT8    *Data,
+  IN UINTN          Size
+  )
+{
+  UINTN     Offset;
+  UINTN     Part;
+
+  if (Size > BH_SERIAL_RING_SIZE - DROP_MARKER_SIZE) {
+    //
+    // Only the end of very large output can be kept.
+    //
+    Part = Size - (BH_SERIAL_RING_SIZE - DROP_MARKER_SIZE);
+    mDropped += Part;
+    mDroppedTotal += Part;
+    Data += Part;
+    Size -= Part;
+    DropOldest (Size);
+  } else if (Size > BH_SERIAL_RING_SIZE - (mHead - mTail)) {
+    DropOldest (Size);
+  }
+
+  Offset = mHead & RING_MASK;
+  Part = MIN (Size, BH_SERIAL_RING_SIZE - Offset);
+  CopyMem (&mRing[Offset], Data, Part);
+  CopyMem (mRing, Data + Part, Size - Part);
+  mHead += Size;
+}
+
+STATIC
+VOID
+QueueAscii (
+  IN CONST CHAR8    *String
+  )
+{
+  Queue ((CONST UINT8 *) String, AsciiStrLen (String));
+}
+
+//
+// Queue String as UTF-8.
+//
+STATIC
+VOID
+QueueString (
+  IN CONST CHAR16   *String
+  )
+{
+  UINT8     Buffer[256];
+  UINTN     Size;
+  CHAR16    Char;
+
+  Size = 0;
+  for (; *String != L'\0'; ++String) {
+    if (Size > sizeof (Buffer) - 3) {
+      Queue (Buffer, Size);
+      Size = 0;
+    }
+
+    Char = *String;
+    if (Char < 0x80) {
+      Buffer[Size++] = (UINT8) Char;
+    } else if (Char < 0x800) {
+      Buffer[Size++] = (UINT8) (0xC0 | (Char >> 6));
+      Buffer[Size++] = (UINT8) (0x80 | (Char & 0x3F));
+    } else {
+      Buffer[Size++] = (UINT8) (0xE0 | (Char >> 12));
+      Buffer[Size++] = (UINT8) (0x80 | ((Char >> 6) & 0x3F));
+      Buffer[Size++] = (UINT8) (0x80 | (Char & 0x3F));
+    }
+  }
+
+  Queue (Buffer, Size);
+}
+
+STATIC
+EFI_STATUS
+EFIAPI
+MirrorOutputString (
+  IN EFI_SIMPLE_TEXT_OUTPUT_PROTOCOL  *This,
+  IN CHAR16                           *String
+  )
+{
+  EFI_STATUS  Status;
+
+  Status = mOriginalOutputString (This, String);
+
+  //
+  // Mirrored even on warning or error, as it is what the program meant to show.
+  //
+  QueueString (String);
+
+  return Status;
+}
+
+STATIC
+EFI_STATUS
+EFIAPI
+MirrorSetAttribute (
+  IN EFI_SIMPLE_TEXT_OUTPUT_PROTOCOL  *This,
+  IN UINTN                            Attribute
+  )
+{
+  EFI_STATUS  Status;
+  CHAR8       Sequence[ANSI_MAX_SEQUENCE];
+
+  Status = mOriginalSetAttribute (This, Attribute);
+
+  if (mAnsi && !EFI_ERROR (Status) && Attribute != mAttribute) {
+    mAttribute = Attribute;
+    AsciiSPrint (
+      Sequence,
+      sizeof (Sequence),
+      "\x1B[0;%u;%um",
+      ((Attribute & BIT3) != 0 ? 90 : 30) + mAnsiColours[Attribute & 0x07],
+      40 + mAnsiColours[(Attribute >> 4) & 0x07]
+      );
+    QueueAscii (Sequence);
+  }
+
+  return Status;
+}
+
+STATIC
+EFI_STATUS
+EFIAPI
+MirrorClearScreen (
+  IN EFI_SIMPLE_TEXT_OUTPUT_PROTOCOL  *This
+  )
+{
+  EFI_STATUS  Status;
+
+  Status = mOriginalClearScreen (This);
+
+  if (!EFI_ERROR (Status)) {
+    //
+    // Form feed separates screens in a plain capture.
+    //
+    QueueAscii (mAnsi ? "\x1B[2J\x1B[H" : "\f");
+  }
+
+  return Status;
+}
+
+STATIC
+EFI_STATUS
+EFIAPI
+MirrorSetCursorPosition (
+  IN EFI_SIMPLE_TEXT_OUTPUT_PROTOCOL  *This,
+  IN UINTN                            Column,
+  IN UINTN                            Row
+  )
+{
+  EFI_STATUS  Status;
+  CHAR8       Sequence[ANSI_MAX_SEQUENCE];
+
+  Status = mOriginalSetCursorPosition (This, Column, Row);
+
+  if (mAnsi && !EFI_ERROR (Status)) {
+    AsciiSPrint (Sequence, sizeof (Sequence), "\x1B[%u;%uH", (UINT32) Row + 1, (UINT32) Column + 1);
+    QueueAscii (Sequence);
+  }
+
+  return Status;
+}
+
+//
+// Key wait idle slice.
+//
+STATIC
+BOOLEAN
+SerialIdle (
+  VOID
+  )
+{
+  Drain (BH_SERIAL_IDLE_WRITE);
+  return mHead != mTail;
+}
+
+VOID
+BhSerialStart (
+  IN CONST CHAR8  *Mode,
+  IN BOOLEAN      InitPort
+  )
+{
+  if (mActive || Mode == NULL || AsciiStrCmp (Mode, BH_SERIAL_MIRROR_NONE) == 0) {
+    return;
+  }
+
+  if (AsciiStrCmp (Mode, BH_SERIAL_MIRROR_ANSI) == 0) {
+    mAnsi = TRUE;
+  } else if (AsciiStrCmp (Mode, BH_SERIAL_MIRROR_TEXT) == 0) {
+    mAnsi = FALSE;
+  } else {
+    DEBUG ((DEBUG_WARN, "BH: Unknown SerialMirror %a\n", Mode));
+    return;
+  }
+
+  if (InitPort) {
+    SerialPortInitialize ();
+  }
+
+  mHead = 0;
+  mTail = 0;
+  mMarkerSize = 0;
+  mDropped = 0;
+  mDroppedTotal = 0;
+  mOverflows = 0;
+  mAttribute = MAX_UINTN;
+
+  mConOut = gST->ConOut;
+  mOriginalOutputString = mConOut->OutputString;
+  mOriginalSetAttribute = mConOut->SetAttribute;
+  mOriginalClearScreen = mConOut->ClearScreen;
+  mOriginalSetCursorPosition = mConOut->SetCursorPosition;
+
+  mConOut->OutputString = MirrorOutputString;
+  mConOut->SetAttribute = MirrorSetAttribute;
+  mConOut->ClearScreen = MirrorClearScreen;
+  mConOut->SetCursorPosition = MirrorSetCursorPosition;
+
+  setkeywaitidle (SerialIdle);
+
+  mActive = TRUE;
+
+  DEBUG ((DEBUG_INFO, "BH: Serial mirror started (%a)\n", Mode));
+}
+
+VOID
+BhSerialStop (
+  VOID
+  )
+{
+  if (!mActive) {
+    return;
+  }
+
+  setkeywaitidle (NULL);
+
+  mConOut->OutputString = mOriginalOutputString;
+  mConOut->SetAttribute = mOriginalSetAttribute;
+  mConOut->ClearScreen = mOriginalClearScreen;
+  mConOut->SetCursorPosition = mOriginalSetCursorPosition;
+
+  if (mAnsi) {
+    QueueAscii ("\x1B[0m");
+  }
+  Drain (MAX_UINTN);
+
+  mActive = FALSE;
+
+  DEBUG ((
+    DEBUG_INFO,
+    "BH: Serial mirror stopped, %u overflows, %Lu bytes dropped\n",
+    mOverflows,
+    (UINT64) mDroppedTotal
+    ));
+}
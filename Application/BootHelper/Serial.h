@@ -0,0 +1,51 @@
+/** @file
+  Declaration of serial mirror of console output.
+
+  Copyright (c) 2020, Mike Beaton. All rights reserved.<BR>
+  SPDX-License-Identifier: BSD-3-Clause
+
+**/
+
+#ifndef __BH__SERIAL__
+#define __BH__SERIAL__
+
+//
+// Basic UEFI Libraries
+//
+#include <Uefi.h>
+#include <Library/UefiLib.h>
+
+//
+// Values of Config/SerialMirror.
+//
+#define BH_SERIAL_MIRROR_NONE       "None"
+#define BH_SERIAL_MIRROR_TEXT       "Text"
+#define BH_SERIAL_MIRROR_ANSI       "Ansi"
+
+//
+// Mirrored output is queued here while the UI draws; if it would overflow, the oldest
+// output is dropped and a "[n bytes dropped]" marker is left in its place.
+//
+#define BH_SERIAL_RING_SIZE         SIZE_64KB
+
+//
+// Largest single write while waiting for a key, so that a key press is seen within about
+// 45ms at 115200 baud.
+//
+#define BH_SERIAL_IDLE_WRITE        512
+
+// Mirror all console output to the serial port, as UTF-8 text ("Text") or with ANSI colour and
+// cursor codes as well ("Ansi"); initialise the port first if InitPort; no-op for "None"
+VOID
+BhSerialStart (
+  IN CONST CHAR8  *Mode,
+  IN BOOLEAN      InitPort
+  );
+
+// Write everything queued and stop mirroring
+VOID
+BhSerialStop (
+  VOID
+  );
+
+#endif
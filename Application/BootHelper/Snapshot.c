@@ -0,0 +1,728 @@
+/** @file
+  NVRAM snapshot file format, export, and browsing of snapshot files.
+
+  Copyright (c) 2020, Mike Beaton. All rights reserved.<BR>
+  SPDX-License-Identifier: BSD-3-Clause
+
+**/
+
+//
+// Basic UEFI Libraries
+//
+#include <Uefi.h>
+#include <Library/UefiLib.h>
+#include <Library/BaseLib.h>
+#include <Library/BaseMemoryLib.h>
+#include <Library/MemoryAllocationLib.h>
+#include <Library/PrintLib.h>
+
+//
+// Boot and Runtime Services
+//
+#include <Library/UefiRuntimeServicesTableLib.h>
+
+//
+// OC Libraries
+//
+#include <Library/OcDebugLogLib.h>
+
+//
+// Local includes
+//
+#include "Crypt.h"
+#include "DisplayVars.h"
+#include "EzKb.h"
+#include "FileUtils.h"
+#include "Platform.h"
+#include "Progress.h"
+#include "Snapshot.h"
+#include "Utils.h"
+#include "VarEngine.h"
+
+#define SNAPSHOT_MAX_CHOICES        26
+
+//
+// Saved names are <machine GUID>-<yyyymmdd>-<hhmmss>.bhsnap; this is the length up to the time.
+//
+#define SNAPSHOT_TIME_OFFSET        37
+
+typedef struct SNAPSHOT_DIFFER_ {
+  BH_VAR_STORE      *Store;
+  BH_VAR_STORE      *Other;
+  BOOLEAN           IsSnapshot;   ///< Store is the snapshot, Other is live
+  UINT32            NextEntry;
+  BH_SNAPSHOT_DIFF  *Diff;
+  EFI_STATUS        Status;
+} SNAPSHOT_DIFFER;
+
+typedef struct SNAPSHOT_CHOICES_ {
+  CHAR16            **Names;
+  UINT32            Count;
+  UINT32            AllocCount;
+} SNAPSHOT_CHOICES;
+
+typedef struct SNAPSHOT_WRITER_ {
+  BH_VAR_STORE  *Store;
+  UINT8         *Out;
+  UINT32        NextEntry;
+} SNAPSHOT_WRITER;
+
+STATIC
+BOOLEAN
+HasExtension (
+  IN CONST CHAR16   *Name,
+  IN CONST CHAR16   *Extension
+  )
+{
+  UINTN   Length;
+  UINTN   ExtensionLength;
+
+  Length = StrLen (Name);
+  ExtensionLength = StrLen (Extension);
+
+  return Length > ExtensionLength && StrCmp (&Name[Length - ExtensionLength], Extension) == 0;
+}
+
+//
+// Names are visited in id order, and entries are sorted by name id, so each
+// name is decoded exactly once.
+//
+STATIC
+BOOLEAN
+WriteEntriesForName (
+  IN VOID           *Context,
+  IN UINT32         Id,
+  IN CONST CHAR16   *Name
+  )
+{
+  SNAPSHOT_WRITER     *Writer;
+  BH_VAR_ENTRY        *Entry;
+  BH_SNAPSHOT_RECORD  Record;
+  UINTN               NameSize;
+
+  Writer = Context;
+  NameSize = StrSize (Name);
+
+  while (Writer->NextEntry < Writer->Store->EntryCount
+    && Writer->Store->Entries[Writer->NextEntry].NameId == Id) {
+    Entry = &Writer->Store->Entries[Writer->NextEntry];
+
+    CopyGuid (&Record.Guid, &Writer->Store->Guids[Entry->GuidIndex]);
+    Record.Attributes = Entry->Attributes;
+    Record.NameSize = (UINT16) NameSize;
+    Record.Reserved = 0;
+    Record.DataSize = Entry->DataSize;
+
+    CopyMem (Writer->Out, &Record, sizeof (Record));
+    Writer->Out += sizeof (Record);
+    CopyMem (Writer->Out, Name, NameSize);
+    Writer->Out += NameSize;
+    CopyMem (Writer->Out, Writer->Store->Data + Entry->DataOffset, Entry->DataSize);
+    Writer->Out += Entry->DataSize;
+
+    Writer->NextEntry++;
+  }
+
+  return TRUE;
+}
+
+EFI_STATUS
+BhSnapshotSerialize (
+  IN  BH_VAR_STORE  *Store,
+  OUT VOID          **Buffer,
+  OUT UINTN         *Size
+  )
+{
+  EFI_STATUS          Status;
+  BH_SNAPSHOT_HEADER  *Header;
+  SNAPSHOT_WRITER     Writer;
+  UINTN               MaxSize;
+
+  MaxSize = sizeof (BH_SNAPSHOT_HEADER)
+    + (UINTN) Store->EntryCount * (sizeof (BH_SNAPSHOT_RECORD) + BhNameDictMaxNameSize (&Store->Names))
+    + Store->DataSize;
+
+  Header = AllocatePool (MaxSize);
+  if (Header == NULL) {
+    return EFI_OUT_OF_RESOURCES;
+  }
+
+  ZeroMem (Header, sizeof (*Header));
+  Header->Signature = BH_SNAPSHOT_SIGNATURE;
+  Header->Version = BH_SNAPSHOT_VERSION;
+  Header->HeaderSize = sizeof (*Header);
+  CopyGuid (&Header->MachineId, &BhGetPlatformInfo ()->SystemUuid);
+  gRT->GetTime (&Header->Time, NULL);
+  Header->EntryCount = Store->EntryCount;
+
+  Writer.Store = Store;
+  Writer.Out = (UINT8 *) (Header + 1);
+  Writer.NextEntry = 0;
+
+  Status = BhNameDictIteratePrefix (&Store->Names, L"", WriteEntriesForName, &Writer);
+  if (EFI_ERROR (Status)) {
+    FreePool (Header);
+    return Status;
+  }
+
+  ASSERT (Writer.NextEntry == Store->EntryCount);
+
+  *Buffer = Header;
+  *Size = Writer.Out - (UINT8 *) Header;
+
+  return EFI_SUCCESS;
+}
+
+EFI_STATUS
+BhSnapshotExport (
+  IN  EFI_FILE_PROTOCOL   *Root,
+  IN  CONST CHAR8         *Passphrase OPTIONAL,
+  OUT CHAR16              *FileName OPTIONAL,
+  IN  UINTN               FileNameSize
+  )
+{
+  EFI_STATUS          Status;
+  BH_VAR_STORE        Store;
+  VOID                *Buffer;
+  UINTN               Size;
+  BH_SNAPSHOT_HEADER  *Header;
+  CHAR16              Path[128];
+
+  Status = BhVarStoreSnapshot (&Store);
+  if (EFI_ERROR (Status)) {
+    return Status;
+  }
+
+  Status = BhSnapshotSerialize (&Store, &Buffer, &Size);
+  BhVarStoreFree (&Store);
+  if (EFI_ERROR (Status)) {
+    return Status;
+  }
+
+  Header = Buffer;
+  UnicodeSPrint (
+    Path,
+    sizeof (Path),
+    L"%s\\%g-%04u%02u%02u-%02u%02u%02u%s",
+    BH_SNAPSHOT_DIRECTORY,
+    &Header->MachineId,
+    Header->Time.Year,
+    Header->Time.Month,
+    Header->Time.Day,
+    Header->Time.Hour,
+    Header->Time.Minute,
+    Header->Time.Second,
+    BH_SNAPSHOT_EXTENSION
+    );
+
+  if (Passphrase != NULL) {
+    StrCatS (Path, ARRAY_SIZE (Path), BH_CRYPT_EXTENSION);
+    Status = BhCryptWriteFile (Root, Path, Passphrase, Buffer, Size);
+  } else {
+    Status = BhWriteFile (Root, Path, Buffer, Size);
+  }
+  ZeroMem (Buffer, Size);
+  FreePool (Buffer);
+
+  DEBUG ((DEBUG_INFO, "BH: Snapshot %s of %u bytes - %r\n", Path, (UINT32) Size, Status));
+
+  if (!EFI_ERROR (Status) && FileName != NULL) {
+    StrCpyS (FileName, FileNameSize / sizeof (CHAR16), Path);
+  }
+
+  return Status;
+}
+
+EFI_STATUS
+BhSnapshotOpen (
+  IN  EFI_FILE_PROTOCOL   *Root,
+  IN  CONST CHAR16        *Path,
+  OUT BH_VAR_STORE        *Store,
+  OUT BH_SNAPSHOT_HEADER  *Header OPTIONAL
+  )
+{
+  EFI_STATUS          Status;
+  CONST CHAR8         *Passphrase;
+  UINT8               *Buffer;
+  UINTN               Size;
+  BH_SNAPSHOT_HEADER  FileHeader;
+  BH_SNAPSHOT_RECORD  Record;
+  BH_VAR_ENTRY        *Entries;
+  CHAR16              **Names;
+  UINT8               *NameBuffer;
+  UINTN               NameOffset;
+  UINTN               Offset;
+  UINT32              GuidAllocCount;
+  UINT32              GuidIndex;
+  UINT32              Count;
+
+  ZeroMem (Store, sizeof (*Store));
+
+  if (HasExtension (Path, BH_CRYPT_EXTENSION)) {
+    Status = BhCryptGetPassphrase (FALSE, &Passphrase);
+    if (!EFI_ERROR (Status)) {
+      Status = BhCryptReadFile (Root, Path, Passphrase, (VOID **) &Buffer, &Size);
+      if (Status == EFI_SECURITY_VIOLATION) {
+        BhCryptForget ();
+      }
+    }
+  } else {
+    Status = BhReadFile (Root, Path, (VOID **) &Buffer, &Size);
+  }
+  if (EFI_ERROR (Status)) {
+    return Status;
+  }
+
+  if (Size >= sizeof (FileHeader)) {
+    CopyMem (&FileHeader, Buffer, sizeof (FileHeader));
+  }
+  if (Size < sizeof (FileHeader)
+    || FileHeader.Signature != BH_SNAPSHOT_SIGNATURE
+    || FileHeader.Version != BH_SNAPSHOT_VERSION
+    || FileHeader.HeaderSize < sizeof (FileHeader)
+    || FileHeader.HeaderSize > Size
+    || FileHeader.EntryCount > (Size - FileHeader.HeaderSize) / sizeof (BH_SNAPSHOT_RECORD)) {
+    DEBUG ((DEBUG_WARN, "BH: Ignoring invalid snapshot %s\n", Path));
+    FreePool (Buffer);
+    return EFI_VOLUME_CORRUPTED;
+  }
+
+  //
+  // Names are only copied out (to aligned storage) for the dictionary build; everything
+  // else is indexed in place, and the file buffer becomes the store's data.
+  //
+  GuidAllocCount = 8;
+  Store->Guids = AllocatePool (GuidAllocCount * sizeof (EFI_GUID));
+  Entries = AllocatePool (MAX (FileHeader.EntryCount, 1) * sizeof (BH_VAR_ENTRY));
+  Names = AllocatePool (MAX (FileHeader.EntryCount, 1) * sizeof (CHAR16 *));
+  NameBuffer = AllocatePool (Size);
+
+  if (Store->Guids == NULL || Entries == NULL || Names == NULL || NameBuffer == NULL) {
+    Status = EFI_OUT_OF_RESOURCES;
+  } else {
+    Offset = FileHeader.HeaderSize;
+    NameOffset = 0;
+
+    for (Count = 0; Count < FileHeader.EntryCount; Count++) {
+      if (Size - Offset < sizeof (Record)) {
+        Status = EFI_VOLUME_CORRUPTED;
+        break;
+      }
+      CopyMem (&Record, Buffer + Offset, sizeof (Record));
+      Offset += sizeof (Record);
+
+      if (Record.NameSize < sizeof (CHAR16)
+        || (Record.NameSize & 1) != 0
+        || Size - Offset < Record.NameSize) {
+        Status = EFI_VOLUME_CORRUPTED;
+        break;
+      }
+      Names[Count] = (CHAR16 *) (NameBuffer + NameOffset);
+      CopyMem (Names[Count], Buffer + Offset, Record.NameSize);
+      NameOffset += Record.NameSize;
+      Offset += Record.NameSize;
+
+      if (Names[Count][Record.NameSize / sizeof (CHAR16) - 1] != L'\0'
+        || Size - Offset < Record.DataSize) {
+        Status = EFI_VOLUME_CORRUPTED;
+        break;
+      }
+
+      GuidIndex = BhVarStoreAddGuid (Store, &Record.Guid, &GuidAllocCount);
+      if (GuidIndex == MAX_UINT32) {
+        Status = EFI_OUT_OF_RESOURCES;
+        break;
+      }
+
+      Entries[Count].GuidIndex = GuidIndex;
+      Entries[Count].Attributes = Record.Attributes;
+      Entries[Count].DataSize = Record.DataSize;
+      Entries[Count].DataOffset = (UINT32) Offset;
+      Offset += Record.DataSize;
+    }
+
+    if (!EFI_ERROR (Status)) {
+      Status = BhVarStoreIndex (Store, Names, Entries, Count);
+    }
+  }
+
+  if (!EFI_ERROR (Status)) {
+    Entries = NULL;
+    Store->Data = Buffer;
+    Store->DataSize = (UINT32) Size;
+    Buffer = NULL;
+
+    if (Header != NULL) {
+      CopyMem (Header, &FileHeader, sizeof (*Header));
+    }
+
+    DEBUG ((
+      DEBUG_INFO,
+      "BH: Opened snapshot %s, %u vars, %u GUIDs, index %u bytes\n",
+      Path,
+      Store->EntryCount,
+      Store->GuidCount,
+      (UINT32) BhVarStoreIndexSize (Store)
+      ));
+  } else {
+    DEBUG ((DEBUG_WARN, "BH: Cannot open snapshot %s - %r\n", Path, Status));
+    BhVarStoreFree (Store);
+  }
+
+  if (Entries != NULL) {
+    FreePool (Entries);
+  }
+  if (Names != NULL) {
+    FreePool (Names);
+  }
+  if (NameBuffer != NULL) {
+    FreePool (NameBuffer);
+  }
+  if (Buffer != NULL) {
+    FreePool (Buffer);
+  }
+
+  return Status;
+}
+
+STATIC
+VOID
+PrintDiffValue (
+  IN CONST CHAR16   *Label,
+  IN CONST CHAR16   *Name,
+  IN BH_VAR_STORE   *Store,
+  IN BH_VAR_ENTRY   *Entry
+  )
+{
+  CHAR16  *Text;
+
+  Text = FormatNvramValue (Name, &Store->Guids[Entry->GuidIndex], Store->Data + Entry->DataOffset, Entry->DataSize);
+  Print (L"  %-9s %s", Label, Text != NULL ? Text : L"?");
+  if ((Entry->Attributes & EFI_VARIABLE_NON_VOLATILE) == 0) {
+    Print (L" (non-persistent)");
+  }
+  Print (L"\n");
+
+  if (Text != NULL) {
+    FreePool (Text);
+  }
+}
+
+STATIC
+VOID
+PrintDiffName (
+  IN UINTN          Colour,
+  IN CHAR16         Mark,
+  IN EFI_GUID       *Guid,
+  IN CONST CHAR16   *Name
+  )
+{
+  SetColour (Colour);
+  Print (L"%c %g:%s\n", Mark, Guid, Name);
+  SetColour (EFI_WHITE);
+}
+
+//
+// Visits every name of Differ->Store; each is looked up in Differ->Other by name,
+// since the two stores have separate name dictionaries.
+//
+STATIC
+BOOLEAN
+DiffName (
+  IN VOID           *Context,
+  IN UINT32         Id,
+  IN CONST CHAR16   *Name
+  )
+{
+  SNAPSHOT_DIFFER   *Differ;
+  BH_VAR_ENTRY      *Entry;
+  BH_VAR_ENTRY      *OtherEntry;
+  EFI_GUID          *Guid;
+
+  Differ = Context;
+
+  while (Differ->NextEntry < Differ->Store->EntryCount
+    && Differ->Store->Entries[Differ->NextEntry].NameId == Id) {
+    Entry = &Differ->Store->Entries[Differ->NextEntry++];
+    Guid = &Differ->Store->Guids[Entry->GuidIndex];
+
+    if (BhProgressCancelled ()) {
+      Differ->Status = EFI_ABORTED;
+      return FALSE;
+    }
+
+    OtherEntry = BhVarStoreFind (Differ->Other, Name, Guid);
+
+    if (!Differ->IsSnapshot) {
+      if (OtherEntry == NULL) {
+        Differ->Diff->OnlyInLive++;
+        PrintDiffName (EFI_LIGHTGREEN, L'+', Guid, Name);
+        PrintDiffValue (L"live:", Name, Differ->Store, Entry);
+      }
+    } else if (OtherEntry == NULL) {
+      Differ->Diff->OnlyInSnapshot++;
+      PrintDiffName (EFI_LIGHTRED, L'-', Guid, Name);
+      PrintDiffValue (L"snapshot:", Name, Differ->Store, Entry);
+    } else if (Entry->Attributes == OtherEntry->Attributes
+      && Entry->DataSize == OtherEntry->DataSize
+      && CompareMem (
+        Differ->Store->Data + Entry->DataOffset,
+        Differ->Other->Data + OtherEntry->DataOffset,
+        Entry->DataSize
+        ) == 0) {
+      Differ->Diff->Same++;
+    } else {
+      Differ->Diff->Changed++;
+      PrintDiffName (EFI_YELLOW, L'~', Guid, Name);
+      PrintDiffValue (L"snapshot:", Name, Differ->Store, Entry);
+      PrintDiffValue (L"live:", Name, Differ->Other, OtherEntry);
+    }
+  }
+
+  return TRUE;
+}
+
+EFI_STATUS
+BhSnapshotDiff (
+  IN  BH_VAR_STORE      *Snapshot,
+  IN  BH_VAR_STORE      *Live,
+  OUT BH_SNAPSHOT_DIFF  *Diff
+  )
+{
+  EFI_STATUS        Status;
+  SNAPSHOT_DIFFER   Differ;
+
+  ZeroMem (Diff, sizeof (*Diff));
+
+  Differ.Store = Snapshot;
+  Differ.Other = Live;
+  Differ.IsSnapshot = TRUE;
+  Differ.NextEntry = 0;
+  Differ.Diff = Diff;
+  Differ.Status = EFI_SUCCESS;
+
+  Status = BhNameDictIteratePrefix (&Snapshot->Names, L"", DiffName, &Differ);
+  if (EFI_ERROR (Status) || EFI_ERROR (Differ.Status)) {
+    return EFI_ERROR (Status) ? Status : Differ.Status;
+  }
+
+  Differ.Store = Live;
+  Differ.Other = Snapshot;
+  Differ.IsSnapshot = FALSE;
+  Differ.NextEntry = 0;
+
+  Status = BhNameDictIteratePrefix (&Live->Names, L"", DiffName, &Differ);
+  if (EFI_ERROR (Status)) {
+    return Status;
+  }
+
+  return Differ.Status;
+}
+
+STATIC
+BOOLEAN
+AddChoice (
+  IN VOID                 *Context,
+  IN EFI_FILE_PROTOCOL    *Directory,
+  IN CONST EFI_FILE_INFO  *Info
+  )
+{
+  SNAPSHOT_CHOICES  *Choices;
+  CHAR16            **NewNames;
+
+  Choices = Context;
+
+  if ((Info->Attribute & EFI_FILE_DIRECTORY) != 0
+    || !(HasExtension (Info->FileName, BH_SNAPSHOT_EXTENSION)
+      || HasExtension (Info->FileName, BH_SNAPSHOT_EXTENSION BH_CRYPT_EXTENSION))) {
+    return TRUE;
+  }
+
+  //
+  // Keep every name: only after sorting is it known which are the newest.
+  //
+  if (Choices->Count == Choices->AllocCount) {
+    NewNames = ReallocatePool (
+      Choices->AllocCount * sizeof (CHAR16 *),
+      (Choices->AllocCount + SNAPSHOT_MAX_CHOICES) * sizeof (CHAR16 *),
+      Choices->Names
+      );
+    if (NewNames == NULL) {
+      return FALSE;
+    }
+    Choices->Names = NewNames;
+    Choices->AllocCount += SNAPSHOT_MAX_CHOICES;
+  }
+
+  Choices->Names[Choices->Count] = AllocateCopyPool (StrSize (Info->FileName), Info->FileName);
+  if (Choices->Names[Choices->Count] != NULL) {
+    Choices->Count++;
+  }
+
+  return TRUE;
+}
+
+STATIC
+CONST CHAR16 *
+SnapshotTime (
+  IN CONST CHAR16   *Name
+  )
+{
+  if (StrLen (Name) > SNAPSHOT_TIME_OFFSET && Name[SNAPSHOT_TIME_OFFSET - 1] == L'-') {
+    return &Name[SNAPSHOT_TIME_OFFSET];
+  }
+
+  return Name;
+}
+
+//
+// Newest first whichever machine took them, so that the most recent snapshots are always offered.
+//
+STATIC
+INTN
+CompareChoices (
+  IN VOID       *Context,
+  IN CONST VOID *Left,
+  IN CONST VOID *Right
+  )
+{
+  CONST CHAR16  *LeftName;
+  CONST CHAR16  *RightName;
+  INTN          Result;
+
+  LeftName = *(CONST CHAR16 **) Left;
+  RightName = *(CONST CHAR16 **) Right;
+
+  Result = StrCmp (SnapshotTime (RightName), SnapshotTime (LeftName));
+  if (Result == 0) {
+    Result = StrCmp (LeftName, RightName);
+  }
+
+  return Result;
+}
+
+STATIC
+EFI_STATUS
+BrowseSnapshot (
+  IN EFI_FILE_PROTOCOL    *Root,
+  IN CONST CHAR16         *Path
+  )
+{
+  EFI_STATUS          Status;
+  BH_VAR_STORE        Store;
+  BH_VAR_STORE        *Live;
+  BH_SNAPSHOT_HEADER  Header;
+  BH_SNAPSHOT_DIFF    Diff;
+  EFI_INPUT_KEY       Key;
+
+  Status = BhSnapshotOpen (Root, Path, &Store, &Header);
+  if (EFI_ERROR (Status)) {
+    return Status;
+  }
+
+  Print (
+    L"Snapshot of %g at %04u-%02u-%02u %02u:%02u:%02u, %u variables\n",
+    &Header.MachineId,
+    Header.Time.Year,
+    Header.Time.Month,
+    Header.Time.Day,
+    Header.Time.Hour,
+    Header.Time.Minute,
+    Header.Time.Second,
+    Store.EntryCount
+    );
+  Print (L"[L]ist; [D]iff with live; any other key to close...\n");
+  getkeystroke (&Key);
+
+  if (Key.UnicodeChar == 'l' || Key.UnicodeChar == 'L') {
+    Print (L"Listing... (any key for next or [Q]uit; E[x]it; List [a]ll remaining; Esc to cancel)\n");
+    BhProgressBegin (NULL);
+    Status = ListStoreVars (&Store);
+    BhProgressEnd ();
+    if (Status == EFI_NOT_FOUND || Status == EFI_SUCCESS) {
+      Status = EFI_SUCCESS;
+    }
+  } else if (Key.UnicodeChar == 'd' || Key.UnicodeChar == 'D') {
+    //
+    // Compare against the store as it is now, not an earlier cached snapshot.
+    //
+    BhVarCacheInvalidate ();
+    Status = BhVarCacheGet (&Live);
+    if (!EFI_ERROR (Status)) {
+      BhProgressBegin (NULL);
+      Status = BhSnapshotDiff (&Store, Live, &Diff);
+      BhProgressEnd ();
+      Print (
+        L"%u same, %u changed, %u only in snapshot, %u only in live\n",
+        Diff.Same,
+        Diff.Changed,
+        Diff.OnlyInSnapshot,
+        Diff.OnlyInLive
+        );
+    }
+  }
+
+  if (Status == EFI_ABORTED) {
+    Print (L"Cancelled.\n");
+    Status = EFI_SUCCESS;
+  }
+
+  BhVarStoreFree (&Store);
+  return Status;
+}
+
+EFI_STATUS
+BhSnapshotBrowse (
+  IN  EFI_FILE_PROTOCOL   *Root
+  )
+{
+  EFI_STATUS        Status;
+  SNAPSHOT_CHOICES  Choices;
+  EFI_INPUT_KEY     Key;
+  CHAR16            Path[256];
+  UINT32            Index;
+
+  ZeroMem (&Choices, sizeof (Choices));
+
+  Status = BhForEachFile (Root, BH_SNAPSHOT_DIRECTORY, AddChoice, &Choices);
+  if (Choices.Count == 0) {
+    if (Choices.Names != NULL) {
+      FreePool (Choices.Names);
+    }
+    Print (L"No snapshots in %s\n", BH_SNAPSHOT_DIRECTORY);
+    return Status == EFI_NOT_FOUND ? EFI_SUCCESS : Status;
+  }
+
+  BhSort (Choices.Names, Choices.Count, sizeof (Choices.Names[0]), CompareChoices, NULL);
+
+  for (Index = SNAPSHOT_MAX_CHOICES; Index < Choices.Count; Index++) {
+    FreePool (Choices.Names[Index]);
+  }
+  if (Choices.Count > SNAPSHOT_MAX_CHOICES) {
+    Print (L"Newest %u of %u snapshots:\n", SNAPSHOT_MAX_CHOICES, Choices.Count);
+    Choices.Count = SNAPSHOT_MAX_CHOICES;
+  }
+
+  for (Index = 0; Index < Choices.Count; Index++) {
+    Print (L"[%c] %s\n", L'a' + Index, Choices.Names[Index]);
+  }
+  Print (L"Choose a snapshot; Esc to cancel...\n");
+
+  Status = EFI_SUCCESS;
+  do {
+    getkeystroke (&Key);
+    Index = (UINT32) ((Key.UnicodeChar | 0x20) - L'a');
+  } while (Key.ScanCode != SCAN_ESC && Index >= Choices.Count);
+
+  if (Key.ScanCode != SCAN_ESC) {
+    UnicodeSPrint (Path, sizeof (Path), L"%s\\%s", BH_SNAPSHOT_DIRECTORY, Choices.Names[Index]);
+    Status = BrowseSnapshot (Root, Path);
+  }
+
+  for (Index = 0; Index < Choices.Count; Index++) {
+    FreePool (Choices.Names[Index]);
+  }
+  FreePool (Choices.Names);
+
+  return Status;
+}
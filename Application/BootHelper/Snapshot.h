@@ -0,0 +1,109 @@
+/** @file
+  Declaration of NVRAM snapshot file format and export.
+
+  Copyright (c) 2020, Mike Beaton. All rights reserved.<BR>
+  SPDX-License-Identifier: BSD-3-Clause
+
+**/
+
+#ifndef __BH__SNAPSHOT__
+#define __BH__SNAPSHOT__
+
+//
+// Basic UEFI Libraries
+//
+#include <Uefi.h>
+#include <Library/UefiLib.h>
+
+//
+// Local includes
+//
+#include "VarStore.h"
+
+#define BH_SNAPSHOT_DIRECTORY       L"Snapshots"
+#define BH_SNAPSHOT_EXTENSION       L".bhsnap"
+
+#define BH_SNAPSHOT_SIGNATURE       SIGNATURE_32 ('B', 'H', 'S', 'N')
+#define BH_SNAPSHOT_VERSION         1
+
+//
+// Snapshot file layout, all values little-endian:
+//   BH_SNAPSHOT_HEADER
+//   EntryCount x (BH_SNAPSHOT_RECORD, CHAR16 Name[NameSize / 2], UINT8 Data[DataSize])
+// Records are in store snapshot order (name, then GUID) and are not padded.
+// Utilities/BhFleet/bhsnap.py reads and writes this format on the host for bharchive.py;
+// keep them in step.
+//
+#pragma pack(1)
+
+typedef struct BH_SNAPSHOT_HEADER_ {
+  UINT32    Signature;
+  UINT16    Version;
+  UINT16    HeaderSize;
+  EFI_GUID  MachineId;          ///< SMBIOS system UUID, zero if unknown
+  EFI_TIME  Time;
+  UINT32    EntryCount;
+  UINT32    Reserved;
+} BH_SNAPSHOT_HEADER;
+
+typedef struct BH_SNAPSHOT_RECORD_ {
+  EFI_GUID  Guid;
+  UINT32    Attributes;
+  UINT16    NameSize;           ///< In bytes, including terminator
+  UINT16    Reserved;
+  UINT32    DataSize;
+} BH_SNAPSHOT_RECORD;
+
+#pragma pack()
+
+// Serialise store snapshot into a single allocated buffer, which must be freed by the caller using FreePool
+EFI_STATUS
+BhSnapshotSerialize (
+  IN  BH_VAR_STORE  *Store,
+  OUT VOID          **Buffer,
+  OUT UINTN         *Size
+  );
+
+// Snapshot the live store and write it to Snapshots\<machine>-<time>.bhsnap under the BootHelper root,
+// or encrypted with Passphrase to .bhsnap.bhenc if it is given
+EFI_STATUS
+BhSnapshotExport (
+  IN  EFI_FILE_PROTOCOL   *Root,
+  IN  CONST CHAR8         *Passphrase OPTIONAL,
+  OUT CHAR16              *FileName OPTIONAL,
+  IN  UINTN               FileNameSize
+  );
+
+// Index a snapshot file as a read-only store, which can be used wherever a live store snapshot is;
+// variable data stays in the file buffer, owned by the store, and is only decoded when displayed; an
+// encrypted snapshot is decrypted with the session passphrase, which is asked for if needed
+EFI_STATUS
+BhSnapshotOpen (
+  IN  EFI_FILE_PROTOCOL   *Root,
+  IN  CONST CHAR16        *Path,
+  OUT BH_VAR_STORE        *Store,
+  OUT BH_SNAPSHOT_HEADER  *Header OPTIONAL
+  );
+
+typedef struct BH_SNAPSHOT_DIFF_ {
+  UINT32    Same;
+  UINT32    Changed;            ///< Different value or attributes
+  UINT32    OnlyInSnapshot;
+  UINT32    OnlyInLive;
+} BH_SNAPSHOT_DIFF;
+
+// Display each variable which differs between Snapshot and Live, with both values, and count the differences
+EFI_STATUS
+BhSnapshotDiff (
+  IN  BH_VAR_STORE      *Snapshot,
+  IN  BH_VAR_STORE      *Live,
+  OUT BH_SNAPSHOT_DIFF  *Diff
+  );
+
+// Choose a snapshot file under the BootHelper root, then list it or diff it against the live store
+EFI_STATUS
+BhSnapshotBrowse (
+  IN  EFI_FILE_PROTOCOL   *Root
+  );
+
+#endif
@@ -0,0 +1,65 @@
+/** @file
+  BootHelper startup span timing.
+
+  Copyright (c) 2020, Mike Beaton. All rights reserved.<BR>
+  SPDX-License-Identifier: BSD-3-Clause
+
+**/
+
+//
+// Basic UEFI Libraries
+//
+#include <Uefi.h>
+#include <Library/UefiLib.h>
+#include <Library/TimerLib.h>
+
+//
+// Local includes
+//
+#include "Timing.h"
+
+STATIC BH_SPAN  mSpans[BH_MAX_SPANS];
+STATIC UINT32   mSpanCount = 0;
+
+UINT64
+BhTimeNs (
+  VOID
+  )
+{
+  return GetTimeInNanoSecond (GetPerformanceCounter ());
+}
+
+UINT32
+BhSpanBegin (
+  IN CONST CHAR16   *Name
+  )
+{
+  if (mSpanCount == BH_MAX_SPANS) {
+    return BH_SPAN_NONE;
+  }
+
+  mSpans[mSpanCount].Name = Name;
+  mSpans[mSpanCount].Start = BhTimeNs ();
+  mSpans[mSpanCount].End = 0;
+
+  return mSpanCount++;
+}
+
+VOID
+BhSpanEnd (
+  IN UINT32         Span
+  )
+{
+  if (Span < mSpanCount) {
+    mSpans[Span].End = BhTimeNs ();
+  }
+}
+
+CONST BH_SPAN *
+BhSpans (
+  OUT UINT32        *Count
+  )
+{
+  *Count = mSpanCount;
+  return mSpans;
+}
@@ -0,0 +1,51 @@
+/** @file
+  Declaration of BootHelper startup span timing.
+
+  Copyright (c) 2020, Mike Beaton. All rights reserved.<BR>
+  SPDX-License-Identifier: BSD-3-Clause
+
+**/
+
+#ifndef __BH__TIMING__
+#define __BH__TIMING__
+
+//
+// Basic UEFI Libraries
+//
+#include <Uefi.h>
+#include <Library/UefiLib.h>
+
+#define BH_MAX_SPANS        16
+#define BH_SPAN_NONE        MAX_UINT32
+
+typedef struct BH_SPAN_ {
+  CONST CHAR16  *Name;
+  UINT64        Start;            ///< Nanoseconds since counter start (normally reset)
+  UINT64        End;              ///< Zero while span is open
+} BH_SPAN;
+
+// Current time in nanoseconds since counter start
+UINT64
+BhTimeNs (
+  VOID
+  );
+
+// Open a named span (Name must be static), returning BH_SPAN_NONE if the span table is full
+UINT32
+BhSpanBegin (
+  IN CONST CHAR16   *Name
+  );
+
+// Close a span opened by BhSpanBegin
+VOID
+BhSpanEnd (
+  IN UINT32         Span
+  );
+
+// Return recorded spans, in the order they were opened
+CONST BH_SPAN *
+BhSpans (
+  OUT UINT32        *Count
+  );
+
+#endif
@@ -0,0 +1,450 @@
+/** @file
+  Variable usage table and most used panel.
+
+  Counts how often each variable is deliberately inspected or changed (stopped
+  on in a listing, read by a tool through BOOT_HELPER_PROTOCOL, or written),
+  across runs, in Usage.bhuse under the BootHelper root. The most used values
+  are fetched while waiting for keys, so the panel itself never calls firmware.
+
+  Copyright (c) 2020, Mike Beaton. All rights reserved.<BR>
+  SPDX-License-Identifier: BSD-3-Clause
+
+**/
+
+//
+// Basic UEFI Libraries
+//
+#include <Uefi.h>
+#include <Library/UefiLib.h>
+#include <Library/BaseLib.h>
+#include <Library/BaseMemoryLib.h>
+#include <Library/MemoryAllocationLib.h>
+#include <Library/PrintLib.h>
+
+//
+// Boot and Runtime Services
+//
+#include <Library/UefiBootServicesTableLib.h>
+
+//
+// OC Libraries
+//
+#include <Library/OcDebugLogLib.h>
+
+//
+// Local includes
+//
+#include "DisplayVars.h"
+#include "FileUtils.h"
+#include "Plugins.h"
+#include "Usage.h"
+#include "Utils.h"
+#include "VarEngine.h"
+
+//
+// Counts are halved when any reaches this, so that old habits fade.
+//
+#define USAGE_AGE_LIMIT     1024
+
+#define USAGE_LINE_SIZE     256
+
+typedef struct USAGE_ENTRY_ {
+  EFI_GUID  Guid;
+  UINT32    Count;
+  CHAR16    *Name;
+  CHAR16    *Text;              ///< Cached display value, NULL until fetched
+} USAGE_ENTRY;
+
+//
+// Kept in descending order of Count.
+//
+STATIC USAGE_ENTRY  mUsage[BH_USAGE_MAX_ENTRIES];
+STATIC UINT32       mUsageCount   = 0;
+STATIC BOOLEAN      mUsageLoaded  = FALSE;
+STATIC BOOLEAN      mUsageDirty   = FALSE;
+
+//
+// Screen position of the panel, valid until the next key is read.
+//
+STATIC INT32        mPanelRow     = -1;
+STATIC UINT32       mPanelLines   = 0;
+STATIC UINTN        mPanelColumns = 80;
+
+STATIC
+VOID
+FreeEntry (
+  IN OUT USAGE_ENTRY  *Entry
+  )
+{
+  if (Entry->Name != NULL) {
+    FreePool (Entry->Name);
+  }
+  if (Entry->Text != NULL) {
+    FreePool (Entry->Text);
+  }
+  ZeroMem (Entry, sizeof (*Entry));
+}
+
+STATIC
+UINT32
+FindEntry (
+  IN CONST CHAR16     *Name,
+  IN CONST EFI_GUID   *Guid
+  )
+{
+  UINT32  Index;
+
+  for (Index = 0; Index < mUsageCount; Index++) {
+    if (CompareGuid (&mUsage[Index].Guid, Guid) && StrCmp (mUsage[Index].Name, Name) == 0) {
+      break;
+    }
+  }
+
+  return Index;
+}
+
+//
+// Count one use; returns index of the entry, or mUsageCount if it could not be added.
+//
+STATIC
+UINT32
+CountUse (
+  IN CONST CHAR16     *Name,
+  IN CONST EFI_GUID   *Guid
+  )
+{
+  UINT32        Index;
+  UINT32        Aged;
+  USAGE_ENTRY   Swap;
+  CHAR16        *NameCopy;
+
+  Index = FindEntry (Name, Guid);
+
+  if (Index == mUsageCount) {
+    NameCopy = AllocateCopyPool (StrSize (Name), Name);
+    if (NameCopy == NULL) {
+      return mUsageCount;
+    }
+
+    //
+    // When full, a new variable replaces the least used one.
+    //
+    if (mUsageCount == BH_USAGE_MAX_ENTRIES) {
+      Index = mUsageCount - 1;
+      FreeEntry (&mUsage[Index]);
+    } else {
+      mUsageCount++;
+    }
+
+    CopyGuid (&mUsage[Index].Guid, Guid);
+    mUsage[Index].Name = NameCopy;
+  }
+
+  mUsage[Index].Count++;
+  mUsageDirty = TRUE;
+
+  while (Index > 0 && mUsage[Index - 1].Count < mUsage[Index].Count) {
+    CopyMem (&Swap, &mUsage[Index - 1], sizeof (Swap));
+    CopyMem (&mUsage[Index - 1], &mUsage[Index], sizeof (Swap));
+    CopyMem (&mUsage[Index], &Swap, sizeof (Swap));
+    Index--;
+  }
+
+  if (mUsage[0].Count >= USAGE_AGE_LIMIT) {
+    for (Aged = 0; Aged < mUsageCount; Aged++) {
+      mUsage[Aged].Count = (mUsage[Aged].Count + 1) / 2;
+    }
+  }
+
+  return Index;
+}
+
+VOID
+BhUsageNote (
+  IN CONST CHAR16       *Name,
+  IN CONST EFI_GUID     *Guid
+  )
+{
+  if (mUsageLoaded && !CompareGuid (Guid, &gBootHelperVariableGuid)) {
+    CountUse (Name, Guid);
+  }
+}
+
+STATIC
+VOID
+NoteWrite (
+  IN CONST CHAR16     *Name,
+  IN CONST EFI_GUID   *Guid,
+  IN UINT32           Attributes,
+  IN UINTN            Size,
+  IN CONST VOID       *Data
+  )
+{
+  UINT32  Index;
+
+  if (CompareGuid (Guid, &gBootHelperVariableGuid)) {
+    return;
+  }
+
+  //
+  // Cached value is stale; it is fetched again when next idle.
+  //
+  Index = CountUse (Name, Guid);
+  if (Index < mUsageCount && mUsage[Index].Text != NULL) {
+    FreePool (mUsage[Index].Text);
+    mUsage[Index].Text = NULL;
+  }
+}
+
+EFI_STATUS
+BhUsageLoad (
+  IN EFI_FILE_PROTOCOL  *Root
+  )
+{
+  EFI_STATUS              Status;
+  UINT8                   *Buffer;
+  UINTN                   Size;
+  UINTN                   Offset;
+  UINT32                  Index;
+  CONST BH_USAGE_HEADER   *Header;
+  CONST BH_USAGE_RECORD   *Record;
+  CONST CHAR16            *Name;
+
+  mUsageLoaded = TRUE;
+  BhVarAddWriteNotify (NoteWrite);
+
+  Status = BhReadFile (Root, BH_USAGE_PATH, (VOID **) &Buffer, &Size);
+  if (EFI_ERROR (Status)) {
+    return Status == EFI_NOT_FOUND ? EFI_SUCCESS : Status;
+  }
+
+  Header = (CONST BH_USAGE_HEADER *) Buffer;
+  if (Size < sizeof (*Header)
+    || Header->Signature != BH_USAGE_SIGNATURE
+    || Header->Version != BH_USAGE_VERSION
+    || Header->HeaderSize < sizeof (*Header)
+    || Header->HeaderSize > Size) {
+    DEBUG ((DEBUG_WARN, "BH: Ignoring invalid %s\n", BH_USAGE_PATH));
+    FreePool (Buffer);
+    return EFI_VOLUME_CORRUPTED;
+  }
+
+  Offset = Header->HeaderSize;
+  for (Index = 0; Index < Header->EntryCount && mUsageCount < BH_USAGE_MAX_ENTRIES; Index++) {
+    if (Size - Offset < sizeof (*Record)) {
+      break;
+    }
+    Record = (CONST BH_USAGE_RECORD *) (Buffer + Offset);
+    Offset += sizeof (*Record);
+
+    if (Record->NameSize < sizeof (CHAR16)
+      || (Record->NameSize & 1) != 0
+      || Size - Offset < Record->NameSize) {
+      break;
+    }
+    Name = (CONST CHAR16 *) (Buffer + Offset);
+    Offset += Record->NameSize;
+
+    if (Name[Record->NameSize / sizeof (CHAR16) - 1] != L'\0') {
+      break;
+    }
+
+    mUsage[mUsageCount].Name = AllocateCopyPool (Record->NameSize, Name);
+    if (mUsage[mUsageCount].Name == NULL) {
+      break;
+    }
+    CopyGuid (&mUsage[mUsageCount].Guid, &Record->Guid);
+    mUsage[mUsageCount].Count = Record->Count;
+    mUsageCount++;
+  }
+
+  FreePool (Buffer);
+
+  DEBUG ((DEBUG_INFO, "BH: Loaded usage of %u variables\n", mUsageCount));
+
+  return EFI_SUCCESS;
+}
+
+//
+// Print one panel line, truncated and padded to exactly the screen width less one,
+// so that it can be rewritten in place without wrapping.
+//
+STATIC
+VOID
+PrintPanelLine (
+  IN UINT32   Index
+  )
+{
+  CHAR16  Line[USAGE_LINE_SIZE];
+  UINTN   Width;
+  UINTN   Length;
+
+  Width = MIN (mPanelColumns - 1, USAGE_LINE_SIZE - 1);
+
+  Length = UnicodeSPrint (
+    Line,
+    sizeof (Line),
+    L"  %s = %s",
+    mUsage[Index].Name,
+    mUsage[Index].Text != NULL ? mUsage[Index].Text : L"..."
+    );
+
+  while (Length < Width) {
+    Line[Length++] = L' ';
+  }
+  Line[Width] = L'\0';
+
+  Print (L"%s", Line);
+}
+
+VOID
+BhUsagePrintPanel (
+  VOID
+  )
+{
+  UINT32  Index;
+  UINTN   Rows;
+
+  mPanelRow = -1;
+  mPanelLines = MIN (mUsageCount, BH_USAGE_PANEL_SIZE);
+
+  if (mPanelLines == 0) {
+    return;
+  }
+
+  if (EFI_ERROR (gST->ConOut->QueryMode (gST->ConOut, gST->ConOut->Mode->Mode, &mPanelColumns, &Rows))
+    || mPanelColumns < 20) {
+    mPanelColumns = 80;
+  }
+
+  SetColour (EFI_LIGHTCYAN);
+  Print (L"Most used:\n");
+  SetColour (EFI_WHITE);
+
+  for (Index = 0; Index < mPanelLines; Index++) {
+    PrintPanelLine (Index);
+    Print (L"\n");
+  }
+
+  //
+  // Panel is printed last, so its position is known relative to the cursor even if the screen scrolled.
+  //
+  mPanelRow = gST->ConOut->Mode->CursorRow - (INT32) mPanelLines;
+}
+
+BOOLEAN
+BhUsagePrefetch (
+  VOID
+  )
+{
+  EFI_STATUS  Status;
+  UINT32      Index;
+  UINT32      Attributes;
+  UINTN       DataSize;
+  VOID        *Data;
+  INT32       Column;
+  INT32       Row;
+
+  for (Index = 0; Index < MIN (mUsageCount, BH_USAGE_PANEL_SIZE); Index++) {
+    if (mUsage[Index].Text == NULL) {
+      break;
+    }
+  }
+
+  if (Index == MIN (mUsageCount, BH_USAGE_PANEL_SIZE)) {
+    return FALSE;
+  }
+
+  Status = GetNvramValue (mUsage[Index].Name, &mUsage[Index].Guid, &Attributes, &DataSize, &Data);
+  if (EFI_ERROR (Status)) {
+    mUsage[Index].Text = CatSPrint (NULL, L"%r", Status);
+  } else {
+    mUsage[Index].Text = BhPluginDecode (mUsage[Index].Name, &mUsage[Index].Guid, Data, DataSize);
+    if (mUsage[Index].Text == NULL) {
+      mUsage[Index].Text = FormatVar (&mUsage[Index].Guid, Data, DataSize, TRUE);
+    }
+    if (Data != NULL) {
+      FreePool (Data);
+    }
+  }
+
+  if (mUsage[Index].Text == NULL) {
+    //
+    // Out of resources; stop prefetching rather than retry forever.
+    //
+    return FALSE;
+  }
+
+  if (mPanelRow >= 0 && Index < mPanelLines) {
+    Column = gST->ConOut->Mode->CursorColumn;
+    Row = gST->ConOut->Mode->CursorRow;
+    gST->ConOut->SetCursorPosition (gST->ConOut, 0, mPanelRow + Index);
+    PrintPanelLine (Index);
+    gST->ConOut->SetCursorPosition (gST->ConOut, Column, Row);
+  }
+
+  return TRUE;
+}
+
+EFI_STATUS
+BhUsageSave (
+  IN EFI_FILE_PROTOCOL  *Root
+  )
+{
+  EFI_STATUS        Status;
+  UINTN             Size;
+  UINT32            Index;
+  UINT8             *Buffer;
+  UINT8             *Walker;
+  BH_USAGE_HEADER   *Header;
+  BH_USAGE_RECORD   *Record;
+
+  Status = EFI_SUCCESS;
+
+  if (mUsageDirty && Root != NULL) {
+    Size = sizeof (*Header);
+    for (Index = 0; Index < mUsageCount; Index++) {
+      Size += sizeof (*Record) + StrSize (mUsage[Index].Name);
+    }
+
+    Buffer = AllocateZeroPool (Size);
+    if (Buffer == NULL) {
+      Status = EFI_OUT_OF_RESOURCES;
+    } else {
+      Header = (BH_USAGE_HEADER *) Buffer;
+      Header->Signature = BH_USAGE_SIGNATURE;
+      Header->Version = BH_USAGE_VERSION;
+      Header->HeaderSize = sizeof (*Header);
+      Header->EntryCount = mUsageCount;
+
+      Walker = Buffer + sizeof (*Header);
+      for (Index = 0; Index < mUsageCount; Index++) {
+        Record = (BH_USAGE_RECORD *) Walker;
+        CopyGuid (&Record->Guid, &mUsage[Index].Guid);
+        Record->Count = mUsage[Index].Count;
+        Record->NameSize = (UINT16) StrSize (mUsage[Index].Name);
+        Walker += sizeof (*Record);
+        CopyMem (Walker, mUsage[Index].Name, Record->NameSize);
+        Walker += Record->NameSize;
+      }
+
+      Status = BhWriteFile (Root, BH_USAGE_PATH, Buffer, Size);
+      FreePool (Buffer);
+    }
+
+    DEBUG ((DEBUG_INFO, "BH: Saved usage of %u variables - %r\n", mUsageCount, Status));
+  }
+
+  BhVarRemoveWriteNotify (NoteWrite);
+
+  for (Index = 0; Index < mUsageCount; Index++) {
+    FreeEntry (&mUsage[Index]);
+  }
+
+  mUsageCount = 0;
+  mUsageLoaded = FALSE;
+  mUsageDirty = FALSE;
+  mPanelRow = -1;
+
+  return Status;
+}
@@ -0,0 +1,87 @@
+/** @file
+  Declaration of variable usage table and most used panel.
+
+  Copyright (c) 2020, Mike Beaton. All rights reserved.<BR>
+  SPDX-License-Identifier: BSD-3-Clause
+
+**/
+
+#ifndef __BH__USAGE__
+#define __BH__USAGE__
+
+//
+// Basic UEFI Libraries
+//
+#include <Uefi.h>
+#include <Library/UefiLib.h>
+
+#include <Protocol/SimpleFileSystem.h>
+
+#define BH_USAGE_PATH               L"Usage.bhuse"
+
+#define BH_USAGE_SIGNATURE          SIGNATURE_32 ('B', 'H', 'U', 'S')
+#define BH_USAGE_VERSION            1
+
+//
+// Variables tracked, and how many of the most used are shown.
+//
+#define BH_USAGE_MAX_ENTRIES        32
+#define BH_USAGE_PANEL_SIZE         5
+
+//
+// Usage file layout, all values little-endian:
+//   BH_USAGE_HEADER
+//   EntryCount x (BH_USAGE_RECORD, CHAR16 Name[NameSize / 2])
+// Records are in descending order of Count.
+//
+#pragma pack(1)
+
+typedef struct BH_USAGE_HEADER_ {
+  UINT32    Signature;
+  UINT16    Version;
+  UINT16    HeaderSize;
+  UINT32    EntryCount;
+  UINT32    Reserved;
+} BH_USAGE_HEADER;
+
+typedef struct BH_USAGE_RECORD_ {
+  EFI_GUID  Guid;
+  UINT32    Count;
+  UINT16    NameSize;           ///< In bytes, including terminator
+  UINT16    Reserved;
+} BH_USAGE_RECORD;
+
+#pragma pack()
+
+// Load usage table from the BootHelper root, and start counting writes
+EFI_STATUS
+BhUsageLoad (
+  IN EFI_FILE_PROTOCOL  *Root
+  );
+
+// Count one deliberate inspection of a variable; does nothing until the table is loaded
+VOID
+BhUsageNote (
+  IN CONST CHAR16       *Name,
+  IN CONST EFI_GUID     *Guid
+  );
+
+// Print most used panel from cached values only; values not yet fetched are filled in place by BhUsagePrefetch
+VOID
+BhUsagePrintPanel (
+  VOID
+  );
+
+// Fetch one most used value not yet cached; returns FALSE when all are cached (EZKB_IDLE)
+BOOLEAN
+BhUsagePrefetch (
+  VOID
+  );
+
+// Save usage table if it has changed, and free it
+EFI_STATUS
+BhUsageSave (
+  IN EFI_FILE_PROTOCOL  *Root
+  );
+
+#endif
@@ -18,6 +18,11 @@
 #include <Library/UefiBootServicesTableLib.h>
 #include <Library/UefiRuntimeServicesTableLib.h>
 
+//
+// Local includes
+//
+#include "Utils.h"
+
 EFI_STATUS SetColour(
   UINTN Attribute
   )
@@ -34,3 +39,66 @@ void Reboot()
 {
   gRT->ResetSystem(EfiResetWarm, EFI_SUCCESS, 0, NULL);
 }
+
+STATIC
+VOID
+SwapElements (
+  IN OUT UINT8  *Left,
+  IN OUT UINT8  *Right,
+  IN     UINTN  ElementSize
+  )
+{
+  UINT8 Byte;
+
+  while (ElementSize-- > 0) {
+    Byte = *Left;
+    *Left++ = *Right;
+    *Right++ = Byte;
+  }
+}
+
+VOID
+BhSort (
+  IN OUT VOID             *Base,
+  IN     UINTN            Count,
+  IN     UINTN            ElementSize,
+  IN     BH_SORT_COMPARE  Compare,
+  IN     VOID             *Context
+  )
+{
+  UINT8 *Elements;
+  UINTN Start;
+  UINTN End;
+  UINTN Root;
+  UINTN Child;
+
+  if (Count < 2) {
+    return;
+  }
+
+  Elements = Base;
+  Start = Count / 2;
+  End = Count;
+
+  while (End > 1) {
+    if (Start > 0) {
+      Start--;
+    } else {
+      End--;
+      SwapElements (Elements, Elements + End * ElementSize, ElementSize);
+    }
+
+    Root = Start;
+    while ((Child = Root * 2 + 1) < End) {
+      if (Child + 1 < End
+        && Compare (Context, Elements + Child * ElementSize, Elements + (Child + 1) * ElementSize) < 0) {
+        Child++;
+      }
+      if (Compare (Context, Elements + Root * ElementSize, Elements + Child * ElementSize) >= 0) {
+        break;
+      }
+      SwapElements (Elements + Root * ElementSize, Elements + Child * ElementSize, ElementSize);
+      Root = Child;
+    }
+  }
+}
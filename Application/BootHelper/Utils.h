@@ -23,4 +23,23 @@ void Shutdown();
 
 void Reboot();
 
+// Compare two elements for BhSort, returning <0, 0 or >0
+typedef
+INTN
+(*BH_SORT_COMPARE) (
+  IN VOID       *Context,
+  IN CONST VOID *Left,
+  IN CONST VOID *Right
+  );
+
+// In-place heap sort, needing no recursion and no allocation
+VOID
+BhSort (
+  IN OUT VOID             *Base,
+  IN     UINTN            Count,
+  IN     UINTN            ElementSize,
+  IN     BH_SORT_COMPARE  Compare,
+  IN     VOID             *Context
+  );
+
 #endif
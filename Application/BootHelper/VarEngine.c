@@ -0,0 +1,391 @@
+/** @file
+  NVRAM variable engine: cached store snapshot, diff-before-write and profile apply.
+
+  Copyright (c) 2020, Mike Beaton. All rights reserved.<BR>
+  SPDX-License-Identifier: BSD-3-Clause
+
+**/
+
+//
+// Basic UEFI Libraries
+//
+#include <Uefi.h>
+#include <Library/UefiLib.h>
+#include <Library/BaseLib.h>
+#include <Library/BaseMemoryLib.h>
+#include <Library/MemoryAllocationLib.h>
+
+//
+// Boot and Runtime Services
+//
+#include <Library/UefiRuntimeServicesTableLib.h>
+
+//
+// OC Libraries
+//
+#include <Library/OcDebugLogLib.h>
+
+//
+// Local includes
+//
+#include "DisplayVars.h"
+#include "Quirks.h"
+#include "VarEngine.h"
+
+//
+// Longest variable name accepted from configuration.
+//
+#define VAR_ENGINE_MAX_NAME   128
+
+EFI_GUID gBootHelperVariableGuid = BOOT_HELPER_VARIABLE_GUID;
+
+STATIC BOOLEAN      mVarCacheValid = FALSE;
+STATIC BH_VAR_STORE mVarCache;
+
+STATIC BH_VAR_WRITE_NOTIFY mVarWriteNotify[BH_VAR_MAX_WRITE_NOTIFY];
+
+EFI_STATUS
+BhVarAddWriteNotify (
+  IN BH_VAR_WRITE_NOTIFY  Notify
+  )
+{
+  UINT32  Index;
+  UINT32  Free;
+
+  //
+  // Removal leaves gaps, so check every slot for this observer before taking the first free one.
+  //
+  Free = BH_VAR_MAX_WRITE_NOTIFY;
+  for (Index = 0; Index < BH_VAR_MAX_WRITE_NOTIFY; Index++) {
+    if (mVarWriteNotify[Index] == Notify) {
+      return EFI_SUCCESS;
+    }
+    if (mVarWriteNotify[Index] == NULL && Free == BH_VAR_MAX_WRITE_NOTIFY) {
+      Free = Index;
+    }
+  }
+
+  if (Free == BH_VAR_MAX_WRITE_NOTIFY) {
+    return EFI_OUT_OF_RESOURCES;
+  }
+
+  mVarWriteNotify[Free] = Notify;
+  return EFI_SUCCESS;
+}
+
+VOID
+BhVarRemoveWriteNotify (
+  IN BH_VAR_WRITE_NOTIFY  Notify
+  )
+{
+  UINT32  Index;
+
+  for (Index = 0; Index < BH_VAR_MAX_WRITE_NOTIFY; Index++) {
+    if (mVarWriteNotify[Index] == Notify) {
+      mVarWriteNotify[Index] = NULL;
+    }
+  }
+}
+
+EFI_STATUS
+BhVarCacheGet (
+  OUT BH_VAR_STORE  **Store
+  )
+{
+  EFI_STATUS  Status;
+
+  if (!mVarCacheValid) {
+    Status = BhVarStoreSnapshot (&mVarCache);
+    if (EFI_ERROR (Status)) {
+      return Status;
+    }
+    mVarCacheValid = TRUE;
+  }
+
+  *Store = &mVarCache;
+  return EFI_SUCCESS;
+}
+
+VOID
+BhVarCacheInvalidate (
+  VOID
+  )
+{
+  if (mVarCacheValid) {
+    BhVarStoreFree (&mVarCache);
+    mVarCacheValid = FALSE;
+  }
+}
+
+EFI_STATUS
+BhVarRead (
+  IN  CONST CHAR16    *Name,
+  IN  CONST EFI_GUID  *Guid,
+  OUT UINT32          *Attributes OPTIONAL,
+  OUT UINTN           *Size,
+  OUT VOID            **Data
+  )
+{
+  EFI_STATUS    Status;
+  UINT32        CurrentAttributes;
+  BH_VAR_STORE  *Store;
+  BH_VAR_ENTRY  *Entry;
+
+  if (!mVarCacheValid && (BhQuirks () & BH_QUIRK_SLOW_ENUMERATION) != 0) {
+    Status = GetNvramValue ((CHAR16 *) Name, (EFI_GUID *) Guid, &CurrentAttributes, Size, Data);
+    if (!EFI_ERROR (Status) && Attributes != NULL) {
+      *Attributes = CurrentAttributes;
+    }
+    return Status;
+  }
+
+  Status = BhVarCacheGet (&Store);
+  if (EFI_ERROR (Status)) {
+    return Status;
+  }
+
+  Entry = BhVarStoreFind (Store, Name, Guid);
+  if (Entry == NULL) {
+    return EFI_NOT_FOUND;
+  }
+
+  *Data = AllocateCopyPool (MAX (Entry->DataSize, 1), Store->Data + Entry->DataOffset);
+  if (*Data == NULL) {
+    return EFI_OUT_OF_RESOURCES;
+  }
+
+  *Size = Entry->DataSize;
+  if (Attributes != NULL) {
+    *Attributes = Entry->Attributes;
+  }
+
+  return EFI_SUCCESS;
+}
+
+EFI_STATUS
+BhVarWrite (
+  IN  CONST CHAR16    *Name,
+  IN  CONST EFI_GUID  *Guid,
+  IN  UINT32          Attributes,
+  IN  UINTN           Size,
+  IN  CONST VOID      *Data,
+  OUT BOOLEAN         *Changed OPTIONAL
+  )
+{
+  EFI_STATUS  Status;
+  UINT32      CurrentAttributes;
+  UINTN       CurrentSize;
+  VOID        *CurrentData;
+  BOOLEAN     Exists;
+  BOOLEAN     Same;
+  UINT32      Quirks;
+  UINT32      Index;
+
+  if (Changed != NULL) {
+    *Changed = FALSE;
+  }
+
+  Status = GetNvramValue ((CHAR16 *) Name, (EFI_GUID *) Guid, &CurrentAttributes, &CurrentSize, &CurrentData);
+  if (EFI_ERROR (Status) && Status != EFI_NOT_FOUND) {
+    return Status;
+  }
+
+  Exists = Status != EFI_NOT_FOUND;
+
+  if (!Exists) {
+    Same = (Size == 0);
+  } else {
+    Same = Size != 0
+      && CurrentAttributes == Attributes
+      && CurrentSize == Size
+      && CompareMem (CurrentData, Data, Size) == 0;
+    if (CurrentData != NULL) {
+      FreePool (CurrentData);
+    }
+  }
+
+  if (Same) {
+    return EFI_SUCCESS;
+  }
+
+  Quirks = BhQuirks ();
+
+  if (Size == 0) {
+    if ((Quirks & BH_QUIRK_DELETE_ZERO_ATTRIBUTES) != 0) {
+      Attributes = 0;
+    }
+  } else if (Exists
+    && (Quirks & BH_QUIRK_DELETE_BEFORE_WRITE) != 0
+    && (CurrentAttributes != Attributes || CurrentSize != Size)) {
+    Status = gRT->SetVariable (
+      (CHAR16 *) Name,
+      (EFI_GUID *) Guid,
+      (Quirks & BH_QUIRK_DELETE_ZERO_ATTRIBUTES) != 0 ? 0 : CurrentAttributes,
+      0,
+      NULL
+      );
+    //
+    // On this firmware the write itself would fail, or leave a duplicate, if the old
+    // variable is still there.
+    //
+    if (EFI_ERROR (Status) && Status != EFI_NOT_FOUND) {
+      DEBUG ((DEBUG_WARN, "BH: Delete before write %g:%s - %r\n", Guid, Name, Status));
+      BhVarCacheInvalidate ();
+      return Status;
+    }
+  }
+
+  Status = gRT->SetVariable ((CHAR16 *) Name, (EFI_GUID *) Guid, Attributes, Size, (VOID *) Data);
+  DEBUG ((DEBUG_INFO, "BH: Write %g:%s (%u bytes) - %r\n", Guid, Name, (UINT32) Size, Status));
+
+  //
+  // Even a failed write may have partially changed the store.
+  //
+  BhVarCacheInvalidate ();
+
+  if (!EFI_ERROR (Status)) {
+    if (Changed != NULL) {
+      *Changed = TRUE;
+    }
+    for (Index = 0; Index < BH_VAR_MAX_WRITE_NOTIFY; Index++) {
+      if (mVarWriteNotify[Index] != NULL) {
+        mVarWriteNotify[Index] (Name, Guid, Attributes, Size, Data);
+      }
+    }
+  }
+
+  return Status;
+}
+
+EFI_STATUS
+BhVarToggle (
+  IN  CONST CHAR16    *Name,
+  IN  CONST EFI_GUID  *Guid,
+  IN  UINT32          Attributes,
+  IN  UINTN           Size,
+  IN  CONST VOID      *Data,
+  OUT BOOLEAN         *Deleted OPTIONAL
+  )
+{
+  EFI_STATUS  Status;
+  UINT32      CurrentAttributes;
+  UINTN       CurrentSize;
+  VOID        *CurrentData;
+  BOOLEAN     IsSet;
+
+  Status = GetNvramValue ((CHAR16 *) Name, (EFI_GUID *) Guid, &CurrentAttributes, &CurrentSize, &CurrentData);
+  if (EFI_ERROR (Status) && Status != EFI_NOT_FOUND) {
+    return Status;
+  }
+
+  IsSet = FALSE;
+  if (!EFI_ERROR (Status)) {
+    IsSet = CurrentSize == Size && CompareMem (CurrentData, Data, Size) == 0;
+    if (CurrentData != NULL) {
+      FreePool (CurrentData);
+    }
+  }
+
+  if (Deleted != NULL) {
+    *Deleted = IsSet;
+  }
+
+  if (IsSet) {
+    return BhVarWrite (Name, Guid, Attributes, 0, NULL, NULL);
+  }
+
+  return BhVarWrite (Name, Guid, Attributes, Size, Data, NULL);
+}
+
+STATIC
+EFI_STATUS
+ProfileName (
+  IN  OC_STRING   *AsciiName,
+  OUT CHAR16      *Name
+  )
+{
+  EFI_STATUS  Status;
+
+  Status = AsciiStrToUnicodeStrS (OC_BLOB_GET (AsciiName), Name, VAR_ENGINE_MAX_NAME);
+  if (EFI_ERROR (Status)) {
+    DEBUG ((DEBUG_WARN, "BH: Profile variable name %a too long\n", OC_BLOB_GET (AsciiName)));
+  }
+
+  return Status;
+}
+
+EFI_STATUS
+BhVarApplyProfile (
+  IN  BH_NVRAM_CONFIG   *Nvram,
+  OUT UINT32            *WriteCount OPTIONAL
+  )
+{
+  EFI_STATUS  Status;
+  EFI_STATUS  FirstError;
+  UINT32      GuidIndex;
+  UINT32      VarIndex;
+  EFI_GUID    Guid;
+  CHAR16      Name[VAR_ENGINE_MAX_NAME];
+  OC_ASSOC    *Values;
+  OC_DATA     *Value;
+  BOOLEAN     Changed;
+  UINT32      Writes;
+
+  FirstError = EFI_SUCCESS;
+  Writes = 0;
+
+  for (GuidIndex = 0; GuidIndex < Nvram->Delete.Count; GuidIndex++) {
+    Status = AsciiStrToGuid (OC_BLOB_GET (Nvram->Delete.Keys[GuidIndex]), &Guid);
+    if (EFI_ERROR (Status)) {
+      DEBUG ((DEBUG_WARN, "BH: Bad profile delete GUID %a\n", OC_BLOB_GET (Nvram->Delete.Keys[GuidIndex])));
+      continue;
+    }
+
+    for (VarIndex = 0; VarIndex < Nvram->Delete.Values[GuidIndex]->Count; VarIndex++) {
+      if (EFI_ERROR (ProfileName (Nvram->Delete.Values[GuidIndex]->Values[VarIndex], Name))) {
+        continue;
+      }
+
+      Status = BhVarWrite (Name, &Guid, BH_VAR_DEFAULT_ATTRIBUTES, 0, NULL, &Changed);
+      Writes += Changed;
+      if (EFI_ERROR (Status) && !EFI_ERROR (FirstError)) {
+        FirstError = Status;
+      }
+    }
+  }
+
+  for (GuidIndex = 0; GuidIndex < Nvram->Add.Count; GuidIndex++) {
+    Status = AsciiStrToGuid (OC_BLOB_GET (Nvram->Add.Keys[GuidIndex]), &Guid);
+    if (EFI_ERROR (Status)) {
+      DEBUG ((DEBUG_WARN, "BH: Bad profile add GUID %a\n", OC_BLOB_GET (Nvram->Add.Keys[GuidIndex])));
+      continue;
+    }
+
+    Values = Nvram->Add.Values[GuidIndex];
+    for (VarIndex = 0; VarIndex < Values->Count; VarIndex++) {
+      if (EFI_ERROR (ProfileName (Values->Keys[VarIndex], Name))) {
+        continue;
+      }
+
+      Value = Values->Values[VarIndex];
+      Status = BhVarWrite (
+        Name,
+        &Guid,
+        BH_VAR_DEFAULT_ATTRIBUTES,
+        Value->Size,
+        OC_BLOB_GET (Value),
+        &Changed
+        );
+      Writes += Changed;
+      if (EFI_ERROR (Status) && !EFI_ERROR (FirstError)) {
+        FirstError = Status;
+      }
+    }
+  }
+
+  if (WriteCount != NULL) {
+    *WriteCount = Writes;
+  }
+
+  return FirstError;
+}
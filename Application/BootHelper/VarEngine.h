@@ -0,0 +1,118 @@
+/** @file
+  Declaration of NVRAM variable engine: cached store snapshot, diff-before-write
+  and profile apply, shared by the UI and by BOOT_HELPER_PROTOCOL.
+
+  Copyright (c) 2020, Mike Beaton. All rights reserved.<BR>
+  SPDX-License-Identifier: BSD-3-Clause
+
+**/
+
+#ifndef __BH__VAR_ENGINE__
+#define __BH__VAR_ENGINE__
+
+//
+// Basic UEFI Libraries
+//
+#include <Uefi.h>
+#include <Library/UefiLib.h>
+
+//
+// Local includes
+//
+#include "BhConfig.h"
+#include "VarStore.h"
+
+#define BH_VAR_DEFAULT_ATTRIBUTES \
+  (EFI_VARIABLE_BOOTSERVICE_ACCESS | EFI_VARIABLE_RUNTIME_ACCESS | EFI_VARIABLE_NON_VOLATILE)
+
+//
+// Vendor GUID for variables owned by BootHelper itself.
+//
+#define BOOT_HELPER_VARIABLE_GUID \
+  { 0x9d1c7a34, 0x52e8, 0x4b6f, { 0xa1, 0x0e, 0x6c, 0x83, 0xf2, 0x47, 0x5d, 0x19 } }
+
+extern EFI_GUID gBootHelperVariableGuid;
+
+#define BH_VAR_MAX_WRITE_NOTIFY   4
+
+//
+// Called after each successful write made by BhVarWrite; Size == 0 for a delete.
+//
+typedef
+VOID
+(*BH_VAR_WRITE_NOTIFY) (
+  IN CONST CHAR16     *Name,
+  IN CONST EFI_GUID   *Guid,
+  IN UINT32           Attributes,
+  IN UINTN            Size,
+  IN CONST VOID       *Data
+  );
+
+// Add a write observer; up to BH_VAR_MAX_WRITE_NOTIFY may be registered
+EFI_STATUS
+BhVarAddWriteNotify (
+  IN BH_VAR_WRITE_NOTIFY  Notify
+  );
+
+// Remove a write observer, if registered
+VOID
+BhVarRemoveWriteNotify (
+  IN BH_VAR_WRITE_NOTIFY  Notify
+  );
+
+// Return the shared store snapshot, taking it first if there is no valid cached snapshot
+EFI_STATUS
+BhVarCacheGet (
+  OUT BH_VAR_STORE  **Store
+  );
+
+// Drop cached snapshot, so that it is re-taken on next use
+VOID
+BhVarCacheInvalidate (
+  VOID
+  );
+
+// Read one variable into an allocated buffer, which must be freed by the caller using FreePool.
+// Served from the shared snapshot if there is one; otherwise a snapshot is taken first, unless
+// the firmware has BH_QUIRK_SLOW_ENUMERATION, in which case the variable is read directly.
+EFI_STATUS
+BhVarRead (
+  IN  CONST CHAR16    *Name,
+  IN  CONST EFI_GUID  *Guid,
+  OUT UINT32          *Attributes OPTIONAL,
+  OUT UINTN           *Size,
+  OUT VOID            **Data
+  );
+
+// Write a variable only if its value or attributes differ from the live value.
+// Size == 0 deletes the variable, if present. Changed is set if a write was made.
+EFI_STATUS
+BhVarWrite (
+  IN  CONST CHAR16    *Name,
+  IN  CONST EFI_GUID  *Guid,
+  IN  UINT32          Attributes,
+  IN  UINTN           Size,
+  IN  CONST VOID      *Data,
+  OUT BOOLEAN         *Changed OPTIONAL
+  );
+
+// Delete a variable if it currently holds exactly Data, otherwise write Data.
+// Deleted reports which of the two was done.
+EFI_STATUS
+BhVarToggle (
+  IN  CONST CHAR16    *Name,
+  IN  CONST EFI_GUID  *Guid,
+  IN  UINT32          Attributes,
+  IN  UINTN           Size,
+  IN  CONST VOID      *Data,
+  OUT BOOLEAN         *Deleted OPTIONAL
+  );
+
+// Apply NVRAM Delete then Add sections of a configuration, skipping values already present
+EFI_STATUS
+BhVarApplyProfile (
+  IN  BH_NVRAM_CONFIG   *Nvram,
+  OUT UINT32            *WriteCount OPTIONAL
+  );
+
+#endif
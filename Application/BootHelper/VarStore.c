@@ -0,0 +1,426 @@
+/** @file
+  In-memory NVRAM variable store snapshot.
+
+  Copyright (c) 2020, Mike Beaton. All rights reserved.<BR>
+  SPDX-License-Identifier: BSD-3-Clause
+
+**/
+
+//
+// Basic UEFI Libraries
+//
+#include <Uefi.h>
+#include <Library/UefiLib.h>
+#include <Library/MemoryAllocationLib.h>
+#include <Library/BaseMemoryLib.h>
+
+//
+// Boot and Runtime Services
+//
+#include <Library/UefiBootServicesTableLib.h>
+#include <Library/UefiRuntimeServicesTableLib.h>
+
+//
+// OC Libraries
+//
+#include <Library/OcDebugLogLib.h>
+
+//
+// Local includes
+//
+#include "DisplayVars.h"
+#include "Progress.h"
+#include "Utils.h"
+#include "VarStore.h"
+
+#define VAR_STORE_INITIAL_COUNT     64
+#define VAR_STORE_INITIAL_DATA      SIZE_4KB
+
+//
+// Names are only held uncompressed while the snapshot is being taken.
+//
+typedef struct VAR_STORE_BUILD_ {
+  CHAR16        **Names;
+  BH_VAR_ENTRY  *Entries;
+  UINT32        Count;
+  UINT32        AllocCount;
+  UINT32        DataAllocSize;
+} VAR_STORE_BUILD;
+
+UINT32
+BhVarStoreAddGuid (
+  IN OUT BH_VAR_STORE   *Store,
+  IN     CONST EFI_GUID *Guid,
+  IN OUT UINT32         *AllocCount
+  )
+{
+  UINT32  Index;
+  VOID    *NewBuffer;
+
+  //
+  // Real stores have a handful of GUIDs, so a linear scan is fine.
+  //
+  for (Index = 0; Index < Store->GuidCount; Index++) {
+    if (CompareGuid (&Store->Guids[Index], Guid)) {
+      return Index;
+    }
+  }
+
+  if (Store->GuidCount == *AllocCount) {
+    NewBuffer = ReallocatePool (
+      *AllocCount * sizeof (EFI_GUID),
+      *AllocCount * 2 * sizeof (EFI_GUID),
+      Store->Guids
+      );
+    if (NewBuffer == NULL) {
+      return MAX_UINT32;
+    }
+    Store->Guids = NewBuffer;
+    *AllocCount *= 2;
+  }
+
+  CopyGuid (&Store->Guids[Store->GuidCount], Guid);
+  return Store->GuidCount++;
+}
+
+STATIC
+EFI_STATUS
+AddVariable (
+  IN OUT BH_VAR_STORE     *Store,
+  IN OUT VAR_STORE_BUILD  *Build,
+  IN     CHAR16           *Name,
+  IN     UINT32           GuidIndex,
+  IN     EFI_GUID         *Guid
+  )
+{
+  EFI_STATUS    Status;
+  BH_VAR_ENTRY  *Entry;
+  UINT32        Attributes;
+  UINTN         DataSize;
+  VOID          *Data;
+  UINT32        NewAllocSize;
+  VOID          *NewBuffer;
+
+  Status = GetNvramValue (Name, Guid, &Attributes, &DataSize, &Data);
+  if (EFI_ERROR (Status)) {
+    return Status;
+  }
+
+  //
+  // Each buffer is only replaced once its reallocation succeeds, so on failure the build
+  // still owns valid buffers of at least the recorded sizes, for FreeBuild to release.
+  //
+  if (Build->Count == Build->AllocCount) {
+    NewBuffer = ReallocatePool (
+      Build->AllocCount * sizeof (CHAR16 *),
+      Build->AllocCount * 2 * sizeof (CHAR16 *),
+      Build->Names
+      );
+    if (NewBuffer != NULL) {
+      Build->Names = NewBuffer;
+      NewBuffer = ReallocatePool (
+        Build->AllocCount * sizeof (BH_VAR_ENTRY),
+        Build->AllocCount * 2 * sizeof (BH_VAR_ENTRY),
+        Build->Entries
+        );
+    }
+    if (NewBuffer == NULL) {
+      if (Data != NULL) {
+        FreePool (Data);
+      }
+      return EFI_OUT_OF_RESOURCES;
+    }
+    Build->Entries = NewBuffer;
+    Build->AllocCount *= 2;
+  }
+
+  if (Store->DataSize + DataSize > Build->DataAllocSize) {
+    NewAllocSize = Build->DataAllocSize;
+    while (Store->DataSize + DataSize > NewAllocSize) {
+      NewAllocSize *= 2;
+    }
+    NewBuffer = ReallocatePool (Build->DataAllocSize, NewAllocSize, Store->Data);
+    if (NewBuffer == NULL) {
+      if (Data != NULL) {
+        FreePool (Data);
+      }
+      return EFI_OUT_OF_RESOURCES;
+    }
+    Store->Data = NewBuffer;
+    Build->DataAllocSize = NewAllocSize;
+  }
+
+  Build->Names[Build->Count] = AllocateCopyPool (StrSize (Name), Name);
+  if (Build->Names[Build->Count] == NULL) {
+    if (Data != NULL) {
+      FreePool (Data);
+    }
+    return EFI_OUT_OF_RESOURCES;
+  }
+
+  Entry = &Build->Entries[Build->Count];
+  Entry->GuidIndex = GuidIndex;
+  Entry->Attributes = Attributes;
+  Entry->DataSize = (UINT32) DataSize;
+  Entry->DataOffset = Store->DataSize;
+
+  if (DataSize > 0) {
+    CopyMem (Store->Data + Store->DataSize, Data, DataSize);
+  }
+  if (Data != NULL) {
+    FreePool (Data);
+  }
+
+  Store->DataSize += (UINT32) DataSize;
+  Build->Count++;
+
+  return EFI_SUCCESS;
+}
+
+STATIC
+INTN
+CompareEntries (
+  IN VOID       *Context,
+  IN CONST VOID *Left,
+  IN CONST VOID *Right
+  )
+{
+  CONST BH_VAR_ENTRY  *LeftEntry;
+  CONST BH_VAR_ENTRY  *RightEntry;
+
+  LeftEntry = Left;
+  RightEntry = Right;
+
+  if (LeftEntry->NameId != RightEntry->NameId) {
+    return LeftEntry->NameId < RightEntry->NameId ? -1 : 1;
+  }
+
+  if (LeftEntry->GuidIndex != RightEntry->GuidIndex) {
+    return LeftEntry->GuidIndex < RightEntry->GuidIndex ? -1 : 1;
+  }
+
+  return 0;
+}
+
+STATIC
+VOID
+FreeBuild (
+  IN OUT VAR_STORE_BUILD  *Build
+  )
+{
+  UINT32  Index;
+
+  if (Build->Names != NULL) {
+    for (Index = 0; Index < Build->Count; Index++) {
+      FreePool (Build->Names[Index]);
+    }
+    FreePool (Build->Names);
+  }
+
+  if (Build->Entries != NULL) {
+    FreePool (Build->Entries);
+  }
+}
+
+EFI_STATUS
+BhVarStoreIndex (
+  IN OUT BH_VAR_STORE   *Store,
+  IN     CHAR16         **Names,
+  IN     BH_VAR_ENTRY   *Entries,
+  IN     UINT32         Count
+  )
+{
+  EFI_STATUS  Status;
+  UINT32      Index;
+
+  Status = BhNameDictBuild (&Store->Names, Names, Count);
+  if (EFI_ERROR (Status)) {
+    return Status;
+  }
+
+  for (Index = 0; Index < Count; Index++) {
+    BhNameDictFind (&Store->Names, Names[Index], &Entries[Index].NameId);
+  }
+  BhSort (Entries, Count, sizeof (BH_VAR_ENTRY), CompareEntries, NULL);
+
+  Store->Entries = Entries;
+  Store->EntryCount = Count;
+
+  return EFI_SUCCESS;
+}
+
+EFI_STATUS
+BhVarStoreSnapshot (
+  OUT BH_VAR_STORE  *Store
+  )
+{
+  EFI_STATUS        Status;
+  VAR_STORE_BUILD   Build;
+  EFI_GUID          Guid;
+  UINTN             NameBufferSize;
+  UINTN             NameSize;
+  CHAR16            *Name;
+  CHAR16            *NewName;
+  UINT32            GuidAllocCount;
+  UINT32            GuidIndex;
+
+  ZeroMem (Store, sizeof (*Store));
+  ZeroMem (&Build, sizeof (Build));
+
+  GuidAllocCount = 8;
+  Build.AllocCount = VAR_STORE_INITIAL_COUNT;
+  Build.DataAllocSize = VAR_STORE_INITIAL_DATA;
+  Build.Names = AllocatePool (Build.AllocCount * sizeof (CHAR16 *));
+  Build.Entries = AllocatePool (Build.AllocCount * sizeof (BH_VAR_ENTRY));
+  Store->Guids = AllocatePool (GuidAllocCount * sizeof (EFI_GUID));
+  Store->Data = AllocatePool (Build.DataAllocSize);
+
+  NameBufferSize = sizeof (CHAR16);
+  Name = AllocateZeroPool (NameBufferSize);
+
+  if (Build.Names == NULL || Build.Entries == NULL || Store->Guids == NULL || Store->Data == NULL || Name == NULL) {
+    Status = EFI_OUT_OF_RESOURCES;
+  } else {
+    while (TRUE) {
+      do {
+        NameSize = NameBufferSize;
+        Status = gRT->GetNextVariableName (&NameSize, Name, &Guid);
+        if (Status == EFI_BUFFER_TOO_SMALL) {
+          NewName = ReallocatePool (NameBufferSize, NameSize, Name);
+          if (NewName == NULL) {
+            Status = EFI_OUT_OF_RESOURCES;
+            break;
+          }
+          Name = NewName;
+          NameBufferSize = NameSize;
+        }
+      } while (Status == EFI_BUFFER_TOO_SMALL);
+
+      if (EFI_ERROR (Status)) {
+        break;
+      }
+
+      GuidIndex = BhVarStoreAddGuid (Store, &Guid, &GuidAllocCount);
+      if (GuidIndex == MAX_UINT32) {
+        Status = EFI_OUT_OF_RESOURCES;
+        break;
+      }
+
+      Status = AddVariable (Store, &Build, Name, GuidIndex, &Guid);
+      if (EFI_ERROR (Status)) {
+        break;
+      }
+
+      //
+      // Abandon the partial snapshot if cancelled; nothing is returned.
+      //
+      if (BhProgressUpdate (Build.Count, 0)) {
+        Status = EFI_ABORTED;
+        break;
+      }
+    }
+
+    if (Status == EFI_NOT_FOUND) {
+      Status = BhVarStoreIndex (Store, Build.Names, Build.Entries, Build.Count);
+    }
+  }
+
+  if (!EFI_ERROR (Status)) {
+    Build.Entries = NULL;
+
+    DEBUG ((
+      DEBUG_INFO,
+      "BH: Snapshot %u vars, %u GUIDs, index %u bytes, data %u bytes\n",
+      Store->EntryCount,
+      Store->GuidCount,
+      (UINT32) BhVarStoreIndexSize (Store),
+      Store->DataSize
+      ));
+  }
+
+  if (Name != NULL) {
+    FreePool (Name);
+  }
+
+  FreeBuild (&Build);
+
+  if (EFI_ERROR (Status)) {
+    BhVarStoreFree (Store);
+  }
+
+  return Status;
+}
+
+VOID
+BhVarStoreFree (
+  IN OUT BH_VAR_STORE *Store
+  )
+{
+  BhNameDictFree (&Store->Names);
+
+  if (Store->Guids != NULL) {
+    FreePool (Store->Guids);
+  }
+  if (Store->Entries != NULL) {
+    FreePool (Store->Entries);
+  }
+  if (Store->Data != NULL) {
+    FreePool (Store->Data);
+  }
+
+  ZeroMem (Store, sizeof (*Store));
+}
+
+BH_VAR_ENTRY *
+BhVarStoreFind (
+  IN BH_VAR_STORE   *Store,
+  IN CONST CHAR16   *Name,
+  IN CONST EFI_GUID *Guid
+  )
+{
+  BH_VAR_ENTRY  Key;
+  UINT32        Low;
+  UINT32        High;
+  UINT32        Middle;
+  INTN          Result;
+
+  if (!BhNameDictFind (&Store->Names, Name, &Key.NameId)) {
+    return NULL;
+  }
+
+  for (Key.GuidIndex = 0; Key.GuidIndex < Store->GuidCount; Key.GuidIndex++) {
+    if (CompareGuid (&Store->Guids[Key.GuidIndex], Guid)) {
+      break;
+    }
+  }
+
+  if (Key.GuidIndex == Store->GuidCount) {
+    return NULL;
+  }
+
+  Low = 0;
+  High = Store->EntryCount;
+  while (Low < High) {
+    Middle = Low + (High - Low) / 2;
+    Result = CompareEntries (NULL, &Store->Entries[Middle], &Key);
+    if (Result == 0) {
+      return &Store->Entries[Middle];
+    } else if (Result < 0) {
+      Low = Middle + 1;
+    } else {
+      High = Middle;
+    }
+  }
+
+  return NULL;
+}
+
+UINTN
+BhVarStoreIndexSize (
+  IN BH_VAR_STORE   *Store
+  )
+{
+  return BhNameDictMemorySize (&Store->Names)
+    + (UINTN) Store->GuidCount * sizeof (EFI_GUID)
+    + (UINTN) Store->EntryCount * sizeof (BH_VAR_ENTRY);
+}
@@ -0,0 +1,89 @@
+/** @file
+  Declaration of in-memory NVRAM variable store snapshot.
+
+  Copyright (c) 2020, Mike Beaton. All rights reserved.<BR>
+  SPDX-License-Identifier: BSD-3-Clause
+
+**/
+
+#ifndef __BH__VAR_STORE__
+#define __BH__VAR_STORE__
+
+//
+// Basic UEFI Libraries
+//
+#include <Uefi.h>
+#include <Library/UefiLib.h>
+
+//
+// Local includes
+//
+#include "NameDict.h"
+
+typedef struct BH_VAR_ENTRY_ {
+  UINT32    NameId;           ///< Id in Store->Names
+  UINT32    GuidIndex;        ///< Index into Store->Guids
+  UINT32    Attributes;
+  UINT32    DataSize;
+  UINT32    DataOffset;       ///< Offset into Store->Data
+} BH_VAR_ENTRY;
+
+//
+// Entries are sorted by name, then GUID, so all GUIDs for a name are adjacent.
+//
+typedef struct BH_VAR_STORE_ {
+  BH_NAME_DICT  Names;
+  EFI_GUID      *Guids;
+  UINT32        GuidCount;
+  BH_VAR_ENTRY  *Entries;
+  UINT32        EntryCount;
+  UINT8         *Data;
+  UINT32        DataSize;
+} BH_VAR_STORE;
+
+// Find or add Guid in Store->Guids, growing it from AllocCount entries if needed; returns its index,
+// or MAX_UINT32 if out of resources
+UINT32
+BhVarStoreAddGuid (
+  IN OUT BH_VAR_STORE   *Store,
+  IN     CONST EFI_GUID *Guid,
+  IN OUT UINT32         *AllocCount
+  );
+
+// Build name dictionary and sorted index for Count entries, where Names[i] is the name of Entries[i]
+// and each entry's GuidIndex and data fields are already set; on success Store owns Entries
+EFI_STATUS
+BhVarStoreIndex (
+  IN OUT BH_VAR_STORE   *Store,
+  IN     CHAR16         **Names,
+  IN     BH_VAR_ENTRY   *Entries,
+  IN     UINT32         Count
+  );
+
+// Snapshot every variable in the live store
+EFI_STATUS
+BhVarStoreSnapshot (
+  OUT BH_VAR_STORE  *Store
+  );
+
+// Free snapshot
+VOID
+BhVarStoreFree (
+  IN OUT BH_VAR_STORE *Store
+  );
+
+// Find entry by name and GUID, or NULL if not present in the snapshot
+BH_VAR_ENTRY *
+BhVarStoreFind (
+  IN BH_VAR_STORE   *Store,
+  IN CONST CHAR16   *Name,
+  IN CONST EFI_GUID *Guid
+  );
+
+// Total bytes held by the snapshot, excluding variable data
+UINTN
+BhVarStoreIndexSize (
+  IN BH_VAR_STORE   *Store
+  );
+
+#endif
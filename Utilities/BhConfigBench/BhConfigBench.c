@@ -0,0 +1,526 @@
+/** @file
+  Host benchmark of BootHelper.plist parsing, XML against binary plist.
+
+  Both files should hold the same content, e.g. the binary one made with
+    plutil -convert binary1 -o BootHelper.bplist BootHelper.plist
+  Each is parsed into a fresh BH_GLOBAL_CONFIG as at startup, and every value
+  of the two results is compared, reporting the first difference.
+
+  Copyright (c) 2020, Mike Beaton. All rights reserved.<BR>
+  SPDX-License-Identifier: BSD-3-Clause
+
+**/
+
+#include <Library/BaseMemoryLib.h>
+
+#include "BhConfig.h"
+#include "BhConfigParse.h"
+#include "Bplist.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define BENCH_DEFAULT_ITERATIONS    2000
+
+STATIC
+UINT8 *
+ReadWholeFile (
+  IN  CONST CHAR8   *Path,
+  OUT UINT32        *Size
+  )
+{
+  FILE    *File;
+  long    Length;
+  UINT8   *Buffer;
+
+  File = fopen (Path, "rb");
+  if (File == NULL) {
+    return NULL;
+  }
+
+  Buffer = NULL;
+  if (fseek (File, 0, SEEK_END) == 0 && (Length = ftell (File)) > 0 && fseek (File, 0, SEEK_SET) == 0) {
+    Buffer = malloc ((size_t) Length);
+    if (Buffer != NULL && fread (Buffer, 1, (size_t) Length, File) != (size_t) Length) {
+      free (Buffer);
+      Buffer = NULL;
+    }
+    *Size = (UINT32) Length;
+  }
+
+  fclose (File);
+  return Buffer;
+}
+
+STATIC
+double
+NowUs (
+  VOID
+  )
+{
+  struct timespec   Now;
+
+  clock_gettime (CLOCK_MONOTONIC, &Now);
+  return Now.tv_sec * 1e6 + Now.tv_nsec / 1e3;
+}
+
+//
+// Report a differing value; enclosing arrays and maps then report where it was.
+//
+STATIC
+BOOLEAN
+Same (
+  IN CONST CHAR8  *Name,
+  IN BOOLEAN      Equal
+  )
+{
+  if (!Equal) {
+    printf ("content differs at %s\n", Name);
+  }
+
+  return Equal;
+}
+
+#define SAME_VALUE(A, B, Field) \
+  Same (#Field, (A)->Field == (B)->Field)
+
+#define SAME_BYTES(A, B, Field) \
+  Same (#Field, CompareMem (&(A)->Field, &(B)->Field, sizeof ((A)->Field)) == 0)
+
+#define SAME_BLOB(A, B, Field) \
+  Same (#Field, (A)->Field.Size == (B)->Field.Size \
+    && CompareMem (OC_BLOB_GET (&(A)->Field), OC_BLOB_GET (&(B)->Field), (A)->Field.Size) == 0)
+
+#define SAME_ARRAY(A, B, Field, SameEntry) \
+  SameEntries (#Field, (VOID **) (A)->Field.Values, (VOID **) (B)->Field.Values, \
+    (A)->Field.Count, (B)->Field.Count, SameEntry)
+
+#define SAME_MAP(A, B, Field, SameEntry) \
+  SameMap (#Field, (OC_STRING **) (A)->Field.Keys, (OC_STRING **) (B)->Field.Keys, \
+    (VOID **) (A)->Field.Values, (VOID **) (B)->Field.Values, (A)->Field.Count, (B)->Field.Count, SameEntry)
+
+typedef
+BOOLEAN
+(*SAME_ENTRY) (
+  IN CONST VOID   *A,
+  IN CONST VOID   *B
+  );
+
+STATIC
+BOOLEAN
+SameEntries (
+  IN CONST CHAR8  *Name,
+  IN VOID         **A,
+  IN VOID         **B,
+  IN UINT32       CountA,
+  IN UINT32       CountB,
+  IN SAME_ENTRY   SameEntry
+  )
+{
+  UINT32  Index;
+
+  if (!Same (Name, CountA == CountB)) {
+    return FALSE;
+  }
+
+  for (Index = 0; Index < CountA; Index++) {
+    if (!SameEntry (A[Index], B[Index])) {
+      printf ("  in %s[%u]\n", Name, Index);
+      return FALSE;
+    }
+  }
+
+  return TRUE;
+}
+
+STATIC
+BOOLEAN
+SameString (
+  IN CONST VOID   *A,
+  IN CONST VOID   *B
+  )
+{
+  CONST OC_STRING  *StringA;
+  CONST OC_STRING  *StringB;
+
+  StringA = A;
+  StringB = B;
+  return Same (
+    "string",
+    StringA->Size == StringB->Size
+      && CompareMem (OC_BLOB_GET (StringA), OC_BLOB_GET (StringB), StringA->Size) == 0
+    );
+}
+
+STATIC
+BOOLEAN
+SameData (
+  IN CONST VOID   *A,
+  IN CONST VOID   *B
+  )
+{
+  CONST OC_DATA  *DataA;
+  CONST OC_DATA  *DataB;
+
+  DataA = A;
+  DataB = B;
+  return Same (
+    "data",
+    DataA->Size == DataB->Size
+      && CompareMem (OC_BLOB_GET (DataA), OC_BLOB_GET (DataB), DataA->Size) == 0
+    );
+}
+
+STATIC
+BOOLEAN
+SameMap (
+  IN CONST CHAR8  *Name,
+  IN OC_STRING    **KeysA,
+  IN OC_STRING    **KeysB,
+  IN VOID         **ValuesA,
+  IN VOID         **ValuesB,
+  IN UINT32       CountA,
+  IN UINT32       CountB,
+  IN SAME_ENTRY   SameEntry
+  )
+{
+  UINT32  Index;
+
+  if (!Same (Name, CountA == CountB)) {
+    return FALSE;
+  }
+
+  for (Index = 0; Index < CountA; Index++) {
+    if (!SameString (KeysA[Index], KeysB[Index])
+      || !SameEntry (ValuesA[Index], ValuesB[Index])) {
+      printf ("  in %s entry %u (%s)\n", Name, Index, OC_BLOB_GET (KeysA[Index]));
+      return FALSE;
+    }
+  }
+
+  return TRUE;
+}
+
+//
+// A BH_NVRAM_DELETE_ENTRY, or a BH_NVRAM_LEGACY_ENTRY which has the same layout.
+//
+STATIC
+BOOLEAN
+SameStrings (
+  IN CONST VOID   *A,
+  IN CONST VOID   *B
+  )
+{
+  CONST BH_NVRAM_DELETE_ENTRY  *ArrayA;
+  CONST BH_NVRAM_DELETE_ENTRY  *ArrayB;
+
+  ArrayA = A;
+  ArrayB = B;
+  return SameEntries (
+    "names",
+    (VOID **) ArrayA->Values,
+    (VOID **) ArrayB->Values,
+    ArrayA->Count,
+    ArrayB->Count,
+    SameString
+    );
+}
+
+STATIC
+BOOLEAN
+SameAssoc (
+  IN CONST VOID   *A,
+  IN CONST VOID   *B
+  )
+{
+  CONST OC_ASSOC  *AssocA;
+  CONST OC_ASSOC  *AssocB;
+
+  AssocA = A;
+  AssocB = B;
+  return SameMap (
+    "variables",
+    AssocA->Keys,
+    AssocB->Keys,
+    (VOID **) AssocA->Values,
+    (VOID **) AssocB->Values,
+    AssocA->Count,
+    AssocB->Count,
+    SameData
+    );
+}
+
+STATIC
+BOOLEAN
+SameTool (
+  IN CONST VOID   *A,
+  IN CONST VOID   *B
+  )
+{
+  CONST BH_MISC_TOOLS_ENTRY  *ToolA;
+  CONST BH_MISC_TOOLS_ENTRY  *ToolB;
+
+  ToolA = A;
+  ToolB = B;
+  return SAME_BLOB (ToolA, ToolB, Arguments)
+    && SAME_VALUE (ToolA, ToolB, Auxiliary)
+    && SAME_BLOB (ToolA, ToolB, Comment)
+    && SAME_VALUE (ToolA, ToolB, Enabled)
+    && SAME_BLOB (ToolA, ToolB, Name)
+    && SAME_BLOB (ToolA, ToolB, Path)
+    && SAME_VALUE (ToolA, ToolB, RealPath)
+    && SAME_VALUE (ToolA, ToolB, TextMode);
+}
+
+STATIC
+BOOLEAN
+SamePlugin (
+  IN CONST VOID   *A,
+  IN CONST VOID   *B
+  )
+{
+  CONST BH_MISC_PLUGIN_ENTRY  *PluginA;
+  CONST BH_MISC_PLUGIN_ENTRY  *PluginB;
+
+  PluginA = A;
+  PluginB = B;
+  return SAME_ARRAY (PluginA, PluginB, Actions, SameString)
+    && SAME_BLOB (PluginA, PluginB, Comment)
+    && SAME_ARRAY (PluginA, PluginB, Decoders, SameString)
+    && SAME_VALUE (PluginA, PluginB, Enabled)
+    && SAME_BLOB (PluginA, PluginB, Path);
+}
+
+STATIC
+BOOLEAN
+SameQuirk (
+  IN CONST VOID   *A,
+  IN CONST VOID   *B
+  )
+{
+  CONST BH_MISC_QUIRK_ENTRY  *QuirkA;
+  CONST BH_MISC_QUIRK_ENTRY  *QuirkB;
+
+  QuirkA = A;
+  QuirkB = B;
+  return SAME_BLOB (QuirkA, QuirkB, Comment)
+    && SAME_VALUE (QuirkA, QuirkB, DeleteBeforeWrite)
+    && SAME_VALUE (QuirkA, QuirkB, DeleteZeroAttributes)
+    && SAME_VALUE (QuirkA, QuirkB, Enabled)
+    && SAME_VALUE (QuirkA, QuirkB, MaxRevision)
+    && SAME_VALUE (QuirkA, QuirkB, MinRevision)
+    && SAME_BLOB (QuirkA, QuirkB, Model)
+    && SAME_VALUE (QuirkA, QuirkB, SlowEnumeration)
+    && SAME_BLOB (QuirkA, QuirkB, Vendor);
+}
+
+STATIC
+BOOLEAN
+SameRule (
+  IN CONST VOID   *A,
+  IN CONST VOID   *B
+  )
+{
+  CONST BH_MISC_RULE_ENTRY  *RuleA;
+  CONST BH_MISC_RULE_ENTRY  *RuleB;
+
+  RuleA = A;
+  RuleB = B;
+  return SAME_BLOB (RuleA, RuleB, Comment)
+    && SAME_VALUE (RuleA, RuleB, Enabled)
+    && SAME_ARRAY (RuleA, RuleB, If, SameString)
+    && SAME_ARRAY (RuleA, RuleB, Then, SameString);
+}
+
+//
+// Every value in the parsed configuration, so that both formats are shown to give the same result.
+//
+STATIC
+BOOLEAN
+SameConfig (
+  IN CONST BH_GLOBAL_CONFIG  *A,
+  IN CONST BH_GLOBAL_CONFIG  *B
+  )
+{
+  return SAME_BLOB (A, B, Config.ExportPassphrase)
+    && SAME_VALUE (A, B, Config.InstallProtocol)
+    && SAME_BLOB (A, B, Config.PickerMode)
+    && SAME_VALUE (A, B, Config.PollAppleHotKeys)
+    && SAME_BLOB (A, B, Config.SerialMirror)
+    && SAME_VALUE (A, B, Config.ShowPicker)
+    && SAME_BLOB (A, B, Config.Xanana)
+    && SAME_ARRAY (A, B, Misc.BlessOverride, SameString)
+    && SAME_VALUE (A, B, Misc.Boot.ConsoleAttributes)
+    && SAME_BLOB (A, B, Misc.Boot.HibernateMode)
+    && SAME_VALUE (A, B, Misc.Boot.HideAuxiliary)
+    && SAME_VALUE (A, B, Misc.Boot.PickerAttributes)
+    && SAME_VALUE (A, B, Misc.Boot.PickerAudioAssist)
+    && SAME_BLOB (A, B, Misc.Boot.PickerMode)
+    && SAME_VALUE (A, B, Misc.Boot.PollAppleHotKeys)
+    && SAME_VALUE (A, B, Misc.Boot.ShowPicker)
+    && SAME_VALUE (A, B, Misc.Boot.TakeoffDelay)
+    && SAME_VALUE (A, B, Misc.Boot.Timeout)
+    && SAME_VALUE (A, B, Misc.Debug.AppleDebug)
+    && SAME_VALUE (A, B, Misc.Debug.ApplePanic)
+    && SAME_VALUE (A, B, Misc.Debug.DisableWatchDog)
+    && SAME_VALUE (A, B, Misc.Debug.DisplayDelay)
+    && SAME_VALUE (A, B, Misc.Debug.DisplayLevel)
+    && SAME_VALUE (A, B, Misc.Debug.SerialInit)
+    && SAME_VALUE (A, B, Misc.Debug.SysReport)
+    && SAME_VALUE (A, B, Misc.Debug.Target)
+    && SAME_ARRAY (A, B, Misc.Entries, SameTool)
+    && SAME_ARRAY (A, B, Misc.Plugins, SamePlugin)
+    && SAME_ARRAY (A, B, Misc.Quirks, SameQuirk)
+    && SAME_ARRAY (A, B, Misc.Rules, SameRule)
+    && SAME_VALUE (A, B, Misc.Security.AllowNvramReset)
+    && SAME_VALUE (A, B, Misc.Security.AllowSetDefault)
+    && SAME_VALUE (A, B, Misc.Security.ApECID)
+    && SAME_VALUE (A, B, Misc.Security.AuthRestart)
+    && SAME_VALUE (A, B, Misc.Security.BlacklistAppleUpdate)
+    && SAME_BLOB (A, B, Misc.Security.BootProtect)
+    && SAME_BLOB (A, B, Misc.Security.DmgLoading)
+    && SAME_VALUE (A, B, Misc.Security.EnablePassword)
+    && SAME_VALUE (A, B, Misc.Security.ExposeSensitiveData)
+    && SAME_VALUE (A, B, Misc.Security.HaltLevel)
+    && SAME_BYTES (A, B, Misc.Security.PasswordHash)
+    && SAME_BLOB (A, B, Misc.Security.PasswordSalt)
+    && SAME_VALUE (A, B, Misc.Security.ScanPolicy)
+    && SAME_BLOB (A, B, Misc.Security.SecureBootModel)
+    && SAME_BLOB (A, B, Misc.Security.Vault)
+    && SAME_ARRAY (A, B, Misc.Tools, SameTool)
+    && SAME_MAP (A, B, Nvram.Add, SameAssoc)
+    && SAME_MAP (A, B, Nvram.Delete, SameStrings)
+    && SAME_VALUE (A, B, Nvram.LegacyEnable)
+    && SAME_VALUE (A, B, Nvram.LegacyOverwrite)
+    && SAME_MAP (A, B, Nvram.Legacy, SameStrings)
+    && SAME_VALUE (A, B, Nvram.WriteFlash);
+}
+
+//
+// Parse as at startup, choosing the parser by format.
+//
+STATIC
+EFI_STATUS
+ParseConfig (
+  OUT BH_GLOBAL_CONFIG  *Config,
+  IN  UINT8             *Buffer,
+  IN  UINT32            Size
+  )
+{
+  if (BhBplistIsBinary (Buffer, Size)) {
+    return BhConfigurationInitBinary (Config, Buffer, Size);
+  }
+
+  return BhConfigurationInit (Config, Buffer, Size);
+}
+
+//
+// Mean time for one parse of Buffer; the XML parser works in place, so every iteration
+// parses a fresh copy, for either format. Result is the first parse, for comparison.
+//
+STATIC
+double
+TimeParse (
+  IN  UINT8             *Buffer,
+  IN  UINT32            Size,
+  IN  UINT32            Iterations,
+  OUT BH_GLOBAL_CONFIG  *Result
+  )
+{
+  BH_GLOBAL_CONFIG  Config;
+  UINT8             *Scratch;
+  UINT32            Index;
+  double            Start;
+  double            Total;
+
+  Scratch = malloc (Size);
+  if (Scratch == NULL) {
+    return -1;
+  }
+
+  CopyMem (Scratch, Buffer, Size);
+  if (EFI_ERROR (ParseConfig (Result, Scratch, Size))) {
+    free (Scratch);
+    return -1;
+  }
+
+  Total = 0;
+  for (Index = 0; Index < Iterations; Index++) {
+    CopyMem (Scratch, Buffer, Size);
+    Start = NowUs ();
+    ParseConfig (&Config, Scratch, Size);
+    BhConfigurationFree (&Config);
+    Total += NowUs () - Start;
+  }
+
+  free (Scratch);
+  return Total / Iterations;
+}
+
+int
+main (
+  int   argc,
+  char  *argv[]
+  )
+{
+  UINT8     *Xml;
+  UINT8     *Binary;
+  UINT32    XmlSize;
+  UINT32    BinarySize;
+  UINT32    Iterations;
+  double    XmlUs;
+  double              BinaryUs;
+  BH_GLOBAL_CONFIG    XmlConfig;
+  BH_GLOBAL_CONFIG    BinaryConfig;
+  BOOLEAN             Matches;
+
+  if (argc < 3) {
+    fprintf (stderr, "usage: %s BootHelper.plist BootHelper.bplist [iterations]\n", argv[0]);
+    return 1;
+  }
+
+  Iterations = argc > 3 ? (UINT32) strtoul (argv[3], NULL, 0) : BENCH_DEFAULT_ITERATIONS;
+  if (Iterations == 0) {
+    Iterations = 1;
+  }
+
+  Xml = ReadWholeFile (argv[1], &XmlSize);
+  Binary = ReadWholeFile (argv[2], &BinarySize);
+  if (Xml == NULL || Binary == NULL) {
+    fprintf (stderr, "BhConfigBench: cannot read %s\n", Xml == NULL ? argv[1] : argv[2]);
+    return 1;
+  }
+
+  if (BhBplistIsBinary (Xml, XmlSize) || !BhBplistIsBinary (Binary, BinarySize)) {
+    fprintf (stderr, "BhConfigBench: expected an XML plist then a binary plist\n");
+    return 1;
+  }
+
+  XmlUs = TimeParse (Xml, XmlSize, Iterations, &XmlConfig);
+  if (XmlUs < 0) {
+    fprintf (stderr, "BhConfigBench: %s failed to parse\n", argv[1]);
+    return 1;
+  }
+
+  BinaryUs = TimeParse (Binary, BinarySize, Iterations, &BinaryConfig);
+  if (BinaryUs < 0) {
+    fprintf (stderr, "BhConfigBench: %s failed to parse\n", argv[2]);
+    return 1;
+  }
+
+  printf ("XML     %8u bytes %10.2f us/parse\n", XmlSize, XmlUs);
+  printf ("binary  %8u bytes %10.2f us/parse\n", BinarySize, BinaryUs);
+  printf ("binary is %.1fx faster over %u iterations\n", XmlUs / BinaryUs, Iterations);
+
+  Matches = SameConfig (&XmlConfig, &BinaryConfig);
+  if (Matches) {
+    printf ("content matches\n");
+  }
+
+  BhConfigurationFree (&XmlConfig);
+  BhConfigurationFree (&BinaryConfig);
+  free (Xml);
+  free (Binary);
+  return Matches ? 0 : 1;
+}
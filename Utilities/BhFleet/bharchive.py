@@ -0,0 +1,263 @@
+#!/usr/bin/env python3
+#  Copyright (c) 2020, Mike Beaton. All rights reserved.
+#  SPDX-License-Identifier: BSD-3-Clause
+
+"""
+Deduplicated, content-addressed archive of BootHelper NVRAM snapshots.
+
+Archive layout:
+  objects/<2 hex>/<sha256>            each distinct variable value, stored once
+  machines/<machine-id>/<time>-<snapshot hash>.manifest
+                                      one line per variable: GUID, attributes, value hash, name;
+                                      the hash prefix keeps snapshots taken in the same second,
+                                      or by machines reporting the same (e.g. zero) id, apart
+  ingested/<sha256 of snapshot file>  marker holding the manifest path, so that re-ingesting an
+                                      unchanged snapshot costs one sequential hash of the file
+
+Usage:
+  bharchive.py ingest ARCHIVE SNAPSHOT... [-j JOBS]
+  bharchive.py list ARCHIVE [MACHINE]
+  bharchive.py extract ARCHIVE MANIFEST OUTPUT.bhsnap
+  bharchive.py stats ARCHIVE
+"""
+
+import argparse
+import concurrent.futures
+import hashlib
+import os
+import sys
+import tempfile
+
+import bhsnap
+
+MANIFEST_MAGIC = '# BhArchive manifest 1'
+MANIFEST_EXTENSION = '.manifest'
+# Hex digits of the snapshot file hash in each manifest name
+MANIFEST_HASH_DIGITS = 16
+
+
+class ArchiveError(Exception):
+    pass
+
+
+def atomic_write(path, data, mode='wb'):
+    """Write via a temporary file and rename, so that concurrent writers of the same content are safe."""
+    directory = os.path.dirname(path)
+    os.makedirs(directory, exist_ok=True)
+    fd, temp = tempfile.mkstemp(dir=directory, prefix='.tmp-')
+    try:
+        with os.fdopen(fd, mode) as f:
+            f.write(data)
+        os.replace(temp, path)
+    except BaseException:
+        try:
+            os.unlink(temp)
+        except OSError:
+            pass
+        raise
+
+
+def exclusive_write(path, data):
+    """Write a new file, never replacing an existing one; returns False if path already has this content."""
+    directory = os.path.dirname(path)
+    os.makedirs(directory, exist_ok=True)
+    fd, temp = tempfile.mkstemp(dir=directory, prefix='.tmp-')
+    try:
+        with os.fdopen(fd, 'wb') as f:
+            f.write(data)
+        try:
+            os.link(temp, path)
+        except FileExistsError:
+            with open(path, 'rb') as f:
+                if f.read() != data:
+                    raise ArchiveError('%s already exists with different content' % path)
+            return False
+    finally:
+        os.unlink(temp)
+    return True
+
+
+def object_path(archive, digest):
+    return os.path.join(archive, 'objects', digest[:2], digest)
+
+
+def store_object(archive, data):
+    digest = hashlib.sha256(data).hexdigest()
+    path = object_path(archive, digest)
+    if os.path.exists(path):
+        return digest, False
+    atomic_write(path, bytes(data))
+    return digest, True
+
+
+def ingest_one(archive, snapshot_path):
+    """Ingest a single snapshot file; runs in a worker process."""
+    with open(snapshot_path, 'rb') as f:
+        raw = f.read()
+
+    file_digest = hashlib.sha256(raw).hexdigest()
+    marker = os.path.join(archive, 'ingested', file_digest)
+    if os.path.exists(marker):
+        with open(marker, 'r', encoding='utf-8') as f:
+            return snapshot_path, f.read().strip(), 0, 0, True
+
+    snapshot = bhsnap.parse(raw)
+    lines = [MANIFEST_MAGIC,
+             '# machine %s' % snapshot.machine_id,
+             '# time %s' % snapshot.time_string]
+    new_objects = 0
+    for var in snapshot.variables:
+        digest, created = store_object(archive, var.data)
+        new_objects += created
+        lines.append('%s\t%08x\t%s\t%s' % (var.guid, var.attributes, digest, var.name))
+
+    name = '%s-%s%s' % (snapshot.time_string, file_digest[:MANIFEST_HASH_DIGITS], MANIFEST_EXTENSION)
+    manifest = os.path.join('machines', snapshot.machine_id, name)
+    exclusive_write(os.path.join(archive, manifest), ('\n'.join(lines) + '\n').encode('utf-8'))
+    atomic_write(marker, (manifest + '\n').encode('utf-8'))
+
+    return snapshot_path, manifest, len(snapshot.variables), new_objects, False
+
+
+def read_manifest(path):
+    """Return (header dict, list of (guid, attributes, digest, name))."""
+    header = {}
+    entries = []
+    with open(path, 'r', encoding='utf-8') as f:
+        first = f.readline().rstrip('\n')
+        if first != MANIFEST_MAGIC:
+            raise ValueError('%s: not a BhArchive manifest' % path)
+        for line in f:
+            line = line.rstrip('\n')
+            if line.startswith('# '):
+                key, _, value = line[2:].partition(' ')
+                header[key] = value
+            elif line:
+                guid, attributes, digest, name = line.split('\t', 3)
+                entries.append((guid, int(attributes, 16), digest, name))
+    return header, entries
+
+
+def iter_manifests(archive, machine=None):
+    root = os.path.join(archive, 'machines')
+    if not os.path.isdir(root):
+        return
+    machines = [machine] if machine else sorted(os.listdir(root))
+    for m in machines:
+        directory = os.path.join(root, m)
+        if not os.path.isdir(directory):
+            continue
+        for name in sorted(os.listdir(directory)):
+            if name.endswith(MANIFEST_EXTENSION):
+                yield os.path.join('machines', m, name)
+
+
+def iter_ingested(archive):
+    """Yield (sha256 of snapshot file, manifest path) for every snapshot ingested."""
+    root = os.path.join(archive, 'ingested')
+    if not os.path.isdir(root):
+        return
+    for digest in sorted(os.listdir(root)):
+        if digest.startswith('.'):
+            continue
+        with open(os.path.join(root, digest), 'r', encoding='utf-8') as f:
+            yield digest, f.read().strip()
+
+
+def cmd_ingest(args):
+    jobs = args.jobs or os.cpu_count() or 1
+    total_vars = total_new = skipped = failed = 0
+    with concurrent.futures.ProcessPoolExecutor(max_workers=jobs) as pool:
+        futures = {pool.submit(ingest_one, args.archive, path): path for path in args.snapshots}
+        for future in concurrent.futures.as_completed(futures):
+            try:
+                path, manifest, count, new_objects, was_known = future.result()
+            except (OSError, ValueError, bhsnap.SnapshotError, ArchiveError) as e:
+                # One bad file is reported and skipped, the rest are still ingested
+                failed += 1
+                print('%s: error: %s' % (futures[future], e), file=sys.stderr)
+                continue
+            if was_known:
+                skipped += 1
+                print('%s: unchanged (%s)' % (path, manifest))
+            else:
+                total_vars += count
+                total_new += new_objects
+                print('%s: %u vars, %u new values -> %s' % (path, count, new_objects, manifest))
+    print('ingested %u snapshots (%u unchanged, %u failed), %u vars, %u new values'
+          % (len(args.snapshots) - failed, skipped, failed, total_vars, total_new))
+    return 1 if failed else 0
+
+
+def cmd_list(args):
+    for manifest in iter_manifests(args.archive, args.machine):
+        print(manifest)
+    return 0
+
+
+def cmd_extract(args):
+    header, entries = read_manifest(os.path.join(args.archive, args.manifest))
+    variables = []
+    for guid, attributes, digest, name in entries:
+        with open(object_path(args.archive, digest), 'rb') as f:
+            variables.append(bhsnap.Variable(guid, name, attributes, f.read()))
+    time = header.get('time', '00000000-000000')
+    time = (int(time[0:4]), int(time[4:6]), int(time[6:8]), int(time[9:11]), int(time[11:13]), int(time[13:15]))
+    snapshot = bhsnap.Snapshot(header.get('machine', '00000000-0000-0000-0000-000000000000'), time, variables)
+    with open(args.output, 'wb') as f:
+        f.write(bhsnap.serialize(snapshot))
+    return 0
+
+
+def cmd_stats(args):
+    manifests = list(iter_manifests(args.archive))
+    machines = {m.split(os.sep)[1] for m in manifests}
+    references = 0
+    referenced_bytes = 0
+    sizes = {}
+    for manifest in manifests:
+        _, entries = read_manifest(os.path.join(args.archive, manifest))
+        for _, _, digest, _ in entries:
+            references += 1
+            if digest not in sizes:
+                sizes[digest] = os.path.getsize(object_path(args.archive, digest))
+            referenced_bytes += sizes[digest]
+    stored = sum(sizes.values())
+    print('machines:   %u' % len(machines))
+    print('snapshots:  %u' % len(manifests))
+    print('variables:  %u (%u distinct values)' % (references, len(sizes)))
+    print('value data: %u bytes stored for %u bytes referenced' % (stored, referenced_bytes))
+    return 0
+
+
+def main(argv=None):
+    parser = argparse.ArgumentParser(description='BootHelper fleet snapshot archive')
+    sub = parser.add_subparsers(dest='command', required=True)
+
+    p = sub.add_parser('ingest', help='add snapshot files to the archive')
+    p.add_argument('archive')
+    p.add_argument('snapshots', nargs='+')
+    p.add_argument('-j', '--jobs', type=int, default=0, help='worker processes (default: all cores)')
+    p.set_defaults(func=cmd_ingest)
+
+    p = sub.add_parser('list', help='list manifests')
+    p.add_argument('archive')
+    p.add_argument('machine', nargs='?')
+    p.set_defaults(func=cmd_list)
+
+    p = sub.add_parser('extract', help='rebuild a .bhsnap file from a manifest')
+    p.add_argument('archive')
+    p.add_argument('manifest')
+    p.add_argument('output')
+    p.set_defaults(func=cmd_extract)
+
+    p = sub.add_parser('stats', help='show deduplication statistics')
+    p.add_argument('archive')
+    p.set_defaults(func=cmd_stats)
+
+    args = parser.parse_args(argv)
+    return args.func(args)
+
+
+if __name__ == '__main__':
+    sys.exit(main())
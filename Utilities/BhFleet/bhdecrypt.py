@@ -0,0 +1,167 @@
+#!/usr/bin/env python3
+#  Copyright (c) 2020, Mike Beaton. All rights reserved.
+#  SPDX-License-Identifier: BSD-3-Clause
+
+"""
+Decrypt BootHelper encrypted exports (.bhenc), e.g. NVRAM snapshots saved as .bhsnap.bhenc.
+
+Layout matches Application/BootHelper/Crypt.h, all values little-endian:
+  header:     Signature 'BHEN', Version, HeaderSize, Iterations, Reserved, Salt[16], Iv[16]
+  ciphertext: AES-256-CTR, counter block starting at Iv, big-endian increment
+  tag:        HMAC-SHA256 of header and ciphertext, 32 bytes
+Keys are the two halves of 64 bytes of PBKDF2-HMAC-SHA256(passphrase, Salt, Iterations).
+
+AES is implemented here so that the tool needs nothing beyond the standard library.
+
+Usage:
+  bhdecrypt.py FILE.bhenc [-o OUT]    write OUT (default: FILE without .bhenc)
+  BH_PASSPHRASE=... bhdecrypt.py ...  passphrase from environment instead of prompt
+"""
+
+import argparse
+import getpass
+import hashlib
+import hmac
+import os
+import struct
+import sys
+
+SIGNATURE = b'BHEN'
+VERSION = 1
+EXTENSION = '.bhenc'
+
+HEADER = struct.Struct('<4sHHII16s16s')
+TAG_SIZE = 32
+KEY_SIZE = 32
+# Same bound as BH_CRYPT_MAX_ITERATIONS
+MAX_ITERATIONS = 16 * 10000
+
+
+class CryptError(Exception):
+    pass
+
+
+def _sbox():
+    sbox = [0] * 256
+    p = q = 1
+    while True:
+        # p steps through GF(2^8) multiplying by 3, q dividing by 3, so q is the inverse of p
+        p = p ^ ((p << 1) & 0xFF) ^ (0x1B if p & 0x80 else 0)
+        q ^= q << 1
+        q ^= q << 2
+        q ^= q << 4
+        q &= 0xFF
+        if q & 0x80:
+            q ^= 0x09
+        x = q ^ ((q << 1) | (q >> 7)) ^ ((q << 2) | (q >> 6)) ^ ((q << 3) | (q >> 5)) ^ ((q << 4) | (q >> 4))
+        sbox[p] = (x ^ 0x63) & 0xFF
+        if p == 1:
+            break
+    sbox[0] = 0x63
+    return sbox
+
+
+SBOX = _sbox()
+
+
+def _xtime(a):
+    return ((a << 1) ^ 0x1B) & 0xFF if a & 0x80 else a << 1
+
+
+def expand_key(key):
+    """AES-256 key schedule, as 15 round keys of 16 bytes."""
+    words = [list(key[i:i + 4]) for i in range(0, 32, 4)]
+    rcon = 1
+    for i in range(8, 60):
+        temp = list(words[i - 1])
+        if i % 8 == 0:
+            temp = [SBOX[b] for b in temp[1:] + temp[:1]]
+            temp[0] ^= rcon
+            rcon = _xtime(rcon)
+        elif i % 8 == 4:
+            temp = [SBOX[b] for b in temp]
+        words.append([a ^ b for a, b in zip(words[i - 8], temp)])
+    return [sum(words[r * 4:r * 4 + 4], []) for r in range(15)]
+
+
+def encrypt_block(round_keys, block):
+    s = [a ^ b for a, b in zip(block, round_keys[0])]
+    for r in range(1, 15):
+        s = [SBOX[b] for b in s]
+        # ShiftRows, state is column-major
+        s = [s[(i + 4 * (i % 4)) % 16] for i in range(16)]
+        if r != 14:
+            mixed = []
+            for c in range(4):
+                a = s[c * 4:c * 4 + 4]
+                t = a[0] ^ a[1] ^ a[2] ^ a[3]
+                mixed += [a[i] ^ t ^ _xtime(a[i] ^ a[(i + 1) % 4]) for i in range(4)]
+            s = mixed
+        s = [a ^ b for a, b in zip(s, round_keys[r])]
+    return bytes(s)
+
+
+def aes_ctr(key, iv, data):
+    round_keys = expand_key(key)
+    counter = int.from_bytes(iv, 'big')
+    out = bytearray(len(data))
+    for offset in range(0, len(data), 16):
+        stream = encrypt_block(round_keys, counter.to_bytes(16, 'big'))
+        chunk = data[offset:offset + 16]
+        out[offset:offset + len(chunk)] = bytes(a ^ b for a, b in zip(chunk, stream))
+        counter = (counter + 1) & ((1 << 128) - 1)
+    return bytes(out)
+
+
+def decrypt(buffer, passphrase):
+    """Authenticate and decrypt an encrypted export, returning the original file contents."""
+    if len(buffer) < HEADER.size + TAG_SIZE:
+        raise CryptError('file too short')
+    signature, version, header_size, iterations, _, salt, iv = HEADER.unpack_from(buffer)
+    if signature != SIGNATURE:
+        raise CryptError('bad signature')
+    if version != VERSION:
+        raise CryptError('unsupported version %u' % version)
+    end = len(buffer) - TAG_SIZE
+    if header_size < HEADER.size or header_size > end or not 0 < iterations <= MAX_ITERATIONS:
+        raise CryptError('bad header')
+
+    keys = hashlib.pbkdf2_hmac('sha256', passphrase.encode('ascii'), salt, iterations, 2 * KEY_SIZE)
+    tag = hmac.new(keys[KEY_SIZE:], buffer[:end], hashlib.sha256).digest()
+    if not hmac.compare_digest(tag, buffer[end:]):
+        raise CryptError('wrong passphrase, or file altered')
+
+    return aes_ctr(keys[:KEY_SIZE], iv, buffer[header_size:end])
+
+
+def main(argv=None):
+    parser = argparse.ArgumentParser(description='BootHelper encrypted export decrypter')
+    parser.add_argument('file', help='encrypted file (.bhenc)')
+    parser.add_argument('-o', '--output', help='output file (default: input without %s)' % EXTENSION)
+    args = parser.parse_args(argv)
+
+    output = args.output
+    if output is None:
+        if not args.file.endswith(EXTENSION):
+            parser.error('give -o for a file not ending %s' % EXTENSION)
+        output = args.file[:-len(EXTENSION)]
+
+    passphrase = os.environ.get('BH_PASSPHRASE')
+    if passphrase is None:
+        passphrase = getpass.getpass('Passphrase: ')
+
+    try:
+        with open(args.file, 'rb') as f:
+            plain = decrypt(f.read(), passphrase)
+        with open(output, 'wb') as f:
+            f.write(plain)
+    except (OSError, UnicodeEncodeError, CryptError) as e:
+        print('bhdecrypt: %s' % e, file=sys.stderr)
+        return 1
+
+    print('%s -> %s (%u bytes)' % (args.file, output, len(plain)))
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -0,0 +1,379 @@
+#!/usr/bin/env python3
+#  Copyright (c) 2020, Mike Beaton. All rights reserved.
+#  SPDX-License-Identifier: BSD-3-Clause
+
+"""
+Columnar query index over fleet NVRAM snapshots.
+
+One row per machine (its latest snapshot), one memory-mapped column per (GUID, name). Each
+column cell is two little-endian UINT64s: a value hash (0 = variable absent; low bit set only
+for values of up to 8 bytes, which have a scalar) and the value decoded as a little-endian
+scalar (0 when there is none, so never matched by scalar predicates). Distinct values are kept
+once in a value heap, so prefix predicates test each distinct value once rather than each row.
+Each snapshot is indexed once by the SHA-256 of its file, whether found loose or in an archive.
+
+Index layout:
+  index.json     row count, capacity, machines, column files and indexed sources
+  columns/*.col  capacity x 16 bytes, grown by doubling
+  values.bin     distinct values, appended
+  values.idx     hash, offset, size triples for values.bin
+
+Usage:
+  bhindex.py update INDEX [--archive ARCHIVE] [SNAPSHOT...]
+  bhindex.py query INDEX PREDICATE... [-t]
+  bhindex.py columns INDEX
+
+Predicates (all must hold; NAME may be GUID:name, unqualified names prefer the Apple GUID):
+  NAME=0x7f          scalar equality           NAME="text"     value equality (NUL optional)
+  NAME^="text"       value starts with text    NAME&0x10       any mask bits set
+  NAME&0x7f=0x77     masked scalar equality    NAME            variable present
+  !NAME              variable absent
+"""
+
+import argparse
+import hashlib
+import json
+import mmap
+import os
+import re
+import struct
+import sys
+import time
+
+import bhsnap
+import bharchive
+
+APPLE_GUID = '7C436110-AB2A-4BBB-A880-FE41995C9F82'
+CELL = struct.Struct('<QQ')
+VALUE_INDEX = struct.Struct('<QQI')
+INITIAL_CAPACITY = 64
+INDEX_VERSION = 2
+SCALAR_SIZE = 8
+
+
+def value_hash(data):
+    """Non-zero 64-bit hash of a value; zero is reserved for 'absent', bit 0 for has_scalar."""
+    h = int.from_bytes(hashlib.sha256(data).digest()[:8], 'little') & ~1
+    if len(data) <= SCALAR_SIZE:
+        return h | 1
+    return h or 2
+
+
+def has_scalar(h):
+    return h & 1 != 0
+
+
+def value_scalar(data):
+    return int.from_bytes(bytes(data), 'little') if len(data) <= SCALAR_SIZE else 0
+
+
+class Index:
+    def __init__(self, path):
+        self.path = path
+        self.meta_path = os.path.join(path, 'index.json')
+        if os.path.exists(self.meta_path):
+            with open(self.meta_path, 'r', encoding='utf-8') as f:
+                self.meta = json.load(f)
+            if self.meta.get('version') != INDEX_VERSION:
+                raise ValueError('%s: index version %s, not %u; delete it and run update again'
+                                 % (path, self.meta.get('version'), INDEX_VERSION))
+        else:
+            self.meta = {'version': INDEX_VERSION, 'rows': 0, 'capacity': INITIAL_CAPACITY,
+                         'machines': [], 'columns': {}, 'sources': {}}
+        self.rows = {m['id']: i for i, m in enumerate(self.meta['machines'])}
+        self.maps = {}
+        self.values = None
+
+    # Columns
+
+    def column_file(self, key):
+        return os.path.join(self.path, 'columns', self.meta['columns'][key])
+
+    def column(self, key, create=False):
+        """Return a writable memoryview of UINT64 cells for column key, or None."""
+        if key in self.maps:
+            return self.maps[key][1]
+        if key not in self.meta['columns']:
+            if not create:
+                return None
+            self.meta['columns'][key] = hashlib.sha1(key.encode('utf-8')).hexdigest() + '.col'
+            os.makedirs(os.path.join(self.path, 'columns'), exist_ok=True)
+            with open(self.column_file(key), 'wb') as f:
+                f.truncate(self.meta['capacity'] * CELL.size)
+        f = open(self.column_file(key), 'r+b')
+        if os.path.getsize(self.column_file(key)) < self.meta['capacity'] * CELL.size:
+            f.truncate(self.meta['capacity'] * CELL.size)
+        m = mmap.mmap(f.fileno(), 0)
+        view = memoryview(m).cast('Q')
+        self.maps[key] = (f, view, m)
+        return view
+
+    def close_columns(self):
+        for f, view, m in self.maps.values():
+            view.release()
+            m.close()
+            f.close()
+        self.maps = {}
+
+    def grow(self, rows):
+        if rows <= self.meta['capacity']:
+            return
+        capacity = self.meta['capacity']
+        while capacity < rows:
+            capacity *= 2
+        self.close_columns()
+        for key in self.meta['columns']:
+            with open(self.column_file(key), 'r+b') as f:
+                f.truncate(capacity * CELL.size)
+        self.meta['capacity'] = capacity
+
+    # Values
+
+    def load_values(self):
+        if self.values is not None:
+            return
+        self.values = {}
+        path = os.path.join(self.path, 'values.idx')
+        if os.path.exists(path):
+            with open(path, 'rb') as f:
+                raw = f.read()
+            for h, offset, size in VALUE_INDEX.iter_unpack(raw):
+                self.values[h] = (offset, size)
+
+    def add_value(self, h, data, heap, index):
+        if h in self.values:
+            return
+        heap.seek(0, os.SEEK_END)
+        offset = heap.tell()
+        heap.write(data)
+        index.write(VALUE_INDEX.pack(h, offset, len(data)))
+        self.values[h] = (offset, len(data))
+
+    def read_value(self, h, heap):
+        offset, size = self.values[h]
+        heap.seek(offset)
+        return heap.read(size)
+
+    # Update
+
+    def row_for(self, machine, snapshot_time):
+        """Row for machine, or None if the index already holds a newer snapshot for it."""
+        if machine in self.rows:
+            row = self.rows[machine]
+            if self.meta['machines'][row]['time'] > snapshot_time:
+                return None
+            return row
+        row = self.meta['rows']
+        self.grow(row + 1)
+        self.meta['rows'] = row + 1
+        self.meta['machines'].append({'id': machine, 'time': snapshot_time})
+        self.rows[machine] = row
+        return row
+
+    def add_snapshot(self, source, machine, snapshot_time, variables, heap, index):
+        """variables: iterable of (guid, name, data)."""
+        if source in self.meta['sources']:
+            return False
+        self.meta['sources'][source] = machine
+        row = self.row_for(machine, snapshot_time)
+        if row is None:
+            return True
+        self.meta['machines'][row]['time'] = snapshot_time
+
+        present = set()
+        for guid, name, data in variables:
+            key = '%s:%s' % (guid, name)
+            h = value_hash(data)
+            self.add_value(h, data, heap, index)
+            cells = self.column(key, create=True)
+            cells[row * 2] = h
+            cells[row * 2 + 1] = value_scalar(data)
+            present.add(key)
+
+        # A newer snapshot replaces the whole row, so clear variables which have gone.
+        for key in self.meta['columns']:
+            if key not in present:
+                cells = self.column(key)
+                cells[row * 2] = 0
+                cells[row * 2 + 1] = 0
+        return True
+
+    def save(self):
+        self.close_columns()
+        temp = self.meta_path + '.tmp'
+        with open(temp, 'w', encoding='utf-8') as f:
+            json.dump(self.meta, f)
+        os.replace(temp, self.meta_path)
+
+    # Query
+
+    def resolve(self, name):
+        if ':' in name and re.match(r'^[0-9A-Fa-f-]{36}:', name):
+            return name[:36].upper() + name[36:]
+        apple = '%s:%s' % (APPLE_GUID, name)
+        if apple in self.meta['columns']:
+            return apple
+        matches = [k for k in self.meta['columns'] if k[37:] == name]
+        if len(matches) == 1:
+            return matches[0]
+        if len(matches) > 1:
+            raise ValueError('%s is ambiguous, qualify with one of: %s' % (name, ', '.join(matches)))
+        return apple
+
+
+PREDICATE = re.compile(r'^(?P<not>!)?(?P<name>[^=&^]+?)(?:(?P<op>\^=|=|&)(?P<arg>.*))?$')
+
+
+def parse_literal(text):
+    if len(text) >= 2 and text[0] == text[-1] and text[0] in '"\'':
+        return text[1:-1].encode('utf-8')
+    return int(text, 0)
+
+
+def compile_predicate(index, text, heap):
+    """Return a function (hash, scalar) -> bool for one column, plus the column key."""
+    m = PREDICATE.match(text)
+    if not m:
+        raise ValueError('bad predicate: %s' % text)
+    key = index.resolve(m.group('name'))
+    op = m.group('op')
+    arg = m.group('arg')
+
+    if m.group('not'):
+        if op:
+            raise ValueError('! only applies to bare names: %s' % text)
+        return key, lambda h, s: h == 0
+    if op is None:
+        return key, lambda h, s: h != 0
+
+    if op == '&':
+        mask, _, expect = arg.partition('=')
+        mask = int(mask, 0)
+        if expect:
+            expect = int(expect, 0)
+            return key, lambda h, s: has_scalar(h) and (s & mask) == expect
+        return key, lambda h, s: has_scalar(h) and (s & mask) != 0
+
+    literal = parse_literal(arg)
+    if op == '=' and isinstance(literal, int):
+        return key, lambda h, s: has_scalar(h) and s == literal
+    if isinstance(literal, int):
+        raise ValueError('prefix needs a quoted string: %s' % text)
+    if op == '=':
+        wanted = {value_hash(literal), value_hash(literal + b'\0')}
+        return key, lambda h, s: h in wanted
+
+    # Prefix: test each distinct value in the column once.
+    index.load_values()
+    verdicts = {0: False}
+
+    def prefix(h, s):
+        if h not in verdicts:
+            verdicts[h] = index.read_value(h, heap).startswith(literal)
+        return verdicts[h]
+    return key, prefix
+
+
+def cmd_update(args):
+    index = Index(args.index)
+    os.makedirs(args.index, exist_ok=True)
+    index.load_values()
+    added = 0
+    with open(os.path.join(args.index, 'values.bin'), 'ab+') as heap, \
+            open(os.path.join(args.index, 'values.idx'), 'ab') as vindex:
+        if args.archive:
+            digests = {manifest: digest for digest, manifest in bharchive.iter_ingested(args.archive)}
+            for manifest in bharchive.iter_manifests(args.archive):
+                if manifest in digests:
+                    source = 'sha256:' + digests[manifest]
+                else:
+                    source = 'archive:' + manifest.replace(os.sep, '/')
+                if source in index.meta['sources']:
+                    continue
+                header, entries = bharchive.read_manifest(os.path.join(args.archive, manifest))
+
+                def variables():
+                    for guid, _, digest, name in entries:
+                        with open(bharchive.object_path(args.archive, digest), 'rb') as f:
+                            yield guid, name, f.read()
+                added += index.add_snapshot(source, header['machine'], header['time'], variables(), heap, vindex)
+        for path in args.snapshots:
+            with open(path, 'rb') as f:
+                raw = f.read()
+            source = 'sha256:' + hashlib.sha256(raw).hexdigest()
+            if source in index.meta['sources']:
+                continue
+            snap = bhsnap.parse(raw)
+            added += index.add_snapshot(source, snap.machine_id, snap.time_string,
+                                        ((v.guid, v.name, bytes(v.data)) for v in snap.variables), heap, vindex)
+    index.save()
+    print('indexed %u new snapshots; %u machines, %u columns'
+          % (added, index.meta['rows'], len(index.meta['columns'])))
+    return 0
+
+
+def cmd_query(args):
+    start = time.perf_counter()
+    heap_path = os.path.join(args.index, 'values.bin')
+    if not os.path.exists(os.path.join(args.index, 'index.json')) or not os.path.exists(heap_path):
+        raise ValueError('%s is not a complete index, run bhindex.py update first' % args.index)
+    index = Index(args.index)
+    rows = index.meta['rows']
+    selected = range(rows)
+    with open(heap_path, 'rb') as heap:
+        for text in args.predicates:
+            key, test = compile_predicate(index, text, heap)
+            cells = index.column(key)
+            if cells is None:
+                selected = [r for r in selected if test(0, 0)]
+            else:
+                selected = [r for r in selected if test(cells[r * 2], cells[r * 2 + 1])]
+            if not selected:
+                break
+    index.close_columns()
+    for row in selected:
+        machine = index.meta['machines'][row]
+        print('%s\t%s' % (machine['id'], machine['time']))
+    if args.time:
+        print('%u of %u machines in %.2f ms' % (len(selected), rows, (time.perf_counter() - start) * 1000),
+              file=sys.stderr)
+    return 0
+
+
+def cmd_columns(args):
+    index = Index(args.index)
+    for key in sorted(index.meta['columns']):
+        print(key)
+    return 0
+
+
+def main(argv=None):
+    parser = argparse.ArgumentParser(description='BootHelper fleet NVRAM query index')
+    sub = parser.add_subparsers(dest='command', required=True)
+
+    p = sub.add_parser('update', help='add new snapshots to the index')
+    p.add_argument('index')
+    p.add_argument('snapshots', nargs='*', help='.bhsnap files')
+    p.add_argument('--archive', help='also index every manifest in a bharchive.py archive')
+    p.set_defaults(func=cmd_update)
+
+    p = sub.add_parser('query', help='list machines matching all predicates')
+    p.add_argument('index')
+    p.add_argument('predicates', nargs='+')
+    p.add_argument('-t', '--time', action='store_true', help='report query time')
+    p.set_defaults(func=cmd_query)
+
+    p = sub.add_parser('columns', help='list indexed (GUID, name) columns')
+    p.add_argument('index')
+    p.set_defaults(func=cmd_columns)
+
+    args = parser.parse_args(argv)
+    try:
+        return args.func(args)
+    except (ValueError, bhsnap.SnapshotError) as e:
+        print('error: %s' % e, file=sys.stderr)
+        return 1
+
+
+if __name__ == '__main__':
+    sys.exit(main())
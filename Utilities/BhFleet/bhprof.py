@@ -0,0 +1,152 @@
+#!/usr/bin/env python3
+#  Copyright (c) 2020, Mike Beaton. All rights reserved.
+#  SPDX-License-Identifier: BSD-3-Clause
+
+"""
+Symbolise a BootHelper sampling profile (Profile.bhprof) into a flat profile.
+
+Layout matches Application/BootHelper/Profile.h, all values little-endian:
+  header:  Signature 'BHPR', Version, HeaderSize, ImageBase, ImageSize, IntervalUs, Count, Dropped, Reserved
+  samples: UINT64 instruction pointer, Count of them
+
+Symbols come from the build's debug file or a map file:
+  ELF       BootHelper.debug from a GCC build, addresses are image offsets
+  text      nm output ("ADDR TYPE NAME") or a GNU ld map ("0xADDR NAME"); use --link-base
+            if the addresses include a preferred load address
+
+Usage:
+  bhprof.py Profile.bhprof Build/.../BootHelper.debug [--top N]
+"""
+
+import argparse
+import bisect
+import re
+import struct
+import sys
+
+SIGNATURE = b'BHPR'
+VERSION = 1
+
+HEADER = struct.Struct('<4sHHQQIIII')
+
+OUTSIDE = '[outside image]'
+UNKNOWN = '[unknown]'
+
+TEXT_SYMBOL = re.compile(r'^\s*(?:0x)?([0-9a-fA-F]{4,16})\s+(?:[tTwW]\s+)?([A-Za-z_.$][\w.$@]*)\s*$')
+
+
+class ProfileError(Exception):
+    pass
+
+
+def read_profile(buffer):
+    """Return (header dict, list of samples) from profile file contents."""
+    if len(buffer) < HEADER.size:
+        raise ProfileError('file too short')
+    signature, version, header_size, image_base, image_size, interval, count, dropped, _ = HEADER.unpack_from(buffer)
+    if signature != SIGNATURE:
+        raise ProfileError('bad signature')
+    if version != VERSION:
+        raise ProfileError('unsupported version %u' % version)
+    if header_size < HEADER.size or header_size + count * 8 > len(buffer):
+        raise ProfileError('bad header')
+    samples = list(struct.unpack_from('<%uQ' % count, buffer, header_size))
+    header = {'base': image_base, 'size': image_size, 'interval': interval, 'count': count, 'dropped': dropped}
+    return header, samples
+
+
+def elf_symbols(buffer):
+    """Function symbols as (address, name) from an ELF symbol table."""
+    if buffer[4] == 2:
+        ehdr, shdr, sym = '<16xHHIQQQIHHHHHH', '<IIQQQQIIQQ', struct.Struct('<IBBHQQ')
+    else:
+        ehdr, shdr, sym = '<16xHHIIIIIHHHHHH', '<IIIIIIIIII', struct.Struct('<IIIBBH')
+    fields = struct.unpack_from(ehdr, buffer)
+    shoff, shentsize, shnum = fields[5], fields[10], fields[11]
+    sections = [struct.unpack_from(shdr, buffer, shoff + i * shentsize) for i in range(shnum)]
+
+    symbols = []
+    for section in sections:
+        # SHT_SYMTAB
+        if section[1] != 2:
+            continue
+        offset, size, link = section[4], section[5], section[6]
+        strtab = sections[link][4]
+        for at in range(offset, offset + size, sym.size):
+            if buffer[4] == 2:
+                name, info, _, shndx, value, _ = sym.unpack_from(buffer, at)
+            else:
+                name, value, _, info, _, shndx = sym.unpack_from(buffer, at)
+            # STT_FUNC, defined
+            if info & 0xF != 2 or shndx == 0:
+                continue
+            end = buffer.index(b'\0', strtab + name)
+            symbols.append((value, buffer[strtab + name:end].decode('ascii', 'replace')))
+    return symbols
+
+
+def text_symbols(text):
+    symbols = []
+    for line in text.splitlines():
+        match = TEXT_SYMBOL.match(line)
+        if match:
+            symbols.append((int(match.group(1), 16), match.group(2)))
+    return symbols
+
+
+def load_symbols(path, link_base):
+    with open(path, 'rb') as f:
+        buffer = f.read()
+    if buffer[:4] == b'\x7fELF':
+        symbols = elf_symbols(buffer)
+    else:
+        symbols = text_symbols(buffer.decode('latin-1'))
+    if not symbols:
+        raise ProfileError('no function symbols in %s' % path)
+    return sorted((address - link_base, name) for address, name in symbols)
+
+
+def flat_profile(header, samples, symbols):
+    """Return [(count, name)] most frequent first."""
+    addresses = [address for address, _ in symbols]
+    counts = {}
+    for sample in samples:
+        offset = sample - header['base']
+        if offset < 0 or offset >= header['size']:
+            name = OUTSIDE
+        else:
+            index = bisect.bisect_right(addresses, offset) - 1
+            name = symbols[index][1] if index >= 0 else UNKNOWN
+        counts[name] = counts.get(name, 0) + 1
+    return sorted(((count, name) for name, count in counts.items()), key=lambda item: (-item[0], item[1]))
+
+
+def main(argv=None):
+    parser = argparse.ArgumentParser(description='BootHelper sampling profile symboliser')
+    parser.add_argument('profile', help='profile file (Profile.bhprof)')
+    parser.add_argument('symbols', help='BootHelper.debug (ELF), nm output or map file')
+    parser.add_argument('--link-base', type=lambda v: int(v, 0), default=0,
+                        help='address the symbols were linked at (default 0)')
+    parser.add_argument('--top', type=int, default=30, help='number of entries to show, 0 for all (default 30)')
+    args = parser.parse_args(argv)
+
+    try:
+        with open(args.profile, 'rb') as f:
+            header, samples = read_profile(f.read())
+        symbols = load_symbols(args.symbols, args.link_base)
+    except (OSError, IndexError, ValueError, struct.error, ProfileError) as e:
+        print('bhprof: %s' % e, file=sys.stderr)
+        return 1
+
+    print('%u samples every %uus (%.1fs), %u dropped, image 0x%X size 0x%X' % (
+        header['count'], header['interval'], header['count'] * header['interval'] / 1e6,
+        header['dropped'], header['base'], header['size']))
+    print('%9s %6s  %s' % ('samples', '%', 'function'))
+    profile = flat_profile(header, samples, symbols)
+    for count, name in profile[:args.top or None]:
+        print('%9u %5.1f%%  %s' % (count, 100.0 * count / max(len(samples), 1), name))
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
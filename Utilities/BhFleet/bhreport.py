@@ -0,0 +1,162 @@
+#!/usr/bin/env python3
+#  Copyright (c) 2020, Mike Beaton. All rights reserved.
+#  SPDX-License-Identifier: BSD-3-Clause
+
+"""
+Reader for the BootHelper session report, which BootHelper publishes to NVRAM at exit.
+
+Layout matches Application/BootHelper/Report.h, all values little-endian:
+  header:  Signature 'BHRP', Version, HeaderSize, ToolVersion, EFI_TIME, Flags, SectionCount
+  section: Type, Reserved, Size, UINT8 Payload[Size]
+
+Usage:
+  bhreport.py                 read the report from this Mac's NVRAM (macOS only)
+  bhreport.py FILE            read a raw report saved from NVRAM
+  bhreport.py --json [FILE]   print as JSON, for collection by a fleet agent
+"""
+
+import argparse
+import json
+import plistlib
+import struct
+import subprocess
+import sys
+
+VARIABLE = '9D1C7A34-52E8-4B6F-A10E-6C83F2475D19:BootHelperReport'
+
+SIGNATURE = b'BHRP'
+VERSION = 1
+
+HEADER = struct.Struct('<4sHHIHBBBBBBIhBBHH')
+SECTION = struct.Struct('<BBH')
+VERIFY = struct.Struct('<II')
+TIMING = struct.Struct('<IB')
+
+SECTION_VERIFY = 1
+SECTION_ACTIONS = 2
+SECTION_TIMINGS = 3
+
+FLAGS = {
+    0x1: 'truncated',
+    0x2: 'verified',
+    0x4: 'canary-lost',
+}
+
+ACTIONS = {
+    1: 'write',
+    2: 'delete',
+}
+
+
+class ReportError(Exception):
+    pass
+
+
+def _names(payload, offset, fixed):
+    """Yield (fixed fields, name) for each length-prefixed item; fixed ends with the name length."""
+    while offset < len(payload):
+        if offset + fixed.size > len(payload):
+            raise ReportError('truncated item')
+        fields = fixed.unpack_from(payload, offset)
+        offset += fixed.size
+        length = fields[-1]
+        if offset + length > len(payload):
+            raise ReportError('truncated item name')
+        yield fields[:-1], payload[offset:offset + length].decode('ascii', 'replace')
+        offset += length
+
+
+def parse(buffer):
+    """Parse report bytes into a dict."""
+    if len(buffer) < HEADER.size:
+        raise ReportError('truncated header')
+
+    fields = HEADER.unpack_from(buffer, 0)
+    signature, version, header_size, tool_version = fields[0:4]
+    year, month, day, hour, minute, second = fields[4:10]
+    flags, section_count = fields[15:17]
+
+    if signature != SIGNATURE:
+        raise ReportError('bad signature')
+    if version != VERSION:
+        raise ReportError('unsupported version %u' % version)
+
+    report = {
+        'tool_version': '%u.%u.%u' % ((tool_version >> 16) & 0xff, (tool_version >> 8) & 0xff, tool_version & 0xff),
+        'time': '%04u-%02u-%02uT%02u:%02u:%02u' % (year, month, day, hour, minute, second),
+        'flags': [name for bit, name in sorted(FLAGS.items()) if flags & bit],
+    }
+
+    offset = header_size
+    for _ in range(section_count):
+        if offset + SECTION.size > len(buffer):
+            raise ReportError('truncated section')
+        section_type, _, size = SECTION.unpack_from(buffer, offset)
+        offset += SECTION.size
+        payload = buffer[offset:offset + size]
+        if len(payload) != size:
+            raise ReportError('truncated section payload')
+        offset += size
+
+        if section_type == SECTION_VERIFY and size >= VERIFY.size:
+            checked, failed = VERIFY.unpack_from(payload, 0)
+            report['verify'] = {'checked': checked, 'failed': failed}
+        elif section_type == SECTION_ACTIONS and size >= 2:
+            (total,) = struct.unpack_from('<H', payload, 0)
+            report['actions_total'] = total
+            report['actions'] = [
+                {'action': ACTIONS.get(kind, str(kind)), 'name': name}
+                for (kind,), name in _names(payload, 2, struct.Struct('<BB'))
+            ]
+        elif section_type == SECTION_TIMINGS:
+            report['timings_us'] = {name: us for (us,), name in _names(payload, 0, TIMING)}
+
+    return report
+
+
+def read_nvram():
+    """Read the raw report from NVRAM with nvram -x, which returns binary values as plist data."""
+    out = subprocess.run(['nvram', '-x', VARIABLE], check=True, capture_output=True).stdout
+    values = plistlib.loads(out)
+    if VARIABLE not in values:
+        raise ReportError('no report in NVRAM')
+    return values[VARIABLE]
+
+
+def main(argv=None):
+    parser = argparse.ArgumentParser(description='BootHelper NVRAM session report reader')
+    parser.add_argument('file', nargs='?', help='raw report file (default: read NVRAM)')
+    parser.add_argument('--json', action='store_true', help='print as JSON')
+    args = parser.parse_args(argv)
+
+    try:
+        if args.file is None:
+            buffer = read_nvram()
+        else:
+            with open(args.file, 'rb') as f:
+                buffer = f.read()
+        report = parse(buffer)
+    except (OSError, subprocess.CalledProcessError, ReportError) as e:
+        print('bhreport: %s' % e, file=sys.stderr)
+        return 1
+
+    if args.json:
+        print(json.dumps(report, indent=2))
+        return 0
+
+    print('BootHelper %s at %s%s' % (
+        report['tool_version'], report['time'],
+        (' (%s)' % ', '.join(report['flags'])) if report['flags'] else ''))
+    if 'verify' in report:
+        print('verified:   %(checked)u checked, %(failed)u failed' % report['verify'])
+    if 'actions' in report:
+        print('actions:    %u' % report['actions_total'])
+        for action in report['actions']:
+            print('  %-7s %s' % (action['action'], action['name']))
+    for name, us in report.get('timings_us', {}).items():
+        print('timing:     %-24s %8.3f ms' % (name, us / 1000.0))
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -0,0 +1,110 @@
+#!/usr/bin/env python3
+#  Copyright (c) 2020, Mike Beaton. All rights reserved.
+#  SPDX-License-Identifier: BSD-3-Clause
+
+"""
+Reader and writer for BootHelper NVRAM snapshot (.bhsnap) files.
+
+Layout matches Application/BootHelper/Snapshot.h, all values little-endian:
+  header: Signature 'BHSN', Version, HeaderSize, MachineId (GUID), EFI_TIME, EntryCount, Reserved
+  record: Guid, Attributes, NameSize, Reserved, DataSize, CHAR16 Name[], UINT8 Data[]
+"""
+
+import struct
+import uuid
+
+SIGNATURE = b'BHSN'
+VERSION = 1
+
+HEADER = struct.Struct('<4sHH16sHBBBBBBIhBBII')
+RECORD = struct.Struct('<16sIHHI')
+
+
+class SnapshotError(Exception):
+    pass
+
+
+class Variable:
+    __slots__ = ('guid', 'name', 'attributes', 'data')
+
+    def __init__(self, guid, name, attributes, data):
+        self.guid = guid
+        self.name = name
+        self.attributes = attributes
+        self.data = data
+
+    @property
+    def key(self):
+        return '%s:%s' % (self.guid, self.name)
+
+
+class Snapshot:
+    def __init__(self, machine_id, time, variables):
+        self.machine_id = machine_id
+        self.time = time
+        self.variables = variables
+
+    @property
+    def time_string(self):
+        return '%04u%02u%02u-%02u%02u%02u' % self.time[:6]
+
+
+def guid_to_str(raw):
+    return str(uuid.UUID(bytes_le=raw)).upper()
+
+
+def guid_to_bytes(text):
+    return uuid.UUID(text).bytes_le
+
+
+def parse(buffer):
+    """Parse snapshot bytes, returning a Snapshot; data values are memoryview slices of buffer."""
+    view = memoryview(buffer)
+    if len(view) < HEADER.size:
+        raise SnapshotError('truncated header')
+
+    fields = HEADER.unpack_from(view, 0)
+    signature, version, header_size, machine_id = fields[0:4]
+    year, month, day, hour, minute, second = fields[4:10]
+    count = fields[15]
+
+    if signature != SIGNATURE:
+        raise SnapshotError('bad signature')
+    if version != VERSION:
+        raise SnapshotError('unsupported version %u' % version)
+
+    offset = header_size
+    variables = []
+    for _ in range(count):
+        if offset + RECORD.size > len(view):
+            raise SnapshotError('truncated record')
+        guid, attributes, name_size, _, data_size = RECORD.unpack_from(view, offset)
+        offset += RECORD.size
+        end = offset + name_size + data_size
+        if end > len(view):
+            raise SnapshotError('truncated record data')
+        name = bytes(view[offset:offset + name_size]).decode('utf-16-le').rstrip('\0')
+        data = view[offset + name_size:end]
+        variables.append(Variable(guid_to_str(guid), name, attributes, data))
+        offset = end
+
+    return Snapshot(guid_to_str(machine_id), (year, month, day, hour, minute, second), variables)
+
+
+def read(path):
+    with open(path, 'rb') as f:
+        return parse(f.read())
+
+
+def serialize(snapshot):
+    """Serialize Snapshot back into .bhsnap bytes."""
+    year, month, day, hour, minute, second = snapshot.time[:6]
+    out = [HEADER.pack(SIGNATURE, VERSION, HEADER.size, guid_to_bytes(snapshot.machine_id),
+                       year, month, day, hour, minute, second, 0, 0, 0, 0, 0,
+                       len(snapshot.variables), 0)]
+    for var in snapshot.variables:
+        name = (var.name + '\0').encode('utf-16-le')
+        out.append(RECORD.pack(guid_to_bytes(var.guid), var.attributes, len(name), 0, len(var.data)))
+        out.append(name)
+        out.append(bytes(var.data))
+    return b''.join(out)